@@ -41,33 +41,93 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include "cosim_api.h"
 
-cosim * cosim::s_instance = NULL;
+//--------------------------------------------------------------------
+// cosim_cpu_api::run: Generic run loop on top of step()/step_block()
+//--------------------------------------------------------------------
+int64_t cosim_cpu_api::run(int64_t max, const cosim_run_cond &cond)
+{
+    int64_t executed = 0;
+    bool    watch    = (cond.stop_pc != COSIM_PC_NONE || cond.trace_pc != COSIM_PC_NONE);
+
+    while (!get_fault() && !get_stopped() && !get_exited() && (max < 0 || executed < max))
+    {
+        uint32_t last_pc = get_pc();
+
+        // No per instruction PC checks, run a block at a time
+        if (!watch)
+        {
+            int64_t left = (max < 0) ? 0x7FFFFFFF : (max - executed);
+            executed += step_block((left > 0x7FFFFFFF) ? 0x7FFFFFFF : (int)left);
+            continue;
+        }
+
+        step();
+        executed++;
 
+        if (last_pc == cond.trace_pc)
+            enable_trace(cond.trace_mask);
+        if (last_pc == cond.stop_pc)
+            break;
+    }
+
+    return executed;
+}
+
+//--------------------------------------------------------------------
+// ~cosim: Delete owned models
+//--------------------------------------------------------------------
+cosim::~cosim()
+{
+    std::vector <void *> deleted;
+
+    // A model may be attached as both CPU and memory, delete it once
+    for (std::vector<cosim_cpu_item>::iterator it = m_cpu.begin() ; it != m_cpu.end(); ++it)
+        if (it->owned)
+        {
+            deleted.push_back(dynamic_cast<void *>(it->cpu));
+            delete it->cpu;
+        }
+
+    for (std::vector<cosim_mem_item>::iterator it = m_mem.begin() ; it != m_mem.end(); ++it)
+        if (it->owned && std::find(deleted.begin(), deleted.end(), dynamic_cast<void *>(it->mem)) == deleted.end())
+        {
+            deleted.push_back(dynamic_cast<void *>(it->mem));
+            delete it->mem;
+        }
+}
 //--------------------------------------------------------------------
 // attach_cpu
 //--------------------------------------------------------------------
-void cosim::attach_cpu(std::string name, cosim_cpu_api *p)
+void cosim::attach_cpu(std::string name, cosim_cpu_api *p, bool owned /*= false*/)
 {
     cosim_cpu_item item;
     
-    item.name = name;
-    item.cpu  = p;
+    item.name  = name;
+    item.cpu   = p;
+    item.owned = owned;
 
     m_cpu.push_back(item);
+
+    // Events are compared between models, record once there are two
+    if (m_cpu.size() > 1)
+        for (size_t i=0;i<m_cpu.size();i++)
+            m_cpu[i].cpu->event_enable = true;
 }
 //--------------------------------------------------------------------
 // attach_mem
 //--------------------------------------------------------------------
-void cosim::attach_mem(std::string name, cosim_mem_api *p, uint32_t base, uint32_t size)
+void cosim::attach_mem(std::string name, cosim_mem_api *p, uint32_t base, uint32_t size, bool owned /*= false*/)
 {
     cosim_mem_item item;
     
-    item.name = name;
-    item.mem  = p;
-    item.base = base;
-    item.size = size;
+    item.name  = name;
+    item.mem   = p;
+    item.base  = base;
+    item.size  = size;
+    item.owned = owned;
 
     m_mem.push_back(item);
 }
@@ -76,6 +136,8 @@ void cosim::attach_mem(std::string name, cosim_mem_api *p, uint32_t base, uint32
 //--------------------------------------------------------------------
 void cosim::reset(uint32_t pc)
 {
+    m_mismatch = false;
+
     for (std::vector<cosim_cpu_item>::iterator it = m_cpu.begin() ; it != m_cpu.end(); ++it)
         it->cpu->reset(pc);
 }
@@ -84,7 +146,7 @@ void cosim::reset(uint32_t pc)
 //--------------------------------------------------------------------
 bool cosim::get_fault(void)
 {
-    bool fault = false;
+    bool fault = m_mismatch;
 
     for (std::vector<cosim_cpu_item>::iterator it = m_cpu.begin() ; it != m_cpu.end(); ++it)
         fault |= it->cpu->get_fault();
@@ -104,6 +166,28 @@ bool cosim::get_stopped(void)
     return stopped;
 }
 //--------------------------------------------------------------------
+// get_exited: Any CPU requested exit
+//--------------------------------------------------------------------
+bool cosim::get_exited(void)
+{
+    for (std::vector<cosim_cpu_item>::iterator it = m_cpu.begin() ; it != m_cpu.end(); ++it)
+        if (it->cpu->get_exited())
+            return true;
+
+    return false;
+}
+//--------------------------------------------------------------------
+// get_exit_code: Exit code of the first CPU to exit
+//--------------------------------------------------------------------
+int cosim::get_exit_code(void)
+{
+    for (std::vector<cosim_cpu_item>::iterator it = m_cpu.begin() ; it != m_cpu.end(); ++it)
+        if (it->cpu->get_exited())
+            return it->cpu->get_exit_code();
+
+    return 0;
+}
+//--------------------------------------------------------------------
 // step:
 //--------------------------------------------------------------------
 void cosim::step(void)
@@ -128,7 +212,8 @@ void cosim::step(void)
                     if (item.arg1 != last.arg1 || item.arg2 != last.arg2)
                     {
                         fprintf(stderr, "ERROR: Event %d mismatch %08x == %08x && %08x == %08x\n", ev, item.arg1, last.arg1, item.arg2, last.arg2);
-                        exit(-1);
+                        m_mismatch = true;
+                        return ;
                     }
                 }
                 first = false;
@@ -145,7 +230,8 @@ void cosim::step(void)
         if (m_cpu.front().cpu->get_pc() != it->cpu->get_pc())
         {
             fprintf(stderr, "ERROR: PC mismatch %08x (%s) != %08x (%s)\n", it->cpu->get_pc(), it->name.c_str(), m_cpu.front().cpu->get_pc(), m_cpu.front().name.c_str());
-            exit(-1);
+            m_mismatch = true;
+            return ;
         }
         
     int num_reg = get_num_reg();
@@ -156,7 +242,8 @@ void cosim::step(void)
                 if (m_cpu.front().cpu->get_register(i) != it->cpu->get_register(i))
                 {
                     fprintf(stderr, "ERROR: PC=%08x REG%d mismatch %08x (%s) != %08x (%s)\n", m_cpu.front().cpu->get_pc(), i, it->cpu->get_register(i), it->name.c_str(), m_cpu.front().cpu->get_register(i), m_cpu.front().name.c_str());
-                    exit(-1);
+                    m_mismatch = true;
+                    return ;
                 }
 }
 //--------------------------------------------------------------------
@@ -231,12 +318,36 @@ bool cosim::create_memory(uint32_t addr, uint32_t size, uint8_t *mem /*= NULL*/)
     return ok;
 }
 //--------------------------------------------------------------------
+// set_sparse_memory:
+//--------------------------------------------------------------------
+bool cosim::set_sparse_memory(bool enable)
+{
+    bool ok = true;
+
+    for (std::vector<cosim_mem_item>::iterator it = m_mem.begin() ; it != m_mem.end(); ++it)
+        ok &= it->mem->set_sparse_memory(enable);
+
+    return ok;
+}
+//--------------------------------------------------------------------
+// create_file_memory:
+//--------------------------------------------------------------------
+bool cosim::create_file_memory(uint32_t addr, uint32_t size, const char *filename)
+{
+    bool ok = true;
+
+    for (std::vector<cosim_mem_item>::iterator it = m_mem.begin() ; it != m_mem.end(); ++it)
+        ok &= it->mem->create_file_memory(addr, size, filename);
+
+    return ok;
+}
+//--------------------------------------------------------------------
 // valid_addr:
 //--------------------------------------------------------------------
 bool cosim::valid_addr(uint32_t addr)
 {
     for (std::vector<cosim_mem_item>::iterator it = m_mem.begin() ; it != m_mem.end(); ++it)
-        if (addr >= it->base && addr < (it->base + it->size))
+        if (addr >= it->base && addr < (it->base + it->size) && it->mem->valid_addr(addr))
             return true;
     return false;
 }
@@ -250,6 +361,27 @@ void cosim::write(uint32_t addr, uint8_t data)
             it->mem->write(addr, data);
 }
 //--------------------------------------------------------------------
+// write_block: Bulk write
+//--------------------------------------------------------------------
+bool cosim::write_block(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    bool found = false;
+    bool ok    = true;
+
+    for (std::vector<cosim_mem_item>::iterator it = m_mem.begin() ; it != m_mem.end(); ++it)
+        if (addr >= it->base && ((uint64_t)addr + len) <= ((uint64_t)it->base + it->size))
+        {
+            ok   &= it->mem->write_block(addr, data, len);
+            found = true;
+        }
+
+    // Spans several memories, fall back to byte writes
+    if (!found)
+        return cosim_mem_api::write_block(addr, data, len);
+
+    return ok;
+}
+//--------------------------------------------------------------------
 // read: Read write
 //--------------------------------------------------------------------
 uint8_t cosim::read(uint32_t addr)
@@ -278,9 +410,56 @@ uint32_t cosim::read_word(uint32_t addr)
     return data;
 }
 //--------------------------------------------------------------------
+// save_snapshot: Write state of all CPUs then all memories
+//--------------------------------------------------------------------
+#define COSIM_SNAPSHOT_MAGIC    0x504e5352  // "RSNP"
+
+bool cosim::save_snapshot(const char *filename)
+{
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+        return false;
+
+    uint32_t header[3] = { COSIM_SNAPSHOT_MAGIC, (uint32_t)m_cpu.size(), (uint32_t)m_mem.size() };
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+    for (std::vector<cosim_cpu_item>::iterator it = m_cpu.begin() ; ok && it != m_cpu.end(); ++it)
+        ok = it->cpu->save_state(f);
+
+    for (std::vector<cosim_mem_item>::iterator it = m_mem.begin() ; ok && it != m_mem.end(); ++it)
+        ok = it->mem->save_memory(f);
+
+    ok &= (fclose(f) == 0);
+    return ok;
+}
+//--------------------------------------------------------------------
+// restore_snapshot: Restore a snapshot onto the same configuration
+//--------------------------------------------------------------------
+bool cosim::restore_snapshot(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return false;
+
+    uint32_t header[3];
+    bool ok = fread(header, sizeof(header), 1, f) == 1 &&
+              header[0] == COSIM_SNAPSHOT_MAGIC &&
+              header[1] == m_cpu.size() &&
+              header[2] == m_mem.size();
+
+    for (std::vector<cosim_cpu_item>::iterator it = m_cpu.begin() ; ok && it != m_cpu.end(); ++it)
+        ok = it->cpu->restore_state(f);
+
+    for (std::vector<cosim_mem_item>::iterator it = m_mem.begin() ; ok && it != m_mem.end(); ++it)
+        ok = it->mem->restore_memory(f);
+
+    fclose(f);
+    return ok;
+}
+//--------------------------------------------------------------------
 // at_exit: On simulation exit
 //--------------------------------------------------------------------
-void cosim::at_exit(uint32_t exit_code)
+int cosim::at_exit(int exit_code)
 {
     if (m_dump_file)
     {
@@ -295,7 +474,7 @@ void cosim::at_exit(uint32_t exit_code)
 
         uint8_t *buffer = new uint8_t[dump_size];
         for (int i=0;i<dump_size;i++)
-            buffer[i] = cosim::instance()->read((uint32_t)m_dump_start + i);
+            buffer[i] = read((uint32_t)m_dump_start + i);
 
         // Binary block
         if (!sig_txt_file)
@@ -332,5 +511,5 @@ void cosim::at_exit(uint32_t exit_code)
         buffer = NULL;
     }
 
-    exit(exit_code);
+    return exit_code;
 }
@@ -1,6 +1,7 @@
 #ifndef __CPU_API_H__
 #define __CPU_API_H__
 
+#include <stdio.h>
 #include <stdint.h>
 #include <vector>
 #include <queue>
@@ -25,12 +26,43 @@ public:
     uint32_t arg2;
 };
 
+//--------------------------------------------------------------------
+// Stop conditions for cosim_cpu_api::run()
+//--------------------------------------------------------------------
+#define COSIM_PC_NONE       0xFFFFFFFF
+
+// Watchpoint access types (cosim_cpu_api::set_watchpoint)
+#define COSIM_WATCH_READ    (1 << 0)
+#define COSIM_WATCH_WRITE   (1 << 1)
+
+class cosim_run_cond
+{
+public:
+    cosim_run_cond(): stop_pc(COSIM_PC_NONE), trace_pc(COSIM_PC_NONE), trace_mask(1) { }
+
+    uint32_t stop_pc;       // Stop one instruction after executing this PC
+    uint32_t trace_pc;      // Enable trace one instruction after this PC
+    uint32_t trace_mask;
+};
+
+class BinaryTrace;
+class Profiler;
+class Coverage;
+class TimingModel;
+class CacheSim;
+class LockstepChecker;
+class Device;
+class IConsoleIO;
+
 //--------------------------------------------------------------------
 // Abstract interface for CPU simulation API
 //--------------------------------------------------------------------
 class cosim_cpu_api
 {
 public:
+    cosim_cpu_api(): event_enable(false) { }
+    virtual ~cosim_cpu_api() { }
+
     // Reset core to execute from specified PC
     virtual void      reset(uint32_t pc) = 0;
 
@@ -39,13 +71,72 @@ public:
     virtual bool      get_stopped(void) = 0;
     virtual bool      get_break(void)  { return false; }
 
+    // Exit requested by the target (exit code valid once exited)
+    virtual bool      get_exited(void)    { return false; }
+    virtual int       get_exit_code(void) { return 0; }
+
     // Execute one instruction
     virtual void      step(void) = 0;
 
+    // Execute up to max instructions, returns number executed
+    virtual int       step_block(int max) { step(); return 1; }
+
+    // Run until fault, stop, exit or a run condition (max < 0 = no limit),
+    // returns number of instructions executed
+    virtual int64_t   run(int64_t max, const cosim_run_cond &cond);
+
+    // Snapshot of architectural state (false if unsupported)
+    virtual bool      save_state(FILE *f)    { return false; }
+    virtual bool      restore_state(FILE *f) { return false; }
+
+    // Select execution engine (implementation specific)
+    virtual void      set_engine(int engine) { }
+
+    // Binary trace of retired instructions (optional)
+    virtual bool      set_binary_trace(BinaryTrace *trace) { return false; }
+
+    // Cycle approximate timing model (optional)
+    virtual bool      set_timing(TimingModel *timing) { return false; }
+
+    // L1 cache simulator (optional)
+    virtual bool      set_cache_sim(CacheSim *sim) { return false; }
+
+    // Report executed instructions to a lockstep checker (optional)
+    virtual bool      set_lockstep(LockstepChecker *checker) { return false; }
+
+    // Target console for putc / getc / printf (optional)
+    virtual bool      set_console(IConsoleIO *cio) { return false; }
+
+    // Memory mapped device, owned by the CPU once attached (optional)
+    virtual bool      attach_device(Device *device, uint32_t base, uint32_t size) { return false; }
+
+    // PC sampling profiler (optional)
+    virtual bool      set_profiler(Profiler *profiler) { return false; }
+
+    // Code coverage collection (optional)
+    virtual bool      set_coverage(Coverage *coverage) { return false; }
+
+    // Fast-forward time through idle loops (optional)
+    virtual void      set_idle_skip(bool enable) { }
+
+    // Number of harts sharing memory, run round-robin or on host threads
+    virtual bool      set_harts(int count, int quantum, bool threads) { return count == 1; }
+
     // Breakpoints
     virtual bool      set_breakpoint(uint32_t pc)   { return false; }
     virtual bool      clr_breakpoint(uint32_t pc) { return false; }
 
+    // Data watchpoints on virtual addresses (COSIM_WATCH_XXX), the run
+    // stops after the accessing instruction
+    virtual bool      set_watchpoint(uint32_t addr, uint32_t len, int type) { return false; }
+    virtual bool      clr_watchpoint(uint32_t addr, uint32_t len, int type) { return false; }
+    virtual bool      get_watch_hit(uint32_t *pc, uint32_t *addr, int *type) { return false; }
+
+    // High level emulation: run a libc routine ("memcpy", "memset",
+    // "strlen", "memcmp") natively when entered at 'pc'
+    virtual bool      set_hle(const char *routine, uint32_t pc) { return false; }
+    virtual void      set_hle_cost(int call_cost, int word_cost) { }
+
     // State after execution
     virtual uint32_t  get_opcode(void) = 0;
     virtual uint32_t  get_pc(void) = 0;
@@ -62,12 +153,16 @@ public:
     // Instruction trace
     virtual void      enable_trace(uint32_t mask) = 0;
 
-    // Event Queue
+    // Event Queue (only recorded when another model consumes it)
+    bool event_enable;
     std::queue <cosim_event > event_q[COSIM_EVENT_MAX];
     void event_push(t_cosim_event ev, uint32_t arg1, uint32_t arg2)
     {
         cosim_event item;
-        
+
+        if (!event_enable)
+            return ;
+
         item.type  = ev;
         item.arg1  = arg1;
         item.arg2  = arg2;
@@ -89,10 +184,35 @@ public:
 class cosim_mem_api
 {
 public:
+    virtual ~cosim_mem_api() { }
+
     virtual bool    create_memory(uint32_t addr, uint32_t size, uint8_t *mem = NULL) = 0;
     virtual bool    valid_addr(uint32_t addr) = 0;
+
+    // Later regions reserve address space and allocate pages on first
+    // touch (false if unsupported)
+    virtual bool    set_sparse_memory(bool enable) { return false; }
+
+    // Sparse region starting with a copy on write mapping of 'filename'
+    virtual bool    create_file_memory(uint32_t addr, uint32_t size, const char *filename) { return false; }
     virtual void    write(uint32_t addr, uint8_t data) = 0;
     virtual uint8_t read(uint32_t addr) = 0;
+
+    // Snapshot of memory contents (false if unsupported)
+    virtual bool    save_memory(FILE *f)    { return false; }
+    virtual bool    restore_memory(FILE *f) { return false; }
+
+    // Bulk write (e.g. image loading), false if any byte is unmapped
+    virtual bool    write_block(uint32_t addr, const uint8_t *data, uint32_t len)
+    {
+        for (uint32_t i=0;i<len;i++)
+        {
+            if (!valid_addr(addr + i))
+                return false;
+            write(addr + i, data[i]);
+        }
+        return true;
+    }
 };
 
 //--------------------------------------------------------------------
@@ -103,6 +223,7 @@ class cosim_cpu_item
 public:
     std::string    name;
     cosim_cpu_api *cpu;
+    bool           owned;
 };
 
 class cosim_mem_item
@@ -112,27 +233,23 @@ public:
     cosim_mem_api *mem;
     uint32_t       base;
     uint32_t       size;
+    bool           owned;
 };
 
 //--------------------------------------------------------------------
 // Class: Cosimulation framework
+// One context per simulation; contexts share no state so several can
+// run concurrently (one per host thread) in the same process.
 //--------------------------------------------------------------------
-class cosim: public cosim_cpu_api, cosim_mem_api
+class cosim: public cosim_cpu_api, public cosim_mem_api
 {
-private:
-    static cosim * s_instance;
-    cosim() { m_dump_file = NULL; }
-
 public:
-    static cosim *instance(void)
-    {
-        if (!s_instance)
-            s_instance = new cosim();
-        return s_instance;
-    }
+    cosim(): m_dump_file(NULL), m_mismatch(false) { }
+    virtual ~cosim();
 
-    void attach_cpu(std::string name, cosim_cpu_api *p);
-    void attach_mem(std::string name, cosim_mem_api *p, uint32_t base, uint32_t size);
+    // Owned models are deleted with the context
+    void attach_cpu(std::string name, cosim_cpu_api *p, bool owned = false);
+    void attach_mem(std::string name, cosim_mem_api *p, uint32_t base, uint32_t size, bool owned = false);
 
     // cosim_cpu_api
 
@@ -142,6 +259,8 @@ public:
     // Status    
     bool get_fault(void);
     bool get_stopped(void);
+    bool get_exited(void);
+    int  get_exit_code(void);
 
     // Execute one instruction
     void step(void);
@@ -162,14 +281,22 @@ public:
 
     // cosim_mem_api
     bool    create_memory(uint32_t addr, uint32_t size, uint8_t *mem = NULL);
+    bool    set_sparse_memory(bool enable);
+    bool    create_file_memory(uint32_t addr, uint32_t size, const char *filename);
     bool    valid_addr(uint32_t addr);
     void    write(uint32_t addr, uint8_t data);
     uint8_t read(uint32_t addr);
+    bool    write_block(uint32_t addr, const uint8_t *data, uint32_t len);
 
     void     write_word(uint32_t addr, uint32_t data);
     uint32_t read_word(uint32_t addr);
 
-    void    at_exit(uint32_t exitcode);
+    // Post simulation actions (memory dump), returns exit_code
+    int     at_exit(int exit_code);
+
+    // Save / restore all attached CPUs and memories
+    bool    save_snapshot(const char *filename);
+    bool    restore_snapshot(const char *filename);
 
     // Set memory dump on exit
     void    dump_on_exit(const char *filename, uint32_t dump_start, uint32_t dump_end)
@@ -186,6 +313,9 @@ private:
     const char * m_dump_file;
     uint32_t     m_dump_start;
     uint32_t     m_dump_end;
+
+    // Lockstep comparison failed
+    bool         m_mismatch;
 };
 
 #endif
@@ -0,0 +1,239 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "cosim_api.h"
+#include "cosim_lockstep.h"
+#include "riscv_inst_dump.h"
+
+//--------------------------------------------------------------------
+// Construction
+//--------------------------------------------------------------------
+LockstepChecker::LockstepChecker(int history /*= LOCKSTEP_HISTORY*/)
+{
+    m_ref         = NULL;
+    m_ref_valid   = false;
+    m_history.resize(history > 0 ? history : 1);
+    m_history_pos = 0;
+    m_history_num = 0;
+    m_retired     = 0;
+    m_mismatch    = false;
+    m_reason[0]   = 0;
+    memset(&m_ref_rec, 0, sizeof(m_ref_rec));
+}
+//--------------------------------------------------------------------
+// attach: Reference model reports executed instructions to this
+//--------------------------------------------------------------------
+bool LockstepChecker::attach(cosim_cpu_api *ref)
+{
+    if (!ref->set_lockstep(this))
+    {
+        fprintf(stderr, "ERROR: Reference model does not support lockstep checking\n");
+        return false;
+    }
+
+    m_ref = ref;
+    return true;
+}
+//--------------------------------------------------------------------
+// retire: Step the reference model past one DUT retirement and compare
+//--------------------------------------------------------------------
+bool LockstepChecker::retire(const t_trace_record &dut)
+{
+    if (m_mismatch)
+        return false;
+
+    // Memory faults trap without retiring on the DUT, step the reference
+    // through those to the instruction the DUT reports.
+    for (int skip = 0; ; skip++)
+    {
+        m_ref_valid = false;
+        m_ref->step();
+
+        if (!m_ref_valid || m_ref->get_fault())
+        {
+            snprintf(m_reason, sizeof(m_reason), "reference model stopped");
+            m_bad_dut  = dut;
+            memset(&m_bad_ref, 0, sizeof(m_bad_ref));
+            m_mismatch = true;
+            return false;
+        }
+
+        if (!(m_ref_rec.flags & TRACE_FLAG_TRAP) || (dut.flags & TRACE_FLAG_TRAP) ||
+            m_ref_rec.pc == dut.pc || skip == LOCKSTEP_MAX_SKIP)
+            break;
+
+        push_history(m_ref_rec);
+    }
+
+    if (!compare(dut, m_ref_rec))
+    {
+        m_bad_dut  = dut;
+        m_bad_ref  = m_ref_rec;
+        m_mismatch = true;
+        return false;
+    }
+
+    push_history(m_ref_rec);
+    m_retired++;
+    return true;
+}
+//--------------------------------------------------------------------
+// push_history: Ring of the last matched instructions
+//--------------------------------------------------------------------
+void LockstepChecker::push_history(const t_trace_record &rec)
+{
+    m_history[m_history_pos] = rec;
+    m_history_pos = (m_history_pos + 1) % (int)m_history.size();
+    if (m_history_num < (int)m_history.size())
+        m_history_num++;
+}
+//--------------------------------------------------------------------
+// compare: Fill in m_reason and return false on mismatch
+//--------------------------------------------------------------------
+bool LockstepChecker::compare(const t_trace_record &dut, const t_trace_record &ref)
+{
+    if (dut.pc != ref.pc)
+    {
+        snprintf(m_reason, sizeof(m_reason), "PC %08x != %08x", dut.pc, ref.pc);
+        return false;
+    }
+
+    if (dut.opcode != ref.opcode)
+    {
+        snprintf(m_reason, sizeof(m_reason), "opcode %08x != %08x", dut.opcode, ref.opcode);
+        return false;
+    }
+
+    if ((dut.flags & TRACE_FLAG_TRAP) != (ref.flags & TRACE_FLAG_TRAP))
+    {
+        snprintf(m_reason, sizeof(m_reason), "exception %s != %s",
+                 (dut.flags & TRACE_FLAG_TRAP) ? "yes" : "no", (ref.flags & TRACE_FLAG_TRAP) ? "yes" : "no");
+        return false;
+    }
+
+    // Writeback: register and value
+    bool dut_wb = (dut.flags & TRACE_FLAG_WB) && dut.rd != 0;
+    bool ref_wb = (ref.flags & TRACE_FLAG_WB) && ref.rd != 0;
+    if (dut_wb != ref_wb || (dut_wb && dut.rd != ref.rd))
+    {
+        snprintf(m_reason, sizeof(m_reason), "rd x%d != x%d", dut_wb ? dut.rd : 0, ref_wb ? ref.rd : 0);
+        return false;
+    }
+    if (dut_wb && dut.rd_value != ref.rd_value)
+    {
+        snprintf(m_reason, sizeof(m_reason), "x%d %08x != %08x", dut.rd, dut.rd_value, ref.rd_value);
+        return false;
+    }
+
+    // Store: address and the bytes written
+    if ((dut.flags & TRACE_FLAG_STORE) != (ref.flags & TRACE_FLAG_STORE))
+    {
+        snprintf(m_reason, sizeof(m_reason), "store %s != %s",
+                 (dut.flags & TRACE_FLAG_STORE) ? "yes" : "no", (ref.flags & TRACE_FLAG_STORE) ? "yes" : "no");
+        return false;
+    }
+    if (dut.flags & TRACE_FLAG_STORE)
+    {
+        int      width = (ref.flags >> TRACE_WIDTH_SHIFT) & TRACE_WIDTH_MASK;
+        uint32_t mask  = (width >= 4) ? 0xFFFFFFFF : ((1 << (width * 8)) - 1);
+
+        if (dut.mem_addr != ref.mem_addr)
+        {
+            snprintf(m_reason, sizeof(m_reason), "store address %08x != %08x", dut.mem_addr, ref.mem_addr);
+            return false;
+        }
+        if ((dut.mem_data & mask) != (ref.mem_data & mask))
+        {
+            snprintf(m_reason, sizeof(m_reason), "store data %08x != %08x", dut.mem_data & mask, ref.mem_data & mask);
+            return false;
+        }
+    }
+
+    return true;
+}
+//--------------------------------------------------------------------
+// print_record: One retirement with disassembly
+//--------------------------------------------------------------------
+void LockstepChecker::print_record(FILE *f, const char *name, const t_trace_record &rec)
+{
+    char str[80];
+
+    // Disassembly is prefixed with the PC
+    if (!riscv_inst_decode(str, rec.pc, rec.opcode))
+        snprintf(str, sizeof(str), "%08x: ???", rec.pc);
+
+    fprintf(f, "%s %08x %-40s", name, rec.opcode, str);
+    if (rec.flags & TRACE_FLAG_TRAP)
+        fprintf(f, " <exception>");
+    if ((rec.flags & TRACE_FLAG_WB) && rec.rd != 0)
+        fprintf(f, " x%d=%08x", rec.rd, rec.rd_value);
+    if (rec.flags & TRACE_FLAG_STORE)
+        fprintf(f, " [%08x]=%08x", rec.mem_addr, rec.mem_data);
+    fprintf(f, "\n");
+}
+//--------------------------------------------------------------------
+// print: Recent history and the first mismatch
+//--------------------------------------------------------------------
+void LockstepChecker::print(FILE *f)
+{
+    fprintf(f, "Lockstep: %llu instructions matched\n", (unsigned long long)m_retired);
+
+    if (!m_mismatch)
+        return;
+
+    fprintf(f, "ERROR: Lockstep mismatch after %llu instructions: %s\n", (unsigned long long)m_retired, m_reason);
+
+    int size = (int)m_history.size();
+    for (int i = 0; i < m_history_num; i++)
+    {
+        int idx = (m_history_pos + size - m_history_num + i) % size;
+        print_record(f, "    ", m_history[idx]);
+    }
+
+    print_record(f, "DUT:", m_bad_dut);
+    print_record(f, "REF:", m_bad_ref);
+}
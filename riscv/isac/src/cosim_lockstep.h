@@ -0,0 +1,112 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __COSIM_LOCKSTEP_H__
+#define __COSIM_LOCKSTEP_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "riscv_trace.h"
+
+class cosim_cpu_api;
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+#define LOCKSTEP_HISTORY            16
+
+// Reference traps the device under test does not retire (memory faults)
+#define LOCKSTEP_MAX_SKIP           4
+
+//--------------------------------------------------------------------
+// LockstepChecker: The device under test (an RTL testbench) reports
+// each retired instruction, the reference model steps alongside and
+// PC, opcode, destination register and store data are compared. The
+// first mismatch is latched and printed with the preceding history.
+//--------------------------------------------------------------------
+class LockstepChecker
+{
+public:
+    LockstepChecker(int history = LOCKSTEP_HISTORY);
+
+    // Reference model, reset to the same PC and memory image as the DUT
+    bool        attach(cosim_cpu_api *ref);
+
+    // Retirement from the device under test (pc, opcode, TRACE_FLAG_WB
+    // with rd / rd_value, TRACE_FLAG_STORE with mem_addr / mem_data and
+    // width, TRACE_FLAG_TRAP). Returns false once a mismatch is found.
+    bool        retire(const t_trace_record &dut);
+
+    // Called by the reference model for each instruction it executes
+    void        reference(const t_trace_record &rec) { m_ref_rec = rec; m_ref_valid = true; }
+
+    bool        get_mismatch(void) { return m_mismatch; }
+    uint64_t    get_retired(void)  { return m_retired; }
+
+    // Recent retirements and the mismatch (if any)
+    void        print(FILE *f);
+
+private:
+    void        push_history(const t_trace_record &rec);
+    bool        compare(const t_trace_record &dut, const t_trace_record &ref);
+    void        print_record(FILE *f, const char *name, const t_trace_record &rec);
+
+    cosim_cpu_api                *m_ref;
+    t_trace_record                m_ref_rec;
+    bool                          m_ref_valid;
+
+    std::vector <t_trace_record > m_history;
+    int                           m_history_pos;
+    int                           m_history_num;
+    uint64_t                      m_retired;
+
+    bool                          m_mismatch;
+    char                          m_reason[128];
+    t_trace_record                m_bad_dut;
+    t_trace_record                m_bad_ref;
+};
+
+#endif
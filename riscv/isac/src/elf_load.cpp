@@ -50,24 +50,162 @@
 #include <libelf.h>
 #include <fcntl.h>
 #include <gelf.h>
-#include <bfd.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 #include "elf_load.h"
 
 //-----------------------------------------------------------------
-// elf_load
+// Symbol index (built once per file)
+//-----------------------------------------------------------------
+struct elf_sym
+{
+    uint32_t    addr;
+    uint32_t    size;
+    std::string name;
+
+    bool operator < (const elf_sym &other) const { return addr < other.addr; }
+};
+
+// Print the memory map while loading (set before loader threads start)
+static int s_verbose = 1;
+
+// Per thread so concurrent simulations can index different images
+static thread_local std::string                                  s_sym_file;
+static thread_local std::vector <elf_sym >                       s_sym_addr;   // Sorted by address
+static thread_local std::unordered_map <std::string, uint32_t >  s_sym_name;
+
+//-----------------------------------------------------------------
+// elf_read_symbols: Index the symbol tables of an open ELF file
+//-----------------------------------------------------------------
+static void elf_read_symbols(Elf *e, const char *filename)
+{
+    Elf_Scn *scn = NULL;
+
+    s_sym_file = filename;
+    s_sym_addr.clear();
+    s_sym_name.clear();
+
+    while ((scn = elf_nextscn(e, scn)) != NULL)
+    {
+        GElf_Shdr shdr;
+
+        if (!gelf_getshdr(scn, &shdr) || shdr.sh_type != SHT_SYMTAB || shdr.sh_entsize == 0)
+            continue;
+
+        Elf_Data *data = elf_getdata(scn, NULL);
+        if (!data)
+            continue;
+
+        int count = shdr.sh_size / shdr.sh_entsize;
+        for (int i=0;i<count;i++)
+        {
+            GElf_Sym sym;
+
+            if (!gelf_getsym(data, i, &sym) || sym.st_shndx == SHN_UNDEF)
+                continue;
+
+            int type = ELF32_ST_TYPE(sym.st_info);
+            if (type == STT_SECTION || type == STT_FILE)
+                continue;
+
+            const char *name = elf_strptr(e, shdr.sh_link, sym.st_name);
+            if (!name || !name[0])
+                continue;
+
+            // First definition wins (matches table order lookups)
+            s_sym_name.insert(std::make_pair(std::string(name), (uint32_t)sym.st_value));
+
+            // Absolute symbols (e.g. linker constants) are not locations
+            if (sym.st_shndx != SHN_ABS)
+            {
+                elf_sym item;
+                item.addr = (uint32_t)sym.st_value;
+                item.size = (uint32_t)sym.st_size;
+                item.name = name;
+                s_sym_addr.push_back(item);
+            }
+        }
+    }
+
+    std::stable_sort(s_sym_addr.begin(), s_sym_addr.end());
+}
+//-----------------------------------------------------------------
+// elf_load_symbols: Make sure the index is for 'filename'
+//-----------------------------------------------------------------
+static bool elf_load_symbols(const char *filename)
+{
+    if (!filename)
+        return false;
+
+    if (s_sym_file == filename)
+        return true;
+
+    if (elf_version ( EV_CURRENT ) == EV_NONE)
+        return false;
+
+    int fd = open ( filename , O_RDONLY , 0);
+    if (fd < 0)
+        return false;
+
+    Elf *e = elf_begin ( fd , ELF_C_READ_MMAP, NULL );
+    if (e == NULL || elf_kind ( e ) != ELF_K_ELF)
+    {
+        if (e)
+            elf_end ( e );
+        close ( fd );
+        return false;
+    }
+
+    elf_read_symbols(e, filename);
+
+    elf_end ( e );
+    close ( fd );
+    return true;
+}
+//-----------------------------------------------------------------
+// elf_segment_sections: Names of allocated sections in a segment
+//-----------------------------------------------------------------
+static std::string elf_segment_sections(Elf *e, size_t shstrndx, const GElf_Phdr *phdr)
+{
+    std::string names;
+    Elf_Scn    *scn = NULL;
+
+    while ((scn = elf_nextscn(e, scn)) != NULL)
+    {
+        GElf_Shdr shdr;
+
+        if (!gelf_getshdr(scn, &shdr) || !(shdr.sh_flags & SHF_ALLOC) || shdr.sh_size == 0)
+            continue;
+
+        if (shdr.sh_addr >= phdr->p_vaddr && shdr.sh_addr < (phdr->p_vaddr + phdr->p_memsz))
+        {
+            if (!names.empty())
+                names += " ";
+            names += elf_strptr(e, shstrndx, shdr.sh_name);
+        }
+    }
+
+    return names;
+}
+//-----------------------------------------------------------------
+// elf_load: Load PT_LOAD segments, one bulk copy each. Segments with
+// a load address (LMA) differing from the run address (e.g. .data
+// placed in flash and copied to RAM by the startup code) have their
+// contents written to the LMA, with RAM allocated at the VMA.
 //-----------------------------------------------------------------
 int elf_load(const char *filename, cb_mem_create fn_create, cb_mem_load fn_load, void *arg, uint32_t *start_addr)
 {
     int fd;
     Elf * e;
-    Elf_Kind ek;
-    Elf_Scn *scn;
-    Elf_Data *data;
-    Elf32_Shdr *shdr;
     size_t shstrndx;
-
-    long _data_lma = elf_get_symbol(filename, "_data_lma");
+    size_t phnum;
+    size_t shnum;
+    size_t file_size;
+    const uint8_t *image;
 
     if (elf_version ( EV_CURRENT ) == EV_NONE)
         return 0;
@@ -75,16 +213,22 @@ int elf_load(const char *filename, cb_mem_create fn_create, cb_mem_load fn_load,
     if ((fd = open ( filename , O_RDONLY , 0)) < 0)
         return 0;
 
-    if ((e = elf_begin ( fd , ELF_C_READ, NULL )) == NULL)
-        return 0;
-    
-    ek = elf_kind ( e );
-    if (ek != ELF_K_ELF)
+    if ((e = elf_begin ( fd , ELF_C_READ_MMAP, NULL )) == NULL)
+    {
+        close ( fd );
         return 0;
+    }
 
-    // Get section name header index
-    if (elf_getshdrstrndx(e, &shstrndx)!=0)
+    if (elf_kind ( e ) != ELF_K_ELF ||
+        elf_getshdrstrndx(e, &shstrndx) != 0 ||
+        elf_getphdrnum(e, &phnum) != 0 ||
+        elf_getshdrnum(e, &shnum) != 0 ||
+        (image = (const uint8_t *)elf_rawfile(e, &file_size)) == NULL)
+    {
+        elf_end ( e );
+        close ( fd );
         return 0;
+    }
 
     // Get entry point
     if (start_addr)
@@ -94,109 +238,119 @@ int elf_load(const char *filename, cb_mem_create fn_create, cb_mem_load fn_load,
         *start_addr = (uint32_t)ehdr->e_entry;
     }
 
-    int section_idx = 0;
-    while ((scn = elf_getscn(e, section_idx)) != NULL)
+    // Index symbols while the file is open
+    elf_read_symbols(e, filename);
+
+    int ok = 1;
+    for (size_t i=0;i<phnum && ok;i++)
     {
-        shdr = elf32_getshdr(scn);
+        GElf_Phdr phdr;
+
+        if (!gelf_getphdr(e, i, &phdr) || phdr.p_type != PT_LOAD || phdr.p_memsz == 0)
+            continue;
+
+        uint32_t vaddr = (uint32_t)phdr.p_vaddr;
+        uint32_t lma   = (uint32_t)phdr.p_paddr;
+        uint32_t memsz = (uint32_t)phdr.p_memsz;
+        uint32_t filesz= (uint32_t)phdr.p_filesz;
+
+        // Segments without an allocated section only hold the ELF and
+        // program headers (lld), they are not part of the image
+        std::string sections = elf_segment_sections(e, shstrndx, &phdr);
+        if (shnum > 1 && sections.empty())
+            continue;
 
-        const char *sec_name = elf_strptr(e, shstrndx, shdr->sh_name);
+        if (s_verbose)
+            printf("Memory: 0x%x - 0x%x (Size=%dKB) [%s]\n", vaddr, vaddr + memsz - 1, memsz / 1024, sections.c_str());
 
-        // Section which need allocating
-        if ((shdr->sh_flags & SHF_ALLOC) && (shdr->sh_size > 0))
+        if (!fn_create(arg, vaddr, memsz))
         {
-            data = elf_getdata(scn, NULL);
+            fprintf(stderr, "ERROR: Cannot allocate memory region\n");
+            ok = 0;
+            break;
+        }
 
-            printf("Memory: 0x%x - 0x%x (Size=%dKB) [%s]\n", shdr->sh_addr, shdr->sh_addr + shdr->sh_size - 1, shdr->sh_size / 1024, elf_strptr(e, shstrndx, shdr->sh_name));
+        if (filesz == 0)
+            continue;
 
-            if (!fn_create(arg, shdr->sh_addr, shdr->sh_size))
-            {
-                fprintf(stderr, "ERROR: Cannot allocate memory region\n");
-                close (fd);
-                return 0;
-            }
+        if (phdr.p_offset + filesz > file_size)
+        {
+            fprintf(stderr, "ERROR: Segment outside of file\n");
+            ok = 0;
+            break;
+        }
+
+        // Initialised data loaded from a different address (flash)
+        if (lma != vaddr)
+        {
+            if (s_verbose)
+                printf("Memory: 0x%x - 0x%x (Size=%dKB) [load image]\n", lma, lma + filesz - 1, filesz / 1024);
 
-            if (shdr->sh_type == SHT_PROGBITS)
-            {                
-                int i;
-
-                // Check if the section name is .data and loaded from flash
-                if (strcmp(sec_name, ".data") == 0 && _data_lma != -1) {
-                    if (!fn_create(arg, _data_lma, shdr->sh_size)) {
-                        fprintf(stderr, "ERROR: Cannot allocate flash memory region for .data section\n");
-                        close(fd);
-                        return 0;
-                    }
-
-                    //write flash memory
-                    for (i=0;i<shdr->sh_size;i++)
-                    {                    
-                        if (!fn_load(arg, _data_lma + i, ((uint8_t*)data->d_buf)[i]))
-                        {
-                            fprintf(stderr, "ERROR: Cannot write byte to flash memory 0x%08x\n", uint32_t(_data_lma + i));
-                            close (fd);
-                            return 0;
-                        }
-                    }
-                } 
-                else {
-                    for (i=0;i<shdr->sh_size;i++)
-                    {                    
-                        if (!fn_load(arg, shdr->sh_addr + i, ((uint8_t*)data->d_buf)[i]))
-                        {
-                            fprintf(stderr, "ERROR: Cannot write byte to 0x%08x\n", shdr->sh_addr + i);
-                            close (fd);
-                            return 0;
-                        }
-                    }
-                }
+            if (!fn_create(arg, lma, filesz))
+            {
+                fprintf(stderr, "ERROR: Cannot allocate flash memory region\n");
+                ok = 0;
+                break;
             }
         }
 
-        section_idx++;
-    }    
+        if (!fn_load(arg, lma, image + phdr.p_offset, filesz))
+        {
+            fprintf(stderr, "ERROR: Cannot write segment to 0x%08x\n", lma);
+            ok = 0;
+        }
+    }
 
     elf_end ( e );
     close ( fd );
     
-    return 1;
+    return ok;
 }
 //-----------------------------------------------------------------
-// elf_get_symbol
+// elf_get_symbol: Symbol value by name (-1 if not found)
 //-----------------------------------------------------------------
 long elf_get_symbol(const char *filename, const char *symname)
 {
-    bfd *ibfd;
-    asymbol **symtab;
-    long nsize, nsyms, i;
-    symbol_info syminfo;
-    char **matching;
-
-    bfd_init();
-    ibfd = bfd_openr(filename, NULL);
-
-    if (ibfd == NULL) 
-    {
-        printf("bfd_openr error\n");
+    if (!symname || !elf_load_symbols(filename))
         return -1;
-    }
 
-    if (!bfd_check_format_matches(ibfd, bfd_object, &matching)) 
-    {
-        printf("format mismatches\n");
+    std::unordered_map <std::string, uint32_t >::const_iterator it = s_sym_name.find(symname);
+    if (it == s_sym_name.end())
         return -1;
-    }
 
-    nsize = bfd_get_symtab_upper_bound (ibfd);
-    symtab = (asymbol **)malloc(nsize);
-    nsyms = bfd_canonicalize_symtab(ibfd, symtab);
+    return (long)it->second;
+}
+//-----------------------------------------------------------------
+// elf_get_symbol_name: Symbol containing (or preceding) an address,
+// NULL if none. Optionally returns the offset from the symbol.
+//-----------------------------------------------------------------
+const char *elf_get_symbol_name(const char *filename, uint32_t addr, uint32_t *offset)
+{
+    if (!elf_load_symbols(filename) || s_sym_addr.empty())
+        return NULL;
+
+    elf_sym key;
+    key.addr = addr;
 
-    for (i = 0; i < nsyms; i++) {
-        if (strcmp(symtab[i]->name, symname) == 0) {
-            bfd_symbol_info(symtab[i], &syminfo);
-            return (long) syminfo.value;
-        }
-    }
+    // Last symbol at or below addr
+    std::vector <elf_sym >::const_iterator it = std::upper_bound(s_sym_addr.begin(), s_sym_addr.end(), key);
+    if (it == s_sym_addr.begin())
+        return NULL;
+    --it;
 
-    bfd_close(ibfd);
-    return -1;
+    // Sized symbols must contain the address
+    if (it->size != 0 && (addr - it->addr) >= it->size)
+        return NULL;
+
+    if (offset)
+        *offset = addr - it->addr;
+
+    return it->name.c_str();
+}
+//-----------------------------------------------------------------
+// elf_set_verbose: Enable / disable the memory map printout
+//-----------------------------------------------------------------
+void elf_set_verbose(int verbose)
+{
+    s_verbose = verbose;
 }
@@ -7,12 +7,14 @@
 // Types
 //-------------------------------------------------------------
 typedef int (*cb_mem_create)(void *arg, uint32_t base, uint32_t size);
-typedef int (*cb_mem_load)(void *arg, uint32_t addr, uint8_t data);
+typedef int (*cb_mem_load)(void *arg, uint32_t addr, const uint8_t *data, uint32_t len);
 
 //-------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------
 int  elf_load(const char *filename, cb_mem_create fn_create, cb_mem_load fn_load, void *arg, uint32_t *start_addr);
 long elf_get_symbol(const char *filename, const char *symname);
+const char *elf_get_symbol_name(const char *filename, uint32_t addr, uint32_t *offset);
+void elf_set_verbose(int verbose);
 
 #endif
\ No newline at end of file
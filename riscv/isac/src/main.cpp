@@ -53,19 +53,18 @@
 int main(int argc, char *argv[])
 {
     int exitcode;
+    cosim ctx;
 
+    // Owned by the context
     Riscv * sim = new Riscv();
 
-    cosim::instance()->attach_cpu("sim", sim);
-    cosim::instance()->attach_mem("sim", sim, 0, 0xFFFFFFFF);
+    ctx.attach_cpu("sim", sim, true);
+    ctx.attach_mem("sim", sim, 0, 0xFFFFFFFF, true);
 
-    exitcode = riscv_main(sim, argc, argv);
+    exitcode = riscv_main(&ctx, sim, argc, argv);
 
     // Show execution stats
     sim->stats_dump();
 
-    delete sim;
-    sim = NULL;
-
     return exitcode;
 }
@@ -42,6 +42,8 @@
 #define __MEMORY_H__
 
 #include <stdint.h>
+#include <string.h>
+#include <assert.h>
 
 //--------------------------------------------------------------------
 // Abstract interface for memories
@@ -49,9 +51,19 @@
 class Memory
 {
 public:  
+    virtual             ~Memory() { }
+
     virtual void        reset(void) = 0;
     virtual uint32_t    load(uint32_t address, int width, bool signedLoad) = 0;
     virtual void        store(uint32_t address, uint32_t data, int width) = 0;
+
+    // Contiguous little endian backing store for direct access by the
+    // CPU model, or NULL if accesses must go through load()/store().
+    virtual uint8_t *   get_host_ptr(void) { return NULL; }
+
+    // Host pages backing the region: total, resident and touched
+    // (false if not tracked)
+    virtual bool        get_page_counts(uint32_t *pages, uint32_t *resident, uint32_t *touched) { return false; }
 };
 
 //-----------------------------------------------------------------
@@ -159,6 +171,11 @@ public:
         }
     }
 
+    virtual uint8_t *get_host_ptr(void)
+    {
+        return (uint8_t *)Mem;
+    }
+
 private:
     uint32_t *Mem;
     int      Size;
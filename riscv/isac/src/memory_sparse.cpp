@@ -0,0 +1,185 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "memory_sparse.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define PAGEMAP_PRESENT     (1ULL << 63)
+#define PAGEMAP_SWAPPED     (1ULL << 62)
+#define PAGEMAP_CHUNK       512
+
+//-----------------------------------------------------------------
+// create: Reserve 'size' bytes, the first part mapping 'filename'
+//-----------------------------------------------------------------
+SparseMemory *SparseMemory::create(uint32_t size, const char *filename /*= NULL*/)
+{
+    size_t host_page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size  = ((size_t)size + host_page - 1) & ~(host_page - 1);
+    size_t file_size = 0;
+    int    fd        = -1;
+
+    if (filename)
+    {
+        struct stat st;
+
+        fd = open(filename, O_RDONLY);
+        if (fd < 0)
+            return NULL;
+
+        if (fstat(fd, &st) < 0)
+        {
+            close(fd);
+            return NULL;
+        }
+
+        file_size = (size_t)st.st_size < size ? (size_t)st.st_size : size;
+    }
+
+    // Zero pages, no swap reserved up front
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    // Image pages are read from the file when touched, writes stay private
+    if (file_size)
+    {
+        size_t file_map = (file_size + host_page - 1) & ~(host_page - 1);
+
+        if (mmap(map, file_map, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+        {
+            munmap(map, map_size);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return new SparseMemory((uint8_t *)map, size, map_size);
+}
+//-----------------------------------------------------------------
+// Construction
+//-----------------------------------------------------------------
+SparseMemory::SparseMemory(uint8_t *map, uint32_t size, size_t map_size): SimpleMemory(map, size)
+{
+    m_map      = map;
+    m_map_size = map_size;
+}
+//-----------------------------------------------------------------
+// Destruction
+//-----------------------------------------------------------------
+SparseMemory::~SparseMemory()
+{
+    munmap(m_map, m_map_size);
+}
+//-----------------------------------------------------------------
+// reset: Release touched pages instead of clearing them
+//-----------------------------------------------------------------
+void SparseMemory::reset(void)
+{
+    madvise(m_map, m_map_size, MADV_DONTNEED);
+}
+//-----------------------------------------------------------------
+// get_page_counts: Host pages in the region, held in host RAM
+// (mincore) and mapped by an access since creation or reset (pagemap,
+// same as resident if that is unavailable)
+//-----------------------------------------------------------------
+bool SparseMemory::get_page_counts(uint32_t *pages, uint32_t *resident, uint32_t *touched)
+{
+    size_t host_page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t count     = m_map_size / host_page;
+
+    std::vector <unsigned char> vec(count);
+    if (mincore(m_map, m_map_size, &vec[0]) < 0)
+        return false;
+
+    *pages    = (uint32_t)count;
+    *resident = 0;
+    for (size_t i=0;i<count;i++)
+        *resident += vec[i] & 1;
+
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0)
+    {
+        *touched = *resident;
+        return true;
+    }
+
+    uint64_t entries[PAGEMAP_CHUNK];
+    off_t    first = (off_t)((uintptr_t)m_map / host_page) * sizeof(uint64_t);
+
+    *touched = 0;
+    for (size_t i=0;i<count;i+=PAGEMAP_CHUNK)
+    {
+        size_t  n   = (count - i) < PAGEMAP_CHUNK ? (count - i) : PAGEMAP_CHUNK;
+        ssize_t len = pread(fd, entries, n * sizeof(uint64_t), first + i * sizeof(uint64_t));
+        if (len != (ssize_t)(n * sizeof(uint64_t)))
+        {
+            *touched = *resident;
+            break;
+        }
+
+        for (size_t j=0;j<n;j++)
+            if (entries[j] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED))
+                (*touched)++;
+    }
+
+    close(fd);
+    return true;
+}
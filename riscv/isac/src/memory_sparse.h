@@ -0,0 +1,76 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __MEMORY_SPARSE_H__
+#define __MEMORY_SPARSE_H__
+
+#include <stdint.h>
+#include "memory.h"
+
+//-----------------------------------------------------------------
+// Sparse memory: address space reserved with mmap, zero pages are
+// only allocated by the host on first touch. Optionally the start of
+// the region is a private (copy on write) mapping of an image file.
+//-----------------------------------------------------------------
+class SparseMemory: public SimpleMemory
+{
+public:
+    // NULL if the region cannot be mapped or the file opened
+    static SparseMemory *create(uint32_t size, const char *filename = NULL);
+    virtual             ~SparseMemory();
+
+    // Drop all pages (back to zero / the file contents)
+    virtual void        reset(void);
+
+    virtual bool        get_page_counts(uint32_t *pages, uint32_t *resident, uint32_t *touched);
+
+private:
+    SparseMemory(uint8_t *map, uint32_t size, size_t map_size);
+
+    uint8_t            *m_map;
+    size_t              m_map_size;
+};
+
+#endif
@@ -48,7 +48,11 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <sys/mman.h>
 #include "riscv.h"
+#include "riscv_decode.h"
+#include "riscv_inst_dump.h"
+#include "memory_sparse.h"
 
 //-----------------------------------------------------------------
 // Defines:
@@ -57,15 +61,98 @@
 #define TRACE_ENABLED(l)    (m_trace & l)
 #define INST_STAT(l)
 
+//-----------------------------------------------------------------
+// table_alloc: Zeroed lookup table, host pages only become resident
+// once written (most of the 4GB physical space is never used)
+//-----------------------------------------------------------------
+static void *table_alloc(size_t size)
+{
+    void *table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(table != MAP_FAILED);
+    return table;
+}
+static void table_free(void *table, size_t size)
+{
+    if (table)
+        munmap(table, size);
+}
+
 //-----------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------
 Riscv::Riscv(uint32_t baseAddr /*= 0*/, uint32_t len /*= 0*/)
 {
     m_mem_regions        = 0;
+    m_mem_sparse         = false;
+    m_mem_page_host      = (uint8_t **)table_alloc(MEM_PAGES * sizeof(uint8_t *));
+    m_mem_page_region    = (uint8_t *)table_alloc(MEM_PAGES);
+    m_device_mapped      = false;
+    m_device_next        = DEVICE_NO_EVENT;
+    m_device_pending     = false;
+    m_device_irq         = false;
+    m_ext_irq            = false;
     m_stats_if           = NULL;
     m_console            = NULL;
     m_has_breakpoints    = false;
+    m_breakpoints        = PageBitmap(2);
+    m_has_watchpoints    = false;
+    m_watch_hit          = false;
+    m_watch_pc           = 0;
+    m_watch_addr         = 0;
+    m_watch_type         = 0;
+    m_has_hle            = false;
+    m_hle_entries        = PageBitmap(2);
+    m_hle_call_cost      = HLE_CALL_COST_DEFAULT;
+    m_hle_word_cost      = HLE_WORD_COST_DEFAULT;
+    m_btrace             = NULL;
+    m_timing             = NULL;
+    m_cache_sim          = NULL;
+    m_lockstep           = NULL;
+    m_record             = false;
+    m_trace_access       = false;
+    m_btrace_phys        = 0;
+    m_profiler           = NULL;
+    m_coverage           = NULL;
+    m_profile_left       = 0;
+    m_events             = 0;
+    m_fault              = false;
+    m_break              = false;
+    m_exited             = false;
+    m_exit_code          = 0;
+    m_error[0]           = 0;
+    m_run_stop_pc        = COSIM_PC_NONE;
+    m_run_trace_pc       = COSIM_PC_NONE;
+    m_idle_skip          = false;
+    m_idle_cycles        = 0;
+
+    // Single hart until set_harts()
+    m_mem_owner          = true;
+    m_mem_lock           = NULL;
+    m_hart_id            = 0;
+    m_primary            = this;
+    m_smp_quantum        = SMP_QUANTUM_DEFAULT;
+    m_smp_threads        = false;
+    m_clint_enable       = false;
+    m_clint_pending      = false;
+    m_clint_msip         = 0;
+    m_clint_mtimecmp     = ~(uint64_t)0;
+    m_clint_mtimecmp_set = false;
+    m_clint_timer        = false;
+    m_clint_mtime        = 0;
+
+    // Decoded instruction cache and threaded engine blocks (allocated
+    // when first executed, see create_caches())
+    m_engine             = ENGINE_INTERPRETER;
+    m_decode_cache       = NULL;
+    m_block_cache        = NULL;
+    m_block_map          = (uint32_t **)table_alloc(BLOCK_PAGES * sizeof(uint32_t *));
+    m_block_dirty        = false;
+    m_block_running      = false;
+    m_jit_code           = NULL;
+    m_jit_used           = 0;
+    exec_block<false>(NULL, 0);
+    exec_block<true>(NULL, 0);
+    flush_decode_cache();
 
     // Some memory defined
     if (len != 0)
@@ -78,14 +165,41 @@ Riscv::Riscv(uint32_t baseAddr /*= 0*/, uint32_t len /*= 0*/)
 //-----------------------------------------------------------------
 Riscv::~Riscv()
 {
-    int m;
+    // Other harts only reference hart 0's memory
+    for (size_t i=1;i<m_harts.size();i++)
+        delete m_harts[i];
+
+    release_memory();
+
+    jit_destroy();
+    flush_blocks();
+    table_free(m_block_map, BLOCK_PAGES * sizeof(uint32_t *));
+    table_free(m_block_cache, BLOCK_CACHE_ENTRIES * sizeof(t_block));
+    table_free(m_decode_cache, DECODE_CACHE_ENTRIES * sizeof(t_decoded_inst));
+}
+//-----------------------------------------------------------------
+// release_memory: Free the memory regions and map, if owned by this
+// hart (harts sharing hart 0's memory only reference them)
+//-----------------------------------------------------------------
+void Riscv::release_memory(void)
+{
+    if (!m_mem_owner)
+        return ;
 
-    for (m=0;m<m_mem_regions;m++)
+    for (int m=0;m<m_mem_regions;m++)
     {
-        if (m_mem[m])
-            delete m_mem[m];
+        delete m_mem[m];
         m_mem[m] = NULL;
     }
+
+    table_free(m_mem_page_region, MEM_PAGES);
+    table_free(m_mem_page_host, MEM_PAGES * sizeof(uint8_t *));
+    delete m_mem_lock;
+
+    m_mem_page_region = NULL;
+    m_mem_page_host   = NULL;
+    m_mem_lock        = NULL;
+    m_mem_owner       = false;
 }
 //-----------------------------------------------------------------
 // error: Handle an error
@@ -95,10 +209,14 @@ bool Riscv::error(bool terminal, const char *fmt, ...)
     va_list args;
 
     va_start(args, fmt);
-    vprintf(fmt, args);
+    vsnprintf(m_error, sizeof(m_error), fmt, args);
     va_end(args);
 
-    exit(-1);
+    printf("%s", m_error);
+
+    // Stop this simulation only, the host decides what to do
+    m_fault   = true;
+    m_events |= RUN_EVENT_HALT;
 
     return true;
 }
@@ -109,10 +227,30 @@ bool Riscv::create_memory(uint32_t baseAddr, uint32_t len, uint8_t *buf /*=NULL*
 {
     if (buf)
         return attach_memory(new SimpleMemory(buf, len), baseAddr, len);
+    else if (m_mem_sparse)
+        return create_file_memory(baseAddr, len, NULL);
     else
         return attach_memory(new SimpleMemory(len), baseAddr, len);
 }
 //-----------------------------------------------------------------
+// create_file_memory: Create a sparse memory region, initialised from
+// 'filename' (if not NULL)
+//-----------------------------------------------------------------
+bool Riscv::create_file_memory(uint32_t baseAddr, uint32_t len, const char *filename)
+{
+    Memory *memory = SparseMemory::create(len, filename);
+    if (!memory)
+        return false;
+
+    if (!attach_memory(memory, baseAddr, len))
+    {
+        delete memory;
+        return false;
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
 // attach_memory: Attach a memory device to a particular region
 //-----------------------------------------------------------------
 bool Riscv::attach_memory(Memory *memory, uint32_t baseAddr, uint32_t len)
@@ -124,15 +262,108 @@ bool Riscv::attach_memory(Memory *memory, uint32_t baseAddr, uint32_t len)
 
         m_mem[m_mem_regions] = memory;
         m_mem[m_mem_regions]->reset();
+        m_mem_device[m_mem_regions] = NULL;
 
+        map_memory(m_mem_regions);
         m_mem_regions++;
 
+        // Memory map changed, drop stale decodes
+        flush_decode_cache();
+
+        for (size_t i=1;i<m_harts.size();i++)
+            m_harts[i]->share_memory(this);
+
         return true;
     }
 
     return false;
 }
 //-----------------------------------------------------------------
+// attach_device: Attach a memory mapped device, its accesses bypass
+// the RAM fast path and it is updated with the core timer.
+//-----------------------------------------------------------------
+bool Riscv::attach_device(Device *device, uint32_t baseAddr, uint32_t len)
+{
+    // Devices are driven by hart 0
+    if (m_primary != this || !attach_memory(device, baseAddr, len))
+        return false;
+
+    m_mem_device[m_mem_regions-1] = device;
+    m_device_mapped = true;
+    m_devices.push_back(device);
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->share_memory(this);
+
+    device->update(m_csr_mtime);
+    device_update();
+    return true;
+}
+//-----------------------------------------------------------------
+// device_update: Update devices which are due, then the next event
+// time and the external interrupt (level of all device interrupts).
+//-----------------------------------------------------------------
+void Riscv::device_update(void)
+{
+    std::unique_lock <std::recursive_mutex > lock;
+    if (m_mem_lock)
+        lock = std::unique_lock <std::recursive_mutex >(*m_mem_lock);
+
+    uint64_t next = DEVICE_NO_EVENT;
+    bool     irq  = false;
+
+    m_device_pending.store(false, std::memory_order_relaxed);
+
+    for (size_t i=0;i<m_devices.size();i++)
+    {
+        Device *dev = m_devices[i];
+
+        if (dev->get_next_event() <= m_csr_mtime)
+            dev->update(m_csr_mtime);
+
+        if (dev->get_next_event() < next)
+            next = dev->get_next_event();
+
+        irq |= dev->get_irq();
+    }
+
+    m_device_next = next;
+
+    if (irq)
+    {
+        m_csr_mip |= SR_IP_MEIP;
+        m_events  |= RUN_EVENT_IRQ;
+    }
+    // Falling level, unless also raised by the host
+    else if (m_device_irq && !m_ext_irq)
+        m_csr_mip &= ~SR_IP_MEIP;
+
+    m_device_irq = irq;
+}
+//-----------------------------------------------------------------
+// device_access: A device register was accessed (device lock held)
+//-----------------------------------------------------------------
+void Riscv::device_access(void)
+{
+    // Hart 0 owns MEIP and the device schedule
+    if (m_primary != this)
+        m_primary->m_device_pending.store(true, std::memory_order_release);
+    else
+        device_update();
+}
+//-----------------------------------------------------------------
+// set_console: Console for putc / getc / printf (all harts)
+//-----------------------------------------------------------------
+bool Riscv::set_console(IConsoleIO *cio)
+{
+    m_console = cio;
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_console(cio);
+
+    return true;
+}
+//-----------------------------------------------------------------
 // set_pc: Set PC
 //-----------------------------------------------------------------
 void Riscv::set_pc(uint32_t pc)
@@ -164,8 +395,15 @@ void Riscv::set_register(int r, uint32_t val)
     else if (r == (RISCV_REGNO_CSR0 + CSR_STVAL)) m_csr_stval = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_SATP)) m_csr_satp = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_SSCRATCH)) m_csr_sscratch = val;
-    else if (r == RISCV_REGNO_PRIV) m_csr_mpriv = val;
-    
+    else if (r == RISCV_REGNO_PRIV) { m_csr_mpriv = val; select_execute(); }
+
+    m_events |= RUN_EVENT_IRQ;
+
+#ifdef CONFIG_MMU
+    // Translation state changed behind the core's back
+    if (r == (RISCV_REGNO_CSR0 + CSR_SATP) || r == RISCV_REGNO_PRIV)
+        tlb_flush(true, 0, true, 0);
+#endif
 }
 //-----------------------------------------------------------------
 // get_register: Get register value
@@ -209,8 +447,12 @@ bool Riscv::get_break(void)
 //-----------------------------------------------------------------
 bool Riscv::set_breakpoint(uint32_t pc)
 {
-    m_breakpoints.push_back(pc);
+    m_breakpoints.set(pc);
     m_has_breakpoints = true;
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_breakpoint(pc);
+
     return true;
 }
 //-----------------------------------------------------------------
@@ -218,26 +460,77 @@ bool Riscv::set_breakpoint(uint32_t pc)
 //-----------------------------------------------------------------
 bool Riscv::clr_breakpoint(uint32_t pc)
 {
-    for (std::vector<uint32_t>::iterator it = m_breakpoints.begin() ; it != m_breakpoints.end(); ++it)
-        if ((*it) == pc)
-        {
-            m_breakpoints.erase(it);
-            m_has_breakpoints = !m_breakpoints.empty();
-            return true;
-        }
+    if (!m_breakpoints.clr(pc))
+        return false;
 
-    return false;
+    m_has_breakpoints = !m_breakpoints.empty();
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->clr_breakpoint(pc);
+
+    return true;
 }
 //-----------------------------------------------------------------
 // check_breakpoint: Check if breakpoint has been hit
 //-----------------------------------------------------------------
 bool Riscv::check_breakpoint(uint32_t pc)
 {
-    for (std::vector<uint32_t>::iterator it = m_breakpoints.begin() ; it != m_breakpoints.end(); ++it)
-        if ((*it) == pc)
-            return true;
+    return m_breakpoints.test(pc);
+}
+//-----------------------------------------------------------------
+// set_watchpoint: Stop after reads and/or writes (COSIM_WATCH_XXX)
+// touching [addr, addr + len)
+//-----------------------------------------------------------------
+bool Riscv::set_watchpoint(uint32_t addr, uint32_t len, int type)
+{
+    if (len == 0 || !(type & (COSIM_WATCH_READ | COSIM_WATCH_WRITE)))
+        return false;
 
-    return false;
+    if (type & COSIM_WATCH_READ)
+        m_watch_read.set(addr, len);
+    if (type & COSIM_WATCH_WRITE)
+        m_watch_write.set(addr, len);
+    m_has_watchpoints = true;
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_watchpoint(addr, len, type);
+
+    return true;
+}
+//-----------------------------------------------------------------
+// clr_watchpoint: Remove a watched range (false if none of it was set)
+//-----------------------------------------------------------------
+bool Riscv::clr_watchpoint(uint32_t addr, uint32_t len, int type)
+{
+    bool found = false;
+
+    if (len == 0)
+        return false;
+
+    if (type & COSIM_WATCH_READ)
+        found |= m_watch_read.clr(addr, len);
+    if (type & COSIM_WATCH_WRITE)
+        found |= m_watch_write.clr(addr, len);
+    m_has_watchpoints = !m_watch_read.empty() || !m_watch_write.empty();
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->clr_watchpoint(addr, len, type);
+
+    return found;
+}
+//-----------------------------------------------------------------
+// get_watch_hit: Access which stopped the last run() (false if the
+// stop was not a watchpoint)
+//-----------------------------------------------------------------
+bool Riscv::get_watch_hit(uint32_t *pc, uint32_t *addr, int *type)
+{
+    if (!m_watch_hit)
+        return false;
+
+    *pc   = m_watch_pc;
+    *addr = m_watch_addr;
+    *type = m_watch_type;
+    return true;
 }
 //-----------------------------------------------------------------
 // reset: Reset CPU state
@@ -263,6 +556,7 @@ void Riscv::reset(uint32_t start_addr)
     m_csr_mtime    = 0;
     m_csr_mtimecmp = 0;
     m_csr_mscratch = 0;
+    m_clint_mtime  = 0;
 
     m_csr_sepc     = 0;
     m_csr_sevec    = 0;
@@ -273,46 +567,295 @@ void Riscv::reset(uint32_t start_addr)
 
     m_fault       = false;
     m_break       = false;
+    m_watch_hit   = false;
+    m_exited      = false;
+    m_exit_code   = 0;
+    m_error[0]    = 0;
     m_trace       = 0;
+    m_resv_valid  = false;
+    m_ext_irq     = false;
+    m_device_irq  = false;
+
+    // Devices restart with the timer
+    for (size_t i=0;i<m_devices.size();i++)
+        m_devices[i]->reset();
+    m_device_next = m_devices.empty() ? DEVICE_NO_EVENT : 0;
+
+    m_events     &= ~RUN_EVENT_HALT;
+    m_events     |= RUN_EVENT_IRQ;
+    update_events();
 
+#ifdef CONFIG_MMU
+    tlb_flush(true, 0, true, 0);
+#endif
+    flush_decode_cache();
     stats_reset();
+
+    // All harts start together, firmware picks its path from mhartid
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->reset(start_addr);
 }
 //-----------------------------------------------------------------
-// valid_addr: Check if the physical memory address is valid
+// enable_trace: Set trace mask (all harts)
 //-----------------------------------------------------------------
-bool Riscv::valid_addr(uint32_t address)
+void Riscv::enable_trace(uint32_t mask)
+{
+    m_trace = mask;
+    update_events();
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->enable_trace(mask);
+}
+//-----------------------------------------------------------------
+// map_memory: Add a region to the page map. Pages used by a single
+// region resolve directly (to host memory for RAM wholly covering the
+// page), pages shared between regions fall back to a search.
+//-----------------------------------------------------------------
+void Riscv::map_memory(int region)
+{
+    uint32_t base = m_mem_base[region];
+    uint32_t last = base + (m_mem_size[region] - 1);
+    uint8_t *host = NULL;
+
+    if (m_mem_size[region] == 0)
+        return ;
+
+    // Direct access assumes the host shares the target byte order
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    host = m_mem[region]->get_host_ptr();
+#endif
+
+    for (uint32_t page = base >> MEM_PAGE_SHIFT; page <= (last >> MEM_PAGE_SHIFT); page++)
+    {
+        uint32_t page_base = page << MEM_PAGE_SHIFT;
+        bool     whole     = (page_base >= base) && ((page_base + (MEM_PAGE_SIZE - 1)) <= last);
+
+        if (m_mem_page_region[page] == MEM_PAGE_UNMAPPED)
+        {
+            m_mem_page_region[page] = region + 1;
+            m_mem_page_host[page]   = (host && whole) ? (host + (page_base - base)) : NULL;
+        }
+        else
+        {
+            m_mem_page_region[page] = MEM_PAGE_SCAN;
+            m_mem_page_host[page]   = NULL;
+        }
+    }
+}
+//-----------------------------------------------------------------
+// mem_load: Read from physical memory (false if unmapped)
+//-----------------------------------------------------------------
+bool Riscv::mem_load(uint32_t address, int width, bool signedLoad, uint32_t *value)
+{
+    uint32_t page   = address >> MEM_PAGE_SHIFT;
+    uint8_t *host   = m_mem_page_host[page];
+    int      region = m_mem_page_region[page];
+
+    // RAM: naturally aligned accesses go straight to host memory
+    if (host && !(address & (width - 1)))
+    {
+        host += address & (MEM_PAGE_SIZE - 1);
+
+        switch (width)
+        {
+            case 4:
+            {
+                uint32_t data;
+                memcpy(&data, host, 4);
+                *value = data;
+            }
+            break;
+            case 2:
+            {
+                uint16_t data;
+                memcpy(&data, host, 2);
+                *value = signedLoad ? (uint32_t)(int16_t)data : data;
+            }
+            break;
+            default:
+                *value = signedLoad ? (uint32_t)(int8_t)*host : *host;
+            break;
+        }
+        return true;
+    }
+
+    if (region == MEM_PAGE_UNMAPPED)
+        return m_clint_enable && width == 4 && clint_access(address, false, value);
+
+    // Devices are not thread safe, serialise harts on host threads
+    std::unique_lock <std::recursive_mutex > lock;
+    if (m_mem_lock)
+        lock = std::unique_lock <std::recursive_mutex >(*m_mem_lock);
+
+    region = mem_region(address, region);
+    if (region < 0)
+        return false;
+
+    // Devices see the current time before the access
+    Device *dev = m_mem_device[region];
+    if (dev)
+        dev->update(m_csr_mtime);
+
+    *value = m_mem[region]->load(address - m_mem_base[region], width, signedLoad);
+
+    if (dev)
+        device_access();
+    return true;
+}
+//-----------------------------------------------------------------
+// mem_store: Write to physical memory (false if unmapped)
+//-----------------------------------------------------------------
+bool Riscv::mem_store(uint32_t address, uint32_t data, int width)
+{
+    uint32_t page   = address >> MEM_PAGE_SHIFT;
+    uint8_t *host   = m_mem_page_host[page];
+    int      region = m_mem_page_region[page];
+
+    // RAM: naturally aligned accesses go straight to host memory
+    if (host && !(address & (width - 1)))
+    {
+        host += address & (MEM_PAGE_SIZE - 1);
+
+        switch (width)
+        {
+            case 4:
+                memcpy(host, &data, 4);
+            break;
+            case 2:
+            {
+                uint16_t half = data;
+                memcpy(host, &half, 2);
+            }
+            break;
+            default:
+                *host = data;
+            break;
+        }
+        return true;
+    }
+
+    if (region == MEM_PAGE_UNMAPPED)
+        return m_clint_enable && width == 4 && clint_access(address, true, &data);
+
+    std::unique_lock <std::recursive_mutex > lock;
+    if (m_mem_lock)
+        lock = std::unique_lock <std::recursive_mutex >(*m_mem_lock);
+
+    region = mem_region(address, region);
+    if (region < 0)
+        return false;
+
+    Device *dev = m_mem_device[region];
+    if (dev)
+        dev->update(m_csr_mtime);
+
+    m_mem[region]->store(address - m_mem_base[region], data, width);
+
+    if (dev)
+        device_access();
+    return true;
+}
+//-----------------------------------------------------------------
+// mem_region: Region holding the address given its page map entry
+// (not MEM_PAGE_UNMAPPED), -1 if none.
+//-----------------------------------------------------------------
+int Riscv::mem_region(uint32_t address, int region)
 {
+    // Page used by a single region, which may only partly cover it
+    if (region != MEM_PAGE_SCAN)
+    {
+        region--;
+        return ((address - m_mem_base[region]) < m_mem_size[region]) ? region : -1;
+    }
+
     for (int j=0;j<m_mem_regions;j++)
         if (address >= m_mem_base[j] && address < (m_mem_base[j] + m_mem_size[j]))
-            return true;
+            return j;
 
-    return false;
+    return -1;
+}
+//-----------------------------------------------------------------
+// mem_device: Physical address is a device register
+//-----------------------------------------------------------------
+bool Riscv::mem_device(uint32_t address)
+{
+    uint32_t page   = address >> MEM_PAGE_SHIFT;
+    int      region = m_mem_page_region[page];
+
+    if (m_mem_page_host[page] || region == MEM_PAGE_UNMAPPED)
+        return false;
+
+    region = mem_region(address, region);
+    return region >= 0 && m_mem_device[region] != NULL;
+}
+//-----------------------------------------------------------------
+// valid_addr: Check if the physical memory address is valid
+//-----------------------------------------------------------------
+bool Riscv::valid_addr(uint32_t address)
+{
+    int region = m_mem_page_region[address >> MEM_PAGE_SHIFT];
+
+    if (region == MEM_PAGE_UNMAPPED)
+        return false;
+
+    return mem_region(address, region) >= 0;
 }
 //-----------------------------------------------------------------
 // write: Write a byte to memory (physical address)
 //-----------------------------------------------------------------
 void Riscv::write(uint32_t address, uint8_t data)
 {
-    for (int j=0;j<m_mem_regions;j++)
-        if (address >= m_mem_base[j] && address < (m_mem_base[j] + m_mem_size[j]))
+    if (mem_store(address, data, 1))
+    {
+        invalidate_code(address);
+        return ;
+    }
+
+    error(false, "Failed store @ 0x%08x\n", address);
+}
+//-----------------------------------------------------------------
+// write_block: Write a block to memory (physical address)
+//-----------------------------------------------------------------
+bool Riscv::write_block(uint32_t address, const uint8_t *data, uint32_t len)
+{
+    bool ok = true;
+
+    while (len && ok)
+    {
+        uint32_t offset = address & (MEM_PAGE_SIZE - 1);
+        uint32_t chunk  = MEM_PAGE_SIZE - offset;
+        uint8_t *host   = m_mem_page_host[address >> MEM_PAGE_SHIFT];
+
+        if (chunk > len)
+            chunk = len;
+
+        if (host)
+            memcpy(host + offset, data, chunk);
+        else
         {
-            m_mem[j]->store(address - m_mem_base[j], data, 1);
-            return ;
+            for (uint32_t i=0;i<chunk && ok;i++)
+                ok = mem_store(address + i, data[i], 1);
         }
 
-    error(false, "Failed store @ 0x%08x\n", address);
+        address += chunk;
+        data    += chunk;
+        len     -= chunk;
+    }
+
+    // Loaded over previously executed code?
+    flush_decode_cache();
+    return ok;
 }
 //-----------------------------------------------------------------
 // write32: Write a word to memory (physical address)
 //-----------------------------------------------------------------
 void Riscv::write32(uint32_t address, uint32_t data)
 {
-    for (int j=0;j<m_mem_regions;j++)
-        if (address >= m_mem_base[j] && address < (m_mem_base[j] + m_mem_size[j]))
-        {
-            m_mem[j]->store(address - m_mem_base[j], data, 4);
-            return ;
-        }
+    if (mem_store(address, data, 4))
+    {
+        invalidate_code(address);
+        return ;
+    }
 
     error(false, "Failed store @ 0x%08x\n", address);
 }
@@ -321,22 +864,18 @@ void Riscv::write32(uint32_t address, uint32_t data)
 //-----------------------------------------------------------------
 uint8_t Riscv::read(uint32_t address)
 {
-    for (int j=0;j<m_mem_regions;j++)
-        if (address >= m_mem_base[j] && address < (m_mem_base[j] + m_mem_size[j]))
-            return m_mem[j]->load(address - m_mem_base[j], 1, false);
-
-    return 0;
+    uint32_t data = 0;
+    mem_load(address, 1, false, &data);
+    return data;
 }
 //-----------------------------------------------------------------
 // read32: Read a word from memory (physical address)
 //-----------------------------------------------------------------
 uint32_t Riscv::read32(uint32_t address)
 {
-    for (int j=0;j<m_mem_regions;j++)
-        if (address >= m_mem_base[j] && address < (m_mem_base[j] + m_mem_size[j]))
-            return m_mem[j]->load(address - m_mem_base[j], 4, false);
-
-    return 0;
+    uint32_t data = 0;
+    mem_load(address, 4, false, &data);
+    return data;
 }
 //-----------------------------------------------------------------
 // get_opcode: Get instruction from address
@@ -351,17 +890,8 @@ uint32_t Riscv::get_opcode(uint32_t address)
 //-----------------------------------------------------------------
 int Riscv::mmu_read_word(uint32_t address, uint32_t *val)
 {
-    int m;
     *val = 0;
-
-    for (m=0;m<m_mem_regions;m++)
-        if (address >= m_mem_base[m] && address < (m_mem_base[m] + m_mem_size[m]))
-        {
-            *val = m_mem[m]->load(address - m_mem_base[m], 4, false);
-            return 1;
-        }
-
-    return 0;
+    return mem_load(address, 4, false, val) ? 1 : 0;
 }
 //-----------------------------------------------------------------
 // mmu_walk: Page table walker
@@ -465,32 +995,110 @@ uint32_t Riscv::mmu_walk(uint32_t addr)
     return pte;
 }
 //-----------------------------------------------------------------
-// mmu_i_translate: Translate instruction fetch
+// mmu_lookup: Translate through a TLB, walking the tables on a miss.
+// Permissions are checked by the caller on every access, so entries
+// stay valid across privilege changes.
 //-----------------------------------------------------------------
-int Riscv::mmu_i_translate(uint32_t addr, uint32_t *physical)
+uint32_t Riscv::mmu_lookup(t_tlb_entry *tlb, uint32_t addr, int stats_hit)
 {
-    bool page_fault = false;
+    uint32_t     vpn   = addr >> MMU_PGSHIFT;
+    uint32_t     asid  = (m_csr_satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+    t_tlb_entry *entry = &tlb[vpn & (TLB_ENTRIES-1)];
 
-    // Machine - no MMU
-    if (m_csr_mpriv > PRIV_SUPER)
+    if (entry->valid && entry->vpn == vpn && (entry->asid == asid || (entry->pte & PAGE_GLOBAL)))
     {
-        *physical = addr;
-        return 1; 
+        m_stats[stats_hit]++;
+        return entry->pte;
     }
-    
+
+    // Miss counter follows the hit counter
+    m_stats[stats_hit + 1]++;
+
     uint32_t pte = mmu_walk(addr);
 
-    // Reserved configurations
-    if (((pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE)) == PAGE_WRITE) ||
-        ((pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE)) == (PAGE_EXEC | PAGE_WRITE)))
+    // Only cache valid leaf entries, faults are re-walked
+    if (pte & PAGE_PRESENT)
     {
-        page_fault = true;
+        entry->vpn   = vpn;
+        entry->asid  = asid;
+        entry->pte   = pte;
+        entry->valid = true;
     }
-    // Supervisor mode
-    else if (m_csr_mpriv == PRIV_SUPER)
-    {
-        // Supervisor attempts to execute user mode page
-        if (pte & PAGE_USER)
+
+    return pte;
+}
+//-----------------------------------------------------------------
+// tlb_flush: Invalidate TLB entries (sfence.vma semantics)
+//-----------------------------------------------------------------
+void Riscv::tlb_flush(bool all_addr, uint32_t addr, bool all_asid, uint32_t asid)
+{
+    t_tlb_entry *tlbs[2] = { m_itlb, m_dtlb };
+    uint32_t     vpn     = addr >> MMU_PGSHIFT;
+
+    m_stats[STATS_TLB_FLUSHES]++;
+
+    for (int t=0;t<2;t++)
+    {
+        int first = all_addr ? 0 : (vpn & (TLB_ENTRIES-1));
+        int last  = all_addr ? (TLB_ENTRIES-1) : first;
+
+        for (int i=first;i<=last;i++)
+        {
+            t_tlb_entry *entry = &tlbs[t][i];
+
+            if (!all_addr && entry->vpn != vpn)
+                continue;
+
+            // ASID specific flushes leave global mappings alone
+            if (!all_asid && (entry->asid != asid || (entry->pte & PAGE_GLOBAL)))
+                continue;
+
+            entry->valid = false;
+        }
+    }
+}
+//-----------------------------------------------------------------
+// tlb_satp_write: Handle a change of translation root. A new ASID
+// selects other entries, reusing an ASID for a new root or changing
+// mode drops the stale ones.
+//-----------------------------------------------------------------
+void Riscv::tlb_satp_write(uint32_t old_satp)
+{
+    uint32_t asid     = (m_csr_satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+    uint32_t old_asid = (old_satp   >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+
+    if ((m_csr_satp ^ old_satp) & SATP_MODE)
+        tlb_flush(true, 0, true, 0);
+    else if (asid == old_asid && m_csr_satp != old_satp)
+        tlb_flush(true, 0, false, asid);
+}
+//-----------------------------------------------------------------
+// mmu_i_translate: Translate instruction fetch
+//-----------------------------------------------------------------
+int Riscv::mmu_i_translate(uint32_t addr, uint32_t *physical)
+{
+    bool page_fault = false;
+
+    // Machine - no MMU
+    if (m_csr_mpriv > PRIV_SUPER)
+    {
+        *physical = addr;
+        return 1; 
+    }
+    
+    uint32_t pte = mmu_lookup(m_itlb, addr, STATS_ITLB_HITS);
+
+    // Reserved configurations
+    if (((pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE)) == PAGE_WRITE) ||
+        ((pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE)) == (PAGE_EXEC | PAGE_WRITE)))
+    {
+        page_fault = true;
+    }
+    // Supervisor mode
+    else if (m_csr_mpriv == PRIV_SUPER)
+    {
+        // Supervisor attempts to execute user mode page
+        if (pte & PAGE_USER)
         {
             error(false, "IMMU: Attempt to execute user page 0x%08x\n", addr);
             page_fault = true;
@@ -541,7 +1149,7 @@ int Riscv::mmu_d_translate(uint32_t pc, uint32_t addr, uint32_t *physical, int w
         return 1; 
     }
 
-    uint32_t pte = mmu_walk(addr);
+    uint32_t pte = mmu_lookup(m_dtlb, addr, STATS_DTLB_HITS);
 
     // Reserved configurations
     if (((pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE)) == PAGE_WRITE) ||
@@ -603,21 +1211,39 @@ int Riscv::load(uint32_t pc, uint32_t address, uint32_t *result, int width, bool
         return 0;
 #endif
 
-    DPRINTF(LOG_MEM, ("LOAD: VA 0x%08x PA 0x%08x Width %d\n", address, physical, width));
+    // Devices are accessed from step() so they see the exact time, the
+    // block ends before this instruction.
+    if (m_block_running && mem_device(physical))
+    {
+        m_events |= RUN_EVENT_DEVICE;
+        return 0;
+    }
+
+    if (m_has_watchpoints && m_watch_read.test(address, width) && watch_access(pc, address, COSIM_WATCH_READ))
+        return 0;
 
     event_push(COSIM_EVENT_LOAD, physical & ~3, 0);
 
     m_stats[STATS_LOADS]++;
 
-    for (int j=0;j<m_mem_regions;j++)
-        if (physical >= m_mem_base[j] && physical < (m_mem_base[j] + m_mem_size[j]))
+    if (mem_load(physical, width, signedLoad, result))
+    {
+        if (m_trace_access)
         {
-            *result = m_mem[j]->load(physical - m_mem_base[j], width, signedLoad);
-
+            DPRINTF(LOG_MEM, ("LOAD: VA 0x%08x PA 0x%08x Width %d\n", address, physical, width));
             DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
-            event_push(COSIM_EVENT_LOAD_RESULT, *result, 0);
-            return 1;
+
+            if (m_record)
+            {
+                m_btrace_rec.flags   |= TRACE_FLAG_LOAD | (width << TRACE_WIDTH_SHIFT);
+                m_btrace_rec.mem_addr = address;
+                m_btrace_rec.mem_data = *result;
+                m_btrace_phys         = physical;
+            }
         }
+        event_push(COSIM_EVENT_LOAD_RESULT, *result, 0);
+        return 1;
+    }
 
     error(false, "%08x: Load, bad memory access 0x%x\n", pc, address);
     return 0;
@@ -635,7 +1261,27 @@ int Riscv::store(uint32_t pc, uint32_t address, uint32_t data, int width)
         return 0;
 #endif
 
-    DPRINTF(LOG_MEM, ("STORE: VA 0x%08x PA 0x%08x Value 0x%08x Width %d\n", address, physical, data, width));
+    if (m_block_running && mem_device(physical))
+    {
+        m_events |= RUN_EVENT_DEVICE;
+        return 0;
+    }
+
+    if (m_has_watchpoints && m_watch_write.test(address, width) && watch_access(pc, address, COSIM_WATCH_WRITE))
+        return 0;
+
+    if (m_trace_access)
+    {
+        DPRINTF(LOG_MEM, ("STORE: VA 0x%08x PA 0x%08x Value 0x%08x Width %d\n", address, physical, data, width));
+
+        if (m_record)
+        {
+            m_btrace_rec.flags   |= TRACE_FLAG_STORE | (width << TRACE_WIDTH_SHIFT);
+            m_btrace_rec.mem_addr = address;
+            m_btrace_rec.mem_data = data;
+            m_btrace_phys         = physical;
+        }
+    }
 
     m_stats[STATS_STORES]++;
 
@@ -646,22 +1292,136 @@ int Riscv::store(uint32_t pc, uint32_t address, uint32_t data, int width)
     else
         event_push(COSIM_EVENT_STORE, physical, data);
 
-    for (int j=0;j<m_mem_regions;j++)
-        if (physical >= m_mem_base[j] && physical < (m_mem_base[j] + m_mem_size[j]))
-        {
-            m_mem[j]->store(physical - m_mem_base[j], data, width);
-            return 1;
-        }
+    if (mem_store(physical, data, width))
+    {
+        invalidate_code(physical);
+        invalidate_code(physical + width - 1);
+        return 1;
+    }
 
     error(false, "%08x: Store, bad memory access 0x%x\n", pc, address);
     return 0;
 }
 //-----------------------------------------------------------------
+// watch_access: Access hit a watchpoint. Inside a block, leave the block
+// before the instruction (returns true) so that step() runs it,
+// otherwise the access completes and run() stops after it.
+//-----------------------------------------------------------------
+bool Riscv::watch_access(uint32_t pc, uint32_t address, int type)
+{
+    if (m_block_running)
+    {
+        m_events |= RUN_EVENT_DEVICE;
+        return true;
+    }
+
+    m_break      = true;
+    m_watch_hit  = true;
+    m_watch_pc   = pc;
+    m_watch_addr = address;
+    m_watch_type = type;
+    return false;
+}
+//-----------------------------------------------------------------
+// amo_address: Check alignment and translate an LR/SC/AMO address
+//-----------------------------------------------------------------
+int Riscv::amo_address(uint32_t pc, uint32_t address, uint32_t *physical, int writeNotRead)
+{
+    *physical = address;
+
+    if (address & 3)
+    {
+        exception(writeNotRead ? MCAUSE_MISALIGNED_STORE : MCAUSE_MISALIGNED_LOAD, pc, address);
+        return 0;
+    }
+
+#ifdef CONFIG_MMU
+    if (!mmu_d_translate(pc, address, physical, writeNotRead))
+        return 0;
+#endif
+
+    DPRINTF(LOG_MEM, ("AMO: VA 0x%08x PA 0x%08x\n", address, *physical));
+
+    // Read-modify-writes count as writes, as in the trace below
+    const PageBitmap &watch = writeNotRead ? m_watch_write : m_watch_read;
+    if (m_has_watchpoints && watch.test(address, 4))
+        watch_access(pc, address, writeNotRead ? COSIM_WATCH_WRITE : COSIM_WATCH_READ);
+
+    // Read-modify-writes are traced as stores of rs2, the old value
+    // is the writeback
+    if (m_record)
+    {
+        m_btrace_rec.flags   |= (writeNotRead ? TRACE_FLAG_STORE : TRACE_FLAG_LOAD) | (4 << TRACE_WIDTH_SHIFT);
+        m_btrace_rec.mem_addr = address;
+        m_btrace_phys         = *physical;
+    }
+    return 1;
+}
+//-----------------------------------------------------------------
+// amo_alu: New memory value for an AMO (ENUM_INST_XXX)
+//-----------------------------------------------------------------
+static uint32_t amo_alu(int op, uint32_t value, uint32_t operand)
+{
+    switch (op)
+    {
+        case ENUM_INST_AMOADD_W:  return value + operand;
+        case ENUM_INST_AMOXOR_W:  return value ^ operand;
+        case ENUM_INST_AMOAND_W:  return value & operand;
+        case ENUM_INST_AMOOR_W:   return value | operand;
+        case ENUM_INST_AMOMIN_W:  return ((int32_t)value < (int32_t)operand) ? value : operand;
+        case ENUM_INST_AMOMAX_W:  return ((int32_t)value > (int32_t)operand) ? value : operand;
+        case ENUM_INST_AMOMINU_W: return (value < operand) ? value : operand;
+        case ENUM_INST_AMOMAXU_W: return (value > operand) ? value : operand;
+        default:                  return operand; // amoswap.w, sc.w
+    }
+}
+//-----------------------------------------------------------------
+// mem_amo: Atomic read-modify-write of a physical word, returns the
+// old value. sc.w only writes if the word still holds the LR value.
+//-----------------------------------------------------------------
+bool Riscv::mem_amo(uint32_t address, int op, uint32_t operand, uint32_t *old)
+{
+    uint8_t *host = m_mem_page_host[address >> MEM_PAGE_SHIFT];
+
+    // RAM: host atomics, so harts on other host threads see one update
+    if (host)
+    {
+        uint32_t *word  = (uint32_t *)(host + (address & (MEM_PAGE_SIZE - 1)));
+        uint32_t  value = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+
+        do
+        {
+            if (op == ENUM_INST_SC_W && value != m_resv_value)
+                break;
+        }
+        while (!__atomic_compare_exchange_n(word, &value, amo_alu(op, value, operand), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+        *old = value;
+        return true;
+    }
+
+    // Devices: read-modify-write under the device lock
+    std::unique_lock <std::recursive_mutex > lock;
+    if (m_mem_lock)
+        lock = std::unique_lock <std::recursive_mutex >(*m_mem_lock);
+
+    if (!mem_load(address, 4, false, old))
+        return false;
+
+    if (op == ENUM_INST_SC_W && *old != m_resv_value)
+        return true;
+
+    return mem_store(address, amo_alu(op, *old, operand), 4);
+}
+//-----------------------------------------------------------------
 // access_csr: Perform CSR access
 //-----------------------------------------------------------------
 uint32_t Riscv::access_csr(uint32_t address, uint32_t data, bool set, bool clr)
 {
-    uint32_t result = 0;
+    uint32_t result   = 0;
+#ifdef CONFIG_MMU
+    uint32_t old_satp = m_csr_satp;
+#endif
 
 #define CSR_STD(name, var_name) \
     case CSR_ ##name: \
@@ -695,8 +1455,9 @@ uint32_t Riscv::access_csr(uint32_t address, uint32_t data, bool set, bool clr)
             switch (data & 0xFF000000)
             {
                 case CSR_SIM_CTRL_EXIT:
-                    stats_dump();
-                    exit(data & 0xFF);
+                    m_exited    = true;
+                    m_exit_code = data & 0xFF;
+                    m_events   |= RUN_EVENT_HALT;
                     break;
                 case CSR_SIM_CTRL_PUTC:
                     if (m_console)
@@ -741,7 +1502,14 @@ uint32_t Riscv::access_csr(uint32_t address, uint32_t data, bool set, bool clr)
 
                     char out_str[1024];
                     sprintf(out_str, fmt_str, arg1, arg2, arg3, arg4);
-                    printf("%s",out_str);
+
+                    if (m_console)
+                    {
+                        for (char *p = out_str; *p; p++)
+                            m_console->putchar(*p);
+                    }
+                    else
+                        printf("%s",out_str);
                 }
                 break;
             }
@@ -759,7 +1527,7 @@ uint32_t Riscv::access_csr(uint32_t address, uint32_t data, bool set, bool clr)
         CSR_STD(MIDELEG, m_csr_mideleg)
         CSR_STD(MEDELEG, m_csr_medeleg)
         CSR_STD(MSCRATCH,m_csr_mscratch)
-        CSR_CONST(MHARTID,  MHARTID_VALUE)
+        CSR_CONST(MHARTID,  m_hart_id)
         //--------------------------------------------------------
         // Standard - Supervisor
         //--------------------------------------------------------
@@ -784,9 +1552,12 @@ uint32_t Riscv::access_csr(uint32_t address, uint32_t data, bool set, bool clr)
             result      = m_csr_mtime;
 
             // Non-std behaviour - write to CSR_TIME gives next interrupt threshold            
+            // (next time the low 32-bits of the 64-bit timer match 'data')
             if (set && data != 0)
             {
-                m_csr_mtimecmp = data;
+                m_csr_mtimecmp = (m_csr_mtime & ~(uint64_t)0xFFFFFFFF) | data;
+                if (m_csr_mtimecmp <= m_csr_mtime)
+                    m_csr_mtimecmp += (uint64_t)1 << 32;
 
                 // Clear interrupt pending
                 m_csr_mip &= ~((m_csr_mideleg & SR_IP_STIP) ? SR_IP_STIP : SR_IP_MTIP);
@@ -800,6 +1571,12 @@ uint32_t Riscv::access_csr(uint32_t address, uint32_t data, bool set, bool clr)
             error(false, "*** CSR address not supported %08x [PC=%08x]\n", address, m_pc);
             break;
     }
+
+#ifdef CONFIG_MMU
+    if (m_csr_satp != old_satp)
+        tlb_satp_write(old_satp);
+#endif
+
     return result;
 }
 //-----------------------------------------------------------------
@@ -810,6 +1587,12 @@ void Riscv::exception(uint32_t cause, uint32_t pc, uint32_t badaddr /*= 0*/)
     uint32_t deleg;
     uint32_t bit;
 
+    // Privilege and interrupt enables change
+    m_events |= RUN_EVENT_IRQ;
+
+    // Traps break LR/SC sequences
+    m_resv_valid = false;
+
     // Interrupt
     if (cause >= MCAUSE_INTERRUPT)
     {
@@ -839,6 +1622,7 @@ void Riscv::exception(uint32_t cause, uint32_t pc, uint32_t badaddr /*= 0*/)
 
         // Raise priviledge to supervisor level
         m_csr_mpriv  = PRIV_SUPER;
+        select_execute();
 
         m_csr_msr    = s;
         m_csr_sepc   = pc;
@@ -864,6 +1648,7 @@ void Riscv::exception(uint32_t cause, uint32_t pc, uint32_t badaddr /*= 0*/)
 
         // Raise priviledge to machine level
         m_csr_mpriv  = PRIV_MACHINE;
+        select_execute();
 
         m_csr_msr    = s;
         m_csr_mepc   = pc;
@@ -874,711 +1659,1134 @@ void Riscv::exception(uint32_t cause, uint32_t pc, uint32_t badaddr /*= 0*/)
     }
 }
 //-----------------------------------------------------------------
-// execute: Instruction execution stage
+// flush_decode_cache: Drop all decoded instructions (fence.i)
 //-----------------------------------------------------------------
-void Riscv::execute(void)
+void Riscv::flush_decode_cache(void)
 {
-    uint32_t phy_pc = m_pc;
-
-#ifdef CONFIG_MMU
-    // Translate PC to physical address
-    if (!mmu_i_translate(m_pc, &phy_pc))
-        return ;
-#endif
-
-    // Get opcode at current PC
-    uint32_t opcode = get_opcode(phy_pc);
-    m_pc_x = m_pc;
-
-    // Extract registers
-    int rd          = (opcode & OPCODE_RD_MASK)  >> OPCODE_RD_SHIFT;
-    int rs1         = (opcode & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT;
-    int rs2         = (opcode & OPCODE_RS2_MASK) >> OPCODE_RS2_SHIFT;
-
-    // Extract immediates
-    int typei_imm   = ((signed)(opcode & OPCODE_TYPEI_IMM_MASK)) >> OPCODE_TYPEI_IMM_SHIFT;
-    int typeu_imm   = ((signed)(opcode & OPCODE_TYPEU_IMM_MASK)) >> OPCODE_TYPEU_IMM_SHIFT;
-    int imm20       = typeu_imm << OPCODE_TYPEU_IMM_SHIFT;
-    int imm12       = typei_imm;
-    int bimm        = OPCODE_SBTYPE_IMM(opcode);
-    int jimm20      = OPCODE_UJTYPE_IMM(opcode);
-    int storeimm    = OPCODE_STYPE_IMM(opcode);
-    int shamt       = ((signed)(opcode & OPCODE_SHAMT_MASK)) >> OPCODE_SHAMT_SHIFT;
-
-    // Retrieve registers
-    uint32_t reg_rd  = 0;
-    uint32_t reg_rs1 = m_gpr[rs1];
-    uint32_t reg_rs2 = m_gpr[rs2];
-    uint32_t pc      = m_pc;
-
-    bool take_exception = false;
-
-    DPRINTF(LOG_OPCODES,( "%08x: %08x\n", pc, opcode));
-    DPRINTF(LOG_OPCODES,( "        rd(%d) r%d = %d, r%d = %d\n", rd, rs1, reg_rs1, rs2, reg_rs2));
-
-    // As RVC is not supported, fault on opcode which is all zeros
-    if (opcode == 0)
-    {
-        error(false, "Bad instruction @ %x\n", pc);
-
-        exception(MCAUSE_ILLEGAL_INSTRUCTION, pc);
-        m_fault = true;
-        take_exception = true;        
-    }
-    else if ((opcode & INST_ANDI_MASK) == INST_ANDI)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: andi r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ANDI);
-        reg_rd = reg_rs1 & imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_ORI_MASK) == INST_ORI)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: ori r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ORI);
-        reg_rd = reg_rs1 | imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_XORI_MASK) == INST_XORI)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: xori r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_XORI);
-        reg_rd = reg_rs1 ^ imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_ADDI_MASK) == INST_ADDI)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: addi r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ADDI);
-        reg_rd = reg_rs1 + imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLTI_MASK) == INST_SLTI)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: slti r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_SLTI);
-        reg_rd = (signed)reg_rs1 < (signed)imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLTIU_MASK) == INST_SLTIU)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: sltiu r%d, r%d, %d\n", pc, rd, rs1, (unsigned)imm12));
-        INST_STAT(ENUM_INST_SLTIU);
-        reg_rd = (unsigned)reg_rs1 < (unsigned)imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLLI_MASK) == INST_SLLI)
-    {
-        // ['rd', 'rs1']
-        DPRINTF(LOG_INST,("%08x: slli r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SLLI);
-        reg_rd = reg_rs1 << shamt;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SRLI_MASK) == INST_SRLI)
-    {
-        // ['rd', 'rs1', 'shamt']
-        DPRINTF(LOG_INST,("%08x: srli r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SRLI);
-        reg_rd = (unsigned)reg_rs1 >> shamt;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SRAI_MASK) == INST_SRAI)
-    {
-        // ['rd', 'rs1', 'shamt']
-        DPRINTF(LOG_INST,("%08x: srai r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SRAI);
-        reg_rd = (signed)reg_rs1 >> shamt;
-        pc += 4;        
-    }
-    else if ((opcode & INST_LUI_MASK) == INST_LUI)
-    {
-        // ['rd', 'imm20']
-        DPRINTF(LOG_INST,("%08x: lui r%d, 0x%x\n", pc, rd, imm20));
-        INST_STAT(ENUM_INST_LUI);
-        reg_rd = imm20;
-        pc += 4;        
-    }
-    else if ((opcode & INST_AUIPC_MASK) == INST_AUIPC)
-    {
-        // ['rd', 'imm20']
-        DPRINTF(LOG_INST,("%08x: auipc r%d, 0x%x\n", pc, rd, imm20));
-        INST_STAT(ENUM_INST_AUIPC);
-        reg_rd = imm20 + pc;
-        pc += 4;        
-    }
-    else if ((opcode & INST_ADD_MASK) == INST_ADD)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: add r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_ADD);
-        reg_rd = reg_rs1 + reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SUB_MASK) == INST_SUB)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: sub r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SUB);
-        reg_rd = reg_rs1 - reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLT_MASK) == INST_SLT)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: slt r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLT);
-        reg_rd = (signed)reg_rs1 < (signed)reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLTU_MASK) == INST_SLTU)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: sltu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLTU);
-        reg_rd = (unsigned)reg_rs1 < (unsigned)reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_XOR_MASK) == INST_XOR)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: xor r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_XOR);
-        reg_rd = reg_rs1 ^ reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_OR_MASK) == INST_OR)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: or r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_OR);
-        reg_rd = reg_rs1 | reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_AND_MASK) == INST_AND)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: and r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_AND);
-        reg_rd = reg_rs1 & reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLL_MASK) == INST_SLL)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: sll r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLL);
-        reg_rd = reg_rs1 << reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SRL_MASK) == INST_SRL)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: srl r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SRL);
-        reg_rd = (unsigned)reg_rs1 >> reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SRA_MASK) == INST_SRA)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: sra r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SRA);
-        reg_rd = (signed)reg_rs1 >> reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_JAL_MASK) == INST_JAL)
-    {
-        // ['rd', 'jimm20']
-        DPRINTF(LOG_INST,("%08x: jal r%d, %d\n", pc, rd, jimm20));
-        INST_STAT(ENUM_INST_JAL);
-        reg_rd = pc + 4;
-        pc+= jimm20;
-
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_JALR_MASK) == INST_JALR)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: jalr r%d, r%d\n", pc, rs1, imm12));
-        INST_STAT(ENUM_INST_JALR);
-        reg_rd = pc + 4;
-        pc = (reg_rs1 + imm12) & ~1;
+    // Never used (zero) entries are left alone, see create_caches()
+    for (int i=0;i<DECODE_CACHE_ENTRIES && m_decode_cache;i++)
+        if (i == 0 || m_decode_cache[i].pc)
+            m_decode_cache[i].pc = 0xFFFFFFFF;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BEQ_MASK) == INST_BEQ)
+    flush_blocks();
+}
+//-----------------------------------------------------------------
+// create_caches: Allocate the decoded instruction cache, and the block
+// cache if a block engine is selected, on first execution. Both start
+// zeroed and only the entries used become resident: a zero tag can
+// only match physical address 0, which maps to entry 0, so just that
+// entry needs an invalid tag.
+//-----------------------------------------------------------------
+void Riscv::create_caches(void)
+{
+    if (!m_decode_cache)
     {
-        // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
-        DPRINTF(LOG_INST,("%08x: beq r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BEQ);
-        if (reg_rs1 == reg_rs2)
-            pc += bimm;
-        else
-            pc += 4;
-
-        // No writeback
-        rd = 0;
-
-        m_stats[STATS_BRANCHES]++;        
+        m_decode_cache = (t_decoded_inst *)table_alloc(DECODE_CACHE_ENTRIES * sizeof(t_decoded_inst));
+        m_decode_cache[0].pc = 0xFFFFFFFF;
+        select_execute();
     }
-    else if ((opcode & INST_BNE_MASK) == INST_BNE)
-    {
-        // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
-        DPRINTF(LOG_INST,("%08x: bne r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BNE);
-        if (reg_rs1 != reg_rs2)
-            pc += bimm;
-        else
-            pc += 4;
-
-        // No writeback
-        rd = 0;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BLT_MASK) == INST_BLT)
+    if (!m_block_cache && m_engine != ENGINE_INTERPRETER)
     {
-        // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
-        DPRINTF(LOG_INST,("%08x: blt r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BLT);
-        if ((signed)reg_rs1 < (signed)reg_rs2)
-            pc += bimm;
-        else
-            pc += 4;
-
-        // No writeback
-        rd = 0;
-
-        m_stats[STATS_BRANCHES]++;        
+        m_block_cache = (t_block *)table_alloc(BLOCK_CACHE_ENTRIES * sizeof(t_block));
+        m_block_cache[0].pc = 0xFFFFFFFF;
     }
-    else if ((opcode & INST_BGE_MASK) == INST_BGE)
-    {
-        // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
-        DPRINTF(LOG_INST,("%08x: bge r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BGE);
-        if ((signed)reg_rs1 >= (signed)reg_rs2)
-            pc += bimm;
-        else
-            pc += 4;
-
-        // No writeback
-        rd = 0;
+}
+//-----------------------------------------------------------------
+// invalidate_code: Drop decoded instruction for a modified word
+//-----------------------------------------------------------------
+void Riscv::invalidate_code(uint32_t phys_addr)
+{
+    // Nothing executed yet
+    if (!m_decode_cache)
+        return ;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BLTU_MASK) == INST_BLTU)
-    {
-        // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
-        DPRINTF(LOG_INST,("%08x: bltu r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BLTU);
-        if ((unsigned)reg_rs1 < (unsigned)reg_rs2)
-            pc += bimm;
-        else
-            pc += 4;
+    t_decoded_inst *inst = &m_decode_cache[(phys_addr >> 2) & (DECODE_CACHE_ENTRIES-1)];
 
-        // No writeback
-        rd = 0;
+    if (inst->pc == (phys_addr & ~3))
+        inst->pc = 0xFFFFFFFF;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BGEU_MASK) == INST_BGEU)
+    // Word part of a translated block?
+    uint32_t *map = m_block_map[phys_addr >> BLOCK_PAGE_SHIFT];
+    if (map && (map[(phys_addr >> 7) & 31] & (1 << ((phys_addr >> 2) & 31))))
+        invalidate_blocks(phys_addr >> BLOCK_PAGE_SHIFT);
+}
+//-----------------------------------------------------------------
+// decode: Decode opcode into operand fields and handler
+//-----------------------------------------------------------------
+void Riscv::decode(uint32_t phys_pc, uint32_t opcode, t_decoded_inst *inst)
+{
+    // Handlers, one per RISCV_INST_TABLE row
+#define RISCV_INST(inst, enc, mnemonic, format, handler) &Riscv::handler,
+    static const t_inst_exec handlers[] = 
     {
-        // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
-        DPRINTF(LOG_INST,("%08x: bgeu r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BGEU);
-        if ((unsigned)reg_rs1 >= (unsigned)reg_rs2)
-            pc += bimm;
-        else
-            pc += 4;
+        RISCV_INST_TABLE(RISCV_INST)
+    };
+#undef RISCV_INST
 
-        // No writeback
-        rd = 0;
+    // Extract registers
+    inst->rd        = (opcode & OPCODE_RD_MASK)  >> OPCODE_RD_SHIFT;
+    inst->rs1       = (opcode & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT;
+    inst->rs2       = (opcode & OPCODE_RS2_MASK) >> OPCODE_RS2_SHIFT;
+    inst->opcode    = opcode;
+    inst->pc        = phys_pc;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_LB_MASK) == INST_LB)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: lb r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LB);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 1, true))
-            pc += 4;
-        else
-            return;
-    }
-    else if ((opcode & INST_LH_MASK) == INST_LH)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: lh r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LH);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 2, true))
-            pc += 4;
-        else
-            return;
-    }
-    else if ((opcode & INST_LW_MASK) == INST_LW)
-    {
-        // ['rd', 'rs1', 'imm12']        
-        INST_STAT(ENUM_INST_LW);
-        DPRINTF(LOG_INST,("%08x: lw r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 4, true))
-            pc += 4;
-        else
-            return;
-    }
-    else if ((opcode & INST_LBU_MASK) == INST_LBU)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: lbu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LBU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 1, false))
-            pc += 4;
-        else
-            return;
-    }
-    else if ((opcode & INST_LHU_MASK) == INST_LHU)
-    {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: lhu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LHU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 2, false))
-            pc += 4;
-        else
-            return;
-    }
-    else if ((opcode & INST_LWU_MASK) == INST_LWU)
+    const t_inst_desc *desc = riscv_decode_lookup(opcode);
+    if (desc)
     {
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%08x: lwu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LWU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 4, false))
-            pc += 4;
-        else
-            return;
+        inst->inst = desc->inst;
+        inst->exec = handlers[desc->row];
+        inst->imm  = riscv_decode_imm(desc, opcode);
     }
-    else if ((opcode & INST_SB_MASK) == INST_SB)
+    else
     {
-        // ['imm12hi', 'rs1', 'rs2', 'imm12lo']
-        DPRINTF(LOG_INST,("%08x: sb %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SB);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 1))
-            pc += 4;
-        else
-            return ;
-
-        // No writeback
-        rd = 0;
+        inst->inst = ENUM_INST_MAX;
+        inst->exec = &Riscv::exec_illegal;
+        inst->imm  = 0;
     }
-    else if ((opcode & INST_SH_MASK) == INST_SH)
-    {
-        // ['imm12hi', 'rs1', 'rs2', 'imm12lo']
-        DPRINTF(LOG_INST,("%08x: sh %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SH);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 2))
-            pc += 4;
-        else
-            return ;
+}
+//-----------------------------------------------------------------
+// Instruction handlers
+//-----------------------------------------------------------------
+int Riscv::exec_andi(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_ANDI);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] & inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_ori(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_ORI);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] | inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_xori(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_XORI);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] ^ inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_addi(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_ADDI);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] + inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_slti(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_SLTI);
+    m_gpr[inst->rd] = (signed)m_gpr[inst->rs1] < (signed)inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sltiu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_SLTIU);
+    m_gpr[inst->rd] = (unsigned)m_gpr[inst->rs1] < (unsigned)inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_slli(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1']
+    INST_STAT(ENUM_INST_SLLI);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] << inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_srli(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'shamt']
+    INST_STAT(ENUM_INST_SRLI);
+    m_gpr[inst->rd] = (unsigned)m_gpr[inst->rs1] >> inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_srai(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'shamt']
+    INST_STAT(ENUM_INST_SRAI);
+    m_gpr[inst->rd] = (signed)m_gpr[inst->rs1] >> inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_lui(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'imm20']
+    INST_STAT(ENUM_INST_LUI);
+    m_gpr[inst->rd] = inst->imm;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_auipc(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'imm20']
+    INST_STAT(ENUM_INST_AUIPC);
+    m_gpr[inst->rd] = inst->imm + pc;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_add(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_ADD);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] + m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sub(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_SUB);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] - m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_slt(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_SLT);
+    m_gpr[inst->rd] = (signed)m_gpr[inst->rs1] < (signed)m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sltu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_SLTU);
+    m_gpr[inst->rd] = (unsigned)m_gpr[inst->rs1] < (unsigned)m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_xor(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_XOR);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] ^ m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_or(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_OR);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] | m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_and(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_AND);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] & m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sll(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_SLL);
+    m_gpr[inst->rd] = m_gpr[inst->rs1] << m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_srl(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_SRL);
+    m_gpr[inst->rd] = (unsigned)m_gpr[inst->rs1] >> m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sra(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_SRA);
+    m_gpr[inst->rd] = (signed)m_gpr[inst->rs1] >> m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_jal(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'jimm20']
+    INST_STAT(ENUM_INST_JAL);
+    m_gpr[inst->rd] = pc + 4;
+    m_pc = pc + inst->imm;
 
-        // No writeback
-        rd = 0;
-    }
-    else if ((opcode & INST_SW_MASK) == INST_SW)
-    {
-        // ['imm12hi', 'rs1', 'rs2', 'imm12lo']
-        DPRINTF(LOG_INST,("%08x: sw %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SW);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 4))
-            pc += 4;
-        else
-            return ;
+    if (m_profiler && PROFILE_LINK_REG(inst->rd))
+        m_profiler->call(m_hart_id, pc);
 
-        // No writeback
-        rd = 0;
-    }
-    else if ((opcode & INST_MUL_MASK) == INST_MUL)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: mul r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_MUL);
-        reg_rd = (signed)reg_rs1 * (signed)reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_MULH_MASK) == INST_MULH)
-    {
-        // ['rd', 'rs1', 'rs2']
-        long long res = ((long long) (int)reg_rs1) * ((long long)(int)reg_rs2);
-        INST_STAT(ENUM_INST_MULH);
-        DPRINTF(LOG_INST,("%08x: mulh r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if ((opcode & INST_MULHSU_MASK) == INST_MULHSU)
-    {
-        // ['rd', 'rs1', 'rs2']
-        long long res = ((long long) (int)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
-        INST_STAT(ENUM_INST_MULHSU);
-        DPRINTF(LOG_INST,("%08x: mulhsu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if ((opcode & INST_MULHU_MASK) == INST_MULHU)
-    {
-        // ['rd', 'rs1', 'rs2']
-        unsigned long long res = ((unsigned long long) (unsigned)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
-        INST_STAT(ENUM_INST_MULHU);
-        DPRINTF(LOG_INST,("%08x: mulhu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if ((opcode & INST_DIV_MASK) == INST_DIV)
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_jalr(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_JALR);
+    uint32_t target = (m_gpr[inst->rs1] + inst->imm) & ~1;
+    m_gpr[inst->rd] = pc + 4;
+    m_pc = target;
+
+    if (m_profiler)
     {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: div r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIV);
-        if ((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
-            reg_rd = reg_rs1;
-        else if (reg_rs2 != 0)
-            reg_rd = (signed)reg_rs1 / (signed)reg_rs2;
-        else
-            reg_rd = (unsigned)-1;
-        pc += 4;        
+        if (PROFILE_LINK_REG(inst->rd))
+            m_profiler->call(m_hart_id, pc);
+        else if (inst->rd == 0 && PROFILE_LINK_REG(inst->rs1))
+            m_profiler->ret(m_hart_id, target);
     }
-    else if ((opcode & INST_DIVU_MASK) == INST_DIVU)
+
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_beq(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
+    INST_STAT(ENUM_INST_BEQ);
+    if (m_gpr[inst->rs1] == m_gpr[inst->rs2])
+        m_pc = pc + inst->imm;
+    else
+        m_pc = pc + 4;
+
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_bne(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
+    INST_STAT(ENUM_INST_BNE);
+    if (m_gpr[inst->rs1] != m_gpr[inst->rs2])
+        m_pc = pc + inst->imm;
+    else
+        m_pc = pc + 4;
+
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_blt(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
+    INST_STAT(ENUM_INST_BLT);
+    if ((signed)m_gpr[inst->rs1] < (signed)m_gpr[inst->rs2])
+        m_pc = pc + inst->imm;
+    else
+        m_pc = pc + 4;
+
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_bge(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
+    INST_STAT(ENUM_INST_BGE);
+    if ((signed)m_gpr[inst->rs1] >= (signed)m_gpr[inst->rs2])
+        m_pc = pc + inst->imm;
+    else
+        m_pc = pc + 4;
+
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_bltu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
+    INST_STAT(ENUM_INST_BLTU);
+    if ((unsigned)m_gpr[inst->rs1] < (unsigned)m_gpr[inst->rs2])
+        m_pc = pc + inst->imm;
+    else
+        m_pc = pc + 4;
+
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_bgeu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['bimm12hi', 'rs1', 'rs2', 'bimm12lo']
+    INST_STAT(ENUM_INST_BGEU);
+    if ((unsigned)m_gpr[inst->rs1] >= (unsigned)m_gpr[inst->rs2])
+        m_pc = pc + inst->imm;
+    else
+        m_pc = pc + 4;
+
+    m_stats[STATS_BRANCHES]++;
+    return EXEC_OK;
+}
+int Riscv::exec_lb(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_LB);
+    uint32_t value;
+    if (!load(pc, m_gpr[inst->rs1] + inst->imm, &value, 1, true))
+        return EXEC_ABORT;
+
+    m_gpr[inst->rd] = value;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_lh(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_LH);
+    uint32_t value;
+    if (!load(pc, m_gpr[inst->rs1] + inst->imm, &value, 2, true))
+        return EXEC_ABORT;
+
+    m_gpr[inst->rd] = value;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_lw(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_LW);
+    uint32_t value;
+    if (!load(pc, m_gpr[inst->rs1] + inst->imm, &value, 4, true))
+        return EXEC_ABORT;
+
+    m_gpr[inst->rd] = value;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_lbu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_LBU);
+    uint32_t value;
+    if (!load(pc, m_gpr[inst->rs1] + inst->imm, &value, 1, false))
+        return EXEC_ABORT;
+
+    m_gpr[inst->rd] = value;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_lhu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_LHU);
+    uint32_t value;
+    if (!load(pc, m_gpr[inst->rs1] + inst->imm, &value, 2, false))
+        return EXEC_ABORT;
+
+    m_gpr[inst->rd] = value;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_lwu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'imm12']
+    INST_STAT(ENUM_INST_LWU);
+    uint32_t value;
+    if (!load(pc, m_gpr[inst->rs1] + inst->imm, &value, 4, false))
+        return EXEC_ABORT;
+
+    m_gpr[inst->rd] = value;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sb(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['imm12hi', 'rs1', 'rs2', 'imm12lo']
+    INST_STAT(ENUM_INST_SB);
+    if (!store(pc, m_gpr[inst->rs1] + inst->imm, m_gpr[inst->rs2], 1))
+        return EXEC_ABORT;
+
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sh(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['imm12hi', 'rs1', 'rs2', 'imm12lo']
+    INST_STAT(ENUM_INST_SH);
+    if (!store(pc, m_gpr[inst->rs1] + inst->imm, m_gpr[inst->rs2], 2))
+        return EXEC_ABORT;
+
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sw(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['imm12hi', 'rs1', 'rs2', 'imm12lo']
+    INST_STAT(ENUM_INST_SW);
+    if (!store(pc, m_gpr[inst->rs1] + inst->imm, m_gpr[inst->rs2], 4))
+        return EXEC_ABORT;
+
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_mul(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_MUL);
+    m_gpr[inst->rd] = (signed)m_gpr[inst->rs1] * (signed)m_gpr[inst->rs2];
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_mulh(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    long long res = ((long long) (int)m_gpr[inst->rs1]) * ((long long)(int)m_gpr[inst->rs2]);
+    INST_STAT(ENUM_INST_MULH);
+    m_gpr[inst->rd] = (int)(res >> 32);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_mulhsu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    long long res = ((long long) (int)m_gpr[inst->rs1]) * ((unsigned long long)(unsigned)m_gpr[inst->rs2]);
+    INST_STAT(ENUM_INST_MULHSU);
+    m_gpr[inst->rd] = (int)(res >> 32);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_mulhu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    unsigned long long res = ((unsigned long long) (unsigned)m_gpr[inst->rs1]) * ((unsigned long long)(unsigned)m_gpr[inst->rs2]);
+    INST_STAT(ENUM_INST_MULHU);
+    m_gpr[inst->rd] = (int)(res >> 32);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_div(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_DIV);
+    uint32_t reg_rs1 = m_gpr[inst->rs1];
+    uint32_t reg_rs2 = m_gpr[inst->rs2];
+    if ((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
+        m_gpr[inst->rd] = reg_rs1;
+    else if (reg_rs2 != 0)
+        m_gpr[inst->rd] = (signed)reg_rs1 / (signed)reg_rs2;
+    else
+        m_gpr[inst->rd] = (unsigned)-1;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_divu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_DIVU);
+    uint32_t reg_rs1 = m_gpr[inst->rs1];
+    uint32_t reg_rs2 = m_gpr[inst->rs2];
+    if (reg_rs2 != 0)
+        m_gpr[inst->rd] = (unsigned)reg_rs1 / (unsigned)reg_rs2;
+    else
+        m_gpr[inst->rd] = (unsigned)-1;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_rem(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_REM);
+    uint32_t reg_rs1 = m_gpr[inst->rs1];
+    uint32_t reg_rs2 = m_gpr[inst->rs2];
+    if((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
+        m_gpr[inst->rd] = 0;
+    else if (reg_rs2 != 0)
+        m_gpr[inst->rd] = (signed)reg_rs1 % (signed)reg_rs2;
+    else
+        m_gpr[inst->rd] = reg_rs1;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_remu(const t_decoded_inst *inst, uint32_t pc)
+{
+    // ['rd', 'rs1', 'rs2']
+    INST_STAT(ENUM_INST_REMU);
+    uint32_t reg_rs1 = m_gpr[inst->rs1];
+    uint32_t reg_rs2 = m_gpr[inst->rs2];
+    if (reg_rs2 != 0)
+        m_gpr[inst->rd] = (unsigned)reg_rs1 % (unsigned)reg_rs2;
+    else
+        m_gpr[inst->rd] = reg_rs1;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_ecall(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_ECALL);
+
+    exception(MCAUSE_ECALL_U + m_csr_mpriv, pc);
+    return EXEC_TRAP;
+}
+int Riscv::exec_ebreak(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_EBREAK);
+
+    exception(MCAUSE_BREAKPOINT, pc);
+    m_break = true;
+    return EXEC_TRAP;
+}
+int Riscv::exec_mret(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_MRET);
+
+    assert(m_csr_mpriv == PRIV_MACHINE);
+
+    uint32_t s        = m_csr_msr;
+    uint32_t prev_prv = SR_GET_MPP(m_csr_msr);
+
+    // Interrupt enable pop
+    s &= ~SR_MIE;
+    s |= (s & SR_MPIE) ? SR_MIE : 0;
+    s |= SR_MPIE;
+
+    // Set next MPP to user mode
+    s &= ~SR_MPP;
+    s |=  SR_MPP_U;
+
+    // Set privilege level to previous MPP
+    m_csr_mpriv   = prev_prv;
+    m_csr_msr     = s;
+    select_execute();
+
+    // Return to EPC
+    m_pc          = m_csr_mepc;
+    return EXEC_OK;
+}
+int Riscv::exec_sret(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_SRET);
+
+    assert(m_csr_mpriv == PRIV_SUPER);
+
+    uint32_t s        = m_csr_msr;
+    uint32_t prev_prv = (m_csr_msr & SR_SPP) ? PRIV_SUPER : PRIV_USER;
+
+    // Interrupt enable pop
+    s &= ~SR_SIE;
+    s |= (s & SR_SPIE) ? SR_SIE : 0;
+    s |= SR_SPIE;
+
+    // Set next SPP to user mode
+    s &= ~SR_SPP;
+
+    // Set privilege level to previous MPP
+    m_csr_mpriv   = prev_prv;
+    m_csr_msr     = s;
+    select_execute();
+
+    // Return to EPC
+    m_pc          = m_csr_sepc;
+    return EXEC_OK;
+}
+int Riscv::exec_fence(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_FENCE);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_fence_i(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_FENCE);
+
+    // Instruction stream may have been modified
+    flush_decode_cache();
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sfence(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_FENCE);
+
+#ifdef CONFIG_MMU
+    // rs1 = x0: all addresses, rs2 = x0: all address spaces
+    tlb_flush(inst->rs1 == 0, m_gpr[inst->rs1], inst->rs2 == 0, m_gpr[inst->rs2] & SATP_ASID_MASK);
+#endif
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_csrrw(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_CSRRW);
+    m_gpr[inst->rd] = access_csr(inst->imm, m_gpr[inst->rs1], true, true);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_csrrs(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_CSRRS);
+    m_gpr[inst->rd] = access_csr(inst->imm, m_gpr[inst->rs1], true, false);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_csrrc(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_CSRRC);
+    m_gpr[inst->rd] = access_csr(inst->imm, m_gpr[inst->rs1], false, true);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_csrrwi(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_CSRRWI);
+    m_gpr[inst->rd] = access_csr(inst->imm, inst->rs1, true, true);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_csrrsi(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_CSRRSI);
+    m_gpr[inst->rd] = access_csr(inst->imm, inst->rs1, true, false);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_csrrci(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_CSRRCI);
+    m_gpr[inst->rd] = access_csr(inst->imm, inst->rs1, false, true);
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_wfi(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_WFI);
+    m_pc = pc + 4;
+
+    if (m_idle_skip)
+        idle_skip(true);
+    return EXEC_OK;
+}
+int Riscv::exec_lr_w(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_LR_W);
+    uint32_t physical;
+    uint32_t value;
+
+    if (!amo_address(pc, m_gpr[inst->rs1], &physical, 0))
+        return EXEC_ABORT;
+
+    m_stats[STATS_LOADS]++;
+
+    if (!mem_load(physical, 4, false, &value))
     {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: divu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIVU);
-        if (reg_rs2 != 0)
-            reg_rd = (unsigned)reg_rs1 / (unsigned)reg_rs2;
-        else
-            reg_rd = (unsigned)-1;
-        pc += 4;        
+        error(false, "%08x: LR, bad memory access 0x%x\n", pc, m_gpr[inst->rs1]);
+        return EXEC_ABORT;
     }
-    else if ((opcode & INST_REM_MASK) == INST_REM)
+
+    m_resv_valid    = true;
+    m_resv_addr     = physical;
+    m_resv_value    = value;
+    m_gpr[inst->rd] = value;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_sc_w(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(ENUM_INST_SC_W);
+    uint32_t physical;
+    uint32_t old;
+
+    if (!amo_address(pc, m_gpr[inst->rs1], &physical, 1))
+        return EXEC_ABORT;
+
+    // Succeeds only if nobody changed the word since the LR
+    bool success = false;
+    if (m_resv_valid && m_resv_addr == physical)
     {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: rem r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REM);
-
-        if((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
-            reg_rd = 0;
-        else if (reg_rs2 != 0)
-            reg_rd = (signed)reg_rs1 % (signed)reg_rs2;
-        else
-            reg_rd = reg_rs1;
-        pc += 4;        
+        m_stats[STATS_STORES]++;
+
+        if (!mem_amo(physical, ENUM_INST_SC_W, m_gpr[inst->rs2], &old))
+        {
+            error(false, "%08x: SC, bad memory access 0x%x\n", pc, m_gpr[inst->rs1]);
+            return EXEC_ABORT;
+        }
+
+        success = (old == m_resv_value);
+        if (success)
+        {
+            invalidate_code(physical);
+            invalidate_code(physical + 3);
+        }
     }
-    else if ((opcode & INST_REMU_MASK) == INST_REMU)
+
+    m_resv_valid    = false;
+    m_gpr[inst->rd] = success ? 0 : 1;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_amo_w(const t_decoded_inst *inst, uint32_t pc)
+{
+    INST_STAT(inst->inst);
+    uint32_t physical;
+    uint32_t old;
+
+    if (!amo_address(pc, m_gpr[inst->rs1], &physical, 1))
+        return EXEC_ABORT;
+
+    m_stats[STATS_LOADS]++;
+    m_stats[STATS_STORES]++;
+
+    if (!mem_amo(physical, inst->inst, m_gpr[inst->rs2], &old))
     {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%08x: remu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REMU);
-        if (reg_rs2 != 0)
-            reg_rd = (unsigned)reg_rs1 % (unsigned)reg_rs2;
-        else
-            reg_rd = reg_rs1;
-        pc += 4;        
+        error(false, "%08x: AMO, bad memory access 0x%x\n", pc, m_gpr[inst->rs1]);
+        return EXEC_ABORT;
     }
-    else if ((opcode & INST_ECALL_MASK) == INST_ECALL)
-    {
-        DPRINTF(LOG_INST,("%08x: ecall\n", pc));
-        INST_STAT(ENUM_INST_ECALL);
 
-        exception(MCAUSE_ECALL_U + m_csr_mpriv, pc);
-        take_exception   = true;
-    }
-    else if ((opcode & INST_EBREAK_MASK) == INST_EBREAK)
-    {
-        DPRINTF(LOG_INST,("%08x: ebreak\n", pc));
-        INST_STAT(ENUM_INST_EBREAK);
+    invalidate_code(physical);
+    invalidate_code(physical + 3);
 
-        exception(MCAUSE_BREAKPOINT, pc);
-        take_exception   = true;
-        m_break          = true;
-    }
-    else if ((opcode & INST_MRET_MASK) == INST_MRET)
-    {
-        DPRINTF(LOG_INST,("%08x: mret\n", pc));
-        INST_STAT(ENUM_INST_MRET);
+    m_gpr[inst->rd] = old;
+    m_pc = pc + 4;
+    return EXEC_OK;
+}
+int Riscv::exec_illegal(const t_decoded_inst *inst, uint32_t pc)
+{
+    if (inst->opcode == 0)
+        error(false, "Bad instruction @ %x\n", pc);
+    else
+        error(false, "Bad instruction @ %x (opcode %x)\n", pc, inst->opcode);
 
-        assert(m_csr_mpriv == PRIV_MACHINE);
+    exception(MCAUSE_ILLEGAL_INSTRUCTION, pc);
+    m_fault = true;
+    return EXEC_TRAP;
+}
+//-----------------------------------------------------------------
+// pending_interrupts: Interrupts which are pending and enabled
+//-----------------------------------------------------------------
+uint32_t Riscv::pending_interrupts(void)
+{
+    uint32_t pending_interrupts = (m_csr_mip & m_csr_mie);
 
-        uint32_t s        = m_csr_msr;
-        uint32_t prev_prv = SR_GET_MPP(m_csr_msr);
+    if (!pending_interrupts)
+        return 0;
 
-        // Interrupt enable pop
-        s &= ~SR_MIE;
-        s |= (s & SR_MPIE) ? SR_MIE : 0;
-        s |= SR_MPIE;
+    uint32_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
+    uint32_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
+    uint32_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
+    uint32_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
 
-        // Set next MPP to user mode
-        s &= ~SR_MPP;
-        s |=  SR_MPP_U;
+    return m_interrupts ? m_interrupts : s_interrupts;
+}
+//-----------------------------------------------------------------
+// idle_skip: Hart is waiting for an interrupt (wfi or branch to self),
+// advance the timer to one cycle before the compare point (or the next
+// device event, which may raise the external interrupt) so the next
+// timer tick handles it. Other external interrupts only arrive from
+// outside the run loop.
+//-----------------------------------------------------------------
+void Riscv::idle_skip(bool wfi)
+{
+    uint32_t timer_ip = (m_csr_mideleg & SR_IP_STIP) ? SR_IP_STIP : SR_IP_MTIP;
+    uint64_t target   = DEVICE_NO_EVENT;
 
-        // Set privilege level to previous MPP
-        m_csr_mpriv   = prev_prv;
-        m_csr_msr     = s;
+    // Already pending
+    if (m_csr_mip & m_csr_mie)
+        return ;
 
-        // Return to EPC
-        pc          = m_csr_mepc;
-    }
-    else if ((opcode & INST_SRET_MASK) == INST_SRET)
-    {
-        DPRINTF(LOG_INST,("%08x: sret\n", pc));
-        INST_STAT(ENUM_INST_SRET);
+    if (m_csr_mtimecmp > m_csr_mtime + 1 && idle_wakes(timer_ip, wfi))
+        target = m_csr_mtimecmp - 1;
 
-        assert(m_csr_mpriv == PRIV_SUPER);
+    if (m_device_next > m_csr_mtime + 1 && (m_device_next - 1) < target && idle_wakes(SR_IP_MEIP, wfi))
+        target = m_device_next - 1;
 
-        uint32_t s        = m_csr_msr;
-        uint32_t prev_prv = (m_csr_msr & SR_SPP) ? PRIV_SUPER : PRIV_USER;
+    if (target == DEVICE_NO_EVENT)
+        return ;
 
-        // Interrupt enable pop
-        s &= ~SR_SIE;
-        s |= (s & SR_SPIE) ? SR_SIE : 0;
-        s |= SR_SPIE;
+    uint64_t skipped = target - m_csr_mtime;
+    DPRINTF(LOG_INST,("Idle: skipping %llu cycles\n", (unsigned long long)skipped));
 
-        // Set next SPP to user mode
-        s &= ~SR_SPP;
+    m_idle_cycles += skipped;
+    m_csr_mtime    = target;
+}
+//-----------------------------------------------------------------
+// idle_wakes: Would interrupt 'ip' end the idle loop. wfi wakes on any
+// enabled interrupt, a branch to self only leaves when the interrupt
+// is actually taken.
+//-----------------------------------------------------------------
+bool Riscv::idle_wakes(uint32_t ip, bool wfi)
+{
+    uint32_t mip = m_csr_mip;
+    m_csr_mip |= ip;
+    bool wake = wfi ? ((m_csr_mip & m_csr_mie) != 0) : (pending_interrupts() != 0);
+    m_csr_mip = mip;
 
-        // Set privilege level to previous MPP
-        m_csr_mpriv   = prev_prv;
-        m_csr_msr     = s;
+    return wake;
+}
+//-----------------------------------------------------------------
+// set_idle_skip: Enable fast-forward of idle loops
+//-----------------------------------------------------------------
+void Riscv::set_idle_skip(bool enable)
+{
+    m_idle_skip = enable;
 
-        // Return to EPC
-        pc          = m_csr_sepc;
-    }
-    else if ( ((opcode & INST_SFENCE_MASK) == INST_SFENCE) ||
-              ((opcode & INST_FENCE_MASK) == INST_FENCE) ||
-              ((opcode & INST_IFENCE_MASK) == INST_IFENCE))
-    {
-        DPRINTF(LOG_INST,("%08x: fence\n", pc));
-        INST_STAT(ENUM_INST_FENCE);
-        pc += 4;
-    }
-    else if ((opcode & INST_CSRRW_MASK) == INST_CSRRW)
-    {
-        DPRINTF(LOG_INST,("%08x: csrw r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRW);
-        reg_rd = access_csr(imm12, reg_rs1, true, true);
-        pc += 4;
-    }    
-    else if ((opcode & INST_CSRRS_MASK) == INST_CSRRS)
-    {
-        DPRINTF(LOG_INST,("%08x: csrs r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRS);
-        reg_rd = access_csr(imm12, reg_rs1, true, false);
-        pc += 4;
-    }
-    else if ((opcode & INST_CSRRC_MASK) == INST_CSRRC)
-    {
-        DPRINTF(LOG_INST,("%08x: csrc r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRC);
-        reg_rd = access_csr(imm12, reg_rs1, false, true);
-        pc += 4;
+    // Branch to self blocks are translated differently
+    flush_blocks();
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_idle_skip(enable);
+}
+//-----------------------------------------------------------------
+// trace_writes_rd: Instruction class writes rd
+//-----------------------------------------------------------------
+static bool trace_writes_rd(uint32_t opcode)
+{
+    switch (opcode & 0x7F)
+    {
+        case 0x03: // LOAD
+        case 0x13: // OP-IMM
+        case 0x17: // AUIPC
+        case 0x2F: // AMO
+        case 0x33: // OP
+        case 0x37: // LUI
+        case 0x67: // JALR
+        case 0x6F: // JAL
+            return true;
+        case 0x73: // SYSTEM, CSR accesses only
+            return ((opcode >> 12) & 7) != 0;
+        default:
+            return false;
     }
-    else if ((opcode & INST_CSRRWI_MASK) == INST_CSRRWI)
+}
+//-----------------------------------------------------------------
+// trace_retire: Complete the record, append to the binary trace and
+// feed the timing model / cache simulator / lockstep checker
+//-----------------------------------------------------------------
+void Riscv::trace_retire(uint32_t rd, int result)
+{
+    if (result != EXEC_OK)
+        m_btrace_rec.flags |= TRACE_FLAG_TRAP;
+    else if (rd != 0 && trace_writes_rd(m_btrace_rec.opcode))
     {
-        DPRINTF(LOG_INST,("%08x: csrwi r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRWI);
-        reg_rd = access_csr(imm12, rs1, true, true);
-        pc += 4;
+        m_btrace_rec.flags   |= TRACE_FLAG_WB;
+        m_btrace_rec.rd       = rd;
+        m_btrace_rec.rd_value = m_gpr[rd];
     }
-    else if ((opcode & INST_CSRRSI_MASK) == INST_CSRRSI)
+
+    m_btrace_rec.hart = m_hart_id;
+
+    if (m_btrace)
+        m_btrace->record(m_btrace_rec);
+    if (m_timing)
+        m_timing->retire(m_btrace_rec, m_btrace_phys, m_pc);
+    if (m_cache_sim)
+        m_cache_sim->retire(m_btrace_rec, m_btrace_phys);
+    if (m_lockstep)
+        m_lockstep->reference(m_btrace_rec);
+}
+//-----------------------------------------------------------------
+// set_binary_trace: Record retired instructions to 'trace' (all harts)
+//-----------------------------------------------------------------
+bool Riscv::set_binary_trace(BinaryTrace *trace)
+{
+    m_btrace = trace;
+    update_events();
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_binary_trace(trace);
+
+    // Harts on their own host threads append concurrently
+    if (trace && m_harts.size() > 1 && m_smp_threads)
+        trace->set_concurrent(true);
+
+    return true;
+}
+//-----------------------------------------------------------------
+// set_timing: Feed retired instructions to a timing model (NULL to
+// disable). Models a single core, so only without extra harts.
+//-----------------------------------------------------------------
+bool Riscv::set_timing(TimingModel *timing)
+{
+    if (timing && m_harts.size() > 1)
+        return false;
+
+    m_timing = timing;
+    update_events();
+    return true;
+}
+//-----------------------------------------------------------------
+// set_cache_sim: Feed fetches and data accesses to a cache simulator
+// (NULL to disable). Private L1 caches of a single core.
+//-----------------------------------------------------------------
+bool Riscv::set_cache_sim(CacheSim *sim)
+{
+    if (sim && m_harts.size() > 1)
+        return false;
+
+    m_cache_sim = sim;
+    update_events();
+    return true;
+}
+//-----------------------------------------------------------------
+// set_lockstep: Report each executed instruction to a lockstep checker
+// (NULL to disable). The checker steps one hart.
+//-----------------------------------------------------------------
+bool Riscv::set_lockstep(LockstepChecker *checker)
+{
+    if (checker && m_harts.size() > 1)
+        return false;
+
+    m_lockstep = checker;
+    update_events();
+    return true;
+}
+//-----------------------------------------------------------------
+// set_profiler: Sample PCs into 'profiler' (all harts)
+//-----------------------------------------------------------------
+bool Riscv::set_profiler(Profiler *profiler)
+{
+    m_profiler     = profiler;
+    m_profile_left = profiler ? profiler->get_interval() : 0;
+
+    if (profiler)
+        profiler->set_harts((int)m_harts.size());
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_profiler(profiler);
+
+    // Blocks translated without call / return exits
+    flush_blocks();
+    return true;
+}
+//-----------------------------------------------------------------
+// set_coverage: Record executed PCs and branch outcomes (all harts)
+//-----------------------------------------------------------------
+bool Riscv::set_coverage(Coverage *coverage)
+{
+    m_coverage = coverage;
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_coverage(coverage);
+
+    // Native code writes branch outcomes into 'coverage' directly
+    flush_blocks();
+    return true;
+}
+//-----------------------------------------------------------------
+// execute: Instruction execution stage
+//-----------------------------------------------------------------
+template <int VARIANT>
+void Riscv::execute(void)
+{
+    uint32_t phy_pc = m_pc;
+
+#ifdef CONFIG_MMU
+    // Translate PC to physical address
+    if ((VARIANT & EXEC_VARIANT_MMU) && !mmu_i_translate(m_pc, &phy_pc))
+        return ;
+#endif
+
+    // Lookup decoded instruction, decode opcode at current PC on a miss
+    t_decoded_inst *inst = &m_decode_cache[(phy_pc >> 2) & (DECODE_CACHE_ENTRIES-1)];
+    if (inst->pc != phy_pc)
+        decode(phy_pc, get_opcode(phy_pc), inst);
+
+    m_pc_x = m_pc;
+
+    uint32_t pc = m_pc;
+
+    if (VARIANT & EXEC_VARIANT_TRACE)
     {
-        DPRINTF(LOG_INST,("%08x: csrsi r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRSI);
-        reg_rd = access_csr(imm12, rs1, true, false);
-        pc += 4;
+        DPRINTF(LOG_OPCODES,( "%08x: %08x\n", pc, inst->opcode));
+        DPRINTF(LOG_OPCODES,( "        rd(%d) r%d = %d, r%d = %d\n", inst->rd, inst->rs1, m_gpr[inst->rs1], inst->rs2, m_gpr[inst->rs2]));
+
+        if (m_record)
+        {
+            // Other fields are only valid when flagged
+            m_btrace_rec.flags  = 0;
+            m_btrace_rec.pc     = pc;
+            m_btrace_rec.opcode = inst->opcode;
+        }
     }
-    else if ((opcode & INST_CSRRCI_MASK) == INST_CSRRCI)
+
+    int result;
+    if (m_has_hle && m_hle_entries.test(pc))
+        result = hle_execute(inst, pc);
+    else
     {
-        DPRINTF(LOG_INST,("%08x: csrci r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRCI);
-        reg_rd = access_csr(imm12, rs1, false, true);
-        pc += 4;
+        // Handlers do not trace, disassemble here (only this variant pays)
+        if ((VARIANT & EXEC_VARIANT_TRACE) && TRACE_ENABLED(LOG_INST) && inst->inst != ENUM_INST_MAX)
+            riscv_inst_print(pc, inst->opcode);
+
+        result = (this->*(inst->exec))(inst, pc);
     }
-    else if ((opcode & INST_WFI_MASK) == INST_WFI)
+
+    // Writes to r0 are discarded
+    m_gpr[0] = 0;
+
+    // Faulting instructions count as reached (as in blocks)
+    if (m_coverage)
     {
-        DPRINTF(LOG_INST,("%08x: wfi\n", pc));
-        INST_STAT(ENUM_INST_WFI);
-        pc += 4;
+        m_coverage->executed(pc);
+        if (result == EXEC_OK && inst->inst >= ENUM_INST_BEQ && inst->inst <= ENUM_INST_BGEU)
+            m_coverage->branch(pc, m_pc != pc + 4);
     }
-    else
+
+    if (result == EXEC_ABORT)
     {
-        error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-        exception(MCAUSE_ILLEGAL_INSTRUCTION, pc);
-        m_fault        = true;
-        take_exception = true;
+        if ((VARIANT & EXEC_VARIANT_TRACE) && m_record)
+            trace_retire(inst->rd, result);
+        return ;
     }
 
-    if (rd != 0)
-        m_gpr[rd] = reg_rd;
+    // Branch to self, can only be left by an interrupt
+    if (m_idle_skip && result == EXEC_OK && m_pc == pc)
+        idle_skip(false);
 
     // Pending interrupt
-    if (!take_exception && (m_csr_mip & m_csr_mie))
+    uint32_t interrupts = (result == EXEC_OK) ? pending_interrupts() : 0;
+    if (interrupts)
     {
-        uint32_t pending_interrupts = (m_csr_mip & m_csr_mie);
-        uint32_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
-        uint32_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
-        uint32_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
-        uint32_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
-        uint32_t interrupts         = m_interrupts ? m_interrupts : s_interrupts;
-
-        // Interrupt pending and mask enabled
-        if (interrupts)
-        {
-            //printf("Take Interrupt...: %08x\n", interrupts);
-            int i;
+        //printf("Take Interrupt...: %08x\n", interrupts);
+        int i;
 
-            for (i=IRQ_MIN;i<IRQ_MAX;i++)
+        for (i=IRQ_MIN;i<IRQ_MAX;i++)
+        {
+            if (interrupts & (1 << i))
             {
-                if (interrupts & (1 << i))
-                {
-                    // Only service one interrupt per cycle
-                    DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
-                    exception(MCAUSE_INTERRUPT + i, pc);
-                    take_exception = true;
-                    break;
-                }
+                // Only service one interrupt per cycle
+                DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
+                exception(MCAUSE_INTERRUPT + i, m_pc);
+                break;
             }
         }
+
+        if ((VARIANT & EXEC_VARIANT_TRACE) && m_record)
+            m_btrace_rec.flags |= TRACE_FLAG_IRQ;
     }
 
-    // Stats interface
-    if (m_stats_if)
-        m_stats_if->execute(m_pc, opcode);
+    if ((VARIANT & EXEC_VARIANT_TRACE) && m_record)
+        trace_retire(inst->rd, result);
 
-    if (!take_exception)
-        m_pc = pc;
+    // Stats interface
+    if (VARIANT & EXEC_VARIANT_STATS)
+        m_stats_if->execute(pc, inst->opcode);
 }
 //-----------------------------------------------------------------
-// step: Step through one instruction
+// step_variant: Step through one instruction (specialised)
 //-----------------------------------------------------------------
-void Riscv::step(void)
+template <int VARIANT>
+void Riscv::step_variant(void)
 {
     m_stats[STATS_INSTRUCTIONS]++;
 
     // Execute instruction at current PC
-    execute();
+    execute<VARIANT>();
 
     // Increment timer counter
     m_csr_mtime++;
 
     // Timer should generate a interrupt?
-    // Limited internal timer, truncate to 32-bits
-    m_csr_mtime &= 0xFFFFFFFF;
     if (m_csr_mtime == m_csr_mtimecmp)
         m_csr_mip |= (m_csr_mideleg & SR_IP_STIP) ? SR_IP_STIP : SR_IP_MTIP;
 
+    // Device event due?
+    if (m_csr_mtime >= m_device_next)
+        device_update();
+
     // Dump state
-    if (TRACE_ENABLED(LOG_REGISTERS))
+    if ((VARIANT & EXEC_VARIANT_TRACE) && TRACE_ENABLED(LOG_REGISTERS))
     {
         // Register trace
         int i;
@@ -1592,6 +2800,57 @@ void Riscv::step(void)
     // Breakpoint hit?
     if (m_has_breakpoints && check_breakpoint(m_pc_x))
         m_break = true;
+
+    // Interpreted instructions (CSR, xRET, WFI) may unmask interrupts
+    m_events |= RUN_EVENT_IRQ;
+}
+
+const Riscv::t_step_variant Riscv::s_step_variants[EXEC_VARIANT_MAX] =
+{
+    &Riscv::step_variant<0>,
+    &Riscv::step_variant<EXEC_VARIANT_TRACE>,
+    &Riscv::step_variant<EXEC_VARIANT_STATS>,
+    &Riscv::step_variant<EXEC_VARIANT_STATS | EXEC_VARIANT_TRACE>,
+    &Riscv::step_variant<EXEC_VARIANT_MMU>,
+    &Riscv::step_variant<EXEC_VARIANT_MMU | EXEC_VARIANT_TRACE>,
+    &Riscv::step_variant<EXEC_VARIANT_MMU | EXEC_VARIANT_STATS>,
+    &Riscv::step_variant<EXEC_VARIANT_MMU | EXEC_VARIANT_STATS | EXEC_VARIANT_TRACE>
+};
+//-----------------------------------------------------------------
+// step: Step through one instruction
+//-----------------------------------------------------------------
+void Riscv::step(void)
+{
+    (this->*m_step)();
+}
+//-----------------------------------------------------------------
+// select_execute: Pick the step variant for the current trace, stats
+// and translation state. Must be called when any of them change.
+//-----------------------------------------------------------------
+void Riscv::select_execute(void)
+{
+    int variant = 0;
+
+    if (m_trace || m_record)
+        variant |= EXEC_VARIANT_TRACE;
+    if (m_stats_if)
+        variant |= EXEC_VARIANT_STATS;
+#ifdef CONFIG_MMU
+    // Machine mode fetches are never translated
+    if (m_csr_mpriv <= PRIV_SUPER)
+        variant |= EXEC_VARIANT_MMU;
+#endif
+
+    // First step allocates the caches
+    m_step = m_decode_cache ? s_step_variants[variant] : &Riscv::step_first;
+}
+//-----------------------------------------------------------------
+// step_first: step() before the caches exist
+//-----------------------------------------------------------------
+void Riscv::step_first(void)
+{
+    create_caches();
+    step();
 }
 //-----------------------------------------------------------------
 // set_interrupt: Register pending interrupt
@@ -1599,7 +2858,9 @@ void Riscv::step(void)
 void Riscv::set_interrupt(int irq)
 {
     assert(irq == 0);
+    m_ext_irq  = true;
     m_csr_mip |= SR_IP_MEIP;
+    m_events  |= RUN_EVENT_IRQ;
 }
 //-----------------------------------------------------------------
 // stats_reset: Reset runtime stats
@@ -1609,6 +2870,8 @@ void Riscv::stats_reset(void)
     // Clear stats
     for (int i=STATS_MIN;i<STATS_MAX;i++)
         m_stats[i] = 0;
+
+    m_idle_cycles = 0;
 }
 //-----------------------------------------------------------------
 // stats_dump: Show execution stats
@@ -1631,6 +2894,28 @@ void Riscv::stats_dump(void)
             printf( "- Stores %d (%d%%)\n", m_stats[STATS_STORES], (m_stats[STATS_STORES] * 100) / m_stats[STATS_INSTRUCTIONS]);
             printf( "- Branches Operations %d (%d%%)\n", m_stats[STATS_BRANCHES], (m_stats[STATS_BRANCHES] * 100)  / m_stats[STATS_INSTRUCTIONS]);
         }
+#ifdef CONFIG_MMU
+        if (m_stats[STATS_ITLB_HITS] + m_stats[STATS_ITLB_MISSES] + m_stats[STATS_DTLB_HITS] + m_stats[STATS_DTLB_MISSES])
+        {
+            printf( "- ITLB Hits %d Misses %d\n", m_stats[STATS_ITLB_HITS], m_stats[STATS_ITLB_MISSES]);
+            printf( "- DTLB Hits %d Misses %d\n", m_stats[STATS_DTLB_HITS], m_stats[STATS_DTLB_MISSES]);
+            printf( "- TLB Flushes %d\n", m_stats[STATS_TLB_FLUSHES]);
+        }
+#endif
+        if (m_idle_cycles)
+            printf( "- Idle Cycles Skipped %llu\n", (unsigned long long)m_idle_cycles);
+        if (m_stats[STATS_HLE_CALLS])
+            printf( "- HLE Calls %d\n", m_stats[STATS_HLE_CALLS]);
+        for (size_t i=1;i<m_harts.size();i++)
+            printf( "- Hart %d Instructions %d\n", (int)i, m_harts[i]->m_stats[STATS_INSTRUCTIONS]);
+
+        // Sparse memories: host pages actually used
+        for (int j=0;j<m_mem_regions && m_mem_owner;j++)
+        {
+            uint32_t pages, resident, touched;
+            if (m_mem[j]->get_page_counts(&pages, &resident, &touched))
+                printf( "- Memory 0x%08x Pages %u Resident %u Touched %u\n", m_mem_base[j], pages, resident, touched);
+        }
     }
 
     stats_reset();
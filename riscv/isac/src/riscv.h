@@ -43,9 +43,20 @@
 
 #include <stdint.h>
 #include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
 #include "riscv_isa.h"
 #include "cosim_api.h"
 #include "memory.h"
+#include "riscv_trace.h"
+#include "riscv_profile.h"
+#include "riscv_coverage.h"
+#include "riscv_timing.h"
+#include "riscv_cache.h"
+#include "cosim_lockstep.h"
+#include "riscv_device.h"
+#include "riscv_bitmap.h"
 
 //--------------------------------------------------------------------
 // Defines:
@@ -58,6 +69,60 @@
 
 #define MAX_MEM_REGIONS     16
 
+// Physical memory map (page granular)
+#define MEM_PAGE_SHIFT          12
+#define MEM_PAGE_SIZE           (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGES               (1 << (32 - MEM_PAGE_SHIFT))
+#define MEM_PAGE_UNMAPPED       0       // No region
+#define MEM_PAGE_SCAN           0xFF    // Shared by regions, search m_mem[]
+
+// Decoded instruction cache (direct mapped on physical PC)
+#define DECODE_CACHE_ENTRIES    (1 << 14)
+
+// Threaded engine block cache (direct mapped on physical PC)
+#define BLOCK_CACHE_ENTRIES     (1 << 13)
+#define BLOCK_MAX_INSTS         32
+#define BLOCK_PAGE_SHIFT        12
+#define BLOCK_PAGES             (1 << (32 - BLOCK_PAGE_SHIFT))
+
+// Threaded engine internal ops (follow ENUM_INST_XXX)
+#define THREAD_OP_END           (ENUM_INST_MAX + 0)
+#define THREAD_OP_NOP           (ENUM_INST_MAX + 1)
+#define THREAD_OP_MAX           (ENUM_INST_MAX + 2)
+
+// run()/step_block() slow path triggers (m_events)
+#define RUN_EVENT_IRQ           (1 << 0)    // Interrupt state may have changed
+#define RUN_EVENT_DEBUG         (1 << 1)    // Text trace or stats active
+#define RUN_EVENT_WATCH         (1 << 2)    // run() stop / trace PC armed
+#define RUN_EVENT_HALT          (1 << 3)    // Error or exit, run() returns
+#define RUN_EVENT_DEVICE        (1 << 4)    // Block left at a device / watched access, step() it
+
+// Interpreter step variants (EXEC_VARIANT_XXX flags index the table)
+#define EXEC_VARIANT_TRACE      (1 << 0)    // Trace output enabled
+#define EXEC_VARIANT_STATS      (1 << 1)    // Stats interface attached
+#define EXEC_VARIANT_MMU        (1 << 2)    // Fetches translated (S/U mode)
+#define EXEC_VARIANT_MAX        (1 << 3)
+
+// Software TLBs (direct mapped on VPN, one each for fetch and data)
+#define TLB_ENTRIES             256
+
+// SMP: harts sharing memory, CLINT (msip / mtimecmp per hart)
+#define MAX_HARTS               64
+#define SMP_QUANTUM_DEFAULT     1000
+#define CLINT_BASE              0x02000000
+#define CLINT_SIZE              0x10000
+#define CLINT_MSIP              0x0000
+#define CLINT_MTIMECMP          0x4000
+#define CLINT_MTIME             0xBFF8
+
+// JIT: block executions before native translation, code buffer size
+#define JIT_THRESHOLD           64
+#define JIT_CODE_SIZE           (32 * 1024 * 1024)
+
+// High level emulation: instructions charged per call and per word
+#define HLE_CALL_COST_DEFAULT   10
+#define HLE_WORD_COST_DEFAULT   2
+
 //--------------------------------------------------------------------
 // Enums:
 //--------------------------------------------------------------------
@@ -68,9 +133,31 @@ enum eStats
     STATS_LOADS,
     STATS_STORES,
     STATS_BRANCHES,
+    STATS_ITLB_HITS,
+    STATS_ITLB_MISSES,
+    STATS_DTLB_HITS,
+    STATS_DTLB_MISSES,
+    STATS_TLB_FLUSHES,
+    STATS_HLE_CALLS,
     STATS_MAX
 };
 
+enum eHleRoutine
+{
+    HLE_MEMCPY,
+    HLE_MEMSET,
+    HLE_STRLEN,
+    HLE_MEMCMP,
+    HLE_MAX
+};
+
+enum eEngine
+{
+    ENGINE_INTERPRETER,     // Decode cache + per instruction dispatch
+    ENGINE_THREADED,        // Basic blocks of direct threaded handlers
+    ENGINE_JIT              // Threaded, hot blocks translated to host code
+};
+
 //--------------------------------------------------------------------
 // Abstract interface for stats
 //--------------------------------------------------------------------
@@ -92,6 +179,72 @@ public:
     virtual int getchar(void) = 0;
 };
 
+//--------------------------------------------------------------------
+// Decoded instruction: operand fields and handler for one opcode
+//--------------------------------------------------------------------
+class Riscv;
+struct s_decoded_inst;
+struct s_smp_run;
+
+typedef int (Riscv::*t_inst_exec)(const struct s_decoded_inst *inst, uint32_t pc);
+
+// Handler return codes
+enum eExecResult
+{
+    EXEC_OK,        // Completed, m_pc is the next PC
+    EXEC_TRAP,      // Exception taken, m_pc is the trap vector
+    EXEC_ABORT      // Memory access faulted, instruction did not complete
+};
+
+typedef struct s_decoded_inst
+{
+    uint32_t            pc;         // Physical address tag (~0 = invalid)
+    uint32_t            opcode;
+    t_inst_exec         exec;
+    int32_t             imm;
+    uint8_t             rd;
+    uint8_t             rs1;
+    uint8_t             rs2;
+    uint8_t             inst;       // ENUM_INST_XXX
+} t_decoded_inst;
+
+//--------------------------------------------------------------------
+// TLB entry: leaf PTE (permissions, A/D) for a 4KB virtual page
+//--------------------------------------------------------------------
+typedef struct s_tlb_entry
+{
+    uint32_t            vpn;
+    uint32_t            asid;
+    uint32_t            pte;        // 4KB leaf PTE from mmu_walk()
+    bool                valid;
+} t_tlb_entry;
+
+//--------------------------------------------------------------------
+// Threaded block: straight line run of handlers ending in a branch
+//--------------------------------------------------------------------
+typedef struct s_thread_op
+{
+    const void         *handler;    // Label address in exec_block()
+    int32_t             imm;
+    uint8_t             rd;
+    uint8_t             rs1;
+    uint8_t             rs2;
+    uint8_t             inst;       // ENUM_INST_XXX / THREAD_OP_XXX
+} t_thread_op;
+
+typedef struct s_block
+{
+    uint32_t            pc;         // Physical address tag (~0 = invalid)
+    int                 length;     // Instructions in block (0 = interpret)
+    uint32_t            vpc;        // Virtual PC native code was built for
+    uint32_t            count;      // Executions (JIT hot block detection)
+    void               *native;     // Host code (JIT) or NULL
+    void               *chain;      // Host code other blocks may chain to (NULL until coverage recorded)
+    t_thread_op         ops[BLOCK_MAX_INSTS + 1];
+} t_block;
+
+typedef void (*t_jit_enter)(Riscv *cpu, const void *code, uint32_t *gpr);
+
 //--------------------------------------------------------------------
 // Riscv: RV32IM model
 //--------------------------------------------------------------------
@@ -102,10 +255,16 @@ public:
     virtual             ~Riscv();
 
     bool                create_memory(uint32_t addr, uint32_t size, uint8_t *mem = NULL);
+    bool                set_sparse_memory(bool enable) { m_mem_sparse = enable; return true; }
+    bool                create_file_memory(uint32_t addr, uint32_t size, const char *filename);
     bool                attach_memory(Memory *memory, uint32_t baseAddr, uint32_t len);
 
+    // Memory mapped device (hart 0, owned by the CPU like memories)
+    bool                attach_device(Device *device, uint32_t baseAddr, uint32_t len);
+
     bool                valid_addr(uint32_t address);
     void                write(uint32_t address, uint8_t data);
+    bool                write_block(uint32_t address, const uint8_t *data, uint32_t len);
     void                write32(uint32_t address, uint32_t data);
     uint8_t             read(uint32_t address);
     uint32_t            read32(uint32_t address);
@@ -113,11 +272,30 @@ public:
     void                reset(uint32_t start_addr);
     uint32_t            get_opcode(uint32_t pc);
     void                step(void);
+    int                 step_block(int max);
+    int64_t             run(int64_t max, const cosim_run_cond &cond);
+
+    // SMP (riscv_smp.cpp), hart 0 (this) owns the memory and other harts
+    bool                set_harts(int count, int quantum, bool threads);
+    int                 get_harts(void)      { return m_harts.empty() ? 1 : (int)m_harts.size(); }
+    Riscv *             get_hart(int hart)   { return hart == 0 ? this : m_harts[hart]; }
+
+    // Snapshot (riscv_snapshot.cpp)
+    bool                save_state(FILE *f);
+    bool                restore_state(FILE *f);
+    bool                save_memory(FILE *f);
+    bool                restore_memory(FILE *f);
+
+    // Execution engine (ENGINE_XXX)
+    void                set_engine(int engine);
+    int                 get_engine(void)     { return m_engine; }
 
     void                set_interrupt(int irq);
 
     bool                get_fault(void)      { return m_fault; }
     bool                get_stopped(void)    { return m_break; }
+    bool                get_exited(void)     { return m_exited; }
+    int                 get_exit_code(void)  { return m_exit_code; }
     bool                get_reg_valid(int r) { return true; }
     uint32_t            get_register(int r);
 
@@ -134,28 +312,218 @@ public:
     bool                clr_breakpoint(uint32_t pc);
     bool                check_breakpoint(uint32_t pc);
 
-    void                enable_trace(uint32_t mask)                 { m_trace = mask; }
+    // Data watchpoints (COSIM_WATCH_XXX)
+    bool                set_watchpoint(uint32_t addr, uint32_t len, int type);
+    bool                clr_watchpoint(uint32_t addr, uint32_t len, int type);
+    bool                get_watch_hit(uint32_t *pc, uint32_t *addr, int *type);
 
-    void                set_stats_interface(IStatsInterface *stats) { m_stats_if = stats; }
-    void                set_console(IConsoleIO *cio)                { m_console = cio; }
+    void                enable_trace(uint32_t mask);
+
+    // Binary trace of retired instructions (NULL to disable, all harts)
+    bool                set_binary_trace(BinaryTrace *trace);
+
+    // Cycle approximate timing model of biriscv (NULL to disable)
+    bool                set_timing(TimingModel *timing);
+
+    // L1 cache simulator, one or more configurations (NULL to disable)
+    bool                set_cache_sim(CacheSim *sim);
+
+    // Reference model for an RTL lockstep checker (NULL to disable)
+    bool                set_lockstep(LockstepChecker *checker);
+
+    // PC sampling profiler (NULL to disable, all harts)
+    bool                set_profiler(Profiler *profiler);
+
+    // Code coverage (NULL to disable, all harts)
+    bool                set_coverage(Coverage *coverage);
+
+    void                set_stats_interface(IStatsInterface *stats) { m_stats_if = stats; update_events(); }
+    bool                set_console(IConsoleIO *cio);
 
     void                stats_reset(void);
     void                stats_dump(void);
 
+    // Fast-forward time to the next timer event when idle (wfi, branch to self)
+    void                set_idle_skip(bool enable);
+    uint64_t            get_idle_cycles(void) { return m_idle_cycles; }
+
+    // High level emulation of libc routines entered at 'pc' (all harts)
+    bool                set_hle(const char *routine, uint32_t pc);
+    void                set_hle_cost(int call_cost, int word_cost);
+
+    // Decoded instruction cache
+    void                flush_decode_cache(void);
+
+    // Report an error and halt the run (get_fault()), last message kept
     bool                error(bool terminal, const char *fmt, ...);
+    const char *        get_error(void)      { return m_error; }
 
 protected:  
-    void                execute(void);
+    typedef void (Riscv::*t_step_variant)(void);
+
+    template <int VARIANT> void execute(void);
+    template <int VARIANT> void step_variant(void);
+    void                select_execute(void);
+    void                step_first(void);
     int                 load(uint32_t pc, uint32_t address, uint32_t *result, int width, bool signedLoad);
     int                 store(uint32_t pc, uint32_t address, uint32_t data, int width);
+    bool                watch_access(uint32_t pc, uint32_t address, int type);
+
+    // High level emulation
+    int                 hle_execute(const t_decoded_inst *inst, uint32_t pc);
+    uint8_t            *hle_chunk(uint32_t addr, uint32_t *len, int writeNotRead, uint32_t *physical);
+    bool                hle_range(uint32_t addr, uint32_t len, int writeNotRead);
+    int64_t             hle_memcpy(uint32_t dst, uint32_t src, uint32_t len);
+    int64_t             hle_memset(uint32_t dst, uint8_t value, uint32_t len);
+    int64_t             hle_strlen(uint32_t src, uint32_t *result);
+    int64_t             hle_memcmp(uint32_t a, uint32_t b, uint32_t len, uint32_t *result);
     uint32_t            access_csr(uint32_t address, uint32_t data, bool set, bool clr);
     void                exception(uint32_t cause, uint32_t pc, uint32_t badaddr = 0);
 
+    // Instruction decode
+    void                decode(uint32_t phys_pc, uint32_t opcode, t_decoded_inst *inst);
+    void                invalidate_code(uint32_t phys_addr);
+    void                create_caches(void);
+    uint32_t            pending_interrupts(void);
+    void                idle_skip(bool wfi);
+    bool                idle_wakes(uint32_t ip, bool wfi);
+    void                trace_retire(uint32_t rd, int result);
+    void                update_events(void)
+    {
+        // Per instruction record for the trace / timing / cache / lockstep consumers
+        m_record = (m_btrace || m_timing || m_cache_sim || m_lockstep);
+
+        // Loads and stores look at one flag for both the record and LOG_MEM
+        m_trace_access = m_record || (m_trace & LOG_MEM);
+
+        // Records are also made by the threaded engine, text trace and stats are not
+        if (m_trace || m_stats_if)
+            m_events |= RUN_EVENT_DEBUG;
+        else
+            m_events &= ~RUN_EVENT_DEBUG;
+
+        select_execute();
+    }
+
+    // Snapshot of one hart
+    void                save_hart(FILE *f);
+    bool                restore_hart(FILE *f);
+
+    // Physical memory access
+    void                map_memory(int region);
+    void                share_memory(Riscv *primary);
+    void                release_memory(void);
+    bool                mem_load(uint32_t address, int width, bool signedLoad, uint32_t *value);
+    bool                mem_store(uint32_t address, uint32_t data, int width);
+    int                 mem_region(uint32_t address, int region);
+    bool                mem_device(uint32_t address);
+
+    // Devices (hart 0)
+    void                device_update(void);
+    void                device_access(void);
+
+    // Threaded engine
+    void                flush_blocks(void);
+    void                invalidate_blocks(uint32_t page);
+    void                translate_block(uint32_t phys_pc, t_block *block);
+    template <bool RECORD> int exec_block(const t_block *block, uint32_t pc);
+    void                block_record(const t_block *block, const t_thread_op *op, uint32_t pc);
+    int64_t             run_hart(int64_t max, const cosim_run_cond &cond);
+
+    // SMP
+    int64_t             run_smp(int64_t max, const cosim_run_cond &cond);
+    static void         smp_worker(s_smp_run *ctx, int hart);
+    bool                clint_access(uint32_t address, bool write, uint32_t *value);
+    void                clint_apply(void);
+    void                clint_tick(void);
+    uint64_t            clint_mtime(void);
+
+    // Atomics
+    int                 amo_address(uint32_t pc, uint32_t address, uint32_t *physical, int writeNotRead);
+    bool                mem_amo(uint32_t address, int op, uint32_t operand, uint32_t *old);
+
+    // JIT (x86-64 hosts)
+    bool                jit_init(void);
+    void                jit_destroy(void);
+    void                jit_flush(void);
+    bool                jit_translate(t_block *block, uint32_t pc);
+    static uint64_t     jit_load(Riscv *cpu, uint32_t pc, uint32_t address, uint32_t type);
+    static uint32_t     jit_store(Riscv *cpu, uint32_t pc, uint32_t address, uint32_t data, uint32_t width);
+
+    // Instruction handlers
+    int                 exec_andi(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_ori(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_xori(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_addi(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_slti(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sltiu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_slli(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_srli(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_srai(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lui(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_auipc(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_add(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sub(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_slt(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sltu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_xor(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_or(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_and(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sll(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_srl(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sra(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_jal(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_jalr(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_beq(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_bne(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_blt(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_bge(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_bltu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_bgeu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lb(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lh(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lw(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lbu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lhu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lwu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sb(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sh(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sw(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_mul(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_mulh(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_mulhsu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_mulhu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_div(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_divu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_rem(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_remu(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_ecall(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_ebreak(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_mret(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sret(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_fence(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_fence_i(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sfence(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_csrrw(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_csrrs(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_csrrc(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_csrrwi(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_csrrsi(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_csrrci(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_wfi(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_lr_w(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_sc_w(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_amo_w(const t_decoded_inst *inst, uint32_t pc);
+    int                 exec_illegal(const t_decoded_inst *inst, uint32_t pc);
+
 // MMU
 private:
 #ifdef CONFIG_MMU
     int                 mmu_read_word(uint32_t address, uint32_t *val);
     uint32_t            mmu_walk(uint32_t addr);
+    uint32_t            mmu_lookup(t_tlb_entry *tlb, uint32_t addr, int stats_hit);
+    void                tlb_flush(bool all_addr, uint32_t addr, bool all_asid, uint32_t asid);
+    void                tlb_satp_write(uint32_t old_satp);
     int                 mmu_i_translate(uint32_t addr, uint32_t *physical);
     int                 mmu_d_translate(uint32_t pc, uint32_t addr, uint32_t *physical, int writeNotRead);
 #endif
@@ -194,22 +562,133 @@ private:
     uint32_t            m_mem_base[MAX_MEM_REGIONS];
     uint32_t            m_mem_size[MAX_MEM_REGIONS];
     int                 m_mem_regions;
+    bool                m_mem_sparse;       // create_memory() regions are SparseMemory
+    uint8_t           **m_mem_page_host;
+    uint8_t            *m_mem_page_region;
+    bool                m_mem_owner;        // False for harts sharing hart 0's memory
+    std::recursive_mutex *m_mem_lock;       // Device access (threaded SMP only)
+    Device             *m_mem_device[MAX_MEM_REGIONS]; // Region is a Device (or NULL)
+    bool                m_device_mapped;    // Any region is a Device
+
+    // Devices, updated by hart 0 when mtime reaches m_device_next or
+    // another hart accessed one (m_device_pending)
+    std::vector <Device *> m_devices;
+    uint64_t            m_device_next;
+    std::atomic <bool>  m_device_pending;
+    bool                m_device_irq;       // Devices drive MEIP
+    bool                m_ext_irq;          // MEIP latched by set_interrupt()
+
+    // SMP
+    int                 m_hart_id;
+    Riscv              *m_primary;          // Hart 0
+    std::vector <Riscv *> m_harts;          // All harts (hart 0 only, empty = single)
+    int                 m_smp_quantum;
+    bool                m_smp_threads;
+
+    // LR/SC reservation (SC succeeds if the word still holds the LR value)
+    bool                m_resv_valid;
+    uint32_t            m_resv_addr;
+    uint32_t            m_resv_value;
+
+    // CLINT registers for this hart, written by any hart and applied
+    // by this hart in clint_apply()
+    bool                m_clint_enable;
+    std::mutex          m_clint_lock;
+    std::atomic <bool>  m_clint_pending;
+    uint32_t            m_clint_msip;
+    uint64_t            m_clint_mtimecmp;
+    bool                m_clint_mtimecmp_set;
+    bool                m_clint_timer;      // mtimecmp written, CLINT drives the timer interrupt
+    uint64_t            m_clint_mtime;      // Shared mtime (hart 0 only), see clint_tick()
 
     // Status
     bool                m_fault;
     bool                m_break;
+    bool                m_exited;
+    int                 m_exit_code;
+    char                m_error[256];
     int                 m_trace;
 
-    // Breakpoints
+    // Binary trace, timing model, cache simulator and lockstep checker,
+    // record for the instruction in execute()
+    BinaryTrace        *m_btrace;
+    TimingModel        *m_timing;
+    CacheSim           *m_cache_sim;
+    LockstepChecker    *m_lockstep;
+    bool                m_record;
+    bool                m_trace_access;     // m_record or LOG_MEM
+    t_trace_record      m_btrace_rec;
+    uint32_t            m_btrace_phys;      // Physical address of the access
+
+    // Profiler, instructions until the next sample
+    Profiler           *m_profiler;
+    int64_t             m_profile_left;
+
+    // Code coverage (executed PCs, branch outcomes)
+    Coverage           *m_coverage;
+
+    // Breakpoints (per PC word) and watchpoints (per byte), looked up
+    // only on pages holding one
     bool                m_has_breakpoints;
-    std::vector <uint32_t > m_breakpoints;
+    PageBitmap          m_breakpoints;
+    bool                m_has_watchpoints;
+    PageBitmap          m_watch_read;
+    PageBitmap          m_watch_write;
+    bool                m_watch_hit;
+    uint32_t            m_watch_pc;
+    uint32_t            m_watch_addr;
+    int                 m_watch_type;
+
+    // Interpreter step variant for the current mode
+    t_step_variant      m_step;
+    static const t_step_variant s_step_variants[EXEC_VARIANT_MAX];
+
+    // Pending events (RUN_EVENT_XXX), zero when blocks can run freely
+    uint32_t            m_events;
+    uint32_t            m_run_stop_pc;
+    uint32_t            m_run_trace_pc;
 
     // Stats
     uint32_t            m_stats[STATS_MAX];
     IStatsInterface     *m_stats_if;
 
+    // Idle skip
+    bool                m_idle_skip;
+    uint64_t            m_idle_cycles;      // Timer cycles skipped
+
     // Console
     IConsoleIO         *m_console;
+
+    // High level emulation, entry PC -> HLE_XXX
+    bool                m_has_hle;
+    PageBitmap          m_hle_entries;
+    std::map <uint32_t, int > m_hle_routines;
+    int                 m_hle_call_cost;
+    int                 m_hle_word_cost;
+
+    // Decoded instruction cache
+    t_decoded_inst     *m_decode_cache;
+
+    // Software TLBs
+    t_tlb_entry         m_itlb[TLB_ENTRIES];
+    t_tlb_entry         m_dtlb[TLB_ENTRIES];
+
+    // Threaded engine
+    int                 m_engine;
+    t_block            *m_block_cache;
+    uint32_t          **m_block_map;        // Per page bitmap of translated words
+    std::vector <uint32_t > m_block_pages;  // Pages with a bitmap allocated
+    bool                m_block_dirty;      // Running block was modified
+    bool                m_block_running;    // In a block with devices or watchpoints
+    const void         *m_thread_handlers[THREAD_OP_MAX];
+    const void         *m_record_handlers[THREAD_OP_MAX];  // exec_block<true>() labels
+
+    // JIT
+    uint8_t            *m_jit_code;         // Executable code buffer
+    uint32_t            m_jit_used;
+    t_jit_enter         m_jit_enter;        // Prologue, jumps to block code
+    uint8_t            *m_jit_exit;         // Epilogue, returns to step_block()
+    int32_t             m_jit_budget;       // Instructions left for chaining
 };
 
 #endif
@@ -0,0 +1,175 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_BITMAP_H__
+#define __RISCV_BITMAP_H__
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+#define BITMAP_PAGE_SHIFT       12
+#define BITMAP_PAGE_FLAGS       ((1 << (32 - BITMAP_PAGE_SHIFT)) / 32)
+
+//--------------------------------------------------------------------
+// PageBitmap: Set of addresses (at 1 << 'shift' byte granularity) kept
+// as a bitmap per 4KB page, plus one flag bit per page. Lookups on
+// pages without a flag cost a single bit test.
+//--------------------------------------------------------------------
+class PageBitmap
+{
+public:
+    PageBitmap(int shift = 0): m_shift(shift) { }
+
+    bool empty(void) const { return m_bits.empty(); }
+
+    // Page holding 'addr' has any address set
+    bool page(uint32_t addr) const
+    {
+        uint32_t page = addr >> BITMAP_PAGE_SHIFT;
+        return !m_flags.empty() && (m_flags[page / 32] & (1u << (page % 32)));
+    }
+
+    // Any address in [addr, addr + len) set
+    bool test(uint32_t addr, uint32_t len = 1) const
+    {
+        if (m_flags.empty())
+            return false;
+
+        uint32_t end  = addr + len - 1;
+        uint32_t mask = (1 << BITMAP_PAGE_SHIFT) - 1;
+
+        for (uint32_t page = addr >> BITMAP_PAGE_SHIFT; ; page++)
+        {
+            if (m_flags[page / 32] & (1u << (page % 32)))
+            {
+                const std::vector<uint32_t> &bits = m_bits.find(page)->second;
+
+                uint32_t lo = (page == (addr >> BITMAP_PAGE_SHIFT)) ? (addr & mask) : 0;
+                uint32_t hi = (page == (end  >> BITMAP_PAGE_SHIFT)) ? (end  & mask) : mask;
+                for (uint32_t bit = lo >> m_shift; bit <= (hi >> m_shift); bit++)
+                    if (bits[bit / 32] & (1u << (bit % 32)))
+                        return true;
+            }
+
+            if (page == (end >> BITMAP_PAGE_SHIFT))
+                break;
+        }
+        return false;
+    }
+
+    // Add [addr, addr + len)
+    void set(uint32_t addr, uint32_t len = 1)
+    {
+        if (m_flags.empty())
+            m_flags.resize(BITMAP_PAGE_FLAGS);
+
+        for_each_unit(addr, len, true);
+    }
+
+    // Remove [addr, addr + len), false if none of it was set
+    bool clr(uint32_t addr, uint32_t len = 1)
+    {
+        if (!test(addr, len))
+            return false;
+
+        for_each_unit(addr, len, false);
+        return true;
+    }
+
+private:
+    void for_each_unit(uint32_t addr, uint32_t len, bool value)
+    {
+        uint32_t first = addr >> m_shift;
+        uint32_t last  = (addr + len - 1) >> m_shift;
+
+        for (uint32_t u = first; ; u++)
+        {
+            uint32_t a    = u << m_shift;
+            uint32_t page = a >> BITMAP_PAGE_SHIFT;
+            uint32_t bit  = (a & ((1 << BITMAP_PAGE_SHIFT) - 1)) >> m_shift;
+
+            std::map<uint32_t, std::vector<uint32_t> >::iterator it = m_bits.find(page);
+            if (it == m_bits.end() && value)
+            {
+                it = m_bits.insert(std::make_pair(page, std::vector<uint32_t>(((1 << BITMAP_PAGE_SHIFT) >> m_shift) / 32))).first;
+                m_flags[page / 32] |= (1u << (page % 32));
+            }
+
+            if (it != m_bits.end())
+            {
+                if (value)
+                    it->second[bit / 32] |= (1u << (bit % 32));
+                else
+                {
+                    it->second[bit / 32] &= ~(1u << (bit % 32));
+
+                    // Drop the page once nothing is left in it
+                    bool used = false;
+                    for (size_t i=0;i<it->second.size() && !used;i++)
+                        used = (it->second[i] != 0);
+                    if (!used)
+                    {
+                        m_bits.erase(it);
+                        m_flags[page / 32] &= ~(1u << (page % 32));
+                    }
+                }
+            }
+
+            if (u == last)
+                break;
+        }
+    }
+
+private:
+    int                                         m_shift;
+    std::vector<uint32_t>                       m_flags;    // One bit per page
+    std::map<uint32_t, std::vector<uint32_t> >  m_bits;     // Per page bitmap
+};
+
+#endif
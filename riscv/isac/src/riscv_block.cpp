@@ -0,0 +1,817 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "riscv.h"
+
+//-----------------------------------------------------------------
+// Defines:
+//-----------------------------------------------------------------
+// Direct threaded dispatch needs the labels-as-values extension
+#if defined(__GNUC__) || defined(__clang__)
+    #define THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+    #define OP(name)            op_ ##name
+    #define OP_INTERNAL(name)   op_ ##name
+    #define DISPATCH()          do { if (RECORD) goto *m_record_handlers[op->inst]; goto *op->handler; } while (0)
+#else
+    #define OP(name)            case ENUM_INST_ ##name
+    #define OP_INTERNAL(name)   case THREAD_OP_ ##name
+    #define DISPATCH()          goto dispatch
+#endif
+
+// Recording blocks open a record before each op and retire it after
+#define RECORD_BEGIN()          do { if (RECORD) block_record(block, op, pc); } while (0)
+#define RECORD_RETIRE(result)   do { if (RECORD) trace_retire(op->rd, result); } while (0)
+
+#define NEXT()                  do { if (RECORD) { m_pc = pc + 4; trace_retire(op->rd, EXEC_OK); } \
+                                     op++; pc += 4; RECORD_BEGIN(); DISPATCH(); } while (0)
+
+//-----------------------------------------------------------------
+// set_engine: Select execution engine
+//-----------------------------------------------------------------
+void Riscv::set_engine(int engine)
+{
+    // No JIT for this host, use the threaded engine instead
+    if (engine == ENGINE_JIT && !jit_init())
+    {
+        fprintf(stderr, "JIT: Not available, using threaded engine\n");
+        engine = ENGINE_THREADED;
+    }
+
+    m_engine = engine;
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_engine(engine);
+}
+//-----------------------------------------------------------------
+// flush_blocks: Drop all translated blocks
+//-----------------------------------------------------------------
+void Riscv::flush_blocks(void)
+{
+    // Never used (zero) entries are left alone, see create_caches()
+    for (int i=0;i<BLOCK_CACHE_ENTRIES && m_block_cache;i++)
+        if (i == 0 || m_block_cache[i].pc)
+            m_block_cache[i].pc = 0xFFFFFFFF;
+
+    for (size_t i=0;i<m_block_pages.size();i++)
+    {
+        delete [] m_block_map[m_block_pages[i]];
+        m_block_map[m_block_pages[i]] = NULL;
+    }
+    m_block_pages.clear();
+
+    m_block_dirty = true;
+}
+//-----------------------------------------------------------------
+// invalidate_blocks: Drop translated blocks starting in a page
+//-----------------------------------------------------------------
+void Riscv::invalidate_blocks(uint32_t page)
+{
+    // Blocks never cross a page, so a page maps onto a contiguous
+    // run of block cache entries
+    uint32_t base = page << (BLOCK_PAGE_SHIFT - 2);
+    for (uint32_t i=0;i<(1 << (BLOCK_PAGE_SHIFT - 2));i++)
+    {
+        t_block *block = &m_block_cache[(base + i) & (BLOCK_CACHE_ENTRIES-1)];
+        if ((block->pc >> BLOCK_PAGE_SHIFT) == page)
+            block->pc = 0xFFFFFFFF;
+    }
+
+    memset(m_block_map[page], 0, (1 << (BLOCK_PAGE_SHIFT - 2)) / 8);
+
+    m_block_dirty = true;
+}
+//-----------------------------------------------------------------
+// translate_block: Build threaded op list for block at phys_pc
+//-----------------------------------------------------------------
+void Riscv::translate_block(uint32_t phys_pc, t_block *block)
+{
+    uint32_t page_offset = phys_pc & ((1 << BLOCK_PAGE_SHIFT) - 1);
+    int limit = ((1 << BLOCK_PAGE_SHIFT) - page_offset) >> 2;
+    int n;
+
+    if (limit > BLOCK_MAX_INSTS)
+        limit = BLOCK_MAX_INSTS;
+
+    block->pc     = phys_pc;
+    block->vpc    = 0;
+    block->count  = 0;
+    block->native = NULL;
+    block->chain  = NULL;
+
+    for (n=0;n<limit;n++)
+    {
+        uint32_t addr = phys_pc + (n << 2);
+
+        t_decoded_inst *inst = &m_decode_cache[(addr >> 2) & (DECODE_CACHE_ENTRIES-1)];
+        if (inst->pc != addr)
+            decode(addr, get_opcode(addr), inst);
+
+        t_thread_op *op = &block->ops[n];
+        int  id         = inst->inst;
+        bool terminator = false;
+
+        switch (id)
+        {
+            // System instructions end the block and run on the interpreter
+            case ENUM_INST_ECALL:
+            case ENUM_INST_EBREAK:
+            case ENUM_INST_MRET:
+            case ENUM_INST_SRET:
+            case ENUM_INST_CSRRW:
+            case ENUM_INST_CSRRS:
+            case ENUM_INST_CSRRC:
+            case ENUM_INST_CSRRWI:
+            case ENUM_INST_CSRRSI:
+            case ENUM_INST_CSRRCI:
+            case ENUM_INST_FENCE:
+            case ENUM_INST_WFI:
+            case ENUM_INST_LR_W:
+            case ENUM_INST_SC_W:
+            case ENUM_INST_AMOSWAP_W:
+            case ENUM_INST_AMOADD_W:
+            case ENUM_INST_AMOXOR_W:
+            case ENUM_INST_AMOAND_W:
+            case ENUM_INST_AMOOR_W:
+            case ENUM_INST_AMOMIN_W:
+            case ENUM_INST_AMOMAX_W:
+            case ENUM_INST_AMOMINU_W:
+            case ENUM_INST_AMOMAXU_W:
+            case ENUM_INST_MAX:
+                id = THREAD_OP_END;
+                break;
+            // Control flow ends the block
+            case ENUM_INST_JAL:
+            case ENUM_INST_JALR:
+            case ENUM_INST_BEQ:
+            case ENUM_INST_BNE:
+            case ENUM_INST_BLT:
+            case ENUM_INST_BGE:
+            case ENUM_INST_BLTU:
+            case ENUM_INST_BGEU:
+                terminator = true;
+                break;
+            // Loads and stores always execute (side effects, faults)
+            case ENUM_INST_LB:
+            case ENUM_INST_LH:
+            case ENUM_INST_LW:
+            case ENUM_INST_LBU:
+            case ENUM_INST_LHU:
+            case ENUM_INST_LWU:
+            case ENUM_INST_SB:
+            case ENUM_INST_SH:
+            case ENUM_INST_SW:
+                break;
+            // ALU result to r0 is discarded
+            default:
+                if (inst->rd == 0)
+                    id = THREAD_OP_NOP;
+                break;
+        }
+
+        // Branch to self is an idle loop, left to the interpreter for idle skip
+        if (terminator && m_idle_skip && id != ENUM_INST_JALR && inst->imm == 0)
+            id = THREAD_OP_END;
+
+        // Calls and returns maintain the profiler call stack on the interpreter
+        if (terminator && m_profiler && (id == ENUM_INST_JAL || id == ENUM_INST_JALR) &&
+            (PROFILE_LINK_REG(inst->rd) || (id == ENUM_INST_JALR && inst->rd == 0 && PROFILE_LINK_REG(inst->rs1))))
+            id = THREAD_OP_END;
+
+        if (id == THREAD_OP_END)
+            break;
+
+        op->handler = m_thread_handlers[id];
+        op->inst    = id;
+        op->imm     = inst->imm;
+        op->rd      = inst->rd;
+        op->rs1     = inst->rs1;
+        op->rs2     = inst->rs2;
+
+        if (terminator)
+        {
+            n++;
+            break;
+        }
+    }
+
+    block->length = n;
+
+    // End of block marker
+    block->ops[n].handler = m_thread_handlers[THREAD_OP_END];
+    block->ops[n].inst    = THREAD_OP_END;
+
+    if (n == 0)
+        return ;
+
+    // Mark words so that stores to them drop the block
+    uint32_t page = phys_pc >> BLOCK_PAGE_SHIFT;
+    uint32_t *map = m_block_map[page];
+    if (!map)
+    {
+        map = new uint32_t[(1 << (BLOCK_PAGE_SHIFT - 2)) / 32]();
+        m_block_map[page] = map;
+        m_block_pages.push_back(page);
+    }
+
+    for (int i=0;i<n;i++)
+    {
+        uint32_t word = (page_offset >> 2) + i;
+        map[word / 32] |= (1 << (word % 32));
+    }
+}
+//-----------------------------------------------------------------
+// block_record: Open the trace record for the op at 'pc' (as execute())
+//-----------------------------------------------------------------
+void Riscv::block_record(const t_block *block, const t_thread_op *op, uint32_t pc)
+{
+    if (op->inst == THREAD_OP_END)
+        return ;
+
+    // The op was decoded when translated, usually still in the decode cache
+    uint32_t              phys = block->pc + (op - block->ops) * 4;
+    const t_decoded_inst *inst = &m_decode_cache[(phys >> 2) & (DECODE_CACHE_ENTRIES-1)];
+
+    m_btrace_rec.flags  = 0;
+    m_btrace_rec.pc     = pc;
+    m_btrace_rec.opcode = (inst->pc == phys) ? inst->opcode : get_opcode(phys);
+}
+//-----------------------------------------------------------------
+// exec_block: Run a translated block (block = NULL exports handlers)
+// Returns the number of instructions executed. The RECORD variant
+// retires each op to the binary trace / timing / cache / lockstep
+// consumers and dispatches through its own handler table.
+//-----------------------------------------------------------------
+template <bool RECORD>
+int Riscv::exec_block(const t_block *block, uint32_t pc)
+{
+    if (!block)
+    {
+#ifdef THREADED_DISPATCH
+        #define THREAD_HANDLER(id, name) (RECORD ? m_record_handlers : m_thread_handlers)[id] = &&op_ ##name
+
+        for (int i=0;i<THREAD_OP_MAX;i++)
+            THREAD_HANDLER(i, END);
+
+        THREAD_HANDLER(ENUM_INST_ANDI,   ANDI);
+        THREAD_HANDLER(ENUM_INST_ORI,    ORI);
+        THREAD_HANDLER(ENUM_INST_XORI,   XORI);
+        THREAD_HANDLER(ENUM_INST_ADDI,   ADDI);
+        THREAD_HANDLER(ENUM_INST_SLTI,   SLTI);
+        THREAD_HANDLER(ENUM_INST_SLTIU,  SLTIU);
+        THREAD_HANDLER(ENUM_INST_SLLI,   SLLI);
+        THREAD_HANDLER(ENUM_INST_SRLI,   SRLI);
+        THREAD_HANDLER(ENUM_INST_SRAI,   SRAI);
+        THREAD_HANDLER(ENUM_INST_LUI,    LUI);
+        THREAD_HANDLER(ENUM_INST_AUIPC,  AUIPC);
+        THREAD_HANDLER(ENUM_INST_ADD,    ADD);
+        THREAD_HANDLER(ENUM_INST_SUB,    SUB);
+        THREAD_HANDLER(ENUM_INST_SLT,    SLT);
+        THREAD_HANDLER(ENUM_INST_SLTU,   SLTU);
+        THREAD_HANDLER(ENUM_INST_XOR,    XOR);
+        THREAD_HANDLER(ENUM_INST_OR,     OR);
+        THREAD_HANDLER(ENUM_INST_AND,    AND);
+        THREAD_HANDLER(ENUM_INST_SLL,    SLL);
+        THREAD_HANDLER(ENUM_INST_SRL,    SRL);
+        THREAD_HANDLER(ENUM_INST_SRA,    SRA);
+        THREAD_HANDLER(ENUM_INST_MUL,    MUL);
+        THREAD_HANDLER(ENUM_INST_MULH,   MULH);
+        THREAD_HANDLER(ENUM_INST_MULHSU, MULHSU);
+        THREAD_HANDLER(ENUM_INST_MULHU,  MULHU);
+        THREAD_HANDLER(ENUM_INST_DIV,    DIV);
+        THREAD_HANDLER(ENUM_INST_DIVU,   DIVU);
+        THREAD_HANDLER(ENUM_INST_REM,    REM);
+        THREAD_HANDLER(ENUM_INST_REMU,   REMU);
+        THREAD_HANDLER(ENUM_INST_LB,     LB);
+        THREAD_HANDLER(ENUM_INST_LH,     LH);
+        THREAD_HANDLER(ENUM_INST_LW,     LW);
+        THREAD_HANDLER(ENUM_INST_LBU,    LBU);
+        THREAD_HANDLER(ENUM_INST_LHU,    LHU);
+        THREAD_HANDLER(ENUM_INST_LWU,    LWU);
+        THREAD_HANDLER(ENUM_INST_SB,     SB);
+        THREAD_HANDLER(ENUM_INST_SH,     SH);
+        THREAD_HANDLER(ENUM_INST_SW,     SW);
+        THREAD_HANDLER(ENUM_INST_JAL,    JAL);
+        THREAD_HANDLER(ENUM_INST_JALR,   JALR);
+        THREAD_HANDLER(ENUM_INST_BEQ,    BEQ);
+        THREAD_HANDLER(ENUM_INST_BNE,    BNE);
+        THREAD_HANDLER(ENUM_INST_BLT,    BLT);
+        THREAD_HANDLER(ENUM_INST_BGE,    BGE);
+        THREAD_HANDLER(ENUM_INST_BLTU,   BLTU);
+        THREAD_HANDLER(ENUM_INST_BGEU,   BGEU);
+        THREAD_HANDLER(THREAD_OP_NOP,    NOP);
+
+        #undef THREAD_HANDLER
+#else
+        for (int i=0;i<THREAD_OP_MAX;i++)
+            m_thread_handlers[i] = m_record_handlers[i] = NULL;
+#endif
+        return 0;
+    }
+
+    const t_thread_op *op = block->ops;
+    uint32_t *r           = m_gpr;
+    uint32_t value;
+
+    RECORD_BEGIN();
+
+#ifdef THREADED_DISPATCH
+    DISPATCH();
+    {
+#else
+dispatch:
+    switch (op->inst)
+    {
+#endif
+    //-------------------------------------------------------------
+    // ALU
+    //-------------------------------------------------------------
+    OP(ANDI):   r[op->rd] = r[op->rs1] & op->imm;                           NEXT();
+    OP(ORI):    r[op->rd] = r[op->rs1] | op->imm;                           NEXT();
+    OP(XORI):   r[op->rd] = r[op->rs1] ^ op->imm;                           NEXT();
+    OP(ADDI):   r[op->rd] = r[op->rs1] + op->imm;                           NEXT();
+    OP(SLTI):   r[op->rd] = (signed)r[op->rs1] < (signed)op->imm;           NEXT();
+    OP(SLTIU):  r[op->rd] = (unsigned)r[op->rs1] < (unsigned)op->imm;       NEXT();
+    OP(SLLI):   r[op->rd] = r[op->rs1] << op->imm;                          NEXT();
+    OP(SRLI):   r[op->rd] = (unsigned)r[op->rs1] >> op->imm;                NEXT();
+    OP(SRAI):   r[op->rd] = (signed)r[op->rs1] >> op->imm;                  NEXT();
+    OP(LUI):    r[op->rd] = op->imm;                                        NEXT();
+    OP(AUIPC):  r[op->rd] = op->imm + pc;                                   NEXT();
+    OP(ADD):    r[op->rd] = r[op->rs1] + r[op->rs2];                        NEXT();
+    OP(SUB):    r[op->rd] = r[op->rs1] - r[op->rs2];                        NEXT();
+    OP(SLT):    r[op->rd] = (signed)r[op->rs1] < (signed)r[op->rs2];        NEXT();
+    OP(SLTU):   r[op->rd] = (unsigned)r[op->rs1] < (unsigned)r[op->rs2];    NEXT();
+    OP(XOR):    r[op->rd] = r[op->rs1] ^ r[op->rs2];                        NEXT();
+    OP(OR):     r[op->rd] = r[op->rs1] | r[op->rs2];                        NEXT();
+    OP(AND):    r[op->rd] = r[op->rs1] & r[op->rs2];                        NEXT();
+    OP(SLL):    r[op->rd] = r[op->rs1] << r[op->rs2];                       NEXT();
+    OP(SRL):    r[op->rd] = (unsigned)r[op->rs1] >> r[op->rs2];             NEXT();
+    OP(SRA):    r[op->rd] = (signed)r[op->rs1] >> r[op->rs2];               NEXT();
+    OP_INTERNAL(NOP):                                                       NEXT();
+
+    //-------------------------------------------------------------
+    // Multiply / divide
+    //-------------------------------------------------------------
+    OP(MUL):
+        r[op->rd] = (signed)r[op->rs1] * (signed)r[op->rs2];
+        NEXT();
+    OP(MULH):
+        r[op->rd] = (int)((((long long) (int)r[op->rs1]) * ((long long)(int)r[op->rs2])) >> 32);
+        NEXT();
+    OP(MULHSU):
+        r[op->rd] = (int)((((long long) (int)r[op->rs1]) * ((unsigned long long)(unsigned)r[op->rs2])) >> 32);
+        NEXT();
+    OP(MULHU):
+        r[op->rd] = (int)((((unsigned long long) (unsigned)r[op->rs1]) * ((unsigned long long)(unsigned)r[op->rs2])) >> 32);
+        NEXT();
+    OP(DIV):
+        if ((signed)r[op->rs1] == INT32_MIN && (signed)r[op->rs2] == -1)
+            r[op->rd] = r[op->rs1];
+        else if (r[op->rs2] != 0)
+            r[op->rd] = (signed)r[op->rs1] / (signed)r[op->rs2];
+        else
+            r[op->rd] = (unsigned)-1;
+        NEXT();
+    OP(DIVU):
+        if (r[op->rs2] != 0)
+            r[op->rd] = (unsigned)r[op->rs1] / (unsigned)r[op->rs2];
+        else
+            r[op->rd] = (unsigned)-1;
+        NEXT();
+    OP(REM):
+        if ((signed)r[op->rs1] == INT32_MIN && (signed)r[op->rs2] == -1)
+            r[op->rd] = 0;
+        else if (r[op->rs2] != 0)
+            r[op->rd] = (signed)r[op->rs1] % (signed)r[op->rs2];
+        else
+            r[op->rd] = r[op->rs1];
+        NEXT();
+    OP(REMU):
+        if (r[op->rs2] != 0)
+            r[op->rd] = (unsigned)r[op->rs1] % (unsigned)r[op->rs2];
+        else
+            r[op->rd] = r[op->rs1];
+        NEXT();
+
+    //-------------------------------------------------------------
+    // Loads
+    //-------------------------------------------------------------
+    OP(LB):
+        if (!load(pc, r[op->rs1] + op->imm, &value, 1, true))
+            goto fault;
+        r[op->rd] = value;
+        r[0]      = 0;
+        NEXT();
+    OP(LH):
+        if (!load(pc, r[op->rs1] + op->imm, &value, 2, true))
+            goto fault;
+        r[op->rd] = value;
+        r[0]      = 0;
+        NEXT();
+    OP(LW):
+        if (!load(pc, r[op->rs1] + op->imm, &value, 4, true))
+            goto fault;
+        r[op->rd] = value;
+        r[0]      = 0;
+        NEXT();
+    OP(LBU):
+        if (!load(pc, r[op->rs1] + op->imm, &value, 1, false))
+            goto fault;
+        r[op->rd] = value;
+        r[0]      = 0;
+        NEXT();
+    OP(LHU):
+        if (!load(pc, r[op->rs1] + op->imm, &value, 2, false))
+            goto fault;
+        r[op->rd] = value;
+        r[0]      = 0;
+        NEXT();
+    OP(LWU):
+        if (!load(pc, r[op->rs1] + op->imm, &value, 4, false))
+            goto fault;
+        r[op->rd] = value;
+        r[0]      = 0;
+        NEXT();
+
+    //-------------------------------------------------------------
+    // Stores (leave the block if it modified translated code)
+    //-------------------------------------------------------------
+    OP(SB):
+        if (!store(pc, r[op->rs1] + op->imm, r[op->rs2], 1))
+            goto fault;
+        if (m_block_dirty)
+            goto modified;
+        NEXT();
+    OP(SH):
+        if (!store(pc, r[op->rs1] + op->imm, r[op->rs2], 2))
+            goto fault;
+        if (m_block_dirty)
+            goto modified;
+        NEXT();
+    OP(SW):
+        if (!store(pc, r[op->rs1] + op->imm, r[op->rs2], 4))
+            goto fault;
+        if (m_block_dirty)
+            goto modified;
+        NEXT();
+
+    //-------------------------------------------------------------
+    // Control flow (always last in block)
+    //-------------------------------------------------------------
+    OP(JAL):
+        r[op->rd] = pc + 4;
+        r[0]      = 0;
+        m_pc      = pc + op->imm;
+        goto branch;
+    OP(JALR):
+        m_pc      = (r[op->rs1] + op->imm) & ~1;
+        r[op->rd] = pc + 4;
+        r[0]      = 0;
+        goto branch;
+    OP(BEQ):
+        m_pc = (r[op->rs1] == r[op->rs2]) ? (pc + op->imm) : (pc + 4);
+        goto branch;
+    OP(BNE):
+        m_pc = (r[op->rs1] != r[op->rs2]) ? (pc + op->imm) : (pc + 4);
+        goto branch;
+    OP(BLT):
+        m_pc = ((signed)r[op->rs1] < (signed)r[op->rs2]) ? (pc + op->imm) : (pc + 4);
+        goto branch;
+    OP(BGE):
+        m_pc = ((signed)r[op->rs1] >= (signed)r[op->rs2]) ? (pc + op->imm) : (pc + 4);
+        goto branch;
+    OP(BLTU):
+        m_pc = ((unsigned)r[op->rs1] < (unsigned)r[op->rs2]) ? (pc + op->imm) : (pc + 4);
+        goto branch;
+    OP(BGEU):
+        m_pc = ((unsigned)r[op->rs1] >= (unsigned)r[op->rs2]) ? (pc + op->imm) : (pc + 4);
+        goto branch;
+
+    //-------------------------------------------------------------
+    // End of block (next instruction is not part of it)
+    //-------------------------------------------------------------
+    OP_INTERNAL(END):
+        m_pc   = pc;
+        m_pc_x = pc - 4;
+        return op - block->ops;
+    }
+
+branch:
+    m_stats[STATS_BRANCHES]++;
+    m_pc_x = pc;
+    RECORD_RETIRE(EXEC_OK);
+    return (op - block->ops) + 1;
+
+modified:
+    m_pc   = pc + 4;
+    m_pc_x = pc;
+    RECORD_RETIRE(EXEC_OK);
+    return (op - block->ops) + 1;
+
+fault:
+    // Device access, not executed here (step_block() steps it)
+    if (m_events & RUN_EVENT_DEVICE)
+    {
+        m_pc = pc;
+        if (op != block->ops)
+            m_pc_x = pc - 4;
+        return op - block->ops;
+    }
+
+    // Exception already taken, m_pc is the trap vector
+    m_pc_x = pc;
+    RECORD_RETIRE(EXEC_ABORT);
+    return (op - block->ops) + 1;
+}
+
+template int Riscv::exec_block<false>(const t_block *block, uint32_t pc);
+template int Riscv::exec_block<true>(const t_block *block, uint32_t pc);
+//-----------------------------------------------------------------
+// step_block: Execute up to 'max' instructions on the selected engine
+//-----------------------------------------------------------------
+int Riscv::step_block(int max)
+{
+    // CLINT register written by another hart
+    if (m_clint_pending.load(std::memory_order_acquire))
+        clint_apply();
+
+    // Device event due or device accessed by another hart
+    if (m_csr_mtime >= m_device_next || m_device_pending.load(std::memory_order_acquire))
+        device_update();
+
+    if (m_engine == ENGINE_INTERPRETER)
+    {
+        step();
+        return 1;
+    }
+
+    // Single test on the fast path, anything pending is looked at here
+    if (m_events)
+    {
+        if (m_events & RUN_EVENT_IRQ)
+        {
+            if (pending_interrupts())
+            {
+                step();
+                return 1;
+            }
+            m_events &= ~RUN_EVENT_IRQ;
+        }
+
+        // Text tracing and stats need the interpreter
+        if (m_events & RUN_EVENT_DEBUG)
+        {
+            step();
+            return 1;
+        }
+
+        // Device access which ended the last block
+        if (m_events & RUN_EVENT_DEVICE)
+        {
+            m_events &= ~RUN_EVENT_DEVICE;
+            step();
+            return 1;
+        }
+    }
+
+    // Do not run past the timer compare point
+    if (m_csr_mtimecmp > m_csr_mtime && (m_csr_mtimecmp - m_csr_mtime) < (uint64_t)max)
+        max = (int)(m_csr_mtimecmp - m_csr_mtime);
+
+    // Nor past the next device event
+    if (m_device_next > m_csr_mtime && (m_device_next - m_csr_mtime) < (uint64_t)max)
+        max = (int)(m_device_next - m_csr_mtime);
+
+    uint32_t phy_pc = m_pc;
+
+#ifdef CONFIG_MMU
+    // Fetch fault, same as step() with a faulting execute()
+    if (!mmu_i_translate(m_pc, &phy_pc))
+    {
+        m_stats[STATS_INSTRUCTIONS]++;
+        m_csr_mtime++;
+        if (m_csr_mtime == m_csr_mtimecmp)
+        {
+            m_csr_mip |= (m_csr_mideleg & SR_IP_STIP) ? SR_IP_STIP : SR_IP_MTIP;
+            m_events  |= RUN_EVENT_IRQ;
+        }
+        return 1;
+    }
+#endif
+
+    t_block *block = &m_block_cache[(phy_pc >> 2) & (BLOCK_CACHE_ENTRIES-1)];
+    if (block->pc != phy_pc)
+        translate_block(phy_pc, block);
+
+    // Block starts with a system instruction or exceeds the budget
+    if (block->length == 0 || block->length > max)
+    {
+        step();
+        return 1;
+    }
+
+    // Watched run() PCs and breakpoints are single stepped so run() sees
+    // them (blocks stay within a page, so one page flag test when clear)
+    uint32_t span = block->length * 4;
+    if ((m_events & RUN_EVENT_WATCH) && ((m_run_stop_pc - m_pc) < span || (m_run_trace_pc - m_pc) < span))
+    {
+        step();
+        return 1;
+    }
+    if (m_has_breakpoints && m_breakpoints.test(m_pc, span))
+    {
+        step();
+        return 1;
+    }
+
+    // Emulated routine entries only run on the interpreter
+    if (m_has_hle && m_hle_entries.test(m_pc, span))
+    {
+        step();
+        return 1;
+    }
+
+    int      executed;
+    uint32_t start = m_pc;
+
+    m_block_running = m_device_mapped || m_has_watchpoints;
+
+    // Hot blocks are translated to host code and run natively, which
+    // may chain into further native blocks within the budget. Native
+    // code makes no trace records, so recording runs the threaded ops.
+    bool native = (m_engine == ENGINE_JIT && !m_record);
+
+    if (native && (block->native == NULL || block->vpc != m_pc))
+    {
+        if (++block->count >= JIT_THRESHOLD)
+            jit_translate(block, m_pc);
+    }
+
+    if (native && block->native != NULL && block->vpc == m_pc)
+    {
+        // No chaining (within the page) while watching PCs or on a page
+        // with breakpoints, the next block may hold one
+        bool    watched = (m_events & RUN_EVENT_WATCH) || (m_has_breakpoints && m_breakpoints.page(m_pc));
+        int32_t budget  = watched ? 0 : (max - block->length);
+
+        m_jit_budget = budget;
+        m_jit_enter(this, block->native, m_gpr);
+        executed = block->length + budget - m_jit_budget;
+    }
+    else
+    {
+        m_block_dirty = false;
+        if (m_record)
+            executed = exec_block<true>(block, m_pc);
+        else
+            executed = exec_block<false>(block, m_pc);
+    }
+
+    m_block_running = false;
+
+    // Control flow only ends a block, so the last op is the branch.
+    // Native code records its own branch outcomes and only chains on
+    // (executed > length) into fully recorded blocks.
+    if (m_coverage && executed > 0)
+    {
+        m_coverage->executed(start, (executed < block->length) ? executed : block->length);
+
+        uint32_t last = start + (block->length - 1) * 4;
+        int      id   = block->ops[block->length - 1].inst;
+        if (executed == block->length && id >= ENUM_INST_BEQ && id <= ENUM_INST_BGEU)
+            m_coverage->branch(last, m_pc != last + 4);
+
+        if (block->native && !block->chain && block->vpc == start && m_coverage->covered(start, block->length))
+            block->chain = block->native;
+    }
+
+    m_stats[STATS_INSTRUCTIONS] += executed;
+
+    // Increment timer counter (limited to compare point above)
+    m_csr_mtime += executed;
+    if (m_csr_mtime == m_csr_mtimecmp)
+    {
+        m_csr_mip |= (m_csr_mideleg & SR_IP_STIP) ? SR_IP_STIP : SR_IP_MTIP;
+        m_events  |= RUN_EVENT_IRQ;
+    }
+
+    return executed;
+}
+//-----------------------------------------------------------------
+// run: Execute until fault, stop, exit, a run condition or 'max' (if >= 0)
+// instructions (per hart when SMP)
+//-----------------------------------------------------------------
+int64_t Riscv::run(int64_t max, const cosim_run_cond &cond)
+{
+    if (m_harts.size() > 1)
+        return run_smp(max, cond);
+
+    return run_hart(max, cond);
+}
+//-----------------------------------------------------------------
+// run_hart: run() for this hart alone. The loop only looks beyond
+// m_events when it is set.
+//-----------------------------------------------------------------
+int64_t Riscv::run_hart(int64_t max, const cosim_run_cond &cond)
+{
+    int64_t executed = 0;
+
+    create_caches();
+
+    m_run_stop_pc  = cond.stop_pc;
+    m_run_trace_pc = cond.trace_pc;
+    m_watch_hit    = false;
+    if (m_run_stop_pc != COSIM_PC_NONE || m_run_trace_pc != COSIM_PC_NONE)
+        m_events |= RUN_EVENT_WATCH;
+
+    while (max < 0 || executed < max)
+    {
+        if (m_events)
+        {
+            if (m_fault || m_break || m_exited)
+                break;
+
+            // Last instruction was watched, execute one more then act
+            uint32_t last_pc = m_pc_x;
+            if ((m_events & RUN_EVENT_WATCH) && (last_pc == m_run_stop_pc || last_pc == m_run_trace_pc))
+            {
+                step();
+                executed++;
+
+                if (last_pc == m_run_trace_pc)
+                    enable_trace(cond.trace_mask);
+                if (last_pc == m_run_stop_pc)
+                    break;
+                continue;
+            }
+        }
+
+        int64_t left = (max < 0) ? 0x7FFFFFFF : (max - executed);
+        if (m_profiler && left > m_profile_left)
+            left = m_profile_left;
+
+        int done  = step_block((left > 0x7FFFFFFF) ? 0x7FFFFFFF : (int)left);
+        executed += done;
+
+        // Sample the next PC every profile interval (block boundaries)
+        if (m_profiler && (m_profile_left -= done) <= 0)
+        {
+            m_profiler->sample(m_hart_id, m_pc);
+            m_profile_left = m_profiler->get_interval();
+        }
+    }
+
+    m_events      &= ~RUN_EVENT_WATCH;
+    m_run_stop_pc  = COSIM_PC_NONE;
+    m_run_trace_pc = COSIM_PC_NONE;
+
+    return executed;
+}
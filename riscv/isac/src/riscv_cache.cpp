@@ -0,0 +1,531 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "riscv_cache.h"
+#include "elf_load.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define CACHE_RANDOM_SEED   0x12345678
+
+static bool is_pow2(int x)
+{
+    return x > 0 && (x & (x - 1)) == 0;
+}
+//-----------------------------------------------------------------
+// parse_config: Cache spec (see header)
+//-----------------------------------------------------------------
+bool Cache::parse_config(const char *spec, t_cache_config *cfg)
+{
+    cfg->size           = 0;
+    cfg->ways           = 1;
+    cfg->line           = 32;
+    cfg->policy         = CACHE_REPL_LRU;
+    cfg->write_back     = true;
+    cfg->write_allocate = true;
+
+    if (!strcmp(spec, "none"))
+        return true;
+
+    char buf[128];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+
+    char *save = NULL;
+    int   field = 0;
+    for (char *tok = strtok_r(buf, ":", &save); tok; tok = strtok_r(NULL, ":", &save), field++)
+    {
+        char *end;
+        switch (field)
+        {
+            case 0:
+                cfg->size = (int)strtoul(tok, &end, 0);
+                if (*end == 'k' || *end == 'K')
+                    cfg->size *= 1024;
+                break;
+            case 1:
+                cfg->ways = (int)strtoul(tok, NULL, 0);
+                break;
+            case 2:
+                cfg->line = (int)strtoul(tok, NULL, 0);
+                break;
+            default:
+                if (!strcmp(tok, "lru"))         cfg->policy = CACHE_REPL_LRU;
+                else if (!strcmp(tok, "fifo"))   cfg->policy = CACHE_REPL_FIFO;
+                else if (!strcmp(tok, "random")) cfg->policy = CACHE_REPL_RANDOM;
+                else if (!strcmp(tok, "rr"))     cfg->policy = CACHE_REPL_ROUND_ROBIN;
+                else if (!strcmp(tok, "wb"))     cfg->write_back = true;
+                else if (!strcmp(tok, "wt"))     cfg->write_back = false;
+                else if (!strcmp(tok, "wa"))     cfg->write_allocate = true;
+                else if (!strcmp(tok, "nwa"))    cfg->write_allocate = false;
+                else
+                    return false;
+                break;
+        }
+    }
+
+    if (field < 3 || cfg->ways < 1 || cfg->line < 4 || !is_pow2(cfg->line))
+        return false;
+
+    // Sets are indexed by address bits
+    return cfg->size % (cfg->line * cfg->ways) == 0 && is_pow2(cfg->size / (cfg->line * cfg->ways));
+}
+//-----------------------------------------------------------------
+// format_config: Inverse of parse_config
+//-----------------------------------------------------------------
+void Cache::format_config(const t_cache_config &cfg, char *buf, int len)
+{
+    static const char *policies[] = { "lru", "fifo", "random", "rr" };
+
+    if (!cfg.size)
+        snprintf(buf, len, "none");
+    else if (cfg.size % 1024 == 0)
+        snprintf(buf, len, "%dk:%d:%d:%s:%s:%s", cfg.size / 1024, cfg.ways, cfg.line, policies[cfg.policy],
+                 cfg.write_back ? "wb" : "wt", cfg.write_allocate ? "wa" : "nwa");
+    else
+        snprintf(buf, len, "%d:%d:%d:%s:%s:%s", cfg.size, cfg.ways, cfg.line, policies[cfg.policy],
+                 cfg.write_back ? "wb" : "wt", cfg.write_allocate ? "wa" : "nwa");
+}
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+Cache::Cache()
+{
+    t_cache_config cfg;
+    parse_config("none", &cfg);
+    configure(cfg);
+}
+//-----------------------------------------------------------------
+// configure: Set geometry and invalidate
+//-----------------------------------------------------------------
+void Cache::configure(const t_cache_config &cfg)
+{
+    m_cfg        = cfg;
+    m_sets       = cfg.size ? cfg.size / (cfg.line * cfg.ways) : 0;
+    m_line_shift = 0;
+    while ((1 << m_line_shift) < cfg.line)
+        m_line_shift++;
+
+    reset();
+}
+//-----------------------------------------------------------------
+// reset: Invalidate all lines, clear stats
+//-----------------------------------------------------------------
+void Cache::reset(void)
+{
+    int lines = m_sets * m_cfg.ways;
+
+    m_replace = 0;
+    m_random  = CACHE_RANDOM_SEED;
+    m_clock   = 0;
+    m_tag.assign(lines, 0);
+    m_valid.assign(lines, 0);
+    m_dirty.assign(lines, 0);
+    m_stamp.assign(lines, 0);
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+//-----------------------------------------------------------------
+// access: Lookup, allocate on a miss (reads, and writes when write
+// allocate). Returns CACHE_XXX flags.
+//-----------------------------------------------------------------
+int Cache::access(uint32_t addr, bool write)
+{
+    uint32_t line = addr >> m_line_shift;
+    int      ways = m_cfg.ways;
+    int      base = (line & (m_sets - 1)) * ways;
+
+    m_clock++;
+
+    for (int w=0;w<ways;w++)
+    {
+        int idx = base + w;
+        if (m_valid[idx] && m_tag[idx] == line)
+        {
+            m_stats.hits++;
+            if (m_cfg.policy == CACHE_REPL_LRU)
+                m_stamp[idx] = m_clock;
+
+            if (!write)
+                return CACHE_HIT;
+            if (m_cfg.write_back)
+            {
+                m_dirty[idx] = 1;
+                return CACHE_HIT;
+            }
+            return CACHE_HIT | CACHE_WRITE_MEM;
+        }
+    }
+
+    m_stats.misses++;
+
+    if (write && !m_cfg.write_allocate)
+        return CACHE_WRITE_MEM;
+
+    // Victim: invalid way, else by policy
+    int victim = -1;
+    if (m_cfg.policy == CACHE_REPL_ROUND_ROBIN)
+    {
+        victim    = base + m_replace;
+        m_replace = (m_replace + 1) % ways;
+    }
+    else
+    {
+        for (int w=0;w<ways && victim < 0;w++)
+            if (!m_valid[base + w])
+                victim = base + w;
+
+        if (victim < 0 && m_cfg.policy == CACHE_REPL_RANDOM)
+        {
+            // xorshift32
+            m_random ^= m_random << 13;
+            m_random ^= m_random >> 17;
+            m_random ^= m_random << 5;
+            victim = base + (int)(m_random % ways);
+        }
+        else if (victim < 0)
+        {
+            victim = base;
+            for (int w=1;w<ways;w++)
+                if (m_stamp[base + w] < m_stamp[victim])
+                    victim = base + w;
+        }
+    }
+
+    int result = 0;
+    if (m_valid[victim])
+    {
+        m_stats.evictions++;
+        result |= CACHE_EVICT;
+        if (m_dirty[victim])
+        {
+            m_stats.writebacks++;
+            result |= CACHE_WRITEBACK;
+        }
+    }
+
+    m_tag[victim]   = line;
+    m_valid[victim] = 1;
+    m_dirty[victim] = write && m_cfg.write_back;
+    m_stamp[victim] = m_clock;
+
+    if (write && !m_cfg.write_back)
+        result |= CACHE_WRITE_MEM;
+
+    return result;
+}
+
+//-----------------------------------------------------------------
+// CacheSim
+//-----------------------------------------------------------------
+CacheSim::CacheSim()
+{
+    reset();
+}
+CacheSim::~CacheSim()
+{
+    for (size_t i=0;i<m_configs.size();i++)
+        delete m_configs[i];
+}
+//-----------------------------------------------------------------
+// add_config: Add an I/D cache pair to the sweep
+//-----------------------------------------------------------------
+bool CacheSim::add_config(const char *spec)
+{
+    t_cache_config icfg;
+    t_cache_config dcfg;
+
+    const char *slash = strchr(spec, '/');
+    if (slash)
+    {
+        std::string ispec(spec, slash - spec);
+        if (!Cache::parse_config(ispec.c_str(), &icfg) || !Cache::parse_config(slash + 1, &dcfg))
+            return false;
+    }
+    else
+    {
+        if (!Cache::parse_config(spec, &icfg))
+            return false;
+        dcfg = icfg;
+    }
+
+    char ibuf[64];
+    char dbuf[64];
+    Cache::format_config(icfg, ibuf, sizeof(ibuf));
+    Cache::format_config(dcfg, dbuf, sizeof(dbuf));
+
+    s_config *c = new s_config;
+    c->name = std::string(ibuf) + "/" + dbuf;
+    c->icache.configure(icfg);
+    c->dcache.configure(dcfg);
+    m_configs.push_back(c);
+
+    reset();
+    return true;
+}
+//-----------------------------------------------------------------
+// add_region: Named range, first match wins
+//-----------------------------------------------------------------
+void CacheSim::add_region(const char *name, uint32_t base, uint32_t size)
+{
+    s_region r;
+    r.name = name;
+    r.base = base;
+    r.size = size;
+    m_regions.push_back(r);
+
+    reset();
+}
+//-----------------------------------------------------------------
+// reset: Invalidate caches, clear counts
+//-----------------------------------------------------------------
+void CacheSim::reset(void)
+{
+    s_counts zero;
+    memset(&zero, 0, sizeof(zero));
+
+    for (size_t i=0;i<m_configs.size();i++)
+    {
+        s_config *c = m_configs[i];
+        c->icache.reset();
+        c->dcache.reset();
+        c->fetch_line = 0xFFFFFFFF;
+        c->regions.assign(m_regions.size() + 1, zero);
+        c->pcs.clear();
+    }
+
+    m_pc_index.clear();
+    m_pc_addr.clear();
+    memset(m_memo_pc, 0xFF, sizeof(m_memo_pc));
+}
+//-----------------------------------------------------------------
+// find_region: Index into m_regions, m_regions.size() for other
+//-----------------------------------------------------------------
+int CacheSim::find_region(uint32_t addr)
+{
+    for (size_t i=0;i<m_regions.size();i++)
+        if (addr - m_regions[i].base < m_regions[i].size)
+            return (int)i;
+
+    return (int)m_regions.size();
+}
+//-----------------------------------------------------------------
+// count: Add an access result
+//-----------------------------------------------------------------
+void CacheSim::count(s_counts *c, bool data, int result)
+{
+    if (data)
+    {
+        c->d_access++;
+        c->d_miss += !(result & CACHE_HIT);
+    }
+    else
+    {
+        c->i_access++;
+        c->i_miss += !(result & CACHE_HIT);
+    }
+
+    c->evictions += (result & CACHE_EVICT) ? 1 : 0;
+}
+//-----------------------------------------------------------------
+// retire: Instruction fetch (virtual PC) and data access (physical)
+//-----------------------------------------------------------------
+void CacheSim::retire(const t_trace_record &rec, uint32_t mem_phys)
+{
+    bool data  = (rec.flags & (TRACE_FLAG_LOAD | TRACE_FLAG_STORE)) != 0;
+    bool write = (rec.flags & TRACE_FLAG_STORE) != 0;
+
+    int  iregion = find_region(rec.pc);
+    int  dregion = data ? find_region(mem_phys) : 0;
+
+    // One lookup per instruction for all configurations
+    int      memo = (rec.pc >> 2) & (CACHE_PC_MEMO - 1);
+    uint32_t slot = m_memo_slot[memo];
+    if (m_memo_pc[memo] != rec.pc)
+    {
+        std::pair <std::unordered_map <uint32_t, uint32_t>::iterator, bool> it =
+            m_pc_index.insert(std::make_pair(rec.pc, (uint32_t)m_pc_addr.size()));
+        if (it.second)
+        {
+            s_counts zero;
+            memset(&zero, 0, sizeof(zero));
+
+            m_pc_addr.push_back(rec.pc);
+            for (size_t i=0;i<m_configs.size();i++)
+                m_configs[i]->pcs.push_back(zero);
+        }
+
+        slot              = it.first->second;
+        m_memo_pc[memo]   = rec.pc;
+        m_memo_slot[memo] = slot;
+    }
+
+    for (size_t i=0;i<m_configs.size();i++)
+    {
+        s_config *c  = m_configs[i];
+        s_counts *pc = &c->pcs[slot];
+
+        if (c->icache.enabled())
+        {
+            // Sequential fetches within a line hit without a lookup
+            int      result = CACHE_HIT;
+            uint32_t line   = rec.pc >> c->icache.get_line_shift();
+            if (line == c->fetch_line)
+                c->icache.access_again();
+            else
+            {
+                result        = c->icache.access(rec.pc, false);
+                c->fetch_line = line;
+            }
+            count(pc, false, result);
+            count(&c->regions[iregion], false, result);
+        }
+
+        if (data && c->dcache.enabled())
+        {
+            int result = c->dcache.access(mem_phys, write);
+            count(pc, true, result);
+            count(&c->regions[dregion], true, result);
+        }
+    }
+}
+
+//-----------------------------------------------------------------
+// Report helpers
+//-----------------------------------------------------------------
+static double miss_pct(uint64_t misses, uint64_t accesses)
+{
+    return accesses ? (100.0 * misses) / accesses : 0.0;
+}
+
+static void print_counts(FILE *f, const char *name, const uint64_t *c)
+{
+    // c: i_access, i_miss, d_access, d_miss, evictions
+    fprintf(f, "  %-24s %12llu %10llu %6.2f%% %12llu %10llu %6.2f%% %10llu\n", name,
+            (unsigned long long)c[0], (unsigned long long)c[1], miss_pct(c[1], c[0]),
+            (unsigned long long)c[2], (unsigned long long)c[3], miss_pct(c[3], c[2]),
+            (unsigned long long)c[4]);
+}
+
+static bool func_order(const std::pair <std::string, std::vector <uint64_t > > &a,
+                       const std::pair <std::string, std::vector <uint64_t > > &b)
+{
+    uint64_t ma = a.second[1] + a.second[3];
+    uint64_t mb = b.second[1] + b.second[3];
+    if (ma != mb)
+        return ma > mb;
+    return a.first < b.first;
+}
+//-----------------------------------------------------------------
+// print: Totals, regions and the functions with most misses
+//-----------------------------------------------------------------
+void CacheSim::print(FILE *f, const char *elf, int top_functions)
+{
+    for (size_t i=0;i<m_configs.size();i++)
+    {
+        s_config *c = m_configs[i];
+        const t_cache_stats &is = c->icache.get_stats();
+        const t_cache_stats &ds = c->dcache.get_stats();
+
+        fprintf(f, "Cache Config %d: %s\n", (int)i, c->name.c_str());
+        if (c->icache.enabled())
+            fprintf(f, "- ICache Accesses %llu Hits %llu Misses %llu (%.2f%%) Evictions %llu\n",
+                    (unsigned long long)(is.hits + is.misses), (unsigned long long)is.hits,
+                    (unsigned long long)is.misses, miss_pct(is.misses, is.hits + is.misses),
+                    (unsigned long long)is.evictions);
+        if (c->dcache.enabled())
+            fprintf(f, "- DCache Accesses %llu Hits %llu Misses %llu (%.2f%%) Evictions %llu Writebacks %llu\n",
+                    (unsigned long long)(ds.hits + ds.misses), (unsigned long long)ds.hits,
+                    (unsigned long long)ds.misses, miss_pct(ds.misses, ds.hits + ds.misses),
+                    (unsigned long long)ds.evictions, (unsigned long long)ds.writebacks);
+
+        fprintf(f, "  %-24s %12s %10s %7s %12s %10s %7s %10s\n", "region", "i-access", "i-miss", "i-miss%",
+                "d-access", "d-miss", "d-miss%", "evictions");
+        for (size_t r=0;r<c->regions.size();r++)
+        {
+            const s_counts &rc = c->regions[r];
+            if (!rc.i_access && !rc.d_access)
+                continue;
+
+            uint64_t v[5] = { rc.i_access, rc.i_miss, rc.d_access, rc.d_miss, rc.evictions };
+            print_counts(f, r < m_regions.size() ? m_regions[r].name.c_str() : (m_regions.empty() ? "(all)" : "(other)"), v);
+        }
+
+        // Functions by the PC of the accessing instruction
+        std::unordered_map <std::string, std::vector <uint64_t > > funcs;
+        for (size_t n=0;n<m_pc_addr.size();n++)
+        {
+            const char *sym = elf ? elf_get_symbol_name(elf, m_pc_addr[n], NULL) : NULL;
+            char addr[16];
+            if (!sym)
+            {
+                sprintf(addr, "0x%08x", m_pc_addr[n]);
+                sym = addr;
+            }
+
+            const s_counts &pc = c->pcs[n];
+            std::vector <uint64_t > &v = funcs[sym];
+            if (v.empty())
+                v.assign(5, 0);
+            v[0] += pc.i_access;
+            v[1] += pc.i_miss;
+            v[2] += pc.d_access;
+            v[3] += pc.d_miss;
+            v[4] += pc.evictions;
+        }
+
+        std::vector <std::pair <std::string, std::vector <uint64_t > > > sorted(funcs.begin(), funcs.end());
+        std::sort(sorted.begin(), sorted.end(), func_order);
+
+        fprintf(f, "  %-24s %12s %10s %7s %12s %10s %7s %10s\n", "function", "i-access", "i-miss", "i-miss%",
+                "d-access", "d-miss", "d-miss%", "evictions");
+        for (size_t n=0;n<sorted.size() && (top_functions <= 0 || (int)n < top_functions);n++)
+            print_counts(f, sorted[n].first.c_str(), &sorted[n].second[0]);
+    }
+}
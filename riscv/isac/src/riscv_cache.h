@@ -0,0 +1,209 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_CACHE_H__
+#define __RISCV_CACHE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "riscv_trace.h"
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+// Replacement policies
+#define CACHE_REPL_LRU          0
+#define CACHE_REPL_FIFO         1
+#define CACHE_REPL_RANDOM       2
+#define CACHE_REPL_ROUND_ROBIN  3   // One pointer for all sets (biriscv)
+
+// access() result
+#define CACHE_HIT               (1 << 0)
+#define CACHE_EVICT             (1 << 1)    // Valid line replaced
+#define CACHE_WRITEBACK         (1 << 2)    // ... and it was dirty
+#define CACHE_WRITE_MEM         (1 << 3)    // Store went to memory (write through / no allocate)
+
+// Direct mapped lookaside in front of the PC index
+#define CACHE_PC_MEMO           4096
+
+//--------------------------------------------------------------------
+// Cache geometry and policy (size 0 = no cache)
+//--------------------------------------------------------------------
+typedef struct
+{
+    int     size;
+    int     ways;
+    int     line;
+    int     policy;
+    bool    write_back;
+    bool    write_allocate;
+} t_cache_config;
+
+typedef struct
+{
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    evictions;
+    uint64_t    writebacks;
+} t_cache_stats;
+
+//--------------------------------------------------------------------
+// Cache: Tags only, set associative
+//--------------------------------------------------------------------
+class Cache
+{
+public:
+    Cache();
+
+    // "<size>[k]:<ways>:<line>[:lru|fifo|random|rr][:wb|wt][:wa|nwa]"
+    // or "none". Defaults: lru, write back, write allocate.
+    static bool parse_config(const char *spec, t_cache_config *cfg);
+    static void format_config(const t_cache_config &cfg, char *buf, int len);
+
+    void        configure(const t_cache_config &cfg);
+    void        reset(void);
+    bool        enabled(void) { return m_sets != 0; }
+    int         get_line_shift(void) { return m_line_shift; }
+
+    // Lookup (allocating on a miss), CACHE_XXX flags
+    int         access(uint32_t addr, bool write);
+
+    // Read hit on the most recently accessed line (no state change)
+    void        access_again(void) { m_stats.hits++; }
+
+    const t_cache_stats &get_stats(void) { return m_stats; }
+
+private:
+    t_cache_config          m_cfg;
+    int                     m_sets;
+    int                     m_line_shift;
+    int                     m_replace;      // Round robin pointer
+    uint32_t                m_random;
+    uint64_t                m_clock;        // LRU / FIFO stamps
+
+    // [set * ways + way]
+    std::vector <uint32_t > m_tag;          // Line address
+    std::vector <uint8_t >  m_valid;
+    std::vector <uint8_t >  m_dirty;
+    std::vector <uint64_t > m_stamp;
+
+    t_cache_stats           m_stats;
+};
+
+//--------------------------------------------------------------------
+// CacheSim: L1 instruction and data caches for one or more
+// configurations (a sweep), fed with retired instructions. Counts by
+// address region and by accessing function (PC).
+//--------------------------------------------------------------------
+class CacheSim
+{
+public:
+    CacheSim();
+    ~CacheSim();
+
+    // "<icache>/<dcache>" or one spec for both (see Cache::parse_config)
+    bool        add_config(const char *spec);
+    int         get_configs(void) { return (int)m_configs.size(); }
+
+    // Named address range for the per region report
+    void        add_region(const char *name, uint32_t base, uint32_t size);
+
+    void        reset(void);
+
+    // Instruction retired ('mem_phys' for loads / stores)
+    void        retire(const t_trace_record &rec, uint32_t mem_phys);
+
+    // Totals for configuration 'idx'
+    const char *get_name(int idx)       { return m_configs[idx]->name.c_str(); }
+    Cache      &get_icache(int idx)     { return m_configs[idx]->icache; }
+    Cache      &get_dcache(int idx)     { return m_configs[idx]->dcache; }
+
+    // Report per configuration, functions resolved with 'elf' (may be NULL)
+    void        print(FILE *f, const char *elf, int top_functions);
+
+private:
+    struct s_counts
+    {
+        uint64_t    i_access;
+        uint64_t    i_miss;
+        uint64_t    d_access;
+        uint64_t    d_miss;
+        uint64_t    evictions;
+    };
+
+    struct s_config
+    {
+        std::string                             name;
+        Cache                                   icache;
+        Cache                                   dcache;
+        uint32_t                                fetch_line;
+        std::vector <s_counts >                 regions;    // m_regions + other
+        std::vector <s_counts >                 pcs;        // By m_pc_index
+    };
+
+    struct s_region
+    {
+        std::string     name;
+        uint32_t        base;
+        uint32_t        size;
+    };
+
+    int                 find_region(uint32_t addr);
+    static void         count(s_counts *c, bool data, int result);
+
+    std::vector <s_config *>    m_configs;
+    std::vector <s_region >     m_regions;
+
+    // Instruction address -> slot in s_config::pcs (shared by all)
+    std::unordered_map <uint32_t, uint32_t> m_pc_index;
+    std::vector <uint32_t >     m_pc_addr;
+    uint32_t                    m_memo_pc[CACHE_PC_MEMO];
+    uint32_t                    m_memo_slot[CACHE_PC_MEMO];
+};
+
+#endif
@@ -0,0 +1,232 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include "riscv_console.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+Console::Console()
+{
+    m_out       = stderr;
+    m_pipe      = false;
+    m_policy    = CONSOLE_FLUSH_NEWLINE;
+    m_buf_size  = CONSOLE_BUFFER_DEFAULT;
+    m_input_pos = 0;
+    m_buf.reserve(m_buf_size);
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+Console::~Console()
+{
+    close();
+}
+//-----------------------------------------------------------------
+// open_output: Select where output goes
+//-----------------------------------------------------------------
+bool Console::open_output(const char *target)
+{
+    std::lock_guard <std::mutex > guard(m_lock);
+    FILE *f    = stderr;
+    bool  pipe = false;
+
+    if (target && target[0] == '|')
+    {
+        f    = popen(target + 1, "w");
+        pipe = true;
+    }
+    else if (target && strcmp(target, "-"))
+        f = fopen(target, "w");
+
+    if (!f)
+        return false;
+
+    flush_locked();
+
+    if (m_out != stderr)
+    {
+        if (m_pipe)
+            pclose(m_out);
+        else
+            fclose(m_out);
+    }
+
+    m_out  = f;
+    m_pipe = pipe;
+    return true;
+}
+//-----------------------------------------------------------------
+// open_input: Load the getc script
+//-----------------------------------------------------------------
+bool Console::open_input(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return false;
+
+    std::lock_guard <std::mutex > guard(m_lock);
+    char   buf[4096];
+    size_t len;
+
+    m_input.clear();
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+        m_input.append(buf, len);
+    fclose(f);
+
+    m_input_pos = 0;
+    return true;
+}
+//-----------------------------------------------------------------
+// set_flush: Parse a flush policy
+//-----------------------------------------------------------------
+bool Console::set_flush(const char *policy)
+{
+    std::lock_guard <std::mutex > guard(m_lock);
+
+    if (!strcmp(policy, "newline"))
+        m_policy = CONSOLE_FLUSH_NEWLINE;
+    else if (!strcmp(policy, "halt"))
+        m_policy = CONSOLE_FLUSH_HALT;
+    else if (!strcmp(policy, "exit"))
+        m_policy = CONSOLE_FLUSH_EXIT;
+    else if (!strncmp(policy, "size", 4) && (policy[4] == 0 || policy[4] == '='))
+    {
+        m_policy = CONSOLE_FLUSH_SIZE;
+
+        if (policy[4] == '=')
+        {
+            long size = strtol(policy + 5, NULL, 0);
+            if (size <= 0)
+                return false;
+            m_buf_size = (size_t)size;
+        }
+    }
+    else
+        return false;
+
+    return true;
+}
+//-----------------------------------------------------------------
+// putchar: Buffer an output character
+//-----------------------------------------------------------------
+int Console::putchar(int ch)
+{
+    std::lock_guard <std::mutex > guard(m_lock);
+
+    m_buf.push_back((char)ch);
+
+    if (m_buf.size() >= m_buf_size || (ch == '\n' && m_policy == CONSOLE_FLUSH_NEWLINE))
+        flush_locked();
+
+    return ch;
+}
+//-----------------------------------------------------------------
+// getchar: Next scripted input character, -1 if none
+//-----------------------------------------------------------------
+int Console::getchar(void)
+{
+    std::lock_guard <std::mutex > guard(m_lock);
+
+    // Show any prompt before the input is read
+    flush_locked();
+
+    if (m_input_pos < m_input.size())
+        return (uint8_t)m_input[m_input_pos++];
+
+    return -1;
+}
+//-----------------------------------------------------------------
+// halt: Simulation stopped
+//-----------------------------------------------------------------
+void Console::halt(void)
+{
+    std::lock_guard <std::mutex > guard(m_lock);
+
+    if (m_policy == CONSOLE_FLUSH_NEWLINE || m_policy == CONSOLE_FLUSH_HALT)
+        flush_locked();
+}
+//-----------------------------------------------------------------
+// close: Simulation ended, flush and release the output
+//-----------------------------------------------------------------
+void Console::close(void)
+{
+    std::lock_guard <std::mutex > guard(m_lock);
+
+    flush_locked();
+
+    if (m_out != stderr)
+    {
+        if (m_pipe)
+            pclose(m_out);
+        else
+            fclose(m_out);
+    }
+
+    m_out  = stderr;
+    m_pipe = false;
+}
+//-----------------------------------------------------------------
+// flush: Write out buffered output
+//-----------------------------------------------------------------
+void Console::flush(void)
+{
+    std::lock_guard <std::mutex > guard(m_lock);
+    flush_locked();
+}
+//-----------------------------------------------------------------
+// flush_locked: flush() with m_lock held
+//-----------------------------------------------------------------
+void Console::flush_locked(void)
+{
+    if (m_buf.empty())
+        return ;
+
+    fwrite(m_buf.data(), 1, m_buf.size(), m_out);
+    fflush(m_out);
+    m_buf.clear();
+}
@@ -0,0 +1,112 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_CONSOLE_H__
+#define __RISCV_CONSOLE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <mutex>
+#include "riscv.h"
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+#define CONSOLE_BUFFER_DEFAULT  4096
+
+// Flush policy, all policies flush when the buffer is full, before
+// reading input and when the console is closed.
+enum e_console_flush
+{
+    CONSOLE_FLUSH_NEWLINE,      // Each line
+    CONSOLE_FLUSH_SIZE,         // Only when the buffer is full
+    CONSOLE_FLUSH_HALT,         // When the simulation stops (run() returns)
+    CONSOLE_FLUSH_EXIT          // When the simulation ends
+};
+
+//--------------------------------------------------------------------
+// Console: Buffered target console (CSR_SIM_CTRL putc / getc, printf)
+// Output goes to stderr, a file or a pipe. Input comes from a script
+// read up front, so getc never blocks and returns -1 once it is used up.
+//--------------------------------------------------------------------
+class Console: public IConsoleIO
+{
+public:
+                        Console();
+                        ~Console();
+
+    // NULL or "-" = stderr, "|command" = pipe to command, else a file
+    bool                open_output(const char *target);
+
+    // Characters returned by getc
+    bool                open_input(const char *filename);
+
+    // "newline", "size[=bytes]", "halt" or "exit"
+    bool                set_flush(const char *policy);
+
+    int                 putchar(int ch);
+    int                 getchar(void);
+
+    // Simulation stopped / ended
+    void                halt(void);
+    void                close(void);
+
+    void                flush(void);
+
+private:
+    void                flush_locked(void);
+
+    std::mutex          m_lock;             // Harts on host threads
+    FILE               *m_out;
+    bool                m_pipe;
+    int                 m_policy;
+    std::string         m_buf;
+    size_t              m_buf_size;
+    std::string         m_input;
+    size_t              m_input_pos;
+};
+
+#endif
@@ -0,0 +1,859 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <libelf.h>
+#include <gelf.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "riscv_coverage.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define COVERAGE_MAGIC          0x564f4352  // 'RCOV'
+#define COVERAGE_VERSION        1
+
+// test() result
+#define COVERAGE_EXECUTED       (1 << 0)
+#define COVERAGE_TAKEN          (1 << 1)
+#define COVERAGE_NOT_TAKEN      (1 << 2)
+
+// RISC-V conditional branch (BEQ..BGEU)
+#define OPCODE_BRANCH           0x63
+
+// DWARF line number program
+#define DW_LNS_copy                 1
+#define DW_LNS_advance_pc           2
+#define DW_LNS_advance_line         3
+#define DW_LNS_set_file             4
+#define DW_LNS_const_add_pc         8
+#define DW_LNS_fixed_advance_pc     9
+#define DW_LNE_end_sequence         1
+#define DW_LNE_set_address          2
+#define DW_LNE_define_file          3
+#define DW_LNCT_path                1
+#define DW_LNCT_directory_index     2
+#define DW_FORM_data2               0x05
+#define DW_FORM_data4               0x06
+#define DW_FORM_data8               0x07
+#define DW_FORM_string              0x08
+#define DW_FORM_block               0x09
+#define DW_FORM_data1               0x0b
+#define DW_FORM_strp                0x0e
+#define DW_FORM_udata               0x0f
+#define DW_FORM_data16              0x1e
+#define DW_FORM_line_strp           0x1f
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+Coverage::Coverage()
+{
+    m_pages = new std::atomic <t_page *>[COVERAGE_PAGES]();
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+Coverage::~Coverage()
+{
+    for (uint32_t i=0;i<COVERAGE_PAGES;i++)
+        delete m_pages[i].load();
+
+    delete [] m_pages;
+}
+//-----------------------------------------------------------------
+// alloc_page: First PC recorded in a page
+//-----------------------------------------------------------------
+Coverage::t_page *Coverage::alloc_page(uint32_t index)
+{
+    std::lock_guard <std::mutex> guard(m_alloc);
+
+    t_page *page = m_pages[index].load(std::memory_order_acquire);
+    if (!page)
+    {
+        page = new t_page();
+        m_pages[index].store(page, std::memory_order_release);
+    }
+
+    return page;
+}
+//-----------------------------------------------------------------
+// test: COVERAGE_XXX flags for 'pc'
+//-----------------------------------------------------------------
+int Coverage::test(uint32_t pc)
+{
+    t_page *page = m_pages[pc >> COVERAGE_PAGE_SHIFT].load(std::memory_order_acquire);
+    if (!page)
+        return 0;
+
+    uint32_t index = (pc >> 2) & ((1 << (COVERAGE_PAGE_SHIFT - 2)) - 1);
+    uint32_t bit   = 1u << (index % 32);
+    int      flags = 0;
+
+    if (page->executed[index / 32] & bit)  flags |= COVERAGE_EXECUTED;
+    if (page->taken[index / 32] & bit)     flags |= COVERAGE_TAKEN;
+    if (page->not_taken[index / 32] & bit) flags |= COVERAGE_NOT_TAKEN;
+
+    return flags;
+}
+//-----------------------------------------------------------------
+// get_executed: Number of executed PCs
+//-----------------------------------------------------------------
+uint64_t Coverage::get_executed(void)
+{
+    uint64_t count = 0;
+
+    for (uint32_t i=0;i<COVERAGE_PAGES;i++)
+    {
+        t_page *page = m_pages[i].load();
+        if (page)
+            for (int w=0;w<COVERAGE_PAGE_WORDS;w++)
+                count += __builtin_popcount(page->executed[w].load());
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------
+// Data file: magic, version, page count, then per page its index and
+// the executed, taken and not taken words
+//-----------------------------------------------------------------
+bool Coverage::read_file(FILE *f)
+{
+    uint32_t header[3];
+
+    if (fread(header, sizeof(header), 1, f) != 1 || header[0] != COVERAGE_MAGIC || header[1] != COVERAGE_VERSION)
+        return false;
+
+    for (uint32_t p=0;p<header[2];p++)
+    {
+        uint32_t index;
+        uint32_t words[3 * COVERAGE_PAGE_WORDS];
+
+        if (fread(&index, sizeof(index), 1, f) != 1 || index >= COVERAGE_PAGES ||
+            fread(words, sizeof(words), 1, f) != 1)
+            return false;
+
+        t_page *page = get_page(index << COVERAGE_PAGE_SHIFT);
+        for (int w=0;w<COVERAGE_PAGE_WORDS;w++)
+        {
+            page->executed[w]  |= words[w];
+            page->taken[w]     |= words[COVERAGE_PAGE_WORDS + w];
+            page->not_taken[w] |= words[2 * COVERAGE_PAGE_WORDS + w];
+        }
+    }
+
+    return true;
+}
+bool Coverage::write_file(FILE *f)
+{
+    uint32_t header[3] = { COVERAGE_MAGIC, COVERAGE_VERSION, 0 };
+
+    for (uint32_t i=0;i<COVERAGE_PAGES;i++)
+        if (m_pages[i].load())
+            header[2]++;
+
+    fwrite(header, sizeof(header), 1, f);
+
+    for (uint32_t i=0;i<COVERAGE_PAGES;i++)
+    {
+        t_page *page = m_pages[i].load();
+        if (!page)
+            continue;
+
+        uint32_t words[3 * COVERAGE_PAGE_WORDS];
+        for (int w=0;w<COVERAGE_PAGE_WORDS;w++)
+        {
+            words[w]                           = page->executed[w];
+            words[COVERAGE_PAGE_WORDS + w]     = page->taken[w];
+            words[2 * COVERAGE_PAGE_WORDS + w] = page->not_taken[w];
+        }
+
+        fwrite(&i, sizeof(i), 1, f);
+        fwrite(words, sizeof(words), 1, f);
+    }
+
+    return !ferror(f);
+}
+//-----------------------------------------------------------------
+// load: OR a data file into this
+//-----------------------------------------------------------------
+bool Coverage::load(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return false;
+
+    bool ok = read_file(f);
+    fclose(f);
+    return ok;
+}
+//-----------------------------------------------------------------
+// save: Write a data file. With 'merge' the existing contents are
+// ORed in first (this object ends up with the merged data), holding an
+// exclusive lock so runs finishing together do not lose updates.
+//-----------------------------------------------------------------
+bool Coverage::save(const char *filename, bool merge)
+{
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+
+    FILE *f = fdopen(fd, "r+b");
+    if (!f)
+    {
+        close(fd);
+        return false;
+    }
+
+    bool ok = (flock(fd, LOCK_EX) == 0);
+
+    // Existing data (empty if just created)
+    if (ok && merge)
+    {
+        fseek(f, 0, SEEK_END);
+        if (ftell(f) > 0)
+        {
+            rewind(f);
+            ok = read_file(f);
+        }
+    }
+
+    if (ok)
+    {
+        rewind(f);
+        ok = write_file(f) && fflush(f) == 0 && ftruncate(fd, ftell(f)) == 0;
+    }
+
+    // Closing releases the lock
+    fclose(f);
+    return ok;
+}
+
+//-----------------------------------------------------------------
+// DWARF line table (.debug_line versions 2 to 5)
+//-----------------------------------------------------------------
+struct s_line_range
+{
+    uint32_t    start;
+    uint32_t    end;
+    uint32_t    line;
+    int         file;       // Index into s_elf_info::files
+};
+
+struct s_elf_func
+{
+    uint32_t    addr;
+    std::string name;
+};
+
+struct s_elf_segment
+{
+    uint32_t               vaddr;
+    std::vector <uint8_t > data;
+};
+
+struct s_elf_info
+{
+    std::vector <std::string >   files;
+    std::vector <s_line_range >  ranges;
+    std::vector <s_elf_func >    funcs;
+    std::vector <s_elf_segment > code;
+
+    // Instruction word at 'pc' (0 if not in an executable segment)
+    uint32_t opcode(uint32_t pc) const
+    {
+        for (size_t i=0;i<code.size();i++)
+            if (pc >= code[i].vaddr && (pc - code[i].vaddr) + 4 <= code[i].data.size())
+            {
+                const uint8_t *p = &code[i].data[pc - code[i].vaddr];
+                return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+            }
+        return 0;
+    }
+};
+
+// Bounds checked reader over a section
+struct s_dwarf_reader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    bool           error;
+
+    bool     left(size_t n) { if ((size_t)(end - p) < n) error = true; return !error; }
+    uint8_t  u8(void)       { return left(1) ? *p++ : 0; }
+    uint16_t u16(void)      { uint16_t v = u8(); return v | (u8() << 8); }
+    uint32_t u32(void)      { uint32_t v = u16(); return v | ((uint32_t)u16() << 16); }
+    uint64_t u64(void)      { uint64_t v = u32(); return v | ((uint64_t)u32() << 32); }
+    uint64_t offset(int size) { return size == 8 ? u64() : u32(); }
+    void     skip(size_t n) { if (left(n)) p += n; }
+
+    uint64_t uleb(void)
+    {
+        uint64_t v = 0;
+        int      shift = 0;
+        uint8_t  b;
+        do
+        {
+            b = u8();
+            if (shift < 64)
+                v |= (uint64_t)(b & 0x7f) << shift;
+            shift += 7;
+        }
+        while ((b & 0x80) && !error);
+        return v;
+    }
+    int64_t sleb(void)
+    {
+        int64_t v = 0;
+        int     shift = 0;
+        uint8_t b;
+        do
+        {
+            b = u8();
+            if (shift < 64)
+                v |= (int64_t)(b & 0x7f) << shift;
+            shift += 7;
+        }
+        while ((b & 0x80) && !error);
+        if (shift < 64 && (b & 0x40))
+            v |= -((int64_t)1 << shift);
+        return v;
+    }
+    const char *str(void)
+    {
+        const char *s = (const char *)p;
+        while (left(1) && *p)
+            p++;
+        skip(1);
+        return error ? "" : s;
+    }
+};
+
+struct s_dwarf_sections
+{
+    Elf_Data *line;
+    Elf_Data *line_str;
+    Elf_Data *str;
+};
+
+static const char *dwarf_string(Elf_Data *data, uint64_t offset)
+{
+    if (!data || offset >= data->d_size)
+        return "";
+
+    const char *s = (const char *)data->d_buf + offset;
+    return memchr(s, 0, data->d_size - offset) ? s : "";
+}
+
+static std::string dwarf_path(const std::string &dir, const char *name)
+{
+    if (name[0] == '/' || dir.empty())
+        return name;
+    return dir + "/" + name;
+}
+
+// DWARF 5 directory / file entry (path and directory index only)
+static bool dwarf_entry(s_dwarf_reader &r, const std::vector <std::pair <uint64_t, uint64_t > > &format,
+                        const s_dwarf_sections &sec, int offset_size, std::string *path, uint64_t *dir)
+{
+    for (size_t i=0;i<format.size() && !r.error;i++)
+    {
+        uint64_t    value = 0;
+        const char *text  = NULL;
+
+        switch (format[i].second)
+        {
+            case DW_FORM_string:    text  = r.str();                                   break;
+            case DW_FORM_line_strp: text  = dwarf_string(sec.line_str, r.offset(offset_size)); break;
+            case DW_FORM_strp:      text  = dwarf_string(sec.str, r.offset(offset_size));      break;
+            case DW_FORM_udata:     value = r.uleb();                                  break;
+            case DW_FORM_data1:     value = r.u8();                                    break;
+            case DW_FORM_data2:     value = r.u16();                                   break;
+            case DW_FORM_data4:     value = r.u32();                                   break;
+            case DW_FORM_data8:     value = r.u64();                                   break;
+            case DW_FORM_data16:    r.skip(16);                                        break;
+            case DW_FORM_block:     r.skip(r.uleb());                                  break;
+            default:                return false;
+        }
+
+        if (format[i].first == DW_LNCT_path && text)
+            *path = text;
+        else if (format[i].first == DW_LNCT_directory_index)
+            *dir = value;
+    }
+
+    return !r.error;
+}
+
+static bool dwarf_formats(s_dwarf_reader &r, std::vector <std::pair <uint64_t, uint64_t > > &format)
+{
+    int count = r.u8();
+    for (int i=0;i<count && !r.error;i++)
+    {
+        uint64_t type = r.uleb();
+        format.push_back(std::make_pair(type, r.uleb()));
+    }
+    return !r.error;
+}
+
+// One line number program (compilation unit), false if malformed
+static bool dwarf_unit(s_dwarf_reader &r, const s_dwarf_sections &sec, s_elf_info *info)
+{
+    int      offset_size = 4;
+    uint64_t length      = r.u32();
+    if (length == 0xffffffff)
+    {
+        offset_size = 8;
+        length      = r.u64();
+    }
+
+    if (!r.left(length))
+        return false;
+
+    s_dwarf_reader unit = { r.p, r.p + length, false };
+    r.p += length;
+
+    int version = unit.u16();
+    if (version < 2 || version > 5)
+        return true;
+
+    if (version >= 5)
+        unit.skip(2);   // address_size, segment_selector_size
+
+    uint64_t       header_length = unit.offset(offset_size);
+    const uint8_t *program       = unit.p + header_length;
+
+    int min_inst  = unit.u8();
+    if (version >= 4)
+        unit.u8();      // maximum_operations_per_instruction
+    unit.u8();          // default_is_stmt
+    int line_base   = (int8_t)unit.u8();
+    int line_range  = unit.u8();
+    int opcode_base = unit.u8();
+
+    std::vector <uint8_t > std_lengths;
+    for (int i=1;i<opcode_base;i++)
+        std_lengths.push_back(unit.u8());
+
+    // File table, indexes into info->files
+    std::vector <std::string > dirs;
+    std::vector <int >         files;
+
+    if (version >= 5)
+    {
+        std::vector <std::pair <uint64_t, uint64_t > > format;
+        if (!dwarf_formats(unit, format))
+            return false;
+
+        uint64_t count = unit.uleb();
+        for (uint64_t i=0;i<count && !unit.error;i++)
+        {
+            std::string path;
+            uint64_t    dir = 0;
+            if (!dwarf_entry(unit, format, sec, offset_size, &path, &dir))
+                return false;
+            dirs.push_back(path);
+        }
+
+        format.clear();
+        if (!dwarf_formats(unit, format))
+            return false;
+
+        count = unit.uleb();
+        for (uint64_t i=0;i<count && !unit.error;i++)
+        {
+            std::string path;
+            uint64_t    dir = 0;
+            if (!dwarf_entry(unit, format, sec, offset_size, &path, &dir))
+                return false;
+
+            info->files.push_back(dwarf_path(dir < dirs.size() ? dirs[dir] : "", path.c_str()));
+            files.push_back(info->files.size() - 1);
+        }
+    }
+    else
+    {
+        // Directory 0 is the compilation directory (not in this table)
+        dirs.push_back("");
+        for (const char *dir = unit.str(); *dir && !unit.error; dir = unit.str())
+            dirs.push_back(dir);
+
+        // File numbers start at 1
+        files.push_back(-1);
+        for (const char *name = unit.str(); *name && !unit.error; name = unit.str())
+        {
+            uint64_t dir = unit.uleb();
+            unit.uleb();    // mtime
+            unit.uleb();    // length
+
+            info->files.push_back(dwarf_path(dir < dirs.size() ? dirs[dir] : "", name));
+            files.push_back(info->files.size() - 1);
+        }
+    }
+
+    if (unit.error || line_range == 0 || program < unit.p || program > unit.end)
+        return false;
+
+    unit.p = program;
+
+    // State machine, rows of the current sequence
+    uint64_t address = 0;
+    uint64_t file    = 1;
+    int64_t  line    = 1;
+
+    struct s_row { uint32_t addr; uint32_t line; int file; };
+    std::vector <s_row > rows;
+
+    while (unit.p < unit.end && !unit.error)
+    {
+        int  op   = unit.u8();
+        bool emit = false;
+
+        if (op >= opcode_base)
+        {
+            int adjust = op - opcode_base;
+            address += (adjust / line_range) * min_inst;
+            line    += line_base + (adjust % line_range);
+            emit     = true;
+        }
+        else if (op == 0)
+        {
+            uint64_t       len  = unit.uleb();
+            const uint8_t *next = unit.p + len;
+            if (!unit.left(len) || len == 0)
+                return false;
+
+            switch (unit.u8())
+            {
+                case DW_LNE_end_sequence:
+                {
+                    for (size_t i=0;i + 1<rows.size();i++)
+                    {
+                        s_line_range range = { rows[i].addr, rows[i+1].addr, rows[i].line, rows[i].file };
+                        if (range.start < range.end && range.file >= 0)
+                            info->ranges.push_back(range);
+                    }
+                    if (!rows.empty() && rows.back().addr < address && rows.back().file >= 0)
+                    {
+                        s_line_range range = { rows.back().addr, (uint32_t)address, rows.back().line, rows.back().file };
+                        info->ranges.push_back(range);
+                    }
+
+                    rows.clear();
+                    address = 0;
+                    file    = 1;
+                    line    = 1;
+                    break;
+                }
+                case DW_LNE_set_address:
+                    address = (len - 1) == 8 ? unit.u64() : unit.u32();
+                    break;
+                case DW_LNE_define_file:
+                {
+                    const char *name = unit.str();
+                    uint64_t    dir  = unit.uleb();
+                    info->files.push_back(dwarf_path(dir < dirs.size() ? dirs[dir] : "", name));
+                    files.push_back(info->files.size() - 1);
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            unit.p = next;
+        }
+        else
+        {
+            switch (op)
+            {
+                case DW_LNS_copy:               emit = true;                                            break;
+                case DW_LNS_advance_pc:         address += unit.uleb() * min_inst;                      break;
+                case DW_LNS_advance_line:       line += unit.sleb();                                    break;
+                case DW_LNS_set_file:           file = unit.uleb();                                     break;
+                case DW_LNS_const_add_pc:       address += ((255 - opcode_base) / line_range) * min_inst; break;
+                case DW_LNS_fixed_advance_pc:   address += unit.u16();                                  break;
+                default:
+                    // Skip operands (column, isa, ... and unknown opcodes)
+                    for (int i=0;i<std_lengths[op - 1];i++)
+                        unit.uleb();
+                    break;
+            }
+        }
+
+        if (emit)
+        {
+            s_row row = { (uint32_t)address, (uint32_t)line, file < files.size() ? files[file] : -1 };
+            rows.push_back(row);
+        }
+    }
+
+    return !unit.error;
+}
+
+//-----------------------------------------------------------------
+// elf_read_info: Line table, functions and code of 'filename'
+//-----------------------------------------------------------------
+static bool elf_read_info(const char *filename, s_elf_info *info)
+{
+    if (elf_version(EV_CURRENT) == EV_NONE)
+        return false;
+
+    int fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    Elf *e = elf_begin(fd, ELF_C_READ, NULL);
+    size_t shstrndx;
+    if (!e || elf_kind(e) != ELF_K_ELF || elf_getshdrstrndx(e, &shstrndx) != 0)
+    {
+        if (e)
+            elf_end(e);
+        close(fd);
+        return false;
+    }
+
+    // Executable segments (instruction words)
+    size_t phnum = 0;
+    elf_getphdrnum(e, &phnum);
+    for (size_t i=0;i<phnum;i++)
+    {
+        GElf_Phdr phdr;
+        if (!gelf_getphdr(e, i, &phdr) || phdr.p_type != PT_LOAD || !(phdr.p_flags & PF_X))
+            continue;
+
+        size_t size;
+        char  *image = elf_rawfile(e, &size);
+        if (!image || phdr.p_offset + phdr.p_filesz > size)
+            continue;
+
+        s_elf_segment seg;
+        seg.vaddr = (uint32_t)phdr.p_vaddr;
+        seg.data.assign((uint8_t *)image + phdr.p_offset, (uint8_t *)image + phdr.p_offset + phdr.p_filesz);
+        info->code.push_back(seg);
+    }
+
+    s_dwarf_sections sec = { NULL, NULL, NULL };
+    Elf_Scn *scn = NULL;
+    while ((scn = elf_nextscn(e, scn)) != NULL)
+    {
+        GElf_Shdr shdr;
+        if (!gelf_getshdr(scn, &shdr))
+            continue;
+
+        const char *name = elf_strptr(e, shstrndx, shdr.sh_name);
+        if (!name)
+            continue;
+
+        if (!strcmp(name, ".debug_line"))
+            sec.line = elf_getdata(scn, NULL);
+        else if (!strcmp(name, ".debug_line_str"))
+            sec.line_str = elf_getdata(scn, NULL);
+        else if (!strcmp(name, ".debug_str"))
+            sec.str = elf_getdata(scn, NULL);
+        else if (shdr.sh_type == SHT_SYMTAB && shdr.sh_entsize)
+        {
+            Elf_Data *data = elf_getdata(scn, NULL);
+            int count = data ? shdr.sh_size / shdr.sh_entsize : 0;
+            for (int j=0;j<count;j++)
+            {
+                GElf_Sym sym;
+                if (!gelf_getsym(data, j, &sym) || sym.st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym.st_info) != STT_FUNC)
+                    continue;
+
+                const char *sym_name = elf_strptr(e, shdr.sh_link, sym.st_name);
+                if (!sym_name || !sym_name[0])
+                    continue;
+
+                s_elf_func func;
+                func.addr = (uint32_t)sym.st_value;
+                func.name = sym_name;
+                info->funcs.push_back(func);
+            }
+        }
+    }
+
+    bool ok = (sec.line != NULL);
+    if (ok)
+    {
+        s_dwarf_reader r = { (const uint8_t *)sec.line->d_buf, (const uint8_t *)sec.line->d_buf + sec.line->d_size, false };
+        while (ok && r.p < r.end)
+            ok = dwarf_unit(r, sec, info);
+    }
+
+    elf_end(e);
+    close(fd);
+    return ok;
+}
+
+//-----------------------------------------------------------------
+// write_lcov: Line (DA), branch (BRDA) and function (FN) records for
+// each source file in the line table. A line is hit when any of its
+// instructions executed. Each conditional branch is one block with
+// branch 0 = taken and branch 1 = not taken ('-' if never reached).
+//-----------------------------------------------------------------
+struct s_lcov_line
+{
+    bool                     hit;
+    std::map <uint32_t, int> branches;  // PC -> COVERAGE_XXX flags
+};
+
+struct s_lcov_file
+{
+    std::map <uint32_t, s_lcov_line >         lines;
+    std::map <std::string, std::pair <uint32_t, bool > > funcs;    // Name -> line, hit
+};
+
+bool Coverage::write_lcov(const char *filename, const char *elf, const char *test_name /*= NULL*/)
+{
+    s_elf_info info;
+    if (!elf_read_info(elf, &info))
+        return false;
+
+    std::map <std::string, s_lcov_file > report;
+
+    for (size_t i=0;i<info.ranges.size();i++)
+    {
+        const s_line_range &range = info.ranges[i];
+        s_lcov_line        &line  = report[info.files[range.file]].lines[range.line];
+
+        for (uint32_t pc = (range.start + 3) & ~3; pc < range.end && pc >= range.start; pc += 4)
+        {
+            int flags = test(pc);
+            line.hit |= (flags & COVERAGE_EXECUTED) != 0;
+
+            if ((info.opcode(pc) & 0x7f) == OPCODE_BRANCH)
+                line.branches[pc] = flags;
+        }
+    }
+
+    // Functions are placed at the line of their first instruction
+    for (size_t i=0;i<info.funcs.size();i++)
+    {
+        for (size_t j=0;j<info.ranges.size();j++)
+        {
+            const s_line_range &range = info.ranges[j];
+            if (info.funcs[i].addr >= range.start && info.funcs[i].addr < range.end)
+            {
+                bool hit = (test(info.funcs[i].addr) & COVERAGE_EXECUTED) != 0;
+                report[info.files[range.file]].funcs[info.funcs[i].name] = std::make_pair(range.line, hit);
+                break;
+            }
+        }
+    }
+
+    FILE *f = strcmp(filename, "-") ? fopen(filename, "w") : stdout;
+    if (!f)
+        return false;
+
+    for (std::map <std::string, s_lcov_file >::iterator it = report.begin(); it != report.end(); ++it)
+    {
+        s_lcov_file &file = it->second;
+
+        fprintf(f, "TN:%s\n", test_name ? test_name : "");
+        fprintf(f, "SF:%s\n", it->first.c_str());
+
+        int fn_hit = 0;
+        for (std::map <std::string, std::pair <uint32_t, bool > >::iterator fn = file.funcs.begin(); fn != file.funcs.end(); ++fn)
+            fprintf(f, "FN:%u,%s\n", fn->second.first, fn->first.c_str());
+        for (std::map <std::string, std::pair <uint32_t, bool > >::iterator fn = file.funcs.begin(); fn != file.funcs.end(); ++fn)
+        {
+            fprintf(f, "FNDA:%d,%s\n", fn->second.second ? 1 : 0, fn->first.c_str());
+            fn_hit += fn->second.second;
+        }
+        fprintf(f, "FNF:%d\n", (int)file.funcs.size());
+        fprintf(f, "FNH:%d\n", fn_hit);
+
+        int br_found = 0;
+        int br_hit   = 0;
+        for (std::map <uint32_t, s_lcov_line >::iterator line = file.lines.begin(); line != file.lines.end(); ++line)
+        {
+            int block = 0;
+            for (std::map <uint32_t, int>::iterator br = line->second.branches.begin(); br != line->second.branches.end(); ++br, ++block)
+            {
+                if (br->second & COVERAGE_EXECUTED)
+                {
+                    int taken     = (br->second & COVERAGE_TAKEN) ? 1 : 0;
+                    int not_taken = (br->second & COVERAGE_NOT_TAKEN) ? 1 : 0;
+                    fprintf(f, "BRDA:%u,%d,0,%d\n", line->first, block, taken);
+                    fprintf(f, "BRDA:%u,%d,1,%d\n", line->first, block, not_taken);
+                    br_hit += taken + not_taken;
+                }
+                else
+                {
+                    fprintf(f, "BRDA:%u,%d,0,-\n", line->first, block);
+                    fprintf(f, "BRDA:%u,%d,1,-\n", line->first, block);
+                }
+                br_found += 2;
+            }
+        }
+        fprintf(f, "BRF:%d\n", br_found);
+        fprintf(f, "BRH:%d\n", br_hit);
+
+        int line_hit = 0;
+        for (std::map <uint32_t, s_lcov_line >::iterator line = file.lines.begin(); line != file.lines.end(); ++line)
+        {
+            fprintf(f, "DA:%u,%d\n", line->first, line->second.hit ? 1 : 0);
+            line_hit += line->second.hit;
+        }
+        fprintf(f, "LF:%d\n", (int)file.lines.size());
+        fprintf(f, "LH:%d\n", line_hit);
+        fprintf(f, "end_of_record\n");
+    }
+
+    bool ok = !ferror(f);
+    if (f != stdout)
+        ok &= (fclose(f) == 0);
+    return ok;
+}
@@ -0,0 +1,175 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_COVERAGE_H__
+#define __RISCV_COVERAGE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+#define COVERAGE_PAGE_SHIFT     12
+#define COVERAGE_PAGES          (1 << (32 - COVERAGE_PAGE_SHIFT))
+#define COVERAGE_PAGE_WORDS     ((1 << (COVERAGE_PAGE_SHIFT - 2)) / 32)
+
+//--------------------------------------------------------------------
+// Coverage: executed PC bitmap and taken / not taken outcomes of each
+// conditional branch, per 4KB page of virtual addresses. Bits are only
+// ever set, so harts on different host threads can share one object
+// and data from several runs is merged with OR. Reports map PCs to
+// source lines through the ELF's DWARF line table.
+//--------------------------------------------------------------------
+class Coverage
+{
+public:
+    Coverage();
+    ~Coverage();
+
+    // Straight line run of 'count' instructions from 'pc'
+    void executed(uint32_t pc, int count = 1)
+    {
+        t_page  *page  = get_page(pc);
+        uint32_t index = (pc >> 2) & ((1 << (COVERAGE_PAGE_SHIFT - 2)) - 1);
+
+        // Blocks stay within a page
+        while (count > 0)
+        {
+            int      bit  = index % 32;
+            int      n    = (count < (32 - bit)) ? count : (32 - bit);
+            uint32_t mask = (n == 32) ? ~0u : (((1u << n) - 1) << bit);
+
+            set_bits(&page->executed[index / 32], mask);
+            index += n;
+            count -= n;
+        }
+    }
+
+    // Conditional branch at 'pc' resolved
+    void branch(uint32_t pc, bool taken)
+    {
+        t_page  *page  = get_page(pc);
+        uint32_t index = (pc >> 2) & ((1 << (COVERAGE_PAGE_SHIFT - 2)) - 1);
+
+        set_bits(taken ? &page->taken[index / 32] : &page->not_taken[index / 32], 1u << (index % 32));
+    }
+
+    // All of 'count' instructions from 'pc' already recorded
+    bool covered(uint32_t pc, int count)
+    {
+        t_page  *page  = m_pages[pc >> COVERAGE_PAGE_SHIFT].load(std::memory_order_acquire);
+        uint32_t index = (pc >> 2) & ((1 << (COVERAGE_PAGE_SHIFT - 2)) - 1);
+
+        while (page && count > 0)
+        {
+            int      bit  = index % 32;
+            int      n    = (count < (32 - bit)) ? count : (32 - bit);
+            uint32_t mask = (n == 32) ? ~0u : (((1u << n) - 1) << bit);
+
+            if ((page->executed[index / 32].load(std::memory_order_relaxed) & mask) != mask)
+                return false;
+            index += n;
+            count -= n;
+        }
+
+        return page != NULL;
+    }
+
+    // Word and bit recording one outcome of the branch at 'pc' (set by
+    // native code, which may chain on past the branch)
+    const std::atomic <uint32_t> *outcome(uint32_t pc, bool taken, uint32_t *mask)
+    {
+        t_page  *page  = get_page(pc);
+        uint32_t index = (pc >> 2) & ((1 << (COVERAGE_PAGE_SHIFT - 2)) - 1);
+
+        *mask = 1u << (index % 32);
+        return taken ? &page->taken[index / 32] : &page->not_taken[index / 32];
+    }
+
+    // Data files: OR into this / write (merge = OR with the file's
+    // contents under a lock, for parallel runs sharing one file)
+    bool        load(const char *filename);
+    bool        save(const char *filename, bool merge);
+
+    // lcov tracefile (line, branch and function records)
+    bool        write_lcov(const char *filename, const char *elf, const char *test_name = NULL);
+
+    // Executed PCs
+    uint64_t    get_executed(void);
+
+private:
+    typedef struct s_page
+    {
+        std::atomic <uint32_t> executed[COVERAGE_PAGE_WORDS];
+        std::atomic <uint32_t> taken[COVERAGE_PAGE_WORDS];
+        std::atomic <uint32_t> not_taken[COVERAGE_PAGE_WORDS];
+    } t_page;
+
+    t_page *get_page(uint32_t pc)
+    {
+        t_page *page = m_pages[pc >> COVERAGE_PAGE_SHIFT].load(std::memory_order_acquire);
+        return page ? page : alloc_page(pc >> COVERAGE_PAGE_SHIFT);
+    }
+
+    // Already set bits cost a load only
+    static void set_bits(std::atomic <uint32_t> *word, uint32_t mask)
+    {
+        if ((word->load(std::memory_order_relaxed) & mask) != mask)
+            word->fetch_or(mask, std::memory_order_relaxed);
+    }
+
+    t_page     *alloc_page(uint32_t index);
+    int         test(uint32_t pc);
+    bool        read_file(FILE *f);
+    bool        write_file(FILE *f);
+
+    std::atomic <t_page *> *m_pages;
+    std::mutex              m_alloc;
+};
+
+#endif
@@ -0,0 +1,188 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include "riscv_decode.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Level 1 key: major opcode [6:2] + funct3 [14:12]
+#define DECODE_L1_KEY_MASK      0x707c
+#define DECODE_L1_ENTRIES       256
+// Level 2 key: funct7 [31:25]
+#define DECODE_L2_KEY_MASK      0xfe000000
+#define DECODE_L2_ENTRIES       128
+#define DECODE_LIST_END         0xff
+
+static inline int decode_l1_key(uint32_t opcode)
+{
+    return ((opcode >> 2) & 0x1f) | (((opcode >> 12) & 0x7) << 5);
+}
+
+//-----------------------------------------------------------------
+// Instruction table
+//-----------------------------------------------------------------
+#define RISCV_INST(inst, enc, mnemonic, format, handler) \
+    { INST_ ##enc, INST_ ##enc ##_MASK, ENUM_INST_ ##inst, format, 0, mnemonic },
+
+static t_inst_desc decode_table[] = 
+{
+    RISCV_INST_TABLE(RISCV_INST)
+};
+
+#undef RISCV_INST
+
+#define DECODE_ROWS     ((int)(sizeof(decode_table) / sizeof(decode_table[0])))
+
+//-----------------------------------------------------------------
+// Two level index over decode_table:
+// level 1 selects on opcode / funct3, buckets holding more than one
+// candidate are split again on funct7. Each leaf is a short list of
+// rows (in table order) which are confirmed with the full mask.
+//-----------------------------------------------------------------
+class DecodeIndex
+{
+public:
+    DecodeIndex()
+    {
+        for (int r=0;r<DECODE_ROWS;r++)
+            decode_table[r].row = r;
+
+        for (int key=0;key<DECODE_L1_ENTRIES;key++)
+        {
+            uint32_t l1 = ((key & 0x1f) << 2) | ((key >> 5) << 12) | 3;
+
+            std::vector<int> rows;
+            for (int r=0;r<DECODE_ROWS;r++)
+                if (((l1 ^ decode_table[r].match) & decode_table[r].mask & (DECODE_L1_KEY_MASK | 3)) == 0)
+                    rows.push_back(r);
+
+            if (rows.size() <= 1)
+            {
+                m_l1[key] = add_list(rows, 0, 0);
+                continue;
+            }
+
+            // Split on funct7
+            m_l1[key] = -1 - (int)(m_l2.size() / DECODE_L2_ENTRIES);
+            for (int f7=0;f7<DECODE_L2_ENTRIES;f7++)
+                m_l2.push_back(add_list(rows, (uint32_t)f7 << 25, DECODE_L2_KEY_MASK));
+        }
+    }
+
+    const t_inst_desc *lookup(uint32_t opcode) const
+    {
+        // As RVC is not supported, only 32-bit encodings decode
+        if ((opcode & 3) != 3)
+            return NULL;
+
+        int list = m_l1[decode_l1_key(opcode)];
+        if (list < 0)
+            list = m_l2[(-1 - list) * DECODE_L2_ENTRIES + (opcode >> 25)];
+
+        for (const uint8_t *r = &m_rows[list]; *r != DECODE_LIST_END; r++)
+            if ((opcode & decode_table[*r].mask) == decode_table[*r].match)
+                return &decode_table[*r];
+
+        return NULL;
+    }
+
+private:
+    int add_list(const std::vector<int> &rows, uint32_t key, uint32_t key_mask)
+    {
+        int list = (int)m_rows.size();
+        for (size_t i=0;i<rows.size();i++)
+            if (((key ^ decode_table[rows[i]].match) & decode_table[rows[i]].mask & key_mask) == 0)
+                m_rows.push_back(rows[i]);
+        m_rows.push_back(DECODE_LIST_END);
+        return list;
+    }
+
+private:
+    int                  m_l1[DECODE_L1_ENTRIES];
+    std::vector<int>     m_l2;
+    std::vector<uint8_t> m_rows;
+};
+
+//-----------------------------------------------------------------
+// riscv_decode_lookup: Find the table entry for an opcode (NULL if
+// the opcode is not a supported instruction)
+//-----------------------------------------------------------------
+const t_inst_desc * riscv_decode_lookup(uint32_t opcode)
+{
+    static const DecodeIndex index;
+    return index.lookup(opcode);
+}
+//-----------------------------------------------------------------
+// riscv_decode_imm: Extract the immediate used by an instruction
+//-----------------------------------------------------------------
+int32_t riscv_decode_imm(const t_inst_desc *desc, uint32_t opcode)
+{
+    switch (desc->format)
+    {
+    case FMT_I:
+    case FMT_JALR:
+    case FMT_LOAD:
+    case FMT_CSR:
+    case FMT_CSRI:
+        return ((int32_t)(opcode & OPCODE_TYPEI_IMM_MASK)) >> OPCODE_TYPEI_IMM_SHIFT;
+    case FMT_SHIFT:
+        return ((int32_t)(opcode & OPCODE_SHAMT_MASK)) >> OPCODE_SHAMT_SHIFT;
+    case FMT_U:
+        return (int32_t)(opcode & OPCODE_TYPEU_IMM_MASK);
+    case FMT_J:
+        return OPCODE_UJTYPE_IMM(opcode);
+    case FMT_B:
+        return OPCODE_SBTYPE_IMM(opcode);
+    case FMT_STORE:
+        return OPCODE_STYPE_IMM(opcode);
+    default:
+        return 0;
+    }
+}
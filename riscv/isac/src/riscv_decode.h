@@ -0,0 +1,173 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_DECODE_H__
+#define __RISCV_DECODE_H__
+
+#include <stdint.h>
+#include "riscv_isa.h"
+
+//--------------------------------------------------------------------
+// Operand formats (disassembly layout and immediate selection)
+//--------------------------------------------------------------------
+enum eInstFormat
+{
+    FMT_NONE,       // mnemonic only
+    FMT_R,          // rd, rs1, rs2
+    FMT_I,          // rd, rs1, imm12
+    FMT_SHIFT,      // rd, rs1, shamt
+    FMT_U,          // rd, imm20
+    FMT_J,          // rd, jimm20
+    FMT_JALR,       // rs1, imm12
+    FMT_B,          // rs1, rs2, bimm
+    FMT_LOAD,       // rd, imm12(rs1)
+    FMT_STORE,      // storeimm(rs1), rs2
+    FMT_CSR,        // rd, rs1, csr
+    FMT_CSRI,       // rd, uimm, csr
+    FMT_LR,         // rd, (rs1)
+    FMT_AMO         // rd, rs2, (rs1)
+};
+
+//--------------------------------------------------------------------
+// Instruction table:
+// RISCV_INST(enum, encoding, mnemonic, format, handler)
+//   enum     - ENUM_INST_<enum>
+//   encoding - INST_<encoding> / INST_<encoding>_MASK
+//   handler  - Riscv::<handler>
+// Rows are matched in order, so more specific encodings come first.
+//--------------------------------------------------------------------
+#define RISCV_INST_TABLE(RISCV_INST) \
+    RISCV_INST(ANDI,      ANDI,      "andi",      FMT_I,     exec_andi) \
+    RISCV_INST(ORI,       ORI,       "ori",       FMT_I,     exec_ori) \
+    RISCV_INST(XORI,      XORI,      "xori",      FMT_I,     exec_xori) \
+    RISCV_INST(ADDI,      ADDI,      "addi",      FMT_I,     exec_addi) \
+    RISCV_INST(SLTI,      SLTI,      "slti",      FMT_I,     exec_slti) \
+    RISCV_INST(SLTIU,     SLTIU,     "sltiu",     FMT_I,     exec_sltiu) \
+    RISCV_INST(SLLI,      SLLI,      "slli",      FMT_SHIFT, exec_slli) \
+    RISCV_INST(SRLI,      SRLI,      "srli",      FMT_SHIFT, exec_srli) \
+    RISCV_INST(SRAI,      SRAI,      "srai",      FMT_SHIFT, exec_srai) \
+    RISCV_INST(LUI,       LUI,       "lui",       FMT_U,     exec_lui) \
+    RISCV_INST(AUIPC,     AUIPC,     "auipc",     FMT_U,     exec_auipc) \
+    RISCV_INST(ADD,       ADD,       "add",       FMT_R,     exec_add) \
+    RISCV_INST(SUB,       SUB,       "sub",       FMT_R,     exec_sub) \
+    RISCV_INST(SLT,       SLT,       "slt",       FMT_R,     exec_slt) \
+    RISCV_INST(SLTU,      SLTU,      "sltu",      FMT_R,     exec_sltu) \
+    RISCV_INST(XOR,       XOR,       "xor",       FMT_R,     exec_xor) \
+    RISCV_INST(OR,        OR,        "or",        FMT_R,     exec_or) \
+    RISCV_INST(AND,       AND,       "and",       FMT_R,     exec_and) \
+    RISCV_INST(SLL,       SLL,       "sll",       FMT_R,     exec_sll) \
+    RISCV_INST(SRL,       SRL,       "srl",       FMT_R,     exec_srl) \
+    RISCV_INST(SRA,       SRA,       "sra",       FMT_R,     exec_sra) \
+    RISCV_INST(JAL,       JAL,       "jal",       FMT_J,     exec_jal) \
+    RISCV_INST(JALR,      JALR,      "jalr",      FMT_JALR,  exec_jalr) \
+    RISCV_INST(BEQ,       BEQ,       "beq",       FMT_B,     exec_beq) \
+    RISCV_INST(BNE,       BNE,       "bne",       FMT_B,     exec_bne) \
+    RISCV_INST(BLT,       BLT,       "blt",       FMT_B,     exec_blt) \
+    RISCV_INST(BGE,       BGE,       "bge",       FMT_B,     exec_bge) \
+    RISCV_INST(BLTU,      BLTU,      "bltu",      FMT_B,     exec_bltu) \
+    RISCV_INST(BGEU,      BGEU,      "bgeu",      FMT_B,     exec_bgeu) \
+    RISCV_INST(LB,        LB,        "lb",        FMT_LOAD,  exec_lb) \
+    RISCV_INST(LH,        LH,        "lh",        FMT_LOAD,  exec_lh) \
+    RISCV_INST(LW,        LW,        "lw",        FMT_LOAD,  exec_lw) \
+    RISCV_INST(LBU,       LBU,       "lbu",       FMT_LOAD,  exec_lbu) \
+    RISCV_INST(LHU,       LHU,       "lhu",       FMT_LOAD,  exec_lhu) \
+    RISCV_INST(LWU,       LWU,       "lwu",       FMT_LOAD,  exec_lwu) \
+    RISCV_INST(SB,        SB,        "sb",        FMT_STORE, exec_sb) \
+    RISCV_INST(SH,        SH,        "sh",        FMT_STORE, exec_sh) \
+    RISCV_INST(SW,        SW,        "sw",        FMT_STORE, exec_sw) \
+    RISCV_INST(MUL,       MUL,       "mul",       FMT_R,     exec_mul) \
+    RISCV_INST(MULH,      MULH,      "mulh",      FMT_R,     exec_mulh) \
+    RISCV_INST(MULHSU,    MULHSU,    "mulhsu",    FMT_R,     exec_mulhsu) \
+    RISCV_INST(MULHU,     MULHU,     "mulhu",     FMT_R,     exec_mulhu) \
+    RISCV_INST(DIV,       DIV,       "div",       FMT_R,     exec_div) \
+    RISCV_INST(DIVU,      DIVU,      "divu",      FMT_R,     exec_divu) \
+    RISCV_INST(REM,       REM,       "rem",       FMT_R,     exec_rem) \
+    RISCV_INST(REMU,      REMU,      "remu",      FMT_R,     exec_remu) \
+    RISCV_INST(ECALL,     ECALL,     "ecall",     FMT_NONE,  exec_ecall) \
+    RISCV_INST(EBREAK,    EBREAK,    "ebreak",    FMT_NONE,  exec_ebreak) \
+    RISCV_INST(MRET,      MRET,      "mret",      FMT_NONE,  exec_mret) \
+    RISCV_INST(SRET,      SRET,      "sret",      FMT_NONE,  exec_sret) \
+    RISCV_INST(FENCE,     IFENCE,    "fence",     FMT_NONE,  exec_fence_i) \
+    RISCV_INST(FENCE,     SFENCE,    "sfence",    FMT_NONE,  exec_sfence) \
+    RISCV_INST(FENCE,     FENCE,     "fence",     FMT_NONE,  exec_fence) \
+    RISCV_INST(CSRRW,     CSRRW,     "csrw",      FMT_CSR,   exec_csrrw) \
+    RISCV_INST(CSRRS,     CSRRS,     "csrs",      FMT_CSR,   exec_csrrs) \
+    RISCV_INST(CSRRC,     CSRRC,     "csrc",      FMT_CSR,   exec_csrrc) \
+    RISCV_INST(CSRRWI,    CSRRWI,    "csrwi",     FMT_CSRI,  exec_csrrwi) \
+    RISCV_INST(CSRRSI,    CSRRSI,    "csrsi",     FMT_CSRI,  exec_csrrsi) \
+    RISCV_INST(CSRRCI,    CSRRCI,    "csrci",     FMT_CSRI,  exec_csrrci) \
+    RISCV_INST(WFI,       WFI,       "wfi",       FMT_NONE,  exec_wfi) \
+    RISCV_INST(LR_W,      LR_W,      "lr.w",      FMT_LR,    exec_lr_w) \
+    RISCV_INST(SC_W,      SC_W,      "sc.w",      FMT_AMO,   exec_sc_w) \
+    RISCV_INST(AMOSWAP_W, AMOSWAP_W, "amoswap.w", FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOADD_W,  AMOADD_W,  "amoadd.w",  FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOXOR_W,  AMOXOR_W,  "amoxor.w",  FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOAND_W,  AMOAND_W,  "amoand.w",  FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOOR_W,   AMOOR_W,   "amoor.w",   FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOMIN_W,  AMOMIN_W,  "amomin.w",  FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOMAX_W,  AMOMAX_W,  "amomax.w",  FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOMINU_W, AMOMINU_W, "amominu.w", FMT_AMO,   exec_amo_w) \
+    RISCV_INST(AMOMAXU_W, AMOMAXU_W, "amomaxu.w", FMT_AMO,   exec_amo_w)
+
+//--------------------------------------------------------------------
+// Decode table entry
+//--------------------------------------------------------------------
+typedef struct s_inst_desc
+{
+    uint32_t            match;
+    uint32_t            mask;
+    uint8_t             inst;       // ENUM_INST_XXX
+    uint8_t             format;     // FMT_XXX
+    uint16_t            row;        // Position in RISCV_INST_TABLE
+    const char *        mnemonic;
+} t_inst_desc;
+
+//--------------------------------------------------------------------
+// Prototypes:
+//--------------------------------------------------------------------
+const t_inst_desc * riscv_decode_lookup(uint32_t opcode);
+int32_t             riscv_decode_imm(const t_inst_desc *desc, uint32_t opcode);
+
+#endif
@@ -0,0 +1,514 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "riscv_device.h"
+#include "riscv.h"
+
+//-----------------------------------------------------------------
+// Register access helpers: registers are 32-bit, narrower accesses
+// select the addressed bytes.
+//-----------------------------------------------------------------
+static uint32_t reg_load(uint32_t reg, uint32_t address, int width, bool signedLoad)
+{
+    uint32_t data = reg >> ((address & 3) * 8);
+
+    switch (width)
+    {
+        case 2:
+            data &= 0xFFFF;
+            if (signedLoad && (data & 0x8000))
+                data |= 0xFFFF0000;
+        break;
+        case 1:
+            data &= 0xFF;
+            if (signedLoad && (data & 0x80))
+                data |= 0xFFFFFF00;
+        break;
+    }
+
+    return data;
+}
+static uint32_t reg_store(uint32_t address, uint32_t data, int width)
+{
+    if (width < 4)
+        data &= (1 << (width * 8)) - 1;
+
+    return data << ((address & 3) * 8);
+}
+
+//-----------------------------------------------------------------
+// UartDevice
+//-----------------------------------------------------------------
+UartDevice::UartDevice(IConsoleIO *console /*= NULL*/)
+{
+    m_console   = console;
+    m_input_pos = 0;
+    reset();
+}
+//-----------------------------------------------------------------
+// set_input: Load characters to receive from a file
+//-----------------------------------------------------------------
+bool UartDevice::set_input(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return false;
+
+    char   buf[4096];
+    size_t len;
+
+    m_input.clear();
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+        m_input.append(buf, len);
+    fclose(f);
+
+    m_input_pos = 0;
+    evaluate();
+    return true;
+}
+//-----------------------------------------------------------------
+// reset: Register reset values (uart_registers.v)
+//-----------------------------------------------------------------
+void UartDevice::reset(void)
+{
+    m_now       = 0;
+    m_baud      = UART_BAUD_CFG;
+    m_control   = 0;
+    m_reset_cpu = 0;
+    m_ier       = 0;
+    m_isr       = 0;
+    m_tx_last   = 0;
+    m_tx_count  = 0;
+    m_tx_time   = 0;
+    m_rx_rd     = 0;
+    m_rx_count  = 0;
+    m_rx_time   = 0;
+    m_rx_next   = -1;
+    evaluate();
+}
+//-----------------------------------------------------------------
+// char_time: Ticks per character (16x oversampled bit clock, start,
+// 8 data, optional parity and stop bit)
+//-----------------------------------------------------------------
+uint64_t UartDevice::char_time(void)
+{
+    int bits = (m_control & 4) ? 11 : 10;
+    uint64_t baud = m_baud ? m_baud : 1;
+
+    return 16 * baud * bits;
+}
+//-----------------------------------------------------------------
+// status: UART_STATUS (bbfifo_16x8 flags are exact occupancies)
+//-----------------------------------------------------------------
+uint32_t UartDevice::status(void)
+{
+    uint32_t status = 0;
+
+    if (m_tx_count == 1)                   status |= UART_STATUS_TX_AEMPTY;
+    if (m_tx_count == UART_FIFO_DEPTH - 1) status |= UART_STATUS_TX_AFULL;
+    if (m_tx_count == UART_FIFO_DEPTH / 2) status |= UART_STATUS_TX_HFULL;
+    if (m_tx_count == UART_FIFO_DEPTH)     status |= UART_STATUS_TX_FULL;
+    if (m_rx_count == 1)                   status |= UART_STATUS_RX_AEMPTY;
+    if (m_rx_count == UART_FIFO_DEPTH - 1) status |= UART_STATUS_RX_AFULL;
+    if (m_rx_count == UART_FIFO_DEPTH / 2) status |= UART_STATUS_RX_HFULL;
+    if (m_rx_count == UART_FIFO_DEPTH)     status |= UART_STATUS_RX_FULL;
+    if (m_rx_count != 0)                   status |= UART_STATUS_RX_PRESENT;
+
+    return status;
+}
+//-----------------------------------------------------------------
+// rx_source: Next character to receive (input file, then console)
+//-----------------------------------------------------------------
+bool UartDevice::rx_source(int *ch)
+{
+    if (m_input_pos < m_input.size())
+    {
+        *ch = (uint8_t)m_input[m_input_pos++];
+        return true;
+    }
+
+    if (m_console)
+    {
+        int c = m_console->getchar();
+        if (c >= 0)
+        {
+            *ch = c & 0xFF;
+            return true;
+        }
+    }
+
+    return false;
+}
+//-----------------------------------------------------------------
+// rx_push: Character received into the RX FIFO
+//-----------------------------------------------------------------
+void UartDevice::rx_push(uint8_t ch)
+{
+    // Interrupt on the rising edge of rx_buffer_data_present
+    if (m_rx_count == 0)
+        m_isr |= UART_INT_RX_PRESENT;
+
+    m_rx_fifo[(m_rx_rd + m_rx_count) % UART_FIFO_DEPTH] = ch;
+    m_rx_count++;
+}
+//-----------------------------------------------------------------
+// update: Drain the TX FIFO and receive characters up to 'now'
+//-----------------------------------------------------------------
+void UartDevice::update(uint64_t now)
+{
+    uint64_t last = m_now;
+    uint64_t t    = char_time();
+
+    m_now = now;
+
+    if (m_tx_count)
+    {
+        uint64_t sent = (now - m_tx_time) / t;
+
+        if (sent >= (uint64_t)m_tx_count)
+            m_tx_count = 0;
+        else
+        {
+            m_tx_count -= (int)sent;
+            m_tx_time  += sent * t;
+        }
+    }
+
+    // Characters arrive back to back, or one character time after
+    // the line was last seen idle.
+    while (m_rx_count < UART_FIFO_DEPTH)
+    {
+        if (m_rx_next < 0)
+        {
+            int ch;
+
+            if (!rx_source(&ch))
+                break;
+
+            m_rx_next = ch;
+            m_rx_time = ((m_rx_time > last) ? m_rx_time : last) + t;
+        }
+
+        if (m_rx_time > now)
+            break;
+
+        rx_push(m_rx_next);
+        m_rx_next = -1;
+    }
+
+    evaluate();
+}
+//-----------------------------------------------------------------
+// evaluate: Interrupt output and next event
+//-----------------------------------------------------------------
+void UartDevice::evaluate(void)
+{
+    m_irq = (m_ier & m_isr) != 0;
+
+    if (m_rx_count == UART_FIFO_DEPTH)
+        m_next_event = DEVICE_NO_EVENT;
+    // Character on the line
+    else if (m_rx_next >= 0)
+        m_next_event = m_rx_time;
+    // More input to start receiving, poll the console each character time
+    else if (m_input_pos < m_input.size())
+        m_next_event = m_now;
+    else if (m_console)
+        m_next_event = m_now + char_time();
+    else
+        m_next_event = DEVICE_NO_EVENT;
+}
+//-----------------------------------------------------------------
+// load: Register read
+//-----------------------------------------------------------------
+uint32_t UartDevice::load(uint32_t address, int width, bool signedLoad)
+{
+    uint32_t data = 0;
+
+    switch (address & 0xFC)
+    {
+        case UART_BAUD:
+            data = m_baud;
+        break;
+        case UART_CONTROL:
+            data = m_control;
+        break;
+        case UART_STATUS:
+            data = status();
+        break;
+        case UART_TXDATA:
+            data = m_tx_last;
+        break;
+        case UART_RXDATA:
+            // Status before the read, then pop
+            data = ((status() >> 4) << 8);
+            if (m_rx_count)
+            {
+                data |= m_rx_fifo[m_rx_rd];
+                m_rx_rd = (m_rx_rd + 1) % UART_FIFO_DEPTH;
+                m_rx_count--;
+            }
+        break;
+        case UART_RSTCPU:
+            data = m_reset_cpu;
+        break;
+        case UART_IER:
+            data = m_ier;
+        break;
+        case UART_ISR:
+            data = m_isr;
+        break;
+    }
+
+    evaluate();
+    return reg_load(data, address, width, signedLoad);
+}
+//-----------------------------------------------------------------
+// store: Register write
+//-----------------------------------------------------------------
+void UartDevice::store(uint32_t address, uint32_t data, int width)
+{
+    data = reg_store(address, data, width);
+
+    switch (address & 0xFC)
+    {
+        case UART_BAUD:
+            m_baud = data & 0xFFFF;
+        break;
+        case UART_CONTROL:
+            m_control = data & 0x7;
+        break;
+        case UART_TXDATA:
+            m_tx_last = data & 0xFF;
+
+            // Full FIFO drops the write
+            if (m_tx_count == UART_FIFO_DEPTH)
+                break;
+
+            if (m_tx_count++ == 0)
+                m_tx_time = m_now;
+
+            // Interrupt on the rising edge of tx_buffer_full
+            if (m_tx_count == UART_FIFO_DEPTH)
+                m_isr |= UART_INT_TX_FULL;
+
+            if (m_console)
+                m_console->putchar(m_tx_last);
+            else
+                fprintf(stderr, "%c", m_tx_last);
+        break;
+        case UART_RSTCPU:
+            m_reset_cpu = data & 1;
+        break;
+        case UART_RSTBUF:
+            if (data & 1)
+            {
+                m_tx_count = 0;
+                m_rx_count = 0;
+                m_rx_rd    = 0;
+            }
+        break;
+        case UART_IER:
+            m_ier = data & (UART_INT_RX_PRESENT | UART_INT_TX_FULL);
+        break;
+        case UART_ISR:
+            m_isr &= ~data;
+        break;
+    }
+
+    evaluate();
+}
+
+//-----------------------------------------------------------------
+// TimerDevice
+//-----------------------------------------------------------------
+TimerDevice::TimerDevice()
+{
+    reset();
+}
+//-----------------------------------------------------------------
+// reset: Disabled, all registers zero
+//-----------------------------------------------------------------
+void TimerDevice::reset(void)
+{
+    m_now      = 0;
+    m_ctrl     = 0;
+    m_status   = 0;
+    m_load     = 0;
+    m_prescale = 0;
+    m_count    = 0;
+    m_start    = 0;
+    evaluate();
+}
+//-----------------------------------------------------------------
+// value: Current count
+//-----------------------------------------------------------------
+uint32_t TimerDevice::value(void)
+{
+    if (!(m_ctrl & TIMER_CTRL_ENABLE))
+        return m_count;
+
+    uint64_t elapsed = (m_now - m_start) / ((uint64_t)m_prescale + 1);
+    return (elapsed >= m_count) ? 0 : (uint32_t)(m_count - elapsed);
+}
+//-----------------------------------------------------------------
+// start: Count down from 'count' now
+//-----------------------------------------------------------------
+void TimerDevice::start(uint32_t count)
+{
+    m_count = count;
+    m_start = m_now;
+}
+//-----------------------------------------------------------------
+// update: Expire (and reload) up to 'now', time may have jumped
+// over any number of periods.
+//-----------------------------------------------------------------
+void TimerDevice::update(uint64_t now)
+{
+    m_now = now;
+
+    if (m_next_event <= now)
+    {
+        uint64_t scale = (uint64_t)m_prescale + 1;
+        uint64_t expiry = m_next_event;
+
+        m_status |= TIMER_STATUS_EXPIRED;
+
+        if ((m_ctrl & TIMER_CTRL_PERIODIC) && m_load)
+        {
+            uint64_t period = m_load * scale;
+
+            m_count = m_load;
+            m_start = expiry + ((now - expiry) / period) * period;
+        }
+        else
+            start(0);
+    }
+
+    evaluate();
+}
+//-----------------------------------------------------------------
+// evaluate: Interrupt output and next expiry
+//-----------------------------------------------------------------
+void TimerDevice::evaluate(void)
+{
+    m_irq = (m_ctrl & TIMER_CTRL_IRQ_ENABLE) && (m_status & TIMER_STATUS_EXPIRED);
+
+    if ((m_ctrl & TIMER_CTRL_ENABLE) && m_count)
+        m_next_event = m_start + m_count * ((uint64_t)m_prescale + 1);
+    else
+        m_next_event = DEVICE_NO_EVENT;
+}
+//-----------------------------------------------------------------
+// load: Register read
+//-----------------------------------------------------------------
+uint32_t TimerDevice::load(uint32_t address, int width, bool signedLoad)
+{
+    uint32_t data = 0;
+
+    switch (address & 0xFC)
+    {
+        case TIMER_CTRL:
+            data = m_ctrl;
+        break;
+        case TIMER_STATUS:
+            data = m_status;
+        break;
+        case TIMER_LOAD:
+            data = m_load;
+        break;
+        case TIMER_VALUE:
+            data = value();
+        break;
+        case TIMER_PRESCALE:
+            data = m_prescale;
+        break;
+    }
+
+    return reg_load(data, address, width, signedLoad);
+}
+//-----------------------------------------------------------------
+// store: Register write
+//-----------------------------------------------------------------
+void TimerDevice::store(uint32_t address, uint32_t data, int width)
+{
+    data = reg_store(address, data, width);
+
+    switch (address & 0xFC)
+    {
+        case TIMER_CTRL:
+        {
+            bool was_enabled = (m_ctrl & TIMER_CTRL_ENABLE) != 0;
+
+            // Stopping freezes the count, starting (re)loads it
+            if (was_enabled && !(data & TIMER_CTRL_ENABLE))
+                m_count = value();
+
+            m_ctrl = data & (TIMER_CTRL_ENABLE | TIMER_CTRL_IRQ_ENABLE | TIMER_CTRL_PERIODIC);
+
+            if (!was_enabled && (m_ctrl & TIMER_CTRL_ENABLE))
+                start(m_load);
+        }
+        break;
+        case TIMER_STATUS:
+            m_status &= ~data;
+        break;
+        case TIMER_LOAD:
+            m_load = data;
+        break;
+        case TIMER_VALUE:
+            start(data);
+        break;
+        case TIMER_PRESCALE:
+            // Continue counting from the current value at the new rate
+            start(value());
+            m_prescale = data;
+        break;
+    }
+
+    evaluate();
+}
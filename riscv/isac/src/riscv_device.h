@@ -0,0 +1,220 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_DEVICE_H__
+#define __RISCV_DEVICE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include "memory.h"
+
+class IConsoleIO;
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+#define DEVICE_NO_EVENT         (~(uint64_t)0)
+
+// soc/uart (uart_defines.v)
+#define UART_BASEADDR           0x91000000
+#define UART_SIZE               0x100
+#define UART_FIFO_DEPTH         16          // bbfifo_16x8
+#define UART_BAUD_CFG           54          // 100MHz / (16 * 115200)
+
+#define UART_BAUD               0x00
+#define UART_CONTROL            0x04
+#define UART_STATUS             0x08
+#define UART_TXDATA             0x0c
+#define UART_RXDATA             0x10
+#define UART_RSTCPU             0x14
+#define UART_RSTBUF             0x20
+#define UART_IER                0x24
+#define UART_ISR                0x28
+
+#define UART_STATUS_TX_AEMPTY   (1 << 0)
+#define UART_STATUS_TX_AFULL    (1 << 1)
+#define UART_STATUS_TX_HFULL    (1 << 2)
+#define UART_STATUS_TX_FULL     (1 << 3)
+#define UART_STATUS_RX_AEMPTY   (1 << 4)
+#define UART_STATUS_RX_AFULL    (1 << 5)
+#define UART_STATUS_RX_HFULL    (1 << 6)
+#define UART_STATUS_RX_FULL     (1 << 7)
+#define UART_STATUS_RX_PRESENT  (1 << 8)
+
+#define UART_INT_RX_PRESENT     (1 << 0)
+#define UART_INT_TX_FULL        (1 << 1)
+
+// General purpose timer (no RTL counterpart)
+#define TIMER_BASEADDR          0x92000000
+#define TIMER_SIZE              0x100
+
+#define TIMER_CTRL              0x00
+#define TIMER_STATUS            0x04
+#define TIMER_LOAD              0x08
+#define TIMER_VALUE             0x0c
+#define TIMER_PRESCALE          0x10
+
+#define TIMER_CTRL_ENABLE       (1 << 0)
+#define TIMER_CTRL_IRQ_ENABLE   (1 << 1)
+#define TIMER_CTRL_PERIODIC     (1 << 2)
+
+#define TIMER_STATUS_EXPIRED    (1 << 0)
+
+//--------------------------------------------------------------------
+// Device: Memory mapped peripheral attached with Riscv::attach_device().
+// Time is the core timer (mtime, one tick per instruction). The CPU
+// calls update() with the current time before every register access
+// and when the time reaches get_next_event(), so models only need to
+// bring their state up to 'now' lazily instead of ticking.
+//--------------------------------------------------------------------
+class Device: public Memory
+{
+public:
+                        Device(): m_now(0), m_irq(false), m_next_event(DEVICE_NO_EVENT) { }
+
+    virtual const char *get_name(void) = 0;
+
+    // Advance to 'now', update m_irq / m_next_event
+    virtual void        update(uint64_t now) { m_now = now; }
+
+    // Level sensitive interrupt, routed to the external interrupt (MEIP)
+    bool                get_irq(void)        { return m_irq; }
+
+    // Time at which state changes without a register access
+    uint64_t            get_next_event(void) { return m_next_event; }
+
+protected:
+    uint64_t            m_now;
+    bool                m_irq;
+    uint64_t            m_next_event;
+};
+
+//--------------------------------------------------------------------
+// UartDevice: Register model of soc/uart in slave mode (uart_registers.v)
+// TX characters go to the console, RX characters come from an input
+// file then the console. Both FIFOs move one character per character
+// time derived from the baud configuration.
+//--------------------------------------------------------------------
+class UartDevice: public Device
+{
+public:
+                        UartDevice(IConsoleIO *console = NULL);
+
+    // Characters to receive (before any from the console)
+    bool                set_input(const char *filename);
+
+    const char *        get_name(void) { return "uart"; }
+    void                reset(void);
+    void                update(uint64_t now);
+    uint32_t            load(uint32_t address, int width, bool signedLoad);
+    void                store(uint32_t address, uint32_t data, int width);
+
+private:
+    uint64_t            char_time(void);
+    uint32_t            status(void);
+    bool                rx_source(int *ch);
+    void                rx_push(uint8_t ch);
+    void                evaluate(void);
+
+    IConsoleIO         *m_console;
+    std::string         m_input;
+    size_t              m_input_pos;
+
+    uint32_t            m_baud;
+    uint32_t            m_control;
+    uint32_t            m_reset_cpu;
+    uint32_t            m_ier;
+    uint32_t            m_isr;
+    uint8_t             m_tx_last;
+
+    // TX FIFO occupancy, drains from m_tx_time
+    int                 m_tx_count;
+    uint64_t            m_tx_time;
+
+    // RX FIFO, next character arrives at m_rx_time
+    uint8_t             m_rx_fifo[UART_FIFO_DEPTH];
+    int                 m_rx_rd;
+    int                 m_rx_count;
+    uint64_t            m_rx_time;
+    int                 m_rx_next;          // Character waiting for FIFO space (-1 none)
+};
+
+//--------------------------------------------------------------------
+// TimerDevice: Down counter with prescaler, one shot or periodic
+//
+// CTRL     [0] enable, [1] interrupt enable, [2] periodic (reload)
+// STATUS   [0] expired (write 1 to clear)
+// LOAD     Reload value, written to VALUE when enabled / reloaded
+// VALUE    Current count (ticks / (PRESCALE + 1))
+// PRESCALE Prescaler
+//--------------------------------------------------------------------
+class TimerDevice: public Device
+{
+public:
+                        TimerDevice();
+
+    const char *        get_name(void) { return "timer"; }
+    void                reset(void);
+    void                update(uint64_t now);
+    uint32_t            load(uint32_t address, int width, bool signedLoad);
+    void                store(uint32_t address, uint32_t data, int width);
+
+private:
+    uint32_t            value(void);
+    void                start(uint32_t count);
+    void                evaluate(void);
+
+    uint32_t            m_ctrl;
+    uint32_t            m_status;
+    uint32_t            m_load;
+    uint32_t            m_prescale;
+
+    // Counting down from m_count at m_start (while enabled)
+    uint32_t            m_count;
+    uint64_t            m_start;
+};
+
+#endif
@@ -0,0 +1,364 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "riscv.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define DPRINTF(l,a)        do { if (m_trace & l) printf a; } while (0)
+
+#define HLE_REG_RA          1
+#define HLE_REG_A0          10
+#define HLE_REG_A1          11
+#define HLE_REG_A2          12
+
+static const char *hle_names[HLE_MAX] =
+{
+    "memcpy",   // HLE_MEMCPY
+    "memset",   // HLE_MEMSET
+    "strlen",   // HLE_STRLEN
+    "memcmp"    // HLE_MEMCMP
+};
+
+//-----------------------------------------------------------------
+// set_hle: Emulate 'routine' natively when entered at 'pc' (virtual),
+// false if the routine is not supported
+//-----------------------------------------------------------------
+bool Riscv::set_hle(const char *routine, uint32_t pc)
+{
+    int id;
+    for (id=0;id<HLE_MAX;id++)
+        if (!strcmp(routine, hle_names[id]))
+            break;
+
+    if (id == HLE_MAX || (pc & 3))
+        return false;
+
+    m_hle_routines[pc] = id;
+    m_hle_entries.set(pc);
+    m_has_hle = true;
+
+    // Blocks covering the entry must end there
+    flush_blocks();
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_hle(routine, pc);
+
+    return true;
+}
+//-----------------------------------------------------------------
+// set_hle_cost: Instructions charged per emulated call, plus per
+// 32-bit word processed
+//-----------------------------------------------------------------
+void Riscv::set_hle_cost(int call_cost, int word_cost)
+{
+    m_hle_call_cost = call_cost;
+    m_hle_word_cost = word_cost;
+
+    for (size_t i=1;i<m_harts.size();i++)
+        m_harts[i]->set_hle_cost(call_cost, word_cost);
+}
+//-----------------------------------------------------------------
+// hle_execute: Run the routine at 'pc' natively and return to ra.
+// Falls back to the target instruction at 'pc' when the routine cannot
+// be emulated exactly (an access would fault, is not RAM or is watched,
+// or retired instructions are being recorded).
+//-----------------------------------------------------------------
+int Riscv::hle_execute(const t_decoded_inst *inst, uint32_t pc)
+{
+    std::map <uint32_t, int >::iterator it = m_hle_routines.find(pc);
+    uint32_t a0     = m_gpr[HLE_REG_A0];
+    uint32_t a1     = m_gpr[HLE_REG_A1];
+    uint32_t a2     = m_gpr[HLE_REG_A2];
+    uint32_t result = a0;
+    int64_t  bytes  = -1;
+
+    if (it != m_hle_routines.end() && !m_record)
+    {
+        switch (it->second)
+        {
+            case HLE_MEMCPY: bytes = hle_memcpy(a0, a1, a2);           break;
+            case HLE_MEMSET: bytes = hle_memset(a0, a1, a2);           break;
+            case HLE_STRLEN: bytes = hle_strlen(a0, &result);          break;
+            case HLE_MEMCMP: bytes = hle_memcmp(a0, a1, a2, &result);  break;
+            default:                                                   break;
+        }
+    }
+
+    if (bytes < 0)
+        return (this->*(inst->exec))(inst, pc);
+
+    DPRINTF(LOG_INST,("%08x: hle %s(0x%08x, 0x%08x, 0x%08x) = 0x%08x\n", pc, hle_names[it->second], a0, a1, a2, result));
+
+    m_gpr[HLE_REG_A0] = result;
+
+    uint32_t target = m_gpr[HLE_REG_RA] & ~1;
+    m_pc = target;
+
+    if (m_profiler)
+        m_profiler->ret(m_hart_id, target);
+
+    // Charge the routine's cost, step() accounts for one instruction
+    uint64_t cost = (uint64_t)m_hle_call_cost + (uint64_t)m_hle_word_cost * ((bytes + 3) / 4);
+    uint64_t now  = m_csr_mtime;
+
+    if (cost > 1)
+    {
+        m_stats[STATS_INSTRUCTIONS] += (uint32_t)(cost - 1);
+        m_csr_mtime += cost - 1;
+
+        // Timer compare point passed within the routine
+        if (m_csr_mtimecmp > now && m_csr_mtimecmp <= m_csr_mtime)
+            m_csr_mip |= (m_csr_mideleg & SR_IP_STIP) ? SR_IP_STIP : SR_IP_MTIP;
+    }
+
+    m_stats[STATS_HLE_CALLS]++;
+    return EXEC_OK;
+}
+//-----------------------------------------------------------------
+// hle_chunk: Host pointer for up to 'len' bytes at virtual address
+// 'addr', clipped to the page and memory region. NULL if the target
+// code must do the access itself (it would fault, is not RAM or is
+// watched). Nothing is changed on failure, so the routine can still
+// run on the target.
+//-----------------------------------------------------------------
+uint8_t *Riscv::hle_chunk(uint32_t addr, uint32_t *len, int writeNotRead, uint32_t *physical)
+{
+    uint32_t left = MEM_PAGE_SIZE - (addr & (MEM_PAGE_SIZE - 1));
+    if (*len > left)
+        *len = left;
+
+    *physical = addr;
+
+#ifdef CONFIG_MMU
+    // Same permission checks as mmu_d_translate(), without the fault
+    if (m_csr_mpriv <= PRIV_SUPER)
+    {
+        uint32_t pte  = mmu_lookup(m_dtlb, addr, STATS_DTLB_HITS);
+        uint32_t need = PAGE_PRESENT | (writeNotRead ? PAGE_WRITE : PAGE_READ);
+        uint32_t rwx  = pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE);
+
+        if (m_csr_mpriv == PRIV_USER)
+            need |= PAGE_USER;
+        else if ((pte & PAGE_USER) && !(m_csr_msr & SR_SUM))
+            return NULL;
+
+        if ((pte & need) != need || rwx == PAGE_WRITE || rwx == (PAGE_EXEC | PAGE_WRITE))
+            return NULL;
+
+        *physical = ((pte >> MMU_PGSHIFT) << MMU_PGSHIFT) | (addr & (MMU_PGSIZE - 1));
+    }
+#endif
+
+    const PageBitmap &watch = writeNotRead ? m_watch_write : m_watch_read;
+    if (m_has_watchpoints && watch.test(addr, *len))
+        return NULL;
+
+    uint32_t page = *physical >> MEM_PAGE_SHIFT;
+    uint8_t *host = m_mem_page_host[page];
+    if (host)
+        return host + (*physical & (MEM_PAGE_SIZE - 1));
+
+    // RAM only partly covering the page (ELF segments) or sharing it
+    // with other regions, clipped to the region
+    if (m_mem_page_region[page] == MEM_PAGE_UNMAPPED)
+        return NULL;
+
+    int region = mem_region(*physical, m_mem_page_region[page]);
+    if (region < 0 || m_mem_device[region] || !(host = m_mem[region]->get_host_ptr()))
+        return NULL;
+
+    uint32_t offset = *physical - m_mem_base[region];
+    if (*len > m_mem_size[region] - offset)
+        *len = m_mem_size[region] - offset;
+
+    return host + offset;
+}
+//-----------------------------------------------------------------
+// hle_range: Whole range can be accessed natively
+//-----------------------------------------------------------------
+bool Riscv::hle_range(uint32_t addr, uint32_t len, int writeNotRead)
+{
+    while (len)
+    {
+        uint32_t n = len;
+        uint32_t physical;
+
+        if (!hle_chunk(addr, &n, writeNotRead, &physical))
+            return false;
+
+        addr += n;
+        len  -= n;
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// hle_memcpy: memcpy(dst, src, len), returns bytes copied (-1 = not
+// emulated)
+//-----------------------------------------------------------------
+int64_t Riscv::hle_memcpy(uint32_t dst, uint32_t src, uint32_t len)
+{
+    // Check everything before the first write
+    if (!hle_range(src, len, 0) || !hle_range(dst, len, 1))
+        return -1;
+
+    for (uint32_t left = len; left; )
+    {
+        uint32_t n = left;
+        uint32_t m = left;
+        uint32_t physical;
+
+        uint8_t *s = hle_chunk(src, &n, 0, &physical);
+        uint8_t *d = hle_chunk(dst, &m, 1, &physical);
+        if (m < n)
+            n = m;
+
+        memmove(d, s, n);
+
+        // Copies over code drop the decoded instructions
+        for (uint32_t a = physical & ~3; a < physical + n; a += 4)
+            invalidate_code(a);
+
+        src  += n;
+        dst  += n;
+        left -= n;
+    }
+
+    return len;
+}
+//-----------------------------------------------------------------
+// hle_memset: memset(dst, value, len), returns bytes written
+//-----------------------------------------------------------------
+int64_t Riscv::hle_memset(uint32_t dst, uint8_t value, uint32_t len)
+{
+    if (!hle_range(dst, len, 1))
+        return -1;
+
+    for (uint32_t left = len; left; )
+    {
+        uint32_t n = left;
+        uint32_t physical;
+
+        uint8_t *d = hle_chunk(dst, &n, 1, &physical);
+        memset(d, value, n);
+
+        for (uint32_t a = physical & ~3; a < physical + n; a += 4)
+            invalidate_code(a);
+
+        dst  += n;
+        left -= n;
+    }
+
+    return len;
+}
+//-----------------------------------------------------------------
+// hle_strlen: strlen(src), returns bytes read
+//-----------------------------------------------------------------
+int64_t Riscv::hle_strlen(uint32_t src, uint32_t *result)
+{
+    uint32_t length = 0;
+
+    for (;;)
+    {
+        uint32_t n = MEM_PAGE_SIZE;
+        uint32_t physical;
+
+        uint8_t *s = hle_chunk(src + length, &n, 0, &physical);
+        if (!s)
+            return -1;
+
+        uint8_t *end = (uint8_t *)memchr(s, 0, n);
+        if (end)
+        {
+            length += end - s;
+            break;
+        }
+
+        length += n;
+    }
+
+    *result = length;
+    return (int64_t)length + 1;
+}
+//-----------------------------------------------------------------
+// hle_memcmp: memcmp(a, b, len), returns bytes compared
+//-----------------------------------------------------------------
+int64_t Riscv::hle_memcmp(uint32_t a, uint32_t b, uint32_t len, uint32_t *result)
+{
+    uint32_t done = 0;
+
+    *result = 0;
+
+    while (done < len)
+    {
+        uint32_t n = len - done;
+        uint32_t m = len - done;
+        uint32_t physical;
+
+        uint8_t *pa = hle_chunk(a + done, &n, 0, &physical);
+        uint8_t *pb = hle_chunk(b + done, &m, 0, &physical);
+        if (!pa || !pb)
+            return -1;
+        if (m < n)
+            n = m;
+
+        // First differing byte, as unsigned char
+        for (uint32_t i=0;i<n;i++)
+            if (pa[i] != pb[i])
+            {
+                *result = (uint32_t)((int)pa[i] - (int)pb[i]);
+                return (int64_t)done + i + 1;
+            }
+
+        done += n;
+    }
+
+    return len;
+}
@@ -54,6 +54,12 @@
 // Mask 0x7f
 //   lui, auipc, jal
 
+// Mask 0xf800707f
+//   sc.w, amoswap.w, amoadd.w, amoxor.w, amoand.w, amoor.w, amomin.w, amomax.w, amominu.w, amomaxu.w
+
+// Mask 0xf9f0707f
+//   lr.w
+
 //--------------------------------------------------------------------
 // Instructions
 //--------------------------------------------------------------------
@@ -117,6 +123,17 @@ enum eInstructions
     ENUM_INST_REMU,
     ENUM_INST_FENCE,
     ENUM_INST_WFI,
+    ENUM_INST_LR_W,
+    ENUM_INST_SC_W,
+    ENUM_INST_AMOSWAP_W,
+    ENUM_INST_AMOADD_W,
+    ENUM_INST_AMOXOR_W,
+    ENUM_INST_AMOAND_W,
+    ENUM_INST_AMOOR_W,
+    ENUM_INST_AMOMIN_W,
+    ENUM_INST_AMOMAX_W,
+    ENUM_INST_AMOMINU_W,
+    ENUM_INST_AMOMAXU_W,
     ENUM_INST_MAX
 };
 
@@ -180,6 +197,17 @@ static const char * inst_names[ENUM_INST_MAX+1] =
     [ENUM_INST_REMU] = "remu",
     [ENUM_INST_FENCE] = "fence",
     [ENUM_INST_WFI] = "wfi",
+    [ENUM_INST_LR_W] = "lr.w",
+    [ENUM_INST_SC_W] = "sc.w",
+    [ENUM_INST_AMOSWAP_W] = "amoswap.w",
+    [ENUM_INST_AMOADD_W] = "amoadd.w",
+    [ENUM_INST_AMOXOR_W] = "amoxor.w",
+    [ENUM_INST_AMOAND_W] = "amoand.w",
+    [ENUM_INST_AMOOR_W] = "amoor.w",
+    [ENUM_INST_AMOMIN_W] = "amomin.w",
+    [ENUM_INST_AMOMAX_W] = "amomax.w",
+    [ENUM_INST_AMOMINU_W] = "amominu.w",
+    [ENUM_INST_AMOMAXU_W] = "amomaxu.w",
     [ENUM_INST_MAX] = ""
 };
 
@@ -427,6 +455,50 @@ static const char * inst_names[ENUM_INST_MAX+1] =
 #define INST_WFI 0x10500073
 #define INST_WFI_MASK 0xffff8fff
 
+// lr.w
+#define INST_LR_W 0x1000202f
+#define INST_LR_W_MASK 0xf9f0707f
+
+// sc.w
+#define INST_SC_W 0x1800202f
+#define INST_SC_W_MASK 0xf800707f
+
+// amoswap.w
+#define INST_AMOSWAP_W 0x800202f
+#define INST_AMOSWAP_W_MASK 0xf800707f
+
+// amoadd.w
+#define INST_AMOADD_W 0x202f
+#define INST_AMOADD_W_MASK 0xf800707f
+
+// amoxor.w
+#define INST_AMOXOR_W 0x2000202f
+#define INST_AMOXOR_W_MASK 0xf800707f
+
+// amoand.w
+#define INST_AMOAND_W 0x6000202f
+#define INST_AMOAND_W_MASK 0xf800707f
+
+// amoor.w
+#define INST_AMOOR_W 0x4000202f
+#define INST_AMOOR_W_MASK 0xf800707f
+
+// amomin.w
+#define INST_AMOMIN_W 0x8000202f
+#define INST_AMOMIN_W_MASK 0xf800707f
+
+// amomax.w
+#define INST_AMOMAX_W 0xa000202f
+#define INST_AMOMAX_W_MASK 0xf800707f
+
+// amominu.w
+#define INST_AMOMINU_W 0xc000202f
+#define INST_AMOMINU_W_MASK 0xf800707f
+
+// amomaxu.w
+#define INST_AMOMAXU_W 0xe000202f
+#define INST_AMOMAXU_W_MASK 0xf800707f
+
 #define IS_LOAD_INST(a)     (((a) & 0x7F) == 0x03)
 #define IS_STORE_INST(a)    (((a) & 0x7F) == 0x23)
 #define IS_BRANCH_INST(a)   ((((a) & 0x7F) == 0x6f) || \
@@ -548,7 +620,6 @@ static const char * inst_names[ENUM_INST_MAX+1] =
 #define CSR_MTIMEH_MASK   0xFFFFFFFF
 #define CSR_MHARTID       0xF14
 #define CSR_MHARTID_MASK  0xFFFFFFFF
-    #define MHARTID_VALUE 0
 
 #define CSR_PMPCFG0           0x3a0 // pmpcfg0
 #define CSR_PMPCFG0_MASK      0xFFFFFFFF
@@ -608,7 +679,7 @@ static const char * inst_names[ENUM_INST_MAX+1] =
 #define MISA_RVS MISA_RV('S')
 #define MISA_RVU MISA_RV('U')
 
-#define MISA_VALUE (MISA_RV32 | MISA_RVI | MISA_RVM | MISA_RVS | MISA_RVU)
+#define MISA_VALUE (MISA_RV32 | MISA_RVI | MISA_RVM | MISA_RVA | MISA_RVS | MISA_RVU)
 
 //--------------------------------------------------------------------
 // Register Enumerations:
@@ -0,0 +1,618 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
+#include "riscv.h"
+
+// Native code generation is only supported on x86-64 POSIX hosts
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+    #define JIT_X86_64
+    #include <sys/mman.h>
+#endif
+
+#ifdef JIT_X86_64
+//-----------------------------------------------------------------
+// Defines:
+//-----------------------------------------------------------------
+// Worst case host code for one block (32 instructions + exits)
+#define JIT_BLOCK_MAX_CODE      8192
+
+// Host registers
+#define HOST_EAX                0
+#define HOST_ECX                1
+#define HOST_EDX                2
+#define HOST_ESI                6
+#define HOST_EDI                7
+
+// Condition codes (jcc rel32 = 0x0F, 0x80 | cc)
+#define CC_B                    0x2
+#define CC_AE                   0x3
+#define CC_E                    0x4
+#define CC_NE                   0x5
+#define CC_L                    0xC
+#define CC_GE                   0xD
+
+//-----------------------------------------------------------------
+// Host code emitter
+// Register usage: rbx = Riscv *, rbp = m_gpr, eax/ecx/edx scratch
+//-----------------------------------------------------------------
+class JitEmitter
+{
+public:
+    JitEmitter(uint8_t *p): m_p(p) { }
+
+    uint8_t *pos(void) { return m_p; }
+
+    void u8(uint8_t v)   { *m_p++ = v; }
+    void u32(uint32_t v) { memcpy(m_p, &v, 4); m_p += 4; }
+    void u64(uint64_t v) { memcpy(m_p, &v, 8); m_p += 8; }
+
+    // op host, [rbp + r*4]  (mov = 0x8B, add = 0x03, sub = 0x2B, cmp = 0x3B ...)
+    void gpr_op(uint8_t op, int host, int r)  { u8(op); u8(0x45 | (host << 3)); u8(r * 4); }
+    void gpr_load(int host, int r)            { gpr_op(0x8B, host, r); }
+    void gpr_store(int host, int r)           { gpr_op(0x89, host, r); }
+    // mov dword [rbp + r*4], imm32
+    void gpr_store_imm(int r, uint32_t imm)   { u8(0xC7); u8(0x45); u8(r * 4); u32(imm); }
+
+    // op eax, imm32 (short eax forms: add = 0x05, or = 0x0D, and = 0x25 ...)
+    void eax_imm(uint8_t op, uint32_t imm)    { u8(op); u32(imm); }
+    // mov host, imm32
+    void mov_imm(int host, uint32_t imm)      { u8(0xB8 + host); u32(imm); }
+    // mov rax, imm64
+    void mov_rax_imm64(uint64_t imm)          { u8(0x48); u8(0xB8); u64(imm); }
+
+    // op [rbx + disp32] with reg / extension field
+    void cpu_modrm(int reg, int32_t disp)     { u8(0x80 | (reg << 3) | 3); u32(disp); }
+    // mov dword [rbx + disp32], imm32
+    void cpu_store_imm(int32_t disp, uint32_t imm) { u8(0xC7); cpu_modrm(0, disp); u32(imm); }
+    // mov dword [rbx + disp32], host
+    void cpu_store(int32_t disp, int host)    { u8(0x89); cpu_modrm(host, disp); }
+    // add dword [rbx + disp32], imm32
+    void cpu_add_imm(int32_t disp, uint32_t imm) { u8(0x81); cpu_modrm(0, disp); u32(imm); }
+    // inc dword [rbx + disp32]
+    void cpu_inc(int32_t disp)                { u8(0xFF); cpu_modrm(0, disp); }
+
+    // setcc al; movzx eax, al
+    void setcc_eax(int cc)                    { u8(0x0F); u8(0x90 | cc); u8(0xC0); u8(0x0F); u8(0xB6); u8(0xC0); }
+
+    // call rax (address loaded first)
+    void call(const void *fn)                 { mov_rax_imm64((uint64_t)(uintptr_t)fn); u8(0xFF); u8(0xD0); }
+
+    // jcc / jmp rel32, return patch location
+    uint8_t *jcc(int cc)                      { u8(0x0F); u8(0x80 | cc); u32(0); return m_p - 4; }
+    uint8_t *jmp(void)                        { u8(0xE9); u32(0); return m_p - 4; }
+    void     jmp_to(const uint8_t *target)    { patch(jmp(), target); }
+
+    static void patch(uint8_t *loc, const uint8_t *target)
+    {
+        int32_t rel = (int32_t)(target - (loc + 4));
+        memcpy(loc, &rel, 4);
+    }
+    void bind(uint8_t *loc) { patch(loc, m_p); }
+
+private:
+    uint8_t *m_p;
+};
+
+//-----------------------------------------------------------------
+// Division helpers (RISC-V results for /0 and overflow)
+//-----------------------------------------------------------------
+static uint32_t jit_div(uint32_t a, uint32_t b)
+{
+    if ((signed)a == INT32_MIN && (signed)b == -1)
+        return a;
+    else if (b != 0)
+        return (signed)a / (signed)b;
+    else
+        return (unsigned)-1;
+}
+static uint32_t jit_divu(uint32_t a, uint32_t b)
+{
+    return (b != 0) ? (a / b) : (unsigned)-1;
+}
+static uint32_t jit_rem(uint32_t a, uint32_t b)
+{
+    if ((signed)a == INT32_MIN && (signed)b == -1)
+        return 0;
+    else if (b != 0)
+        return (signed)a % (signed)b;
+    else
+        return a;
+}
+static uint32_t jit_remu(uint32_t a, uint32_t b)
+{
+    return (b != 0) ? (a % b) : a;
+}
+#endif
+
+//-----------------------------------------------------------------
+// jit_load: Load helper for native code
+// Returns value, bit 32 set if the access faulted (trap taken)
+//-----------------------------------------------------------------
+uint64_t Riscv::jit_load(Riscv *cpu, uint32_t pc, uint32_t address, uint32_t type)
+{
+    uint32_t value = 0;
+
+    if (!cpu->load(pc, address, &value, type & 7, (type & 8) != 0))
+    {
+        // Device access, leave before this instruction
+        if (cpu->m_events & RUN_EVENT_DEVICE)
+        {
+            cpu->m_pc = pc;
+            cpu->m_jit_budget++;
+        }
+        return 1ULL << 32;
+    }
+
+    return value;
+}
+//-----------------------------------------------------------------
+// jit_store: Store helper for native code
+// Returns 0 = faulted (trap taken), 1 = ok, 2 = ok but modified code
+//-----------------------------------------------------------------
+uint32_t Riscv::jit_store(Riscv *cpu, uint32_t pc, uint32_t address, uint32_t data, uint32_t width)
+{
+    cpu->m_block_dirty = false;
+
+    if (!cpu->store(pc, address, data, width))
+    {
+        if (cpu->m_events & RUN_EVENT_DEVICE)
+        {
+            cpu->m_pc = pc;
+            cpu->m_jit_budget++;
+        }
+        return 0;
+    }
+
+    return cpu->m_block_dirty ? 2 : 1;
+}
+//-----------------------------------------------------------------
+// jit_init: Allocate code buffer and build entry/exit stubs
+//-----------------------------------------------------------------
+bool Riscv::jit_init(void)
+{
+#ifdef JIT_X86_64
+    if (m_jit_code)
+        return true;
+
+    void *mem = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return false;
+
+    m_jit_code = (uint8_t *)mem;
+    jit_flush();
+    return true;
+#else
+    return false;
+#endif
+}
+//-----------------------------------------------------------------
+// jit_destroy: Release code buffer
+//-----------------------------------------------------------------
+void Riscv::jit_destroy(void)
+{
+#ifdef JIT_X86_64
+    if (m_jit_code)
+        munmap(m_jit_code, JIT_CODE_SIZE);
+    m_jit_code = NULL;
+#endif
+}
+//-----------------------------------------------------------------
+// jit_flush: Drop all native code (code buffer full)
+//-----------------------------------------------------------------
+void Riscv::jit_flush(void)
+{
+#ifdef JIT_X86_64
+    // Chain is only ever set to native
+    for (int i=0;i<BLOCK_CACHE_ENTRIES && m_block_cache;i++)
+    {
+        if (!m_block_cache[i].native)
+            continue;
+        m_block_cache[i].native = NULL;
+        m_block_cache[i].chain  = NULL;
+    }
+
+    JitEmitter e(m_jit_code);
+
+    // Entry: save callee saved registers, rbx = cpu, rbp = gpr, jump to block
+    m_jit_enter = (t_jit_enter)e.pos();
+    e.u8(0x53);                                 // push rbx
+    e.u8(0x55);                                 // push rbp
+    e.u8(0x48); e.u8(0x83); e.u8(0xEC); e.u8(0x08); // sub rsp, 8 (align calls)
+    e.u8(0x48); e.u8(0x89); e.u8(0xFB);         // mov rbx, rdi
+    e.u8(0x48); e.u8(0x89); e.u8(0xD5);         // mov rbp, rdx
+    e.u8(0xFF); e.u8(0xE6);                     // jmp rsi
+
+    // Exit: restore and return to step_block()
+    m_jit_exit = e.pos();
+    e.u8(0x48); e.u8(0x83); e.u8(0xC4); e.u8(0x08); // add rsp, 8
+    e.u8(0x5D);                                 // pop rbp
+    e.u8(0x5B);                                 // pop rbx
+    e.u8(0xC3);                                 // ret
+
+    m_jit_used = e.pos() - m_jit_code;
+#endif
+}
+//-----------------------------------------------------------------
+// jit_translate: Translate a threaded block into host code
+//-----------------------------------------------------------------
+bool Riscv::jit_translate(t_block *block, uint32_t pc)
+{
+#ifdef JIT_X86_64
+    if (!m_jit_code || block->length == 0)
+        return false;
+
+    if (m_jit_used + JIT_BLOCK_MAX_CODE > JIT_CODE_SIZE)
+        jit_flush();
+
+    // CPU state offsets from rbx
+    const uint8_t *base   = (const uint8_t *)this;
+    int32_t off_pc        = (const uint8_t *)&m_pc - base;
+    int32_t off_pc_x      = (const uint8_t *)&m_pc_x - base;
+    int32_t off_budget    = (const uint8_t *)&m_jit_budget - base;
+    int32_t off_branches  = (const uint8_t *)&m_stats[STATS_BRANCHES] - base;
+
+    uint8_t *start = m_jit_code + m_jit_used;
+    JitEmitter e(start);
+
+    int length = block->length;
+
+    // Leave native code with m_pc = target, chaining into the next
+    // native block when it is in the same page and within budget (with
+    // coverage, once all of the next block is recorded - see step_block()).
+    #define EXIT_TO(target) \
+        do { \
+            uint32_t _target = (target); \
+            if ((_target >> BLOCK_PAGE_SHIFT) == (pc >> BLOCK_PAGE_SHIFT)) \
+            { \
+                uint32_t _phys = (block->pc & ~((1 << BLOCK_PAGE_SHIFT) - 1)) | (_target & ((1 << BLOCK_PAGE_SHIFT) - 1)); \
+                t_block *_next = &m_block_cache[(_phys >> 2) & (BLOCK_CACHE_ENTRIES-1)]; \
+                e.mov_rax_imm64((uint64_t)(uintptr_t)_next); \
+                /* cmp dword [rax + pc], phys; jne exit */ \
+                e.u8(0x81); e.u8(0x78); e.u8(offsetof(t_block, pc)); e.u32(_phys); \
+                uint8_t *_miss1 = e.jcc(CC_NE); \
+                /* cmp dword [rax + vpc], target; jne exit */ \
+                e.u8(0x81); e.u8(0x78); e.u8(offsetof(t_block, vpc)); e.u32(_target); \
+                uint8_t *_miss2 = e.jcc(CC_NE); \
+                /* mov rcx, [rax + chain]; test rcx, rcx; jz exit */ \
+                e.u8(0x48); e.u8(0x8B); e.u8(0x48); e.u8(offsetof(t_block, chain)); \
+                e.u8(0x48); e.u8(0x85); e.u8(0xC9); \
+                uint8_t *_miss3 = e.jcc(CC_E); \
+                /* mov edx, [rax + length]; cmp [budget], edx; jl exit */ \
+                e.u8(0x8B); e.u8(0x50); e.u8(offsetof(t_block, length)); \
+                e.u8(0x39); e.cpu_modrm(HOST_EDX, off_budget); \
+                uint8_t *_miss4 = e.jcc(CC_L); \
+                /* sub [budget], edx; jmp rcx */ \
+                e.u8(0x29); e.cpu_modrm(HOST_EDX, off_budget); \
+                e.u8(0xFF); e.u8(0xE1); \
+                e.bind(_miss1); e.bind(_miss2); e.bind(_miss3); e.bind(_miss4); \
+            } \
+            e.cpu_store_imm(off_pc, _target); \
+            e.jmp_to(m_jit_exit); \
+        } while (0)
+
+    // Coverage: record the branch outcome here, as the exit may chain
+    #define RECORD_OUTCOME(taken) \
+        do { \
+            if (m_coverage) \
+            { \
+                uint32_t _mask; \
+                e.mov_rax_imm64((uint64_t)(uintptr_t)m_coverage->outcome(inst_pc, (taken), &_mask)); \
+                /* test dword [rax], mask; jnz done; lock or dword [rax], mask */ \
+                e.u8(0xF7); e.u8(0x00); e.u32(_mask); \
+                uint8_t *_done = e.jcc(CC_NE); \
+                e.u8(0xF0); e.u8(0x81); e.u8(0x08); e.u32(_mask); \
+                e.bind(_done); \
+            } \
+        } while (0)
+
+    // Leave part way through the block (instruction i completed or
+    // faulted), returning the unexecuted instructions to the budget.
+    #define EXIT_EARLY(i, inst_pc) \
+        do { \
+            if (length - ((i) + 1)) \
+                e.cpu_add_imm(off_budget, length - ((i) + 1)); \
+            e.cpu_store_imm(off_pc_x, inst_pc); \
+        } while (0)
+
+    for (int i=0;i<=length;i++)
+    {
+        const t_thread_op *op = &block->ops[i];
+        uint32_t inst_pc = pc + (i << 2);
+        int rd  = op->rd;
+        int rs1 = op->rs1;
+        int rs2 = op->rs2;
+
+        switch (op->inst)
+        {
+            //-----------------------------------------------------
+            // ALU
+            //-----------------------------------------------------
+            case ENUM_INST_ADDI:
+            case ENUM_INST_ANDI:
+            case ENUM_INST_ORI:
+            case ENUM_INST_XORI:
+            {
+                uint8_t alu = (op->inst == ENUM_INST_ADDI) ? 0x05 :
+                              (op->inst == ENUM_INST_ANDI) ? 0x25 :
+                              (op->inst == ENUM_INST_ORI)  ? 0x0D : 0x35;
+                e.gpr_load(HOST_EAX, rs1);
+                e.eax_imm(alu, op->imm);
+                e.gpr_store(HOST_EAX, rd);
+            }
+            break;
+            case ENUM_INST_SLTI:
+            case ENUM_INST_SLTIU:
+                e.gpr_load(HOST_EAX, rs1);
+                e.eax_imm(0x3D, op->imm);
+                e.setcc_eax(op->inst == ENUM_INST_SLTI ? CC_L : CC_B);
+                e.gpr_store(HOST_EAX, rd);
+                break;
+            case ENUM_INST_SLLI:
+            case ENUM_INST_SRLI:
+            case ENUM_INST_SRAI:
+                e.gpr_load(HOST_EAX, rs1);
+                e.u8(0xC1);
+                e.u8(op->inst == ENUM_INST_SLLI ? 0xE0 : op->inst == ENUM_INST_SRLI ? 0xE8 : 0xF8);
+                e.u8(op->imm);
+                e.gpr_store(HOST_EAX, rd);
+                break;
+            case ENUM_INST_LUI:
+                e.gpr_store_imm(rd, op->imm);
+                break;
+            case ENUM_INST_AUIPC:
+                e.gpr_store_imm(rd, op->imm + inst_pc);
+                break;
+            case ENUM_INST_ADD:
+            case ENUM_INST_SUB:
+            case ENUM_INST_AND:
+            case ENUM_INST_OR:
+            case ENUM_INST_XOR:
+            {
+                uint8_t alu = (op->inst == ENUM_INST_ADD) ? 0x03 :
+                              (op->inst == ENUM_INST_SUB) ? 0x2B :
+                              (op->inst == ENUM_INST_AND) ? 0x23 :
+                              (op->inst == ENUM_INST_OR)  ? 0x0B : 0x33;
+                e.gpr_load(HOST_EAX, rs1);
+                e.gpr_op(alu, HOST_EAX, rs2);
+                e.gpr_store(HOST_EAX, rd);
+            }
+            break;
+            case ENUM_INST_SLT:
+            case ENUM_INST_SLTU:
+                e.gpr_load(HOST_EAX, rs1);
+                e.gpr_op(0x3B, HOST_EAX, rs2);
+                e.setcc_eax(op->inst == ENUM_INST_SLT ? CC_L : CC_B);
+                e.gpr_store(HOST_EAX, rd);
+                break;
+            case ENUM_INST_SLL:
+            case ENUM_INST_SRL:
+            case ENUM_INST_SRA:
+                e.gpr_load(HOST_EAX, rs1);
+                e.gpr_load(HOST_ECX, rs2);
+                e.u8(0xD3);
+                e.u8(op->inst == ENUM_INST_SLL ? 0xE0 : op->inst == ENUM_INST_SRL ? 0xE8 : 0xF8);
+                e.gpr_store(HOST_EAX, rd);
+                break;
+            case THREAD_OP_NOP:
+                break;
+
+            //-----------------------------------------------------
+            // Multiply / divide
+            //-----------------------------------------------------
+            case ENUM_INST_MUL:
+                e.gpr_load(HOST_EAX, rs1);
+                e.u8(0x0F); e.u8(0xAF); e.u8(0x45); e.u8(rs2 * 4);  // imul eax, [rbp + rs2]
+                e.gpr_store(HOST_EAX, rd);
+                break;
+            case ENUM_INST_MULH:
+            case ENUM_INST_MULHSU:
+            case ENUM_INST_MULHU:
+                // rax = rs1 (sign/zero extended), rcx = rs2 (sign/zero extended)
+                if (op->inst == ENUM_INST_MULHU)
+                    e.gpr_load(HOST_EAX, rs1);
+                else
+                    { e.u8(0x48); e.gpr_op(0x63, HOST_EAX, rs1); }  // movsxd rax, [rbp + rs1]
+                if (op->inst == ENUM_INST_MULH)
+                    { e.u8(0x48); e.gpr_op(0x63, HOST_ECX, rs2); }  // movsxd rcx, [rbp + rs2]
+                else
+                    e.gpr_load(HOST_ECX, rs2);
+                e.u8(0x48); e.u8(0x0F); e.u8(0xAF); e.u8(0xC1);     // imul rax, rcx
+                e.u8(0x48); e.u8(0xC1);                             // shr/sar rax, 32
+                e.u8(op->inst == ENUM_INST_MULHU ? 0xE8 : 0xF8); e.u8(32);
+                e.gpr_store(HOST_EAX, rd);
+                break;
+            case ENUM_INST_DIV:
+            case ENUM_INST_DIVU:
+            case ENUM_INST_REM:
+            case ENUM_INST_REMU:
+                e.gpr_load(HOST_EDI, rs1);
+                e.gpr_load(HOST_ESI, rs2);
+                e.call(op->inst == ENUM_INST_DIV  ? (const void *)jit_div  :
+                       op->inst == ENUM_INST_DIVU ? (const void *)jit_divu :
+                       op->inst == ENUM_INST_REM  ? (const void *)jit_rem  : (const void *)jit_remu);
+                e.gpr_store(HOST_EAX, rd);
+                break;
+
+            //-----------------------------------------------------
+            // Loads / stores (via helpers, may trap)
+            //-----------------------------------------------------
+            case ENUM_INST_LB:
+            case ENUM_INST_LH:
+            case ENUM_INST_LW:
+            case ENUM_INST_LBU:
+            case ENUM_INST_LHU:
+            case ENUM_INST_LWU:
+            {
+                uint32_t type = (op->inst == ENUM_INST_LB)  ? (1 | 8) :
+                                (op->inst == ENUM_INST_LH)  ? (2 | 8) :
+                                (op->inst == ENUM_INST_LW)  ? (4 | 8) :
+                                (op->inst == ENUM_INST_LBU) ? 1 :
+                                (op->inst == ENUM_INST_LHU) ? 2 : 4;
+
+                e.u8(0x48); e.u8(0x89); e.u8(0xDF);                 // mov rdi, rbx
+                e.mov_imm(HOST_ESI, inst_pc);
+                e.gpr_load(HOST_EDX, rs1);
+                e.u8(0x81); e.u8(0xC2); e.u32(op->imm);             // add edx, imm32
+                e.mov_imm(HOST_ECX, type);
+                e.call((const void *)jit_load);
+                e.u8(0x48); e.u8(0x0F); e.u8(0xBA); e.u8(0xE0); e.u8(32); // bt rax, 32
+                uint8_t *ok = e.jcc(CC_AE);
+                EXIT_EARLY(i, inst_pc);
+                e.jmp_to(m_jit_exit);
+                e.bind(ok);
+                if (rd != 0)
+                    e.gpr_store(HOST_EAX, rd);
+            }
+            break;
+            case ENUM_INST_SB:
+            case ENUM_INST_SH:
+            case ENUM_INST_SW:
+            {
+                uint32_t width = (op->inst == ENUM_INST_SB) ? 1 :
+                                 (op->inst == ENUM_INST_SH) ? 2 : 4;
+
+                e.u8(0x48); e.u8(0x89); e.u8(0xDF);                 // mov rdi, rbx
+                e.mov_imm(HOST_ESI, inst_pc);
+                e.gpr_load(HOST_EDX, rs1);
+                e.u8(0x81); e.u8(0xC2); e.u32(op->imm);             // add edx, imm32
+                e.gpr_load(HOST_ECX, rs2);
+                e.u8(0x41); e.u8(0xB8); e.u32(width);               // mov r8d, width
+                e.call((const void *)jit_store);
+                e.u8(0x83); e.u8(0xF8); e.u8(0x01);                 // cmp eax, 1
+                uint8_t *ok = e.jcc(CC_E);
+                e.u8(0x85); e.u8(0xC0);                             // test eax, eax
+                uint8_t *modified = e.jcc(CC_NE);
+                // Faulted, trap already taken
+                EXIT_EARLY(i, inst_pc);
+                e.jmp_to(m_jit_exit);
+                // Store hit translated code, this block may be stale
+                e.bind(modified);
+                EXIT_EARLY(i, inst_pc);
+                e.cpu_store_imm(off_pc, inst_pc + 4);
+                e.jmp_to(m_jit_exit);
+                e.bind(ok);
+            }
+            break;
+
+            //-----------------------------------------------------
+            // Control flow (always last in block)
+            //-----------------------------------------------------
+            case ENUM_INST_JAL:
+                if (rd != 0)
+                    e.gpr_store_imm(rd, inst_pc + 4);
+                e.cpu_inc(off_branches);
+                e.cpu_store_imm(off_pc_x, inst_pc);
+                EXIT_TO(inst_pc + op->imm);
+                break;
+            case ENUM_INST_JALR:
+                e.gpr_load(HOST_EAX, rs1);
+                e.eax_imm(0x05, op->imm);
+                e.u8(0x83); e.u8(0xE0); e.u8(0xFE);                 // and eax, ~1
+                e.cpu_store(off_pc, HOST_EAX);
+                if (rd != 0)
+                    e.gpr_store_imm(rd, inst_pc + 4);
+                e.cpu_inc(off_branches);
+                e.cpu_store_imm(off_pc_x, inst_pc);
+                e.jmp_to(m_jit_exit);
+                break;
+            case ENUM_INST_BEQ:
+            case ENUM_INST_BNE:
+            case ENUM_INST_BLT:
+            case ENUM_INST_BGE:
+            case ENUM_INST_BLTU:
+            case ENUM_INST_BGEU:
+            {
+                int cc = (op->inst == ENUM_INST_BEQ)  ? CC_E  :
+                         (op->inst == ENUM_INST_BNE)  ? CC_NE :
+                         (op->inst == ENUM_INST_BLT)  ? CC_L  :
+                         (op->inst == ENUM_INST_BGE)  ? CC_GE :
+                         (op->inst == ENUM_INST_BLTU) ? CC_B  : CC_AE;
+
+                e.cpu_inc(off_branches);
+                e.cpu_store_imm(off_pc_x, inst_pc);
+                e.gpr_load(HOST_EAX, rs1);
+                e.gpr_op(0x3B, HOST_EAX, rs2);
+                uint8_t *taken = e.jcc(cc);
+                RECORD_OUTCOME(false);
+                EXIT_TO(inst_pc + 4);
+                e.bind(taken);
+                RECORD_OUTCOME(true);
+                EXIT_TO(inst_pc + op->imm);
+            }
+            break;
+
+            //-----------------------------------------------------
+            // End of block (next instruction not part of it)
+            //-----------------------------------------------------
+            case THREAD_OP_END:
+                e.cpu_store_imm(off_pc_x, inst_pc - 4);
+                EXIT_TO(inst_pc);
+                break;
+            default:
+                assert(!"JIT: Unexpected op");
+                break;
+        }
+    }
+
+    #undef EXIT_TO
+    #undef RECORD_OUTCOME
+    #undef EXIT_EARLY
+
+    m_jit_used    = e.pos() - m_jit_code;
+    assert(e.pos() - start <= JIT_BLOCK_MAX_CODE);
+
+    block->vpc    = pc;
+    block->native = start;
+    block->chain  = m_coverage ? NULL : start;
+    return true;
+#else
+    return false;
+#endif
+}
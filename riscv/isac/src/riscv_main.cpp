@@ -43,8 +43,10 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <getopt.h>
 
 #include "riscv.h"
+#include "riscv_console.h"
 #include "elf_load.h"
 #include "cosim_api.h"
 
@@ -55,22 +57,221 @@
 //-----------------------------------------------------------------
 static int mem_create(void *arg, uint32_t base, uint32_t size)
 {
-    return cosim::instance()->create_memory(base, size);
+    cosim   *ctx    = (cosim *)arg;
+    uint64_t end    = (uint64_t)base + size;
+    bool     mapped = (size != 0);
+
+    // Already inside a region created with -b / -s (or --mem-file)
+    for (uint64_t addr = base; mapped && addr < end; addr = (addr | 0xFFF) + 1)
+        mapped = ctx->valid_addr((uint32_t)addr);
+
+    if (mapped)
+        return 1;
+
+    return ctx->create_memory(base, size);
 }
 //-----------------------------------------------------------------
-// mem_load: Load byte into memory
+// mem_load: Load block into memory
 //-----------------------------------------------------------------
-static int mem_load(void *arg, uint32_t addr, uint8_t data)
+static int mem_load(void *arg, uint32_t addr, const uint8_t *data, uint32_t len)
 {
-    cosim::instance()->write(addr, data);
-    return cosim::instance()->valid_addr(addr);
+    return ((cosim *)arg)->write_block(addr, data, len);
+}
+//-----------------------------------------------------------------
+// device_attach: Create a device from 'name[@base]' and attach it
+//-----------------------------------------------------------------
+static bool device_attach(cosim_cpu_api *sim, const char *spec, const char *uart_input, IConsoleIO *console)
+{
+    const char *at   = strchr(spec, '@');
+    size_t      len  = at ? (size_t)(at - spec) : strlen(spec);
+    Device     *dev  = NULL;
+    uint32_t    base = 0;
+    uint32_t    size = 0;
+
+    if (len == 4 && !strncmp(spec, "uart", len))
+    {
+        UartDevice *uart = new UartDevice(console);
+        if (uart_input && !uart->set_input(uart_input))
+        {
+            fprintf (stderr,"Error: Could not open %s\n", uart_input);
+            delete uart;
+            return false;
+        }
+        dev  = uart;
+        base = UART_BASEADDR;
+        size = UART_SIZE;
+    }
+    else if (len == 5 && !strncmp(spec, "timer", len))
+    {
+        dev  = new TimerDevice();
+        base = TIMER_BASEADDR;
+        size = TIMER_SIZE;
+    }
+    else
+        return false;
+
+    if (at)
+        base = strtoul(at + 1, NULL, 0);
+
+    if (!sim->attach_device(dev, base, size))
+    {
+        delete dev;
+        return false;
+    }
+
+    printf("DEV: %s 0x%08x-%08x\n", dev->get_name(), base, base + size - 1);
+    return true;
+}
+//-----------------------------------------------------------------
+// debug_addr: Address from a number or an ELF symbol
+//-----------------------------------------------------------------
+static bool debug_addr(const char *filename, const char *str, uint32_t *addr)
+{
+    char *end;
+    *addr = strtoul(str, &end, 0);
+    if (end != str && *end == 0)
+        return true;
+
+    long sym = filename ? elf_get_symbol(filename, str) : -1;
+    if (sym == -1)
+        return false;
+
+    *addr = (uint32_t)sym;
+    return true;
+}
+//-----------------------------------------------------------------
+// debug_attach: Add a breakpoint ('pc') or watchpoint ('[r|w|rw:]addr[+len]')
+//-----------------------------------------------------------------
+static bool debug_attach(cosim_cpu_api *sim, const char *filename, const char *spec, bool watch)
+{
+    uint32_t addr;
+
+    if (!watch)
+        return debug_addr(filename, spec, &addr) && sim->set_breakpoint(addr);
+
+    // Access type (default writes)
+    int type = COSIM_WATCH_WRITE;
+    if (!strncmp(spec, "rw:", 3))
+    {
+        type  = COSIM_WATCH_READ | COSIM_WATCH_WRITE;
+        spec += 3;
+    }
+    else if (!strncmp(spec, "r:", 2))
+    {
+        type  = COSIM_WATCH_READ;
+        spec += 2;
+    }
+    else if (!strncmp(spec, "w:", 2))
+        spec += 2;
+
+    std::string name(spec);
+    uint32_t    len  = 4;
+    size_t      plus = name.find('+');
+    if (plus != std::string::npos)
+    {
+        len = strtoul(name.c_str() + plus + 1, NULL, 0);
+        name.erase(plus);
+    }
+
+    return debug_addr(filename, name.c_str(), &addr) && sim->set_watchpoint(addr, len, type);
 }
 //-----------------------------------------------------------------
-// riscv_main
+// hle_attach: Emulate the listed routines ('name[,name...]' or 'all')
+// at their ELF symbols
 //-----------------------------------------------------------------
-int riscv_main(cosim_cpu_api *sim, int argc, char *argv[])
+static void hle_attach(cosim_cpu_api *sim, const char *filename, const char *list)
+{
+    std::string names(strcmp(list, "all") ? list : "memcpy,memset,strlen,memcmp");
+    size_t      pos = 0;
+
+    while (pos <= names.size())
+    {
+        size_t      comma = names.find(',', pos);
+        std::string name  = names.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = (comma == std::string::npos) ? names.size() + 1 : comma + 1;
+
+        long sym = filename ? elf_get_symbol(filename, name.c_str()) : -1;
+        if (sym == -1)
+            fprintf (stderr,"Error: HLE symbol %s not found\n", name.c_str());
+        else if (!sim->set_hle(name.c_str(), (uint32_t)sym))
+            fprintf (stderr,"Error: Could not emulate %s\n", name.c_str());
+        else
+            printf("HLE: %s 0x%08x\n", name.c_str(), (uint32_t)sym);
+    }
+}
+//-----------------------------------------------------------------
+// Long options
+//-----------------------------------------------------------------
+#define OPT_SAVE_AT_CYCLE   0x100
+#define OPT_SAVE_FILE       0x101
+#define OPT_RESTORE         0x102
+#define OPT_IDLE_SKIP       0x103
+#define OPT_HARTS           0x104
+#define OPT_QUANTUM         0x105
+#define OPT_SMP_THREADS     0x106
+#define OPT_TRACE_BIN       0x107
+#define OPT_PROFILE         0x108
+#define OPT_PROFILE_FOLDED  0x109
+#define OPT_PROFILE_INTERVAL 0x10A
+#define OPT_TIMING          0x10B
+#define OPT_CACHE           0x10C
+#define OPT_CACHE_REGION    0x10D
+#define OPT_CACHE_REPORT    0x10E
+#define OPT_DEVICE          0x10F
+#define OPT_UART_INPUT      0x110
+#define OPT_CONSOLE_OUT     0x111
+#define OPT_CONSOLE_IN      0x112
+#define OPT_CONSOLE_FLUSH   0x113
+#define OPT_BREAK           0x114
+#define OPT_WATCH           0x115
+#define OPT_HLE             0x116
+#define OPT_HLE_COST        0x117
+#define OPT_MEM_SPARSE      0x118
+#define OPT_MEM_FILE        0x119
+#define OPT_COVERAGE        0x11A
+#define OPT_COVERAGE_LCOV   0x11B
+
+// Functions listed per cache configuration
+#define CACHE_REPORT_FUNCTIONS  20
+
+static struct option long_options[] =
+{
+    { "save-at-cycle", required_argument, 0, OPT_SAVE_AT_CYCLE },
+    { "save-file",     required_argument, 0, OPT_SAVE_FILE },
+    { "restore",       required_argument, 0, OPT_RESTORE },
+    { "idle-skip",     no_argument,       0, OPT_IDLE_SKIP },
+    { "harts",         required_argument, 0, OPT_HARTS },
+    { "quantum",       required_argument, 0, OPT_QUANTUM },
+    { "smp-threads",   no_argument,       0, OPT_SMP_THREADS },
+    { "trace-bin",     required_argument, 0, OPT_TRACE_BIN },
+    { "profile",       required_argument, 0, OPT_PROFILE },
+    { "profile-folded",required_argument, 0, OPT_PROFILE_FOLDED },
+    { "profile-interval",required_argument, 0, OPT_PROFILE_INTERVAL },
+    { "timing",        required_argument, 0, OPT_TIMING },
+    { "cache",         required_argument, 0, OPT_CACHE },
+    { "cache-region",  required_argument, 0, OPT_CACHE_REGION },
+    { "cache-report",  required_argument, 0, OPT_CACHE_REPORT },
+    { "device",        required_argument, 0, OPT_DEVICE },
+    { "uart-input",    required_argument, 0, OPT_UART_INPUT },
+    { "console-out",   required_argument, 0, OPT_CONSOLE_OUT },
+    { "console-in",    required_argument, 0, OPT_CONSOLE_IN },
+    { "console-flush", required_argument, 0, OPT_CONSOLE_FLUSH },
+    { "break",         required_argument, 0, OPT_BREAK },
+    { "watch",         required_argument, 0, OPT_WATCH },
+    { "hle",           required_argument, 0, OPT_HLE },
+    { "hle-cost",      required_argument, 0, OPT_HLE_COST },
+    { "mem-sparse",    no_argument,       0, OPT_MEM_SPARSE },
+    { "mem-file",      required_argument, 0, OPT_MEM_FILE },
+    { "coverage",      required_argument, 0, OPT_COVERAGE },
+    { "coverage-lcov", required_argument, 0, OPT_COVERAGE_LCOV },
+    { 0, 0, 0, 0 }
+};
+//-----------------------------------------------------------------
+// riscv_main: Run 'sim' (attached to 'ctx') as set by the command
+// line. Returns the target's exit code, -1 on fault or error.
+//-----------------------------------------------------------------
+int riscv_main(cosim *ctx, cosim_cpu_api *sim, int argc, char *argv[])
 {
-    unsigned _cycles = 0;
     int max_cycles = -1;
     char *filename = NULL;
     int help = 0;
@@ -84,9 +285,41 @@ int riscv_main(cosim_cpu_api *sim, int argc, char *argv[])
     char *   dump_file      = NULL;
     char *   dump_sym_start = NULL;
     char *   dump_sym_end   = NULL;
+    int engine = -1;
+    int64_t save_cycle = -1;
+    const char *save_file = "riscv-sim.snap";
+    char *   restore_file   = NULL;
+    bool idle_skip = false;
+    int harts = 0;
+    int quantum = 1000;
+    bool smp_threads = false;
+    char *   trace_bin_file = NULL;
+    BinaryTrace trace_bin;
+    char *   profile_file   = NULL;
+    char *   profile_folded = NULL;
+    int profile_interval = PROFILE_INTERVAL_DEFAULT;
+    char *   timing_spec    = NULL;
+    CacheSim cache_sim;
+    char *   cache_report   = NULL;
+    bool cache_error = false;
+    std::vector <char *> devices;
+    char *   uart_input     = NULL;
+    Console  console;
+    char *   console_out    = NULL;
+    char *   console_in     = NULL;
+    bool console_error = false;
+    std::vector <char *> breakpoints;
+    std::vector <char *> watchpoints;
+    char *   hle_list       = NULL;
+    int hle_call_cost = HLE_CALL_COST_DEFAULT;
+    int hle_word_cost = HLE_WORD_COST_DEFAULT;
+    bool mem_sparse = false;
+    char *   mem_file       = NULL;
+    char *   coverage_file  = NULL;
+    char *   coverage_lcov  = NULL;
     int c;
 
-    while ((c = getopt (argc, argv, "t:v:f:c:r:d:b:s:e:p:j:k:")) != -1)
+    while ((c = getopt_long (argc, argv, "t:v:f:c:r:d:b:s:e:p:j:k:x:", long_options, NULL)) != -1)
     {
         switch(c)
         {
@@ -125,6 +358,118 @@ int riscv_main(cosim_cpu_api *sim, int argc, char *argv[])
             case 'k':
                 dump_sym_end = optarg;
                 break;
+            case 'x':
+                engine = (int)strtoul(optarg, NULL, 0);
+                break;
+            case OPT_SAVE_AT_CYCLE:
+                save_cycle = (int64_t)strtoull(optarg, NULL, 0);
+                break;
+            case OPT_SAVE_FILE:
+                save_file = optarg;
+                break;
+            case OPT_RESTORE:
+                restore_file = optarg;
+                break;
+            case OPT_IDLE_SKIP:
+                idle_skip = true;
+                break;
+            case OPT_HARTS:
+                harts = (int)strtoul(optarg, NULL, 0);
+                break;
+            case OPT_QUANTUM:
+                quantum = (int)strtoul(optarg, NULL, 0);
+                break;
+            case OPT_SMP_THREADS:
+                smp_threads = true;
+                break;
+            case OPT_TRACE_BIN:
+                trace_bin_file = optarg;
+                break;
+            case OPT_PROFILE:
+                profile_file = optarg;
+                break;
+            case OPT_PROFILE_FOLDED:
+                profile_folded = optarg;
+                break;
+            case OPT_PROFILE_INTERVAL:
+                profile_interval = (int)strtoul(optarg, NULL, 0);
+                break;
+            case OPT_TIMING:
+                timing_spec = optarg;
+                break;
+            case OPT_CACHE:
+                if (!cache_sim.add_config(optarg))
+                {
+                    fprintf (stderr,"Error: Bad cache configuration %s\n", optarg);
+                    cache_error = true;
+                }
+                break;
+            case OPT_CACHE_REGION:
+            {
+                // name:base:size
+                char *base = strchr(optarg, ':');
+                char *size = base ? strchr(base + 1, ':') : NULL;
+                if (!size)
+                {
+                    fprintf (stderr,"Error: Bad cache region %s\n", optarg);
+                    cache_error = true;
+                    break;
+                }
+                *base = 0;
+                cache_sim.add_region(optarg, strtoul(base + 1, NULL, 0), strtoul(size + 1, NULL, 0));
+                break;
+            }
+            case OPT_CACHE_REPORT:
+                cache_report = optarg;
+                break;
+            case OPT_DEVICE:
+                devices.push_back(optarg);
+                break;
+            case OPT_UART_INPUT:
+                uart_input = optarg;
+                break;
+            case OPT_CONSOLE_OUT:
+                console_out = optarg;
+                break;
+            case OPT_CONSOLE_IN:
+                console_in = optarg;
+                break;
+            case OPT_CONSOLE_FLUSH:
+                if (!console.set_flush(optarg))
+                {
+                    fprintf (stderr,"Error: Bad console flush policy %s\n", optarg);
+                    console_error = true;
+                }
+                break;
+            case OPT_BREAK:
+                breakpoints.push_back(optarg);
+                break;
+            case OPT_WATCH:
+                watchpoints.push_back(optarg);
+                break;
+            case OPT_HLE:
+                hle_list = optarg;
+                break;
+            case OPT_HLE_COST:
+            {
+                char *end;
+                hle_call_cost = (int)strtoul(optarg, &end, 0);
+                if (*end == ',')
+                    hle_word_cost = (int)strtoul(end + 1, NULL, 0);
+                break;
+            }
+            case OPT_MEM_SPARSE:
+                mem_sparse = true;
+                break;
+            case OPT_MEM_FILE:
+                mem_file = optarg;
+                break;
+            case OPT_COVERAGE:
+                coverage_file = optarg;
+                break;
+            case OPT_COVERAGE_LCOV:
+                coverage_lcov = optarg;
+                break;
             case '?':
             default:
                 help = 1;   
@@ -132,7 +477,7 @@ int riscv_main(cosim_cpu_api *sim, int argc, char *argv[])
         }
     }
 
-    if (help || filename == NULL)
+    if (help || cache_error || console_error || (filename == NULL && restore_file == NULL && mem_file == NULL))
     {
         fprintf (stderr,"Usage:\n");
         fprintf (stderr,"-f filename.elf = Executable to load (ELF)\n");
@@ -146,62 +491,329 @@ int riscv_main(cosim_cpu_api *sim, int argc, char *argv[])
         fprintf (stderr,"-p dumpfile.bin = Post simulation memory dump file\n");
         fprintf (stderr,"-j sym_name     = Symbol for memory dump start\n");
         fprintf (stderr,"-k sym_name     = Symbol for memory dump end\n");
-        exit(-1);
+        fprintf (stderr,"-x [0/1/2]      = Execution engine (0 = interpreter, 1 = threaded, 2 = JIT)\n");
+        fprintf (stderr,"--save-at-cycle nnnn = Save a snapshot after nnnn instructions and stop\n");
+        fprintf (stderr,"--save-file file     = Snapshot file to save (default riscv-sim.snap)\n");
+        fprintf (stderr,"--restore file       = Resume from a snapshot instead of loading an ELF\n");
+        fprintf (stderr,"--idle-skip          = Fast-forward the timer through wfi / branch to self\n");
+        fprintf (stderr,"--harts n            = Number of harts (SMP, adds a CLINT at 0x02000000)\n");
+        fprintf (stderr,"--quantum nnnn       = SMP: instructions per hart between switches (default 1000)\n");
+        fprintf (stderr,"--smp-threads        = SMP: run each hart on its own host thread\n");
+        fprintf (stderr,"--trace-bin file     = Binary trace of retired instructions (see riscv-trace)\n");
+        fprintf (stderr,"--profile file       = Flat profile by function (self / inclusive samples)\n");
+        fprintf (stderr,"--profile-folded file = Collapsed call stacks (flame graph input)\n");
+        fprintf (stderr,"--profile-interval n = Instructions per PC sample (default 1000, 1 = exact)\n");
+        fprintf (stderr,"--timing cache|tcm[,key=value] = Estimate biriscv cycles (riscv_top / riscv_tcm_top)\n");
+        fprintf (stderr,"--cache i[/d]        = Simulate L1 caches, repeat to sweep (size[k]:ways:line[:lru|fifo|random|rr][:wb|wt][:wa|nwa])\n");
+        fprintf (stderr,"--cache-region n:base:size = Named address range in the cache report\n");
+        fprintf (stderr,"--cache-report file  = Cache report file (default stdout)\n");
+        fprintf (stderr,"--device uart|timer[@base] = Add a memory mapped device (uart 0x91000000, timer 0x92000000)\n");
+        fprintf (stderr,"--uart-input file    = Characters received by the UART\n");
+        fprintf (stderr,"--console-out file   = Console output to a file, '|command' or - (default stderr)\n");
+        fprintf (stderr,"--console-in file    = Console input script for getc (-1 once used up)\n");
+        fprintf (stderr,"--console-flush p    = Console flush: newline (default), size[=bytes], halt or exit\n");
+        fprintf (stderr,"--break pc|sym       = Stop after executing this PC (repeatable)\n");
+        fprintf (stderr,"--watch [r:|w:|rw:]addr|sym[+len] = Stop after an access to the range (default w:, 4 bytes, repeatable)\n");
+        fprintf (stderr,"--hle all|name[,name] = Emulate memcpy, memset, strlen, memcmp natively at their ELF symbols\n");
+        fprintf (stderr,"--hle-cost call[,word] = Instructions charged per emulated call and per word (default %d,%d)\n", HLE_CALL_COST_DEFAULT, HLE_WORD_COST_DEFAULT);
+        fprintf (stderr,"--mem-sparse         = Allocate memory pages on first touch (reports pages used)\n");
+        fprintf (stderr,"--mem-file file      = Map an image file at -b (region size -s, copy on write, -f optional)\n");
+        fprintf (stderr,"--coverage file      = Merge executed PCs and branch outcomes into a data file (see riscv-cov)\n");
+        fprintf (stderr,"--coverage-lcov file = lcov line / branch report from the ELF's DWARF line table (- = stdout)\n");
+        return -1;
+    }
+
+    // Extra harts share the memory created below
+    if (harts && !sim->set_harts(harts, quantum, smp_threads))
+    {
+        fprintf (stderr,"Error: Could not create %d harts\n", harts);
+        return -1;
     }
 
-    if (explicit_mem)
+    if (mem_sparse && !ctx->set_sparse_memory(true))
+        fprintf (stderr,"Warning: Sparse memory not supported\n");
+
+    if (mem_file && !restore_file)
+    {
+        printf("MEM: Map %s at 0x%08x-%08x\n", mem_file, mem_base, mem_base + mem_size-1);
+        if (!ctx->create_file_memory(mem_base, mem_size, mem_file))
+        {
+            fprintf (stderr,"Error: Could not map %s\n", mem_file);
+            return -1;
+        }
+    }
+    else if (explicit_mem && !restore_file)
     {
         printf("MEM: Create memory 0x%08x-%08x\n", mem_base, mem_base + mem_size-1);
-        mem_create(NULL, mem_base, mem_size);
+        mem_create(ctx, mem_base, mem_size);
     }
 
     uint32_t start_addr = 0;
+    bool     loaded     = false;
 
+    // Resume from snapshot (memories and CPU state)
+    if (restore_file)
+    {
+        loaded = ctx->restore_snapshot(restore_file);
+        if (loaded)
+            printf("Restored from %s\n", restore_file);
+        else
+            fprintf (stderr,"Error: Could not restore %s\n", restore_file);
+    }
+    // Raw image only, start at its base
+    else if (!filename)
+    {
+        printf("Starting from 0x%08x\n", mem_base);
+        sim->reset(mem_base);
+        loaded = true;
+    }
     // Load ELF file
-    if (elf_load(filename, mem_create, mem_load, sim, &start_addr))
+    else if (elf_load(filename, mem_create, mem_load, ctx, &start_addr))
     {
         printf("Starting from 0x%08x\n", start_addr);
 
+        // Reset CPU to given start PC
+        sim->reset(start_addr);
+        loaded = true;
+    }
+    else
+        fprintf (stderr,"Error: Could not open %s\n", filename);
+
+    if (loaded)
+    {
+        // Buffered target console
+        if (console_out && !console.open_output(console_out))
+            fprintf (stderr,"Error: Could not open console output %s\n", console_out);
+        if (console_in && !console.open_input(console_in))
+            fprintf (stderr,"Error: Could not open console input %s\n", console_in);
+        sim->set_console(&console);
+
+        // Memory mapped devices
+        for (size_t i=0;i<devices.size();i++)
+            if (!device_attach(sim, devices[i], uart_input, &console))
+                fprintf (stderr,"Error: Could not add device %s\n", devices[i]);
+
+        // Breakpoints / watchpoints
+        for (size_t i=0;i<breakpoints.size();i++)
+            if (!debug_attach(sim, restore_file ? NULL : filename, breakpoints[i], false))
+                fprintf (stderr,"Error: Could not set breakpoint %s\n", breakpoints[i]);
+        for (size_t i=0;i<watchpoints.size();i++)
+            if (!debug_attach(sim, restore_file ? NULL : filename, watchpoints[i], true))
+                fprintf (stderr,"Error: Could not set watchpoint %s\n", watchpoints[i]);
+
+        // Native emulation of library routines
+        if (hle_list)
+        {
+            sim->set_hle_cost(hle_call_cost, hle_word_cost);
+            hle_attach(sim, restore_file ? NULL : filename, hle_list);
+        }
+
         // Register dump handler
         if (dump_file)
         {
-            cosim::instance()->dump_on_exit(dump_file, 
+            ctx->dump_on_exit(dump_file, 
                          (uint32_t)elf_get_symbol(filename, dump_sym_start),
                          (uint32_t)elf_get_symbol(filename, dump_sym_end));
         }
 
-        // Reset CPU to given start PC
-        sim->reset(start_addr);
-
         // Enable trace?
         if (trace)
             sim->enable_trace(trace_mask);
 
-        _cycles = 0;
+        // Binary trace (recorded by a background writer)
+        if (trace_bin_file)
+        {
+            if (!trace_bin.open(trace_bin_file) || !sim->set_binary_trace(&trace_bin))
+            {
+                fprintf (stderr,"Error: Could not trace to %s\n", trace_bin_file);
+                trace_bin.close();
+                trace_bin_file = NULL;
+            }
+        }
 
-        uint32_t current_pc = 0;
-        while (!sim->get_fault() && !sim->get_stopped() &&  current_pc != stop_pc)
+        // PC sampling profiler
+        Profiler *profiler = NULL;
+        if (profile_file || profile_folded)
         {
-            current_pc = sim->get_pc();
-            sim->step();
-            _cycles++;
+            profiler = new Profiler(profile_interval);
+            if (!sim->set_profiler(profiler))
+            {
+                fprintf (stderr,"Error: Profiling not supported\n");
+                delete profiler;
+                profiler = NULL;
+            }
+        }
 
-            if (max_cycles != -1 && max_cycles == _cycles)
-                break;
+        // Code coverage
+        Coverage *coverage = NULL;
+        if (coverage_file || coverage_lcov)
+        {
+            coverage = new Coverage();
+            if (!sim->set_coverage(coverage))
+            {
+                fprintf (stderr,"Error: Coverage not supported\n");
+                delete coverage;
+                coverage = NULL;
+            }
+        }
+
+        // biriscv timing model (interpreter only)
+        TimingModel *timing = NULL;
+        if (timing_spec)
+        {
+            t_timing_config cfg;
+            timing = new TimingModel();
+            if (!TimingModel::parse_config(timing_spec, &cfg))
+            {
+                fprintf (stderr,"Error: Bad timing configuration %s\n", timing_spec);
+                delete timing;
+                timing = NULL;
+            }
+            else
+            {
+                timing->set_config(cfg);
+                if (!sim->set_timing(timing))
+                {
+                    fprintf (stderr,"Error: Timing model not supported (single hart only)\n");
+                    delete timing;
+                    timing = NULL;
+                }
+            }
+        }
+
+        // L1 cache simulation (interpreter only)
+        bool caches = cache_sim.get_configs() > 0;
+        if (caches && !sim->set_cache_sim(&cache_sim))
+        {
+            fprintf (stderr,"Error: Cache simulation not supported (single hart only)\n");
+            caches = false;
+        }
+
+        // Select execution engine
+        if (engine != -1)
+            sim->set_engine(engine);
+
+        if (idle_skip)
+            sim->set_idle_skip(true);
+
+        cosim_run_cond cond;
+        cond.stop_pc    = stop_pc;
+        cond.trace_pc   = trace_pc;
+        cond.trace_mask = trace_mask;
+
+        // Run to the checkpoint, save and stop
+        if (save_cycle >= 0)
+        {
+            int64_t executed = sim->run(save_cycle, cond);
+
+            if (executed == save_cycle && !sim->get_fault() && !sim->get_stopped() && !sim->get_exited())
+            {
+                if (ctx->save_snapshot(save_file))
+                    printf("Saved snapshot after %lld instructions to %s\n", (long long)executed, save_file);
+                else
+                    fprintf (stderr,"Error: Could not save %s\n", save_file);
+            }
+            else
+                fprintf (stderr,"Error: Stopped before snapshot point\n");
+        }
+        else
+            sim->run(max_cycles, cond);
+
+        console.halt();
+
+        // Stopped by a breakpoint / watchpoint?
+        if ((!breakpoints.empty() || !watchpoints.empty()) && sim->get_stopped() && !sim->get_fault())
+        {
+            uint32_t watch_pc, watch_addr;
+            int      watch_type;
+
+            if (sim->get_watch_hit(&watch_pc, &watch_addr, &watch_type))
+                printf("WATCH: PC=%08x %s 0x%08x\n", watch_pc, (watch_type == COSIM_WATCH_WRITE) ? "write" : "read", watch_addr);
+            else
+                printf("BREAK: PC=%08x\n", sim->get_pc());
+        }
+
+        if (trace_bin_file)
+        {
+            sim->set_binary_trace(NULL);
+            trace_bin.close();
+            printf("Binary trace: %llu instructions [%s]\n", (unsigned long long)trace_bin.get_records(), trace_bin_file);
+        }
+
+        if (timing)
+        {
+            sim->set_timing(NULL);
+            timing->print(stdout);
+            delete timing;
+        }
 
-            // Turn trace on
-            if (trace_pc == current_pc)
-                sim->enable_trace(trace_mask);
-        }   
+        if (caches)
+        {
+            sim->set_cache_sim(NULL);
+
+            FILE *f = cache_report ? fopen(cache_report, "w") : stdout;
+            if (f)
+            {
+                cache_sim.print(f, restore_file ? NULL : filename, CACHE_REPORT_FUNCTIONS);
+                if (f != stdout)
+                    fclose(f);
+            }
+            else
+                fprintf (stderr,"Error: Could not write %s\n", cache_report);
+        }
+
+        // Reports (symbols from the ELF, addresses after a restore)
+        if (profiler)
+        {
+            sim->set_profiler(NULL);
+
+            const char *elf = restore_file ? NULL : filename;
+            if (profile_file && !profiler->write_flat(profile_file, elf))
+                fprintf (stderr,"Error: Could not write %s\n", profile_file);
+            if (profile_folded && !profiler->write_folded(profile_folded, elf))
+                fprintf (stderr,"Error: Could not write %s\n", profile_folded);
+
+            printf("Profile: %llu samples\n", (unsigned long long)profiler->get_samples());
+            delete profiler;
+        }
+
+        // Merged first, so the report covers all runs sharing the file.
+        // Failing to write either fails the run (CI would lose the report).
+        bool coverage_error = false;
+        if (coverage)
+        {
+            sim->set_coverage(NULL);
 
-        cosim::instance()->at_exit(sim->get_fault());
+            printf("Coverage: %llu PCs executed\n", (unsigned long long)coverage->get_executed());
+
+            if (coverage_file && !coverage->save(coverage_file, true))
+            {
+                fprintf (stderr,"Error: Could not write %s\n", coverage_file);
+                coverage_error = true;
+            }
+            if (coverage_lcov && (restore_file || !coverage->write_lcov(coverage_lcov, filename)))
+            {
+                fprintf (stderr,"Error: Could not write %s (needs an ELF with line info)\n", coverage_lcov);
+                coverage_error = true;
+            }
+            delete coverage;
+        }
+
+        // Simulation over, write out buffered console output
+        sim->set_console(NULL);
+        console.close();
+
+        int exit_code;
+        if (sim->get_exited())
+            exit_code = ctx->at_exit(sim->get_exit_code());
+        else
+            exit_code = ctx->at_exit(sim->get_fault() ? -1 : 0);
+
+        if (coverage_error && exit_code == 0)
+            exit_code = -1;
+
+        return exit_code;
     }
-    else
-        fprintf (stderr,"Error: Could not open %s\n", filename);
 
-    // Fault occurred?
-    if (sim->get_fault())
-        return 1;
-    else
-        return 0;
+    return -1;
 }
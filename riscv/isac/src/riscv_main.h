@@ -6,6 +6,6 @@
 //-------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------
-int riscv_main(cosim_cpu_api *sim, int argc, char *argv[]);
+int riscv_main(cosim *ctx, cosim_cpu_api *sim, int argc, char *argv[]);
 
 #endif
\ No newline at end of file
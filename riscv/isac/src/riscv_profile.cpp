@@ -0,0 +1,336 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "riscv_profile.h"
+#include "elf_load.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+Profiler::Profiler(int interval)
+{
+    m_interval = (interval > 0) ? interval : 1;
+    set_harts(1);
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+Profiler::~Profiler()
+{
+    for (size_t i = 0; i < m_harts.size(); i++)
+    {
+        for (std::unordered_map <uint32_t, s_node *>::iterator it = m_harts[i]->root.children.begin(); it != m_harts[i]->root.children.end(); ++it)
+            delete_node(it->second);
+        delete m_harts[i];
+    }
+}
+//-----------------------------------------------------------------
+// delete_node: Free a call tree node and its children
+//-----------------------------------------------------------------
+void Profiler::delete_node(s_node *node)
+{
+    for (std::unordered_map <uint32_t, s_node *>::iterator it = node->children.begin(); it != node->children.end(); ++it)
+        delete_node(it->second);
+    delete node;
+}
+//-----------------------------------------------------------------
+// set_harts: Grow per hart state (existing samples are kept)
+//-----------------------------------------------------------------
+void Profiler::set_harts(int count)
+{
+    while ((int)m_harts.size() < count)
+    {
+        s_hart *hart = new s_hart;
+        hart->root.callsite = 0;
+        hart->root.parent   = NULL;
+        hart->root.depth    = 0;
+        hart->cur           = &hart->root;
+        hart->overflow      = 0;
+        m_harts.push_back(hart);
+    }
+}
+//-----------------------------------------------------------------
+// call: Descend into the child for this call site
+//-----------------------------------------------------------------
+void Profiler::call(int hart, uint32_t callsite)
+{
+    s_hart *h = m_harts[hart];
+
+    // Runaway recursion: keep attributing to the deepest frame and
+    // balance the returns that would otherwise unwind it
+    if (h->cur->depth >= PROFILE_MAX_DEPTH)
+    {
+        h->overflow++;
+        return;
+    }
+
+    s_node *&child = h->cur->children[callsite];
+    if (!child)
+    {
+        child = new s_node;
+        child->callsite = callsite;
+        child->parent   = h->cur;
+        child->depth    = h->cur->depth + 1;
+    }
+    h->cur = child;
+}
+//-----------------------------------------------------------------
+// ret: Unwind to the frame whose call site returns to 'target'.
+// Returns that match no active frame (longjmp, context switches,
+// tail calls through ra) leave the stack unchanged.
+//-----------------------------------------------------------------
+void Profiler::ret(int hart, uint32_t target)
+{
+    s_hart *h = m_harts[hart];
+
+    if (h->overflow)
+    {
+        h->overflow--;
+        return;
+    }
+
+    for (s_node *node = h->cur; node->parent; node = node->parent)
+    {
+        if (target == node->callsite + 4)
+        {
+            h->cur = node->parent;
+            return;
+        }
+    }
+}
+//-----------------------------------------------------------------
+// get_samples: Total over all harts
+//-----------------------------------------------------------------
+static void count_samples(void *arg, const std::vector <uint32_t > &stack, uint32_t pc, uint64_t count)
+{
+    *(uint64_t*)arg += count;
+}
+uint64_t Profiler::get_samples(void)
+{
+    uint64_t total = 0;
+    visit_all(count_samples, &total);
+    return total;
+}
+//-----------------------------------------------------------------
+// visit: Call 'fn' for each sampled PC with its call site stack
+//-----------------------------------------------------------------
+void Profiler::visit(const s_node *node, std::vector <uint32_t > &stack, t_visit fn, void *arg)
+{
+    for (std::unordered_map <uint32_t, uint64_t>::const_iterator it = node->samples.begin(); it != node->samples.end(); ++it)
+        fn(arg, stack, it->first, it->second);
+
+    for (std::unordered_map <uint32_t, s_node *>::const_iterator it = node->children.begin(); it != node->children.end(); ++it)
+    {
+        stack.push_back(it->first);
+        visit(it->second, stack, fn, arg);
+        stack.pop_back();
+    }
+}
+void Profiler::visit_all(t_visit fn, void *arg)
+{
+    std::vector <uint32_t > stack;
+    for (size_t i = 0; i < m_harts.size(); i++)
+        visit(&m_harts[i]->root, stack, fn, arg);
+}
+
+//-----------------------------------------------------------------
+// Symbol resolution (cached, functions by name)
+//-----------------------------------------------------------------
+struct s_resolver
+{
+    const char                                      *elf;
+    std::unordered_map <uint32_t, std::string >      cache;
+
+    const std::string &lookup(uint32_t addr)
+    {
+        std::unordered_map <uint32_t, std::string >::iterator it = cache.find(addr);
+        if (it != cache.end())
+            return it->second;
+
+        const char *name = elf ? elf_get_symbol_name(elf, addr, NULL) : NULL;
+        char buf[16];
+        if (!name)
+        {
+            sprintf(buf, "0x%08x", addr);
+            name = buf;
+        }
+        return cache[addr] = name;
+    }
+};
+
+//-----------------------------------------------------------------
+// Flat profile
+//-----------------------------------------------------------------
+struct s_func_count
+{
+    uint64_t self;
+    uint64_t total;
+};
+
+struct s_flat_ctx
+{
+    s_resolver                                      *sym;
+    std::unordered_map <std::string, s_func_count >  funcs;
+    std::vector <const std::string *>                frames;
+};
+
+static void flat_visit(void *arg, const std::vector <uint32_t > &stack, uint32_t pc, uint64_t count)
+{
+    s_flat_ctx *ctx = (s_flat_ctx *)arg;
+
+    const std::string &leaf = ctx->sym->lookup(pc);
+    ctx->funcs[leaf].self += count;
+
+    // Inclusive: each function on the stack once (recursion)
+    ctx->frames.clear();
+    ctx->frames.push_back(&leaf);
+    for (size_t i = 0; i < stack.size(); i++)
+        ctx->frames.push_back(&ctx->sym->lookup(stack[i]));
+
+    for (size_t i = 0; i < ctx->frames.size(); i++)
+    {
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++)
+            seen = (*ctx->frames[j] == *ctx->frames[i]);
+
+        if (!seen)
+            ctx->funcs[*ctx->frames[i]].total += count;
+    }
+}
+
+static bool flat_order(const std::pair <std::string, s_func_count > &a, const std::pair <std::string, s_func_count > &b)
+{
+    if (a.second.self != b.second.self)
+        return a.second.self > b.second.self;
+    if (a.second.total != b.second.total)
+        return a.second.total > b.second.total;
+    return a.first < b.first;
+}
+//-----------------------------------------------------------------
+// write_flat: Functions by self samples, with inclusive totals
+//-----------------------------------------------------------------
+bool Profiler::write_flat(const char *filename, const char *elf)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    s_resolver sym;
+    sym.elf = elf;
+
+    s_flat_ctx ctx;
+    ctx.sym = &sym;
+    visit_all(flat_visit, &ctx);
+
+    std::vector <std::pair <std::string, s_func_count > > funcs(ctx.funcs.begin(), ctx.funcs.end());
+    std::sort(funcs.begin(), funcs.end(), flat_order);
+
+    uint64_t samples = get_samples();
+    double   scale   = samples ? (100.0 / samples) : 0.0;
+
+    fprintf(f, "Flat profile: %llu samples, 1 per %d instructions\n\n", (unsigned long long)samples, m_interval);
+    fprintf(f, "  self %%         self  total %%        total  function\n");
+    for (size_t i = 0; i < funcs.size(); i++)
+        fprintf(f, "%7.2f %12llu %7.2f %12llu  %s\n",
+                funcs[i].second.self * scale, (unsigned long long)funcs[i].second.self,
+                funcs[i].second.total * scale, (unsigned long long)funcs[i].second.total,
+                funcs[i].first.c_str());
+
+    fclose(f);
+    return true;
+}
+
+//-----------------------------------------------------------------
+// Collapsed stacks
+//-----------------------------------------------------------------
+struct s_folded_ctx
+{
+    s_resolver                                      *sym;
+    std::unordered_map <std::string, uint64_t >      stacks;
+    std::string                                      key;
+};
+
+static void folded_visit(void *arg, const std::vector <uint32_t > &stack, uint32_t pc, uint64_t count)
+{
+    s_folded_ctx *ctx = (s_folded_ctx *)arg;
+
+    ctx->key.clear();
+    for (size_t i = 0; i < stack.size(); i++)
+    {
+        ctx->key += ctx->sym->lookup(stack[i]);
+        ctx->key += ';';
+    }
+    ctx->key += ctx->sym->lookup(pc);
+
+    ctx->stacks[ctx->key] += count;
+}
+//-----------------------------------------------------------------
+// write_folded: "caller;...;leaf count" lines (flamegraph.pl etc)
+//-----------------------------------------------------------------
+bool Profiler::write_folded(const char *filename, const char *elf)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    s_resolver sym;
+    sym.elf = elf;
+
+    s_folded_ctx ctx;
+    ctx.sym = &sym;
+    visit_all(folded_visit, &ctx);
+
+    std::vector <std::pair <std::string, uint64_t > > stacks(ctx.stacks.begin(), ctx.stacks.end());
+    std::sort(stacks.begin(), stacks.end());
+
+    for (size_t i = 0; i < stacks.size(); i++)
+        fprintf(f, "%s %llu\n", stacks[i].first.c_str(), (unsigned long long)stacks[i].second);
+
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,124 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_PROFILE_H__
+#define __RISCV_PROFILE_H__
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+#define PROFILE_INTERVAL_DEFAULT    1000
+#define PROFILE_MAX_DEPTH           256
+
+// Link registers (ra, t0) mark calls and returns
+#define PROFILE_LINK_REG(r)         ((r) == 1 || (r) == 5)
+
+//--------------------------------------------------------------------
+// Profiler: PC histogram (every instruction or every N) attributed to
+// a call tree built from jal / jalr link register conventions, per
+// hart. Reports resolve addresses through the ELF symbol table.
+//--------------------------------------------------------------------
+class Profiler
+{
+public:
+    Profiler(int interval = PROFILE_INTERVAL_DEFAULT);
+    ~Profiler();
+
+    // Instructions between samples (1 = exact)
+    int         get_interval(void) { return m_interval; }
+
+    // Allocate per hart state (before harts run)
+    void        set_harts(int count);
+
+    // Hart is about to execute 'pc'
+    void sample(int hart, uint32_t pc)
+    {
+        m_harts[hart]->cur->samples[pc]++;
+    }
+
+    // Call from 'callsite' / return to 'target'
+    void        call(int hart, uint32_t callsite);
+    void        ret(int hart, uint32_t target);
+
+    uint64_t    get_samples(void);
+
+    // Flat profile (self and inclusive per function), collapsed
+    // stacks for flame graph tools. 'elf' may be NULL (addresses).
+    bool        write_flat(const char *filename, const char *elf);
+    bool        write_folded(const char *filename, const char *elf);
+
+private:
+    struct s_node
+    {
+        uint32_t                                callsite;
+        s_node                                 *parent;
+        int                                     depth;
+        std::unordered_map <uint32_t, s_node *> children;
+        std::unordered_map <uint32_t, uint64_t> samples;    // PC -> count
+    };
+
+    struct s_hart
+    {
+        s_node  root;
+        s_node *cur;
+        int     overflow;   // Calls not pushed beyond PROFILE_MAX_DEPTH
+    };
+
+    typedef void (*t_visit)(void *arg, const std::vector <uint32_t > &stack, uint32_t pc, uint64_t count);
+
+    static void delete_node(s_node *node);
+    static void visit(const s_node *node, std::vector <uint32_t > &stack, t_visit fn, void *arg);
+    void        visit_all(t_visit fn, void *arg);
+
+    int                     m_interval;
+    std::vector <s_hart *>  m_harts;
+};
+
+#endif
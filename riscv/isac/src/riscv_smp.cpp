@@ -0,0 +1,432 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <thread>
+#include <condition_variable>
+#include "riscv.h"
+
+//-----------------------------------------------------------------
+// SMP run state, shared by all harts for one run()
+//-----------------------------------------------------------------
+struct s_smp_run
+{
+    Riscv                  *primary;
+    int64_t                 max;
+    const cosim_run_cond   *cond;
+    std::vector <int64_t >  executed;   // Per hart
+    std::vector <uint8_t >  halted;     // Per hart, run_hart() stopped early
+
+    // Quantum barrier (threaded)
+    std::mutex              lock;
+    std::condition_variable cv;
+    int                     arrived;
+    uint64_t                generation;
+    bool                    finish;
+};
+
+//-----------------------------------------------------------------
+// smp_slice: Run one hart for up to a quantum
+//-----------------------------------------------------------------
+static void smp_slice(s_smp_run *ctx, Riscv *cpu, int hart, int64_t quantum, int64_t (Riscv::*run_hart)(int64_t, const cosim_run_cond &))
+{
+    int64_t left = quantum;
+
+    if (ctx->max >= 0 && (ctx->max - ctx->executed[hart]) < left)
+        left = ctx->max - ctx->executed[hart];
+
+    if (left <= 0 || ctx->halted[hart])
+        return ;
+
+    int64_t executed = (cpu->*run_hart)(left, *ctx->cond);
+    ctx->executed[hart] += executed;
+
+    // Fault, breakpoint or stop PC
+    if (executed < left)
+        ctx->halted[hart] = true;
+}
+//-----------------------------------------------------------------
+// smp_finished: Any hart halted or all harts at their limit
+//-----------------------------------------------------------------
+static bool smp_finished(s_smp_run *ctx)
+{
+    bool all_done = (ctx->max >= 0);
+
+    for (size_t i=0;i<ctx->executed.size();i++)
+    {
+        if (ctx->halted[i])
+            return true;
+        if (ctx->executed[i] < ctx->max)
+            all_done = false;
+    }
+
+    return all_done;
+}
+//-----------------------------------------------------------------
+// set_harts: Create 'count' harts sharing this hart's memory. Harts
+// run round-robin for 'quantum' instructions each, or with 'threads'
+// on their own host thread, synchronising every quantum.
+//-----------------------------------------------------------------
+bool Riscv::set_harts(int count, int quantum, bool threads)
+{
+    if (count < 1 || count > MAX_HARTS || quantum < 1 || m_primary != this)
+        return false;
+
+    // The timing model, cache simulator and lockstep checker are of a single core
+    if ((m_timing || m_cache_sim || m_lockstep) && count > 1)
+        return false;
+
+    for (size_t i=1;i<m_harts.size();i++)
+        delete m_harts[i];
+    m_harts.clear();
+
+    m_smp_quantum  = quantum;
+    m_smp_threads  = threads;
+    m_clint_enable = true;
+
+    if (threads && !m_mem_lock)
+        m_mem_lock = new std::recursive_mutex;
+
+    if (threads && count > 1 && m_btrace)
+        m_btrace->set_concurrent(true);
+
+    // Per hart call stacks (not shared, so no locking when threaded)
+    if (m_profiler)
+        m_profiler->set_harts(count);
+
+    m_harts.push_back(this);
+    for (int i=1;i<count;i++)
+    {
+        Riscv *hart = new Riscv();
+
+        hart->m_hart_id = i;
+        hart->m_primary = this;
+        hart->share_memory(this);
+        hart->reset(m_pc);
+        hart->enable_trace(m_trace);
+        hart->set_binary_trace(m_btrace);
+        hart->set_profiler(m_profiler);
+        hart->set_coverage(m_coverage);
+        hart->set_engine(m_engine);
+        hart->set_idle_skip(m_idle_skip);
+        hart->set_console(m_console);
+
+        hart->m_has_breakpoints = m_has_breakpoints;
+        hart->m_breakpoints     = m_breakpoints;
+        hart->m_has_watchpoints = m_has_watchpoints;
+        hart->m_watch_read      = m_watch_read;
+        hart->m_watch_write     = m_watch_write;
+
+        hart->m_has_hle         = m_has_hle;
+        hart->m_hle_entries     = m_hle_entries;
+        hart->m_hle_routines    = m_hle_routines;
+        hart->m_hle_call_cost   = m_hle_call_cost;
+        hart->m_hle_word_cost   = m_hle_word_cost;
+
+        m_harts.push_back(hart);
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// share_memory: Use the primary hart's memory map (and devices)
+//-----------------------------------------------------------------
+void Riscv::share_memory(Riscv *primary)
+{
+    release_memory();
+
+    for (int m=0;m<primary->m_mem_regions;m++)
+    {
+        m_mem[m]        = primary->m_mem[m];
+        m_mem_device[m] = primary->m_mem_device[m];
+        m_mem_base[m]   = primary->m_mem_base[m];
+        m_mem_size[m]   = primary->m_mem_size[m];
+    }
+
+    m_mem_regions      = primary->m_mem_regions;
+    m_mem_page_host    = primary->m_mem_page_host;
+    m_mem_page_region  = primary->m_mem_page_region;
+    m_mem_lock         = primary->m_mem_lock;
+    m_device_mapped    = primary->m_device_mapped;
+    m_clint_enable     = primary->m_clint_enable;
+
+    flush_decode_cache();
+}
+//-----------------------------------------------------------------
+// run_smp: run() for all harts, stops when any hart faults, exits,
+// stops or hits the stop PC, or all harts executed 'max' instructions.
+// Returns instructions executed by hart 0.
+//-----------------------------------------------------------------
+int64_t Riscv::run_smp(int64_t max, const cosim_run_cond &cond)
+{
+    s_smp_run ctx;
+    int       harts = (int)m_harts.size();
+
+    ctx.primary    = this;
+    ctx.max        = max;
+    ctx.cond       = &cond;
+    ctx.arrived    = 0;
+    ctx.generation = 0;
+    ctx.finish     = false;
+    ctx.executed.resize(harts, 0);
+    ctx.halted.resize(harts, 0);
+
+    if (m_smp_threads)
+    {
+        std::vector <std::thread > threads;
+
+        // Hart 0 runs on the calling thread
+        for (int i=1;i<harts;i++)
+            threads.push_back(std::thread(smp_worker, &ctx, i));
+        smp_worker(&ctx, 0);
+
+        for (size_t i=0;i<threads.size();i++)
+            threads[i].join();
+    }
+    else
+    {
+        // Round-robin, deterministic
+        while (!smp_finished(&ctx))
+        {
+            for (int i=0;i<harts;i++)
+                smp_slice(&ctx, m_harts[i], i, m_smp_quantum, &Riscv::run_hart);
+            clint_tick();
+        }
+    }
+
+    // A fault, breakpoint or exit on any hart stops the system
+    for (int i=1;i<harts;i++)
+    {
+        m_fault |= m_harts[i]->m_fault;
+        m_break |= m_harts[i]->m_break;
+
+        if (m_harts[i]->m_watch_hit && !m_watch_hit)
+        {
+            m_watch_hit  = true;
+            m_watch_pc   = m_harts[i]->m_watch_pc;
+            m_watch_addr = m_harts[i]->m_watch_addr;
+            m_watch_type = m_harts[i]->m_watch_type;
+        }
+
+        if (m_harts[i]->m_exited && !m_exited)
+        {
+            m_exited    = true;
+            m_exit_code = m_harts[i]->m_exit_code;
+        }
+    }
+
+    return ctx.executed[0];
+}
+//-----------------------------------------------------------------
+// smp_worker: Host thread for one hart. All harts meet at the end of
+// each quantum, the last to arrive decides whether to carry on.
+//-----------------------------------------------------------------
+void Riscv::smp_worker(s_smp_run *ctx, int hart)
+{
+    Riscv *cpu     = ctx->primary->m_harts[hart];
+    int    harts   = (int)ctx->executed.size();
+    int    quantum = ctx->primary->m_smp_quantum;
+
+    for (;;)
+    {
+        smp_slice(ctx, cpu, hart, quantum, &Riscv::run_hart);
+
+        std::unique_lock <std::mutex > guard(ctx->lock);
+        uint64_t generation = ctx->generation;
+
+        if (++ctx->arrived == harts)
+        {
+            ctx->primary->clint_tick();
+            ctx->arrived = 0;
+            ctx->finish  = smp_finished(ctx);
+            ctx->generation++;
+            ctx->cv.notify_all();
+        }
+        else
+        {
+            while (ctx->generation == generation)
+                ctx->cv.wait(guard);
+        }
+
+        if (ctx->finish)
+            break;
+    }
+}
+//-----------------------------------------------------------------
+// clint_access: CLINT register access (word only). msip and mtimecmp
+// belong to the addressed hart, mtime is shared (see clint_tick()).
+//-----------------------------------------------------------------
+bool Riscv::clint_access(uint32_t address, bool write, uint32_t *value)
+{
+    uint32_t offset = address - CLINT_BASE;
+    int      index;
+
+    if (offset >= CLINT_SIZE || (offset & 3))
+        return false;
+
+    // One mtime for all harts, writes are ignored
+    if (offset >= CLINT_MTIME)
+    {
+        if (!write)
+            *value = (uint32_t)(clint_mtime() >> ((offset & 4) ? 32 : 0));
+        return true;
+    }
+
+    if (offset >= CLINT_MTIMECMP)
+        index = (offset - CLINT_MTIMECMP) / 8;
+    else
+        index = (offset - CLINT_MSIP) / 4;
+
+    // No such hart, read as zero
+    if (index >= m_primary->get_harts())
+    {
+        if (!write)
+            *value = 0;
+        return true;
+    }
+
+    Riscv *hart = m_primary->get_hart(index);
+    {
+        std::lock_guard <std::mutex > guard(hart->m_clint_lock);
+
+        if (offset < CLINT_MTIMECMP)
+        {
+            if (write)
+                hart->m_clint_msip = *value & 1;
+            else
+                *value = hart->m_clint_msip;
+        }
+        else
+        {
+            int shift = (offset & 4) ? 32 : 0;
+
+            if (write)
+            {
+                hart->m_clint_mtimecmp &= ~((uint64_t)0xFFFFFFFF << shift);
+                hart->m_clint_mtimecmp |= (uint64_t)*value << shift;
+                hart->m_clint_mtimecmp_set = true;
+            }
+            else
+                *value = (uint32_t)(hart->m_clint_mtimecmp >> shift);
+        }
+
+        if (write)
+            hart->m_clint_pending.store(true, std::memory_order_release);
+    }
+
+    // Own registers take effect straight away
+    if (write && hart == this)
+        clint_apply();
+
+    return true;
+}
+//-----------------------------------------------------------------
+// clint_apply: Update mip from this hart's CLINT registers
+//-----------------------------------------------------------------
+void Riscv::clint_apply(void)
+{
+    std::lock_guard <std::mutex > guard(m_clint_lock);
+    uint32_t timer_ip = (m_csr_mideleg & SR_IP_STIP) ? SR_IP_STIP : SR_IP_MTIP;
+
+    m_clint_pending.store(false, std::memory_order_relaxed);
+
+    if (m_clint_msip)
+        m_csr_mip |= SR_IP_MSIP;
+    else
+        m_csr_mip &= ~SR_IP_MSIP;
+
+    // Once mtimecmp is written, pending while the shared mtime >= mtimecmp.
+    // mtime is hart 0's timer, so hart 0 also checks every tick.
+    if (m_clint_mtimecmp_set)
+    {
+        m_clint_mtimecmp_set = false;
+        m_clint_timer        = true;
+
+        if (m_primary == this)
+            m_csr_mtimecmp = m_clint_mtimecmp;
+    }
+
+    if (m_clint_timer)
+    {
+        if (clint_mtime() >= m_clint_mtimecmp)
+            m_csr_mip |= timer_ip;
+        else
+            m_csr_mip &= ~timer_ip;
+    }
+
+    m_events |= RUN_EVENT_IRQ;
+}
+//-----------------------------------------------------------------
+// clint_mtime: Shared mtime, hart 0's timer at the end of the last
+// quantum (its current timer with a single hart)
+//-----------------------------------------------------------------
+uint64_t Riscv::clint_mtime(void)
+{
+    if (m_primary->m_harts.size() > 1)
+        return m_primary->m_clint_mtime;
+
+    return m_primary->m_csr_mtime;
+}
+//-----------------------------------------------------------------
+// clint_tick: Advance the shared mtime to hart 0's timer, at the end
+// of each quantum while no hart runs. Harts using the CLINT timer
+// compare their mtimecmp against it on their next step.
+//-----------------------------------------------------------------
+void Riscv::clint_tick(void)
+{
+    m_clint_mtime = m_csr_mtime;
+
+    for (size_t i=0;i<m_harts.size();i++)
+    {
+        Riscv *hart = m_harts[i];
+        std::lock_guard <std::mutex > guard(hart->m_clint_lock);
+
+        if (hart->m_clint_timer || hart->m_clint_mtimecmp_set)
+            hart->m_clint_pending.store(true, std::memory_order_release);
+    }
+}
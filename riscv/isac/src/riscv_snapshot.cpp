@@ -0,0 +1,304 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "riscv.h"
+
+//-----------------------------------------------------------------
+// Defines:
+//-----------------------------------------------------------------
+#define SNAPSHOT_TAG_CPU        0x55504352  // "RCPU"
+#define SNAPSHOT_TAG_MEM        0x4d454d52  // "RMEM"
+#define SNAPSHOT_VERSION        2
+
+//-----------------------------------------------------------------
+// Little endian field I/O
+//-----------------------------------------------------------------
+static void snap_write32(FILE *f, uint32_t value)
+{
+    uint8_t buf[4];
+
+    for (int i=0;i<4;i++)
+        buf[i] = value >> (i * 8);
+
+    fwrite(buf, 1, 4, f);
+}
+static void snap_write64(FILE *f, uint64_t value)
+{
+    snap_write32(f, (uint32_t)value);
+    snap_write32(f, (uint32_t)(value >> 32));
+}
+static bool snap_read32(FILE *f, uint32_t *value)
+{
+    uint8_t buf[4];
+
+    if (fread(buf, 1, 4, f) != 4)
+        return false;
+
+    *value = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    return true;
+}
+static bool snap_read64(FILE *f, uint64_t *value)
+{
+    uint32_t lo, hi;
+
+    if (!snap_read32(f, &lo) || !snap_read32(f, &hi))
+        return false;
+
+    *value = ((uint64_t)hi << 32) | lo;
+    return true;
+}
+//-----------------------------------------------------------------
+// save_state: Write architectural state (registers, CSRs, privilege,
+// MMU and pending interrupts) of each hart
+//-----------------------------------------------------------------
+bool Riscv::save_state(FILE *f)
+{
+    snap_write32(f, SNAPSHOT_TAG_CPU);
+    snap_write32(f, SNAPSHOT_VERSION);
+    snap_write32(f, get_harts());
+
+    for (int i=0;i<get_harts();i++)
+        get_hart(i)->save_hart(f);
+
+    return !ferror(f);
+}
+//-----------------------------------------------------------------
+// restore_state: Read state written by save_state(), the hart count
+// must match.
+//-----------------------------------------------------------------
+bool Riscv::restore_state(FILE *f)
+{
+    uint32_t tag, version, harts;
+    bool     ok = true;
+
+    if (!snap_read32(f, &tag) || !snap_read32(f, &version) || tag != SNAPSHOT_TAG_CPU || version != SNAPSHOT_VERSION)
+        return false;
+
+    if (!snap_read32(f, &harts) || harts != (uint32_t)get_harts())
+        return false;
+
+    for (int i=0;i<get_harts();i++)
+        ok &= get_hart(i)->restore_hart(f);
+
+    return ok;
+}
+//-----------------------------------------------------------------
+// save_hart: Write this hart's state
+//-----------------------------------------------------------------
+void Riscv::save_hart(FILE *f)
+{
+    snap_write32(f, m_pc);
+    snap_write32(f, m_pc_x);
+    for (int i=0;i<REGISTERS;i++)
+        snap_write32(f, m_gpr[i]);
+
+    // Machine
+    snap_write32(f, m_csr_mpriv);
+    snap_write32(f, m_csr_msr);
+    snap_write32(f, m_csr_mepc);
+    snap_write32(f, m_csr_mcause);
+    snap_write32(f, m_csr_mevec);
+    snap_write32(f, m_csr_mie);
+    snap_write32(f, m_csr_mip);
+    snap_write64(f, m_csr_mtime);
+    snap_write64(f, m_csr_mtimecmp);
+    snap_write32(f, m_csr_mscratch);
+    snap_write32(f, m_csr_mideleg);
+    snap_write32(f, m_csr_medeleg);
+
+    // Supervisor
+    snap_write32(f, m_csr_sepc);
+    snap_write32(f, m_csr_sevec);
+    snap_write32(f, m_csr_scause);
+    snap_write32(f, m_csr_stval);
+    snap_write32(f, m_csr_satp);
+    snap_write32(f, m_csr_sscratch);
+}
+//-----------------------------------------------------------------
+// restore_hart: Read state written by save_hart()
+//-----------------------------------------------------------------
+bool Riscv::restore_hart(FILE *f)
+{
+    bool ok = true;
+
+    ok &= snap_read32(f, &m_pc);
+    ok &= snap_read32(f, &m_pc_x);
+    for (int i=0;i<REGISTERS;i++)
+        ok &= snap_read32(f, &m_gpr[i]);
+
+    // Machine
+    ok &= snap_read32(f, &m_csr_mpriv);
+    ok &= snap_read32(f, &m_csr_msr);
+    ok &= snap_read32(f, &m_csr_mepc);
+    ok &= snap_read32(f, &m_csr_mcause);
+    ok &= snap_read32(f, &m_csr_mevec);
+    ok &= snap_read32(f, &m_csr_mie);
+    ok &= snap_read32(f, &m_csr_mip);
+    ok &= snap_read64(f, &m_csr_mtime);
+    ok &= snap_read64(f, &m_csr_mtimecmp);
+    ok &= snap_read32(f, &m_csr_mscratch);
+    ok &= snap_read32(f, &m_csr_mideleg);
+    ok &= snap_read32(f, &m_csr_medeleg);
+
+    // Supervisor
+    ok &= snap_read32(f, &m_csr_sepc);
+    ok &= snap_read32(f, &m_csr_sevec);
+    ok &= snap_read32(f, &m_csr_scause);
+    ok &= snap_read32(f, &m_csr_stval);
+    ok &= snap_read32(f, &m_csr_satp);
+    ok &= snap_read32(f, &m_csr_sscratch);
+
+    m_fault      = false;
+    m_break      = false;
+    m_exited     = false;
+    m_exit_code  = 0;
+    m_error[0]   = 0;
+    m_resv_valid = false;
+
+    // Cached translations and decodes belong to the old state
+#ifdef CONFIG_MMU
+    tlb_flush(true, 0, true, 0);
+#endif
+    flush_decode_cache();
+    m_events &= ~RUN_EVENT_HALT;
+    m_events |= RUN_EVENT_IRQ;
+    update_events();
+
+    return ok;
+}
+//-----------------------------------------------------------------
+// save_memory: Write RAM regions, only pages holding non-zero data
+//-----------------------------------------------------------------
+bool Riscv::save_memory(FILE *f)
+{
+    static const uint8_t zero[MEM_PAGE_SIZE] = { 0 };
+    int regions = 0;
+
+    // Device regions have no backing store to save
+    for (int j=0;j<m_mem_regions;j++)
+        if (m_mem[j]->get_host_ptr())
+            regions++;
+
+    snap_write32(f, SNAPSHOT_TAG_MEM);
+    snap_write32(f, SNAPSHOT_VERSION);
+    snap_write32(f, regions);
+
+    for (int j=0;j<m_mem_regions;j++)
+    {
+        const uint8_t *host = m_mem[j]->get_host_ptr();
+        uint32_t       size = m_mem_size[j];
+        uint32_t       pages = 0;
+
+        if (!host)
+            continue;
+
+        for (uint32_t offset=0;offset<size;offset+=MEM_PAGE_SIZE)
+        {
+            uint32_t len = (size - offset) < MEM_PAGE_SIZE ? (size - offset) : MEM_PAGE_SIZE;
+            if (memcmp(host + offset, zero, len))
+                pages++;
+        }
+
+        snap_write32(f, m_mem_base[j]);
+        snap_write32(f, size);
+        snap_write32(f, pages);
+
+        for (uint32_t offset=0;offset<size;offset+=MEM_PAGE_SIZE)
+        {
+            uint32_t len = (size - offset) < MEM_PAGE_SIZE ? (size - offset) : MEM_PAGE_SIZE;
+            if (!memcmp(host + offset, zero, len))
+                continue;
+
+            snap_write32(f, offset);
+            fwrite(host + offset, 1, len, f);
+        }
+    }
+
+    return !ferror(f);
+}
+//-----------------------------------------------------------------
+// restore_memory: Recreate RAM regions written by save_memory()
+//-----------------------------------------------------------------
+bool Riscv::restore_memory(FILE *f)
+{
+    uint32_t tag, version, regions;
+
+    if (!snap_read32(f, &tag) || !snap_read32(f, &version) || !snap_read32(f, &regions) ||
+        tag != SNAPSHOT_TAG_MEM || version != SNAPSHOT_VERSION)
+        return false;
+
+    for (uint32_t r=0;r<regions;r++)
+    {
+        uint32_t base, size, pages;
+
+        if (!snap_read32(f, &base) || !snap_read32(f, &size) || !snap_read32(f, &pages))
+            return false;
+
+        if (!create_memory(base, size))
+            return false;
+
+        uint8_t *host = m_mem[m_mem_regions-1]->get_host_ptr();
+        assert(host);
+
+        for (uint32_t p=0;p<pages;p++)
+        {
+            uint32_t offset;
+
+            if (!snap_read32(f, &offset) || offset >= size)
+                return false;
+
+            uint32_t len = (size - offset) < MEM_PAGE_SIZE ? (size - offset) : MEM_PAGE_SIZE;
+            if (fread(host + offset, 1, len, f) != len)
+                return false;
+        }
+    }
+
+    flush_decode_cache();
+    return true;
+}
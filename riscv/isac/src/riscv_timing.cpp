@@ -0,0 +1,561 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include "riscv_timing.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define RAS_INVALID         0x00000001
+#define BTB_LFSR_INIT       0x0001
+#define BTB_LFSR_TAP        0xB400
+
+// Fetch / decode before the first issue, E2 / writeback after the last
+#define PIPE_FILL           2
+#define PIPE_DRAIN          2
+
+//-----------------------------------------------------------------
+// Presets
+//-----------------------------------------------------------------
+static const t_timing_config s_preset_cache =
+{
+    1,              // dual_issue
+    1,              // load_bypass
+    1,              // mul_bypass
+    0,              // extra_decode
+    1,              // branch_prediction
+    32,             // btb_entries
+    512,            // bht_entries
+    8,              // ras_entries
+    34,             // div_cycles
+    3,              // csr_cycles
+    3,              // flush_penalty
+    16 * 1024,      // icache_size
+    2,              // icache_ways
+    16 * 1024,      // dcache_size
+    2,              // dcache_ways
+    32,             // line_size
+    0x80000000,     // cache_min
+    0x8fffffff,     // cache_max
+    3,              // mem_latency
+    4,              // icache_beat
+    4               // dcache_beat
+};
+
+//-----------------------------------------------------------------
+// Configuration keys (integer fields)
+//-----------------------------------------------------------------
+static const struct
+{
+    const char *name;
+    int t_timing_config::*field;
+} s_config_keys[] =
+{
+    { "dual_issue",        &t_timing_config::dual_issue },
+    { "load_bypass",       &t_timing_config::load_bypass },
+    { "mul_bypass",        &t_timing_config::mul_bypass },
+    { "extra_decode",      &t_timing_config::extra_decode },
+    { "branch_prediction", &t_timing_config::branch_prediction },
+    { "btb_entries",       &t_timing_config::btb_entries },
+    { "bht_entries",       &t_timing_config::bht_entries },
+    { "ras_entries",       &t_timing_config::ras_entries },
+    { "div_cycles",        &t_timing_config::div_cycles },
+    { "csr_cycles",        &t_timing_config::csr_cycles },
+    { "flush_penalty",     &t_timing_config::flush_penalty },
+    { "icache_size",       &t_timing_config::icache_size },
+    { "icache_ways",       &t_timing_config::icache_ways },
+    { "dcache_size",       &t_timing_config::dcache_size },
+    { "dcache_ways",       &t_timing_config::dcache_ways },
+    { "line_size",         &t_timing_config::line_size },
+    { "mem_latency",       &t_timing_config::mem_latency },
+    { "icache_beat",       &t_timing_config::icache_beat },
+    { "dcache_beat",       &t_timing_config::dcache_beat },
+    { NULL, NULL }
+};
+
+static bool is_pow2(int x)
+{
+    return x > 0 && (x & (x - 1)) == 0;
+}
+//-----------------------------------------------------------------
+// parse_config: "<preset>[,key=value...]"
+//-----------------------------------------------------------------
+bool TimingModel::parse_config(const char *spec, t_timing_config *cfg)
+{
+    char buf[512];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+
+    char *save = NULL;
+    char *tok  = strtok_r(buf, ",", &save);
+
+    // Preset, riscv_tcm_top has no caches
+    *cfg = s_preset_cache;
+    if (tok && !strcmp(tok, "tcm"))
+    {
+        cfg->icache_size = 0;
+        cfg->dcache_size = 0;
+    }
+    else if (tok && strcmp(tok, "cache"))
+        return false;
+
+    while ((tok = strtok_r(NULL, ",", &save)) != NULL)
+    {
+        char *eq = strchr(tok, '=');
+        if (!eq)
+            return false;
+        *eq++ = 0;
+
+        uint32_t value = strtoul(eq, NULL, 0);
+
+        if (!strcmp(tok, "cache_min"))
+            cfg->cache_min = value;
+        else if (!strcmp(tok, "cache_max"))
+            cfg->cache_max = value;
+        else
+        {
+            int i;
+            for (i=0;s_config_keys[i].name;i++)
+                if (!strcmp(tok, s_config_keys[i].name))
+                    break;
+
+            if (!s_config_keys[i].name)
+                return false;
+
+            cfg->*(s_config_keys[i].field) = (int)value;
+        }
+    }
+
+    // Table sizes are indexed by address bits in the RTL
+    if (!is_pow2(cfg->btb_entries) || !is_pow2(cfg->bht_entries) || !is_pow2(cfg->ras_entries))
+        return false;
+    if (!is_pow2(cfg->line_size) || cfg->line_size < 4 || cfg->icache_beat <= 0 || cfg->dcache_beat <= 0)
+        return false;
+    if (cfg->icache_size && (cfg->icache_ways <= 0 || !is_pow2(cfg->icache_size / (cfg->line_size * cfg->icache_ways))))
+        return false;
+    if (cfg->dcache_size && (cfg->dcache_ways <= 0 || !is_pow2(cfg->dcache_size / (cfg->line_size * cfg->dcache_ways))))
+        return false;
+
+    return true;
+}
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+TimingModel::TimingModel()
+{
+    set_config(s_preset_cache);
+}
+//-----------------------------------------------------------------
+// set_config: Select configuration and reset
+//-----------------------------------------------------------------
+void TimingModel::set_config(const t_timing_config &cfg)
+{
+    m_cfg = cfg;
+    reset();
+}
+//-----------------------------------------------------------------
+// reset: Empty pipeline, predictors and caches, clear stats
+//-----------------------------------------------------------------
+void TimingModel::reset(void)
+{
+    m_cycle         = 0;
+    m_fetch_ready   = 0;
+    m_fetch_cause   = STALL_TRAP;
+    m_block_until   = 0;
+    m_block_cause   = STALL_DIV;
+    m_lsu_cycle     = 0;
+    m_pair_open     = false;
+    m_pair_pc       = 0;
+    m_pair_class    = CLASS_EXEC;
+    m_pair_rd       = 0;
+    m_fetch_line    = 0xFFFFFFFF;
+    memset(m_ready, 0, sizeof(m_ready));
+
+    s_btb empty = { 0, 0, false, false, false };
+    m_btb.assign(m_cfg.btb_entries, empty);
+    m_bht.assign(m_cfg.bht_entries, 3);
+    m_ras.assign(m_cfg.ras_entries, RAS_INVALID);
+    m_ras_index     = 0;
+    m_lfsr          = BTB_LFSR_INIT;
+
+    // Ways replaced in turn, write back / allocate (icache.v, dcache_core.v)
+    t_cache_config cache;
+    cache.line           = m_cfg.line_size;
+    cache.policy         = CACHE_REPL_ROUND_ROBIN;
+    cache.write_back     = true;
+    cache.write_allocate = true;
+
+    cache.size = m_cfg.icache_size;
+    cache.ways = m_cfg.icache_ways;
+    m_icache.configure(cache);
+
+    cache.size = m_cfg.dcache_size;
+    cache.ways = m_cfg.dcache_ways;
+    m_dcache.configure(cache);
+
+    m_instructions  = 0;
+    m_dual          = 0;
+    m_branches      = 0;
+    m_mispredicts   = 0;
+    memset(m_stalls, 0, sizeof(m_stalls));
+}
+//-----------------------------------------------------------------
+// classify: Execution unit (biriscv_decoder.v)
+//-----------------------------------------------------------------
+int TimingModel::classify(uint32_t opcode)
+{
+    switch (opcode & 0x7f)
+    {
+        case 0x03: // LOAD
+        case 0x23: // STORE
+            return CLASS_LSU;
+        case 0x63: // BRANCH
+        case 0x6f: // JAL
+        case 0x67: // JALR
+            return CLASS_BRANCH;
+        case 0x33: // OP
+            if (((opcode >> 25) & 0x7f) == 1)
+                return (((opcode >> 12) & 7) < 4) ? CLASS_MUL : CLASS_DIV;
+            return CLASS_EXEC;
+        case 0x13: // OP-IMM
+        case 0x37: // LUI
+        case 0x17: // AUIPC
+            return CLASS_EXEC;
+        // SYSTEM, FENCE, and anything else is serialised by the CSR unit
+        default:
+            return CLASS_CSR;
+    }
+}
+//-----------------------------------------------------------------
+// predict: Next fetch PC from the BTB / BHT / RAS
+//-----------------------------------------------------------------
+uint32_t TimingModel::predict(uint32_t pc, int *btb_entry)
+{
+    *btb_entry = -1;
+
+    if (!m_cfg.branch_prediction)
+        return pc + 4;
+
+    for (int i=0;i<(int)m_btb.size();i++)
+        if (m_btb[i].pc == pc)
+            *btb_entry = i;
+
+    if (*btb_entry < 0)
+        return pc + 4;
+
+    const s_btb &e = m_btb[*btb_entry];
+    uint32_t ras_pc = m_ras[m_ras_index];
+
+    if (e.is_ret && !(ras_pc & 1))
+        return ras_pc;
+    if (e.is_jmp || m_bht[(pc >> 2) & (m_cfg.bht_entries - 1)] >= 2)
+        return e.target;
+
+    return pc + 4;
+}
+//-----------------------------------------------------------------
+// train: Update predictors with the resolved branch. The BTB only
+// learns on a mispredict, as in biriscv_npc.v.
+//-----------------------------------------------------------------
+void TimingModel::train(uint32_t pc, uint32_t opcode, uint32_t next_pc, bool mispredict, int btb_entry)
+{
+    if (!m_cfg.branch_prediction)
+        return;
+
+    int  major   = opcode & 0x7f;
+    int  rd      = (opcode >> 7) & 31;
+    int  rs1     = (opcode >> 15) & 31;
+    bool taken   = (next_pc != pc + 4);
+    bool is_jmp  = (major != 0x63);
+    bool is_call = is_jmp && rd == 1;
+    bool is_ret  = major == 0x67 && rd == 0 && rs1 == 1;
+
+    if (!is_jmp)
+    {
+        uint8_t &sat = m_bht[(pc >> 2) & (m_cfg.bht_entries - 1)];
+        if (taken && sat < 3)
+            sat++;
+        else if (!taken && sat > 0)
+            sat--;
+    }
+
+    if (is_call)
+    {
+        m_ras_index = (m_ras_index + 1) & (m_cfg.ras_entries - 1);
+        m_ras[m_ras_index] = pc + 4;
+    }
+    else if (is_ret)
+        m_ras_index = (m_ras_index - 1) & (m_cfg.ras_entries - 1);
+
+    if (!mispredict)
+        return;
+
+    // Allocate with the LFSR on a miss
+    if (btb_entry < 0)
+    {
+        btb_entry = m_lfsr & (m_cfg.btb_entries - 1);
+        m_lfsr    = (m_lfsr & 1) ? ((m_lfsr >> 1) ^ BTB_LFSR_TAP) : (m_lfsr >> 1);
+        m_btb[btb_entry].target = next_pc;
+    }
+    else if (taken)
+        m_btb[btb_entry].target = next_pc;
+
+    m_btb[btb_entry].pc      = pc;
+    m_btb[btb_entry].is_call = is_call;
+    m_btb[btb_entry].is_ret  = is_ret;
+    m_btb[btb_entry].is_jmp  = is_jmp;
+}
+//-----------------------------------------------------------------
+// retire: Schedule one instruction
+//-----------------------------------------------------------------
+void TimingModel::retire(const t_trace_record &rec, uint32_t mem_phys, uint32_t next_pc)
+{
+    uint32_t opcode = rec.opcode;
+    int      major  = opcode & 0x7f;
+    int      cls    = classify(opcode);
+
+    // The scoreboard checks the raw register fields of every opcode
+    int      rd     = (opcode >> 7) & 31;
+    int      rs1    = (opcode >> 15) & 31;
+    int      rs2    = (opcode >> 20) & 31;
+    bool     alloc  = rd != 0 && major != 0x23 && major != 0x63 && major != 0x0f;
+
+    m_instructions++;
+
+    // Fetch: new line through the icache
+    uint32_t line = rec.pc >> m_icache.get_line_shift();
+    if (m_icache.enabled() && line != m_fetch_line)
+    {
+        m_fetch_line = line;
+        if (!(m_icache.access(rec.pc, false) & CACHE_HIT))
+        {
+            uint64_t start = (m_fetch_ready > m_cycle) ? m_fetch_ready : m_cycle;
+            m_fetch_ready = start + m_cfg.mem_latency + (m_cfg.line_size / m_cfg.icache_beat);
+            m_fetch_cause = STALL_ICACHE;
+        }
+    }
+
+    // Second slot of the current cycle: next word of an aligned fetch
+    // pair, combinations from biriscv_issue.v, no dependency on slot 0
+    bool     pair_ok = false;
+    if (m_pair_open && m_cfg.dual_issue && rec.pc == m_pair_pc + 4)
+    {
+        switch (cls)
+        {
+            case CLASS_EXEC:
+            case CLASS_BRANCH:
+                pair_ok = true;
+                break;
+            case CLASS_LSU:
+                pair_ok = (m_pair_class != CLASS_LSU);
+                break;
+            case CLASS_MUL:
+                pair_ok = (m_pair_class != CLASS_MUL);
+                break;
+        }
+
+        if (m_pair_rd && (rs1 == m_pair_rd || rs2 == m_pair_rd || rd == m_pair_rd))
+            pair_ok = false;
+        if (m_ready[rs1] > m_cycle || m_ready[rs2] > m_cycle || m_ready[rd] > m_cycle)
+            pair_ok = false;
+        if (m_fetch_ready > m_cycle || m_block_until > m_cycle)
+            pair_ok = false;
+    }
+
+    uint64_t t;
+    if (pair_ok)
+    {
+        t = m_cycle;
+        m_dual++;
+        m_pair_open = false;
+    }
+    else
+    {
+        t = m_cycle + 1;
+        stall(&t, m_fetch_ready, m_fetch_cause);
+        stall(&t, m_block_until, m_block_cause);
+
+        uint64_t ready = m_ready[rs1];
+        if (m_ready[rs2] > ready) ready = m_ready[rs2];
+        if (m_ready[rd]  > ready) ready = m_ready[rd];
+        stall(&t, ready, STALL_OPERAND);
+
+        // No multiply, divide or CSR in the cycle after a load / store
+        if ((cls == CLASS_MUL || cls == CLASS_DIV || cls == CLASS_CSR) && m_lsu_cycle && m_lsu_cycle + 1 == t)
+            stall(&t, t + 1, STALL_PAIR_LSU);
+
+        m_cycle      = t;
+        m_pair_open  = !(rec.pc & 4) && (cls == CLASS_EXEC || cls == CLASS_LSU || cls == CLASS_MUL);
+        m_pair_pc    = rec.pc;
+        m_pair_class = cls;
+        m_pair_rd    = alloc ? rd : 0;
+    }
+
+    // Result latency
+    uint64_t result = t + 1;
+    switch (cls)
+    {
+        case CLASS_LSU:
+        {
+            m_lsu_cycle = t;
+            result      = t + (m_cfg.load_bypass ? 2 : 3);
+
+            if (!(rec.flags & (TRACE_FLAG_LOAD | TRACE_FLAG_STORE)))
+                break;
+
+            // Data cache miss / uncached access stalls the LSU
+            int penalty = 0;
+            if (m_dcache.enabled())
+            {
+                bool write = (rec.flags & TRACE_FLAG_STORE) != 0;
+
+                if (mem_phys < m_cfg.cache_min || mem_phys > m_cfg.cache_max)
+                    penalty = m_cfg.mem_latency + 1;
+                else
+                {
+                    int access = m_dcache.access(mem_phys, write);
+                    if (!(access & CACHE_HIT))
+                        penalty = m_cfg.mem_latency + (m_cfg.line_size / m_cfg.dcache_beat) * ((access & CACHE_WRITEBACK) ? 2 : 1);
+                }
+            }
+
+            if (penalty)
+            {
+                result += penalty;
+                if (t + 1 + penalty > m_block_until)
+                {
+                    m_block_until = t + 1 + penalty;
+                    m_block_cause = STALL_DCACHE;
+                }
+            }
+            break;
+        }
+        case CLASS_MUL:
+            result = t + (m_cfg.mul_bypass ? 2 : 3);
+            break;
+        case CLASS_DIV:
+            result        = t + m_cfg.div_cycles;
+            m_block_until = result;
+            m_block_cause = STALL_DIV;
+            break;
+        case CLASS_CSR:
+            result        = t + m_cfg.csr_cycles;
+            m_block_until = result;
+            m_block_cause = STALL_CSR;
+            break;
+        case CLASS_BRANCH:
+        {
+            if (rec.flags & TRACE_FLAG_TRAP)
+                break;
+
+            int      entry;
+            uint32_t predicted  = predict(rec.pc, &entry);
+            bool     mispredict = (predicted != next_pc);
+
+            m_branches++;
+            train(rec.pc, opcode, next_pc, mispredict, entry);
+
+            if (mispredict)
+            {
+                m_mispredicts++;
+                m_fetch_ready = t + 1 + m_cfg.flush_penalty + m_cfg.extra_decode;
+                m_fetch_cause = STALL_BRANCH;
+            }
+            break;
+        }
+    }
+
+    if (alloc)
+        m_ready[rd] = result;
+
+    // Exceptions, interrupts, xRET, ecall flush the pipeline
+    if ((rec.flags & (TRACE_FLAG_TRAP | TRACE_FLAG_IRQ)) || (major == 0x73 && ((opcode >> 12) & 7) == 0))
+    {
+        m_fetch_ready = t + 1 + m_cfg.flush_penalty + m_cfg.extra_decode;
+        m_fetch_cause = STALL_TRAP;
+        m_pair_open   = false;
+    }
+}
+//-----------------------------------------------------------------
+// get_cycles: Estimated cycles including pipeline fill and drain
+//-----------------------------------------------------------------
+uint64_t TimingModel::get_cycles(void)
+{
+    if (!m_instructions)
+        return 0;
+
+    uint64_t last = (m_block_until > m_cycle) ? m_block_until : m_cycle;
+    return last + PIPE_FILL + m_cfg.extra_decode + PIPE_DRAIN;
+}
+//-----------------------------------------------------------------
+// print: Report estimate and where the cycles went
+//-----------------------------------------------------------------
+void TimingModel::print(FILE *f)
+{
+    uint64_t cycles = get_cycles();
+    uint64_t insts  = m_instructions;
+
+    fprintf(f, "Timing Model (biriscv, %s):\n", m_cfg.icache_size || m_cfg.dcache_size ? "cache" : "tcm");
+    fprintf(f, "- Instructions %llu\n", (unsigned long long)insts);
+    fprintf(f, "- Cycles %llu (IPC %.3f)\n", (unsigned long long)cycles, cycles ? (double)insts / cycles : 0.0);
+    fprintf(f, "- Dual Issued %llu pairs (%d%% of instructions)\n", (unsigned long long)m_dual, insts ? (int)((m_dual * 200) / insts) : 0);
+    fprintf(f, "- Branches %llu Mispredicted %llu (%d%%)\n", (unsigned long long)m_branches, (unsigned long long)m_mispredicts,
+            m_branches ? (int)((m_mispredicts * 100) / m_branches) : 0);
+    fprintf(f, "- Stall Cycles: operand %llu, after load/store %llu, divide %llu, csr %llu, branch %llu, trap %llu, icache %llu, dcache %llu\n",
+            (unsigned long long)m_stalls[STALL_OPERAND], (unsigned long long)m_stalls[STALL_PAIR_LSU],
+            (unsigned long long)m_stalls[STALL_DIV],     (unsigned long long)m_stalls[STALL_CSR],
+            (unsigned long long)m_stalls[STALL_BRANCH],  (unsigned long long)m_stalls[STALL_TRAP],
+            (unsigned long long)m_stalls[STALL_ICACHE],  (unsigned long long)m_stalls[STALL_DCACHE]);
+    if (m_icache.enabled())
+        fprintf(f, "- ICache Hits %llu Misses %llu\n", (unsigned long long)m_icache.get_stats().hits,
+                (unsigned long long)m_icache.get_stats().misses);
+    if (m_dcache.enabled())
+        fprintf(f, "- DCache Hits %llu Misses %llu Writebacks %llu\n", (unsigned long long)m_dcache.get_stats().hits,
+                (unsigned long long)m_dcache.get_stats().misses, (unsigned long long)m_dcache.get_stats().writebacks);
+}
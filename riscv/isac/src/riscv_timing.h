@@ -0,0 +1,198 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_TIMING_H__
+#define __RISCV_TIMING_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "riscv_trace.h"
+#include "riscv_cache.h"
+
+//--------------------------------------------------------------------
+// Configuration (defaults from riscv/rtl/top/riscv_top.v)
+//--------------------------------------------------------------------
+typedef struct
+{
+    // Core (riscv_core parameters)
+    int         dual_issue;
+    int         load_bypass;
+    int         mul_bypass;
+    int         extra_decode;
+    int         branch_prediction;
+    int         btb_entries;
+    int         bht_entries;
+    int         ras_entries;
+    int         div_cycles;         // Divider busy (blocks issue)
+    int         csr_cycles;         // CSR access (blocks issue)
+    int         flush_penalty;      // Mispredict / trap redirect to issue
+
+    // Caches (0 size = TCM, single cycle)
+    int         icache_size;
+    int         icache_ways;
+    int         dcache_size;
+    int         dcache_ways;
+    int         line_size;
+    uint32_t    cache_min;          // MEM_CACHE_ADDR_MIN/MAX
+    uint32_t    cache_max;
+
+    // External memory (AXI): first beat latency, bytes per beat
+    int         mem_latency;
+    int         icache_beat;
+    int         dcache_beat;
+} t_timing_config;
+
+//--------------------------------------------------------------------
+// TimingModel: Cycle approximate model of the biriscv core fed with
+// retired instructions (in order). Issue follows biriscv_issue.v
+// (pairing, scoreboard), prediction biriscv_npc.v (BTB / BHT / RAS)
+// and the caches icache.v / dcache_core.v (geometry, replacement,
+// write back).
+//--------------------------------------------------------------------
+class TimingModel
+{
+public:
+    TimingModel();
+
+    // Presets: "cache" (riscv_top) or "tcm" (riscv_tcm_top), then
+    // optional ",key=value" overrides. Returns false if invalid.
+    static bool         parse_config(const char *spec, t_timing_config *cfg);
+
+    void                set_config(const t_timing_config &cfg);
+    const t_timing_config &get_config(void) { return m_cfg; }
+    void                reset(void);
+
+    // Instruction retired, 'mem_phys' is the physical address of a load /
+    // store (rec.mem_addr is virtual), 'next_pc' where execution continues
+    void                retire(const t_trace_record &rec, uint32_t mem_phys, uint32_t next_pc);
+
+    uint64_t            get_cycles(void);
+    uint64_t            get_instructions(void) { return m_instructions; }
+
+    void                print(FILE *f);
+
+private:
+    enum e_class
+    {
+        CLASS_EXEC,
+        CLASS_LSU,
+        CLASS_BRANCH,
+        CLASS_MUL,
+        CLASS_DIV,
+        CLASS_CSR
+    };
+
+    enum e_stall
+    {
+        STALL_OPERAND,      // Load / multiply result not ready
+        STALL_PAIR_LSU,     // Mul / div / CSR in the cycle after a load / store
+        STALL_DIV,
+        STALL_CSR,
+        STALL_BRANCH,       // Mispredict flush
+        STALL_TRAP,
+        STALL_ICACHE,
+        STALL_DCACHE,
+        STALL_MAX
+    };
+
+    struct s_btb
+    {
+        uint32_t    pc;
+        uint32_t    target;
+        bool        is_call;
+        bool        is_ret;
+        bool        is_jmp;
+    };
+
+    static int          classify(uint32_t opcode);
+
+    uint32_t            predict(uint32_t pc, int *btb_entry);
+    void                train(uint32_t pc, uint32_t opcode, uint32_t next_pc, bool mispredict, int btb_entry);
+
+    void                stall(uint64_t *t, uint64_t ready, int cause)
+    {
+        if (ready > *t)
+        {
+            m_stalls[cause] += ready - *t;
+            *t = ready;
+        }
+    }
+
+    t_timing_config     m_cfg;
+
+    // Issue state
+    uint64_t            m_cycle;            // Issue cycle of the last instruction
+    uint64_t            m_fetch_ready;      // Earliest issue after a redirect / fetch miss
+    int                 m_fetch_cause;
+    uint64_t            m_block_until;      // Division / CSR / cache miss blocking issue
+    int                 m_block_cause;
+    uint64_t            m_lsu_cycle;        // Last load / store issue cycle (+1)
+    uint64_t            m_ready[32];        // Cycle each register can be read
+    bool                m_pair_open;        // Slot 1 of m_cycle is free
+    uint32_t            m_pair_pc;
+    int                 m_pair_class;
+    int                 m_pair_rd;
+    uint32_t            m_fetch_line;
+
+    // Prediction
+    std::vector <s_btb >    m_btb;
+    std::vector <uint8_t >  m_bht;
+    std::vector <uint32_t > m_ras;
+    int                 m_ras_index;
+    uint16_t            m_lfsr;
+
+    Cache               m_icache;
+    Cache               m_dcache;
+
+    // Stats
+    uint64_t            m_instructions;
+    uint64_t            m_dual;
+    uint64_t            m_branches;
+    uint64_t            m_mispredicts;
+    uint64_t            m_stalls[STALL_MAX];
+};
+
+#endif
@@ -0,0 +1,179 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "riscv_trace.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+BinaryTrace::BinaryTrace()
+{
+    m_file          = NULL;
+    m_chunk_records = 0;
+    m_chunks        = 0;
+    m_fill          = NULL;
+    m_fill_pos      = 0;
+    m_records       = 0;
+    m_concurrent    = false;
+    m_produced      = 0;
+    m_consumed      = 0;
+    m_stop          = false;
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+BinaryTrace::~BinaryTrace()
+{
+    close();
+}
+//-----------------------------------------------------------------
+// open: Create trace file and start the writer
+//-----------------------------------------------------------------
+bool BinaryTrace::open(const char *filename, int chunk_records /*= TRACE_CHUNK_RECORDS*/, int chunks /*= TRACE_CHUNKS*/)
+{
+    if (m_file || chunk_records < 1 || chunks < 2)
+        return false;
+
+    m_file = fopen(filename, "wb");
+    if (!m_file)
+        return false;
+
+    t_trace_header header;
+    header.magic       = TRACE_MAGIC;
+    header.version     = TRACE_VERSION;
+    header.record_size = sizeof(t_trace_record);
+    header.reserved    = 0;
+
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1)
+    {
+        fclose(m_file);
+        m_file = NULL;
+        return false;
+    }
+
+    m_chunk_records = chunk_records;
+    m_chunks        = chunks;
+    m_ring.resize((size_t)chunk_records * chunks);
+    m_length.assign(chunks, 0);
+
+    m_fill          = &m_ring[0];
+    m_fill_pos      = 0;
+    m_records       = 0;
+    m_produced      = 0;
+    m_consumed      = 0;
+    m_stop          = false;
+    m_thread        = std::thread(&BinaryTrace::writer, this);
+
+    return true;
+}
+//-----------------------------------------------------------------
+// close: Flush outstanding records and stop the writer
+//-----------------------------------------------------------------
+void BinaryTrace::close(void)
+{
+    if (!m_file)
+        return ;
+
+    if (m_fill_pos)
+        submit();
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    fclose(m_file);
+    m_file = NULL;
+}
+//-----------------------------------------------------------------
+// submit: Hand the filled chunk to the writer, move to the next one
+//-----------------------------------------------------------------
+void BinaryTrace::submit(void)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    m_length[m_produced % m_chunks] = m_fill_pos;
+    m_produced++;
+    m_cv.notify_all();
+
+    // Ring full, wait for the writer to free a chunk
+    while (m_produced - m_consumed >= (uint64_t)m_chunks)
+        m_cv.wait(lock);
+
+    m_records  += m_fill_pos;
+    m_fill      = &m_ring[(m_produced % m_chunks) * m_chunk_records];
+    m_fill_pos  = 0;
+}
+//-----------------------------------------------------------------
+// writer: Background thread storing chunks in order
+//-----------------------------------------------------------------
+void BinaryTrace::writer(void)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    for (;;)
+    {
+        while (m_consumed == m_produced && !m_stop)
+            m_cv.wait(lock);
+
+        // Stopped and drained
+        if (m_consumed == m_produced)
+            break;
+
+        int idx = (int)(m_consumed % m_chunks);
+        int len = m_length[idx];
+
+        lock.unlock();
+        fwrite(&m_ring[(size_t)idx * m_chunk_records], sizeof(t_trace_record), len, m_file);
+        lock.lock();
+
+        m_consumed++;
+        m_cv.notify_all();
+    }
+}
@@ -0,0 +1,159 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#ifndef __RISCV_TRACE_H__
+#define __RISCV_TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//--------------------------------------------------------------------
+// Binary trace file: header followed by one record per retired
+// instruction (little endian host layout)
+//--------------------------------------------------------------------
+#define TRACE_MAGIC             0x54425652  // "RVBT"
+#define TRACE_VERSION           1
+
+// Record flags
+#define TRACE_FLAG_WB           (1 << 0)    // rd / rd_value valid
+#define TRACE_FLAG_LOAD         (1 << 1)    // mem_addr / mem_data valid
+#define TRACE_FLAG_STORE        (1 << 2)
+#define TRACE_FLAG_TRAP         (1 << 3)    // Exception, instruction did not complete
+#define TRACE_FLAG_IRQ          (1 << 4)    // Interrupt taken after this instruction
+#define TRACE_WIDTH_SHIFT       5           // Access width in bytes (1, 2, 4)
+#define TRACE_WIDTH_MASK        0x7
+
+// Ring buffer defaults
+#define TRACE_CHUNK_RECORDS     16384
+#define TRACE_CHUNKS            32
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+} t_trace_header;
+
+typedef struct
+{
+    uint32_t pc;
+    uint32_t opcode;
+    uint32_t rd_value;      // TRACE_FLAG_WB
+    uint32_t mem_addr;      // TRACE_FLAG_LOAD / STORE, virtual address
+    uint32_t mem_data;
+    uint8_t  rd;            // TRACE_FLAG_WB
+    uint8_t  flags;         // TRACE_FLAG_XXX, width
+    uint16_t hart;
+} t_trace_record;
+
+//--------------------------------------------------------------------
+// BinaryTrace: Records are appended to a ring of chunks in memory, a
+// writer thread stores full chunks to the file. The simulator only
+// waits if the writer falls a whole ring behind.
+//--------------------------------------------------------------------
+class BinaryTrace
+{
+public:
+    BinaryTrace();
+    ~BinaryTrace();
+
+    bool        open(const char *filename, int chunk_records = TRACE_CHUNK_RECORDS, int chunks = TRACE_CHUNKS);
+    void        close(void);
+
+    // Several host threads append (threaded SMP)
+    void        set_concurrent(bool enable) { m_concurrent = enable; }
+
+    uint64_t    get_records(void) { return m_records + m_fill_pos; }
+
+    void record(const t_trace_record &rec)
+    {
+        if (m_concurrent)
+        {
+            std::lock_guard<std::mutex> guard(m_append_lock);
+            append(rec);
+        }
+        else
+            append(rec);
+    }
+
+private:
+    void append(const t_trace_record &rec)
+    {
+        m_fill[m_fill_pos] = rec;
+        if (++m_fill_pos == m_chunk_records)
+            submit();
+    }
+
+    void        submit(void);
+    void        writer(void);
+
+    FILE                       *m_file;
+    std::vector <t_trace_record > m_ring;
+    std::vector <int >          m_length;   // Records in each chunk
+    int                         m_chunk_records;
+    int                         m_chunks;
+
+    // Producer
+    t_trace_record             *m_fill;
+    int                         m_fill_pos;
+    uint64_t                    m_records;
+    bool                        m_concurrent;
+    std::mutex                  m_append_lock;
+
+    // Chunks handed over / written, protected by m_lock
+    uint64_t                    m_produced;
+    uint64_t                    m_consumed;
+    bool                        m_stop;
+    std::mutex                  m_lock;
+    std::condition_variable     m_cv;
+    std::thread                 m_thread;
+};
+
+#endif
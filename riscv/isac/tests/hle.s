@@ -0,0 +1,143 @@
+#-----------------------------------------------------------------
+# HLE regression: memset, memcpy, strlen and memcmp called 4 times each
+# from a small ELF-only image (its one segment covers part of a page).
+# Prints a checksum and exits with 0 if it matches the target code.
+#   riscv-sim -f tests/hle.elf --hle all
+# Built with: riscv64-unknown-elf-gcc -march=rv32im -mabi=ilp32
+#   -nostdlib -Ttext=0x80000000 -o hle.elf hle.s
+#-----------------------------------------------------------------
+    .text
+    .globl _start
+_start:
+    la sp, stack_top
+    li s0, 0
+    li s3, 0
+loop:
+    la a0, buf
+    addi a1, s0, 7
+    li a2, 1000
+    call memset
+    la a0, buf2
+    la a1, buf
+    andi a2, s0, 63
+    addi a2, a2, 900
+    call memcpy
+    la a0, str
+    call strlen
+    add s3, s3, a0
+    la a0, buf
+    la a1, buf2
+    li a2, 1000
+    call memcmp
+    add s3, s3, a0
+    addi s0, s0, 1
+    li t0, 4
+    blt s0, t0, loop
+    la t0, buf2
+    lbu t1, 950(t0)
+    add s3, s3, t1
+    lbu t1, 10(t0)
+    add s3, s3, t1
+    mv a0, s3
+    call print_hex
+    # Exit code 0 if the checksum matches the target routines
+    li a0, 0
+    li t0, 0xd8
+    beq s3, t0, done
+    li a0, 1
+done:
+    j exit
+memset:
+    mv t0, a0
+    add t1, a0, a2
+ms_l:
+    beq t0, t1, ms_d
+    sb a1, 0(t0)
+    addi t0, t0, 1
+    j ms_l
+ms_d:
+    ret
+memcpy:
+    mv t0, a0
+    add t1, a0, a2
+mc_l:
+    beq t0, t1, mc_d
+    lbu t2, 0(a1)
+    sb t2, 0(t0)
+    addi t0, t0, 1
+    addi a1, a1, 1
+    j mc_l
+mc_d:
+    ret
+strlen:
+    mv t0, a0
+sl_l:
+    lbu t1, 0(t0)
+    beqz t1, sl_d
+    addi t0, t0, 1
+    j sl_l
+sl_d:
+    sub a0, t0, a0
+    ret
+memcmp:
+    add t2, a0, a2
+cm_l:
+    beq a0, t2, cm_eq
+    lbu t0, 0(a0)
+    lbu t1, 0(a1)
+    bne t0, t1, cm_ne
+    addi a0, a0, 1
+    addi a1, a1, 1
+    j cm_l
+cm_ne:
+    sub a0, t0, t1
+    ret
+cm_eq:
+    li a0, 0
+    ret
+# print a0 as hex + newline (clobbers t0-t3)
+print_hex:
+    li t1, 28
+ph_loop:
+    srl t0, a0, t1
+    andi t0, t0, 15
+    li t2, 10
+    blt t0, t2, ph_dig
+    addi t0, t0, 87
+    j ph_out
+ph_dig:
+    addi t0, t0, 48
+ph_out:
+    li t3, 0x01000000
+    or t0, t0, t3
+    csrw 0x8b2, t0
+    addi t1, t1, -4
+    bge t1, zero, ph_loop
+    li t0, 0x0100000a
+    csrw 0x8b2, t0
+    ret
+exit:
+    andi a0, a0, 0xff
+    csrw 0x8b2, a0
+    j exit
+.align 2
+str:
+.word 0x20656874
+.word 0x63697571
+.word 0x7262206b
+.word 0x206e776f
+.word 0x20786f66
+.word 0x706d756a
+.word 0x766f2073
+.word 0x74207265
+.word 0x6c206568
+.word 0x20797a61
+.word 0x00676f64
+.align 2
+buf:
+.space 1024
+buf2:
+.space 1024
+.space 512
+stack_top:
+.word 0
@@ -0,0 +1,451 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <libelf.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#include "riscv.h"
+#include "elf_load.h"
+#include "cosim_api.h"
+
+//-----------------------------------------------------------------
+// Batch compliance runner: runs a manifest of ELFs concurrently (one
+// simulation context per test) and compares the begin_signature ..
+// end_signature region against reference signatures in-process.
+//-----------------------------------------------------------------
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define BATCH_MAX_INSTRUCTIONS_DEFAULT  10000000
+
+//-----------------------------------------------------------------
+// Test descriptor and result
+//-----------------------------------------------------------------
+struct s_batch_test
+{
+    std::string elf;
+    std::string reference;
+    std::string name;
+
+    // Result
+    const char *status;         // pass, fail, timeout, error
+    int64_t     instructions;
+    double      wall_ms;
+    int         exit_code;
+    int         sig_words;
+    int         first_mismatch; // Word index, -1 if none
+    std::string error;
+};
+
+struct s_batch_opts
+{
+    int64_t     max_instructions;
+    int         engine;
+};
+
+//-----------------------------------------------------------------
+// Console: target output is discarded
+//-----------------------------------------------------------------
+class BatchConsole: public IConsoleIO
+{
+public:
+    int putchar(int ch) { return ch; }
+    int getchar(void)   { return -1; }
+};
+
+//-----------------------------------------------------------------
+// mem_create: Create memory region
+//-----------------------------------------------------------------
+static int mem_create(void *arg, uint32_t base, uint32_t size)
+{
+    return ((cosim *)arg)->create_memory(base, size);
+}
+//-----------------------------------------------------------------
+// mem_load: Load block into memory
+//-----------------------------------------------------------------
+static int mem_load(void *arg, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    return ((cosim *)arg)->write_block(addr, data, len);
+}
+//-----------------------------------------------------------------
+// load_reference: Read a reference signature. Accepts one word per
+// line, or the 4 words per line (highest address first) written by
+// cosim::at_exit() for .output files.
+//-----------------------------------------------------------------
+static bool load_reference(const char *filename, std::vector <uint32_t > &words)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f)
+        return false;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        int len = strcspn(line, " \t\r\n");
+        if (len == 0)
+            continue;
+
+        // Each 8 digit group is one word, the last group is the lowest
+        for (int pos = len - 8; pos >= 0; pos -= 8)
+        {
+            char word[9];
+            memcpy(word, &line[pos], 8);
+            word[8] = 0;
+            words.push_back((uint32_t)strtoul(word, NULL, 16));
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+//-----------------------------------------------------------------
+// run_test: Run one test in its own simulation context
+//-----------------------------------------------------------------
+static void run_test(s_batch_test *test, const s_batch_opts *opts)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    BatchConsole console;
+    cosim        ctx;
+    Riscv       *cpu = new Riscv();
+    uint32_t     start_addr = 0;
+
+    ctx.attach_cpu("sim", cpu, true);
+    ctx.attach_mem("sim", cpu, 0, 0xFFFFFFFF, true);
+    cpu->set_console(&console);
+
+    test->status         = "error";
+    test->instructions   = 0;
+    test->exit_code      = -1;
+    test->sig_words      = 0;
+    test->first_mismatch = -1;
+
+    if (!elf_load(test->elf.c_str(), mem_create, mem_load, &ctx, &start_addr))
+        test->error = "could not load ELF";
+    else
+    {
+        cpu->reset(start_addr);
+        if (opts->engine != -1)
+            cpu->set_engine(opts->engine);
+
+        test->instructions = cpu->run(opts->max_instructions, cosim_run_cond());
+
+        long sig_start = elf_get_symbol(test->elf.c_str(), "begin_signature");
+        long sig_end   = elf_get_symbol(test->elf.c_str(), "end_signature");
+        std::vector <uint32_t > ref;
+
+        if (cpu->get_fault())
+        {
+            test->error = cpu->get_error();
+            if (!test->error.empty() && test->error[test->error.size()-1] == '\n')
+                test->error.erase(test->error.size()-1);
+        }
+        else if (!cpu->get_exited())
+        {
+            test->status = "timeout";
+            test->error  = "instruction limit reached";
+        }
+        else if (sig_start < 0 || sig_end < sig_start)
+            test->error = "no begin_signature / end_signature";
+        else if (!load_reference(test->reference.c_str(), ref))
+            test->error = "could not read reference";
+        else
+        {
+            test->exit_code = cpu->get_exit_code();
+            test->sig_words = (int)((sig_end - sig_start) / 4);
+
+            // Signature region may be padded beyond the reference
+            for (size_t i=0;i<ref.size() && test->first_mismatch < 0;i++)
+                if ((int)i >= test->sig_words || ctx.read_word((uint32_t)sig_start + i*4) != ref[i])
+                    test->first_mismatch = (int)i;
+
+            if (test->exit_code != 0)
+                test->error = "non-zero exit code";
+            else if (test->first_mismatch >= 0)
+                test->error = "signature mismatch";
+
+            test->status = test->error.empty() ? "pass" : "fail";
+        }
+    }
+
+    test->wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+//-----------------------------------------------------------------
+// load_manifest: One test per line, "<elf> [reference]". The reference
+// defaults to the ELF name with .reference_output. '#' starts a comment.
+//-----------------------------------------------------------------
+static bool load_manifest(const char *filename, std::vector <s_batch_test > &tests)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f)
+        return false;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), f))
+    {
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = 0;
+
+        char *elf = strtok(line, " \t\r\n");
+        char *ref = strtok(NULL, " \t\r\n");
+        if (!elf)
+            continue;
+
+        s_batch_test test;
+        test.elf = elf;
+
+        // Test name: file name without extension
+        const char *base = strrchr(elf, '/');
+        test.name = base ? base + 1 : elf;
+        size_t dot = test.name.rfind('.');
+        if (dot != std::string::npos)
+            test.name.erase(dot);
+
+        if (ref)
+            test.reference = ref;
+        else
+        {
+            test.reference = test.elf;
+            dot = test.reference.rfind('.');
+            if (dot != std::string::npos && dot > test.reference.rfind('/') + 1)
+                test.reference.erase(dot);
+            test.reference += ".reference_output";
+        }
+
+        tests.push_back(test);
+    }
+
+    fclose(f);
+    return true;
+}
+//-----------------------------------------------------------------
+// json_string: Quote and escape a string for JSON output
+//-----------------------------------------------------------------
+static std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+
+    for (size_t i=0;i<s.size();i++)
+    {
+        char c = s[i];
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char esc[8];
+            sprintf(esc, "\\u%04x", c);
+            out += esc;
+        }
+        else
+            out += c;
+    }
+
+    return out + "\"";
+}
+//-----------------------------------------------------------------
+// write_summary: Machine readable results (JSON)
+//-----------------------------------------------------------------
+static bool write_summary(const char *filename, const std::vector <s_batch_test > &tests, int threads, double wall_ms)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    int     passed = 0;
+    int64_t instructions = 0;
+    for (size_t i=0;i<tests.size();i++)
+    {
+        passed       += !strcmp(tests[i].status, "pass");
+        instructions += tests[i].instructions;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"total\": %d,\n", (int)tests.size());
+    fprintf(f, "  \"passed\": %d,\n", passed);
+    fprintf(f, "  \"failed\": %d,\n", (int)tests.size() - passed);
+    fprintf(f, "  \"threads\": %d,\n", threads);
+    fprintf(f, "  \"instructions\": %lld,\n", (long long)instructions);
+    fprintf(f, "  \"wall_ms\": %.3f,\n", wall_ms);
+    fprintf(f, "  \"tests\": [\n");
+
+    for (size_t i=0;i<tests.size();i++)
+    {
+        const s_batch_test &t = tests[i];
+
+        fprintf(f, "    { \"name\": %s, \"elf\": %s, \"reference\": %s, \"status\": \"%s\", "
+                   "\"instructions\": %lld, \"wall_ms\": %.3f, \"exit_code\": %d, "
+                   "\"signature_words\": %d, \"first_mismatch\": %d, \"error\": %s }%s\n",
+                json_string(t.name).c_str(), json_string(t.elf).c_str(), json_string(t.reference).c_str(),
+                t.status, (long long)t.instructions, t.wall_ms, t.exit_code,
+                t.sig_words, t.first_mismatch, json_string(t.error).c_str(),
+                (i + 1 < tests.size()) ? "," : "");
+    }
+
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+
+    return fclose(f) == 0;
+}
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    const char * manifest = NULL;
+    const char * summary  = "riscv-batch.json";
+    int          threads  = (int)std::thread::hardware_concurrency();
+    s_batch_opts opts;
+    int          help = 0;
+    int          c;
+
+    opts.max_instructions = BATCH_MAX_INSTRUCTIONS_DEFAULT;
+    opts.engine           = -1;
+
+    while ((c = getopt (argc, argv, "m:o:j:c:x:")) != -1)
+    {
+        switch(c)
+        {
+            case 'm':
+                manifest = optarg;
+                break;
+            case 'o':
+                summary = optarg;
+                break;
+            case 'j':
+                threads = (int)strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                opts.max_instructions = (int64_t)strtoull(optarg, NULL, 0);
+                break;
+            case 'x':
+                opts.engine = (int)strtoul(optarg, NULL, 0);
+                break;
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || manifest == NULL)
+    {
+        fprintf (stderr,"Usage:\n");
+        fprintf (stderr,"-m manifest.txt = Tests to run, one '<elf> [reference]' per line\n");
+        fprintf (stderr,"-o summary.json = Summary file (default riscv-batch.json)\n");
+        fprintf (stderr,"-j nn           = Host threads (default all cores)\n");
+        fprintf (stderr,"-c nnnn         = Max instructions per test (default %d)\n", BATCH_MAX_INSTRUCTIONS_DEFAULT);
+        fprintf (stderr,"-x [0/1/2]      = Execution engine (0 = interpreter, 1 = threaded, 2 = JIT)\n");
+        return -1;
+    }
+
+    std::vector <s_batch_test > tests;
+    if (!load_manifest(manifest, tests))
+    {
+        fprintf (stderr,"Error: Could not open %s\n", manifest);
+        return -1;
+    }
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > (int)tests.size())
+        threads = tests.size() ? (int)tests.size() : 1;
+
+    // libelf / loader global state, set once before the workers start
+    elf_version(EV_CURRENT);
+    elf_set_verbose(0);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Workers take the next unclaimed test until none are left
+    std::atomic <size_t > next(0);
+    std::mutex            print_lock;
+    std::vector <std::thread > workers;
+
+    for (int i=0;i<threads;i++)
+        workers.push_back(std::thread([&]()
+        {
+            for (size_t t = next++; t < tests.size(); t = next++)
+            {
+                run_test(&tests[t], &opts);
+
+                std::lock_guard<std::mutex> guard(print_lock);
+                fprintf(stderr, "%-7s %s (%lld instructions, %.2f ms)%s%s\n",
+                        tests[t].status, tests[t].elf.c_str(), (long long)tests[t].instructions, tests[t].wall_ms,
+                        tests[t].error.empty() ? "" : ": ", tests[t].error.c_str());
+            }
+        }));
+
+    for (size_t i=0;i<workers.size();i++)
+        workers[i].join();
+
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!write_summary(summary, tests, threads, wall_ms))
+    {
+        fprintf (stderr,"Error: Could not write %s\n", summary);
+        return -1;
+    }
+
+    for (size_t i=0;i<tests.size();i++)
+        if (strcmp(tests[i].status, "pass"))
+            return 1;
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "riscv_coverage.h"
+
+//-----------------------------------------------------------------
+// Merges coverage data files (riscv-sim --coverage) and writes an
+// lcov report
+//-----------------------------------------------------------------
+
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    const char *elf       = NULL;
+    const char *output    = NULL;
+    const char *merged    = NULL;
+    const char *test_name = NULL;
+    int         help      = 0;
+    int         c;
+
+    while ((c = getopt (argc, argv, "e:o:m:t:")) != -1)
+    {
+        switch(c)
+        {
+            case 'e':
+                elf = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'm':
+                merged = optarg;
+                break;
+            case 't':
+                test_name = optarg;
+                break;
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || optind >= argc || (output && !elf) || (!output && !merged))
+    {
+        fprintf (stderr,"Usage: riscv-cov [options] data [data...]\n");
+        fprintf (stderr,"-e file.elf      = ELF with DWARF line info (for -o)\n");
+        fprintf (stderr,"-o file.info     = lcov report (- = stdout)\n");
+        fprintf (stderr,"-m merged.dat    = Write the merged data file\n");
+        fprintf (stderr,"-t name          = lcov test name\n");
+        return -1;
+    }
+
+    Coverage coverage;
+
+    for (int i=optind;i<argc;i++)
+    {
+        if (!coverage.load(argv[i]))
+        {
+            fprintf (stderr,"Error: %s is not a coverage data file\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (merged && !coverage.save(merged, false))
+    {
+        fprintf (stderr,"Error: Could not write %s\n", merged);
+        return -1;
+    }
+
+    if (output && !coverage.write_lcov(output, elf, test_name))
+    {
+        fprintf (stderr,"Error: Could not write %s (needs an ELF with line info)\n", output);
+        return -1;
+    }
+
+    fprintf (stderr,"%d files, %llu PCs executed\n", argc - optind, (unsigned long long)coverage.get_executed());
+    return 0;
+}
@@ -0,0 +1,297 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2022-2024 Zhengde
+// All rights reserved.
+//
+//-----------------------------------------------------------------
+//                     RISC-V ISA Simulator 
+//                            V1.0
+//                     Ultra-Embedded.com
+//                     Copyright 2014-2017
+//
+//                   admin@ultra-embedded.com
+//
+//                       License: BSD
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2014, Ultra-Embedded.com
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions 
+// are met:
+//   - Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   - Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer 
+//     in the documentation and/or other materials provided with the 
+//     distribution.
+//   - Neither the name of the author nor the names of its contributors 
+//     may be used to endorse or promote products derived from this 
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR 
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF 
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include "riscv_trace.h"
+#include "riscv_inst_dump.h"
+#include "elf_load.h"
+
+//-----------------------------------------------------------------
+// Offline decoder for binary traces (riscv-sim --trace-bin)
+//-----------------------------------------------------------------
+
+//-----------------------------------------------------------------
+// Filter
+//-----------------------------------------------------------------
+struct s_trace_filter
+{
+    uint32_t pc_lo, pc_hi;      // Inclusive
+    uint32_t mem_lo, mem_hi;
+    bool     mem_only;
+    int      hart;              // -1 = all
+    int      rd;                // -1 = any
+    uint64_t skip;
+    uint64_t count;             // 0 = no limit
+};
+
+//-----------------------------------------------------------------
+// parse_range: "lo:hi" (hi optional)
+//-----------------------------------------------------------------
+static void parse_range(const char *arg, uint32_t *lo, uint32_t *hi)
+{
+    char *end;
+
+    *lo = strtoul(arg, &end, 0);
+    *hi = (*end == ':') ? strtoul(end + 1, NULL, 0) : 0xFFFFFFFF;
+}
+//-----------------------------------------------------------------
+// match: Record passes the filter
+//-----------------------------------------------------------------
+static bool match(const t_trace_record &rec, const s_trace_filter &f)
+{
+    if (rec.pc < f.pc_lo || rec.pc > f.pc_hi)
+        return false;
+    if (f.hart >= 0 && rec.hart != f.hart)
+        return false;
+    if (f.rd >= 0 && (!(rec.flags & TRACE_FLAG_WB) || rec.rd != f.rd))
+        return false;
+
+    if (f.mem_only)
+    {
+        if (!(rec.flags & (TRACE_FLAG_LOAD | TRACE_FLAG_STORE)))
+            return false;
+        if (rec.mem_addr < f.mem_lo || rec.mem_addr > f.mem_hi)
+            return false;
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// print_record: One line per instruction
+//-----------------------------------------------------------------
+static void print_record(const t_trace_record &rec, const char *elf, bool harts)
+{
+    char     str[1024];
+    uint32_t offset;
+
+    riscv_inst_decode(str, rec.pc, rec.opcode);
+
+    if (harts)
+        printf("[%d] ", rec.hart);
+    printf("%-48s", str);
+
+    const char *sym = elf ? elf_get_symbol_name(elf, rec.pc, &offset) : NULL;
+
+    if (rec.flags & TRACE_FLAG_WB)
+        printf(" r%d=%08x", rec.rd, rec.rd_value);
+    if (rec.flags & (TRACE_FLAG_LOAD | TRACE_FLAG_STORE))
+        printf(" %s%d %08x=%08x", (rec.flags & TRACE_FLAG_STORE) ? "ST" : "LD",
+               (rec.flags >> TRACE_WIDTH_SHIFT) & TRACE_WIDTH_MASK, rec.mem_addr, rec.mem_data);
+    if (rec.flags & TRACE_FLAG_TRAP)
+        printf(" TRAP");
+    if (rec.flags & TRACE_FLAG_IRQ)
+        printf(" IRQ");
+    if (sym)
+        printf(" <%s+0x%x>", sym, offset);
+    printf("\n");
+}
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    const char *   filename = NULL;
+    const char *   elf      = NULL;
+    bool           summary  = false;
+    s_trace_filter filter;
+    int            help     = 0;
+    int            c;
+
+    filter.pc_lo    = 0;
+    filter.pc_hi    = 0xFFFFFFFF;
+    filter.mem_lo   = 0;
+    filter.mem_hi   = 0xFFFFFFFF;
+    filter.mem_only = false;
+    filter.hart     = -1;
+    filter.rd       = -1;
+    filter.skip     = 0;
+    filter.count    = 0;
+
+    while ((c = getopt (argc, argv, "f:e:r:a:mh:d:k:n:s")) != -1)
+    {
+        switch(c)
+        {
+            case 'f':
+                filename = optarg;
+                break;
+            case 'e':
+                elf = optarg;
+                break;
+            case 'r':
+                parse_range(optarg, &filter.pc_lo, &filter.pc_hi);
+                break;
+            case 'a':
+                parse_range(optarg, &filter.mem_lo, &filter.mem_hi);
+                filter.mem_only = true;
+                break;
+            case 'm':
+                filter.mem_only = true;
+                break;
+            case 'h':
+                filter.hart = (int)strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                filter.rd = (int)strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                filter.skip = strtoull(optarg, NULL, 0);
+                break;
+            case 'n':
+                filter.count = strtoull(optarg, NULL, 0);
+                break;
+            case 's':
+                summary = true;
+                break;
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || filename == NULL)
+    {
+        fprintf (stderr,"Usage:\n");
+        fprintf (stderr,"-f trace.bin    = Binary trace (riscv-sim --trace-bin)\n");
+        fprintf (stderr,"-e file.elf     = Annotate PCs with symbols\n");
+        fprintf (stderr,"-r lo[:hi]      = PC range\n");
+        fprintf (stderr,"-a lo[:hi]      = Memory accesses in address range\n");
+        fprintf (stderr,"-m              = Memory accesses only\n");
+        fprintf (stderr,"-h n            = Hart\n");
+        fprintf (stderr,"-d n            = Writes to register rN\n");
+        fprintf (stderr,"-k nnnn         = Skip the first nnnn matches\n");
+        fprintf (stderr,"-n nnnn         = Show at most nnnn matches\n");
+        fprintf (stderr,"-s              = Summary only\n");
+        return -1;
+    }
+
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        fprintf (stderr,"Error: Could not open %s\n", filename);
+        return -1;
+    }
+
+    t_trace_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(t_trace_record))
+    {
+        fprintf (stderr,"Error: %s is not a binary trace\n", filename);
+        fclose(f);
+        return -1;
+    }
+
+    // Hart prefix only for SMP traces, found on the way
+    bool     harts   = filter.hart >= 0;
+    uint64_t total   = 0;
+    uint64_t matched = 0;
+    uint64_t shown   = 0;
+    uint64_t loads   = 0;
+    uint64_t stores  = 0;
+    uint64_t traps   = 0;
+    uint64_t irqs    = 0;
+    std::vector <uint64_t > per_hart;
+
+    std::vector <t_trace_record > buf(TRACE_CHUNK_RECORDS);
+    size_t n;
+    bool   done = false;
+
+    while (!done && (n = fread(&buf[0], sizeof(t_trace_record), buf.size(), f)) > 0)
+    {
+        for (size_t i=0;i<n;i++)
+        {
+            const t_trace_record &rec = buf[i];
+
+            total++;
+            if (rec.hart)
+                harts = true;
+
+            if (!match(rec, filter))
+                continue;
+
+            if (matched++ < filter.skip)
+                continue;
+
+            if (summary)
+            {
+                if (rec.hart >= per_hart.size())
+                    per_hart.resize(rec.hart + 1, 0);
+                per_hart[rec.hart]++;
+                loads  += (rec.flags & TRACE_FLAG_LOAD) != 0;
+                stores += (rec.flags & TRACE_FLAG_STORE) != 0;
+                traps  += (rec.flags & TRACE_FLAG_TRAP) != 0;
+                irqs   += (rec.flags & TRACE_FLAG_IRQ) != 0;
+            }
+            else
+                print_record(rec, elf, harts);
+
+            if (filter.count && ++shown >= filter.count)
+            {
+                done = true;
+                break;
+            }
+        }
+    }
+
+    fclose(f);
+
+    if (summary)
+    {
+        printf("Records %llu, matched %llu\n", (unsigned long long)total, (unsigned long long)matched);
+        printf("- Loads %llu\n", (unsigned long long)loads);
+        printf("- Stores %llu\n", (unsigned long long)stores);
+        printf("- Traps %llu\n", (unsigned long long)traps);
+        printf("- Interrupts %llu\n", (unsigned long long)irqs);
+        for (size_t i=0;i<per_hart.size();i++)
+            printf("- Hart %d Instructions %llu\n", (int)i, (unsigned long long)per_hart[i]);
+    }
+
+    return 0;
+}
@@ -1084,6 +1084,47 @@ module biriscv_issue
     end
     endfunction
 
+    export "DPI-C" function cosim_retire;
+
+    //-------------------------------------------------------------
+    // cosim_retire: Instruction completing in pipe 0 (older) or 1
+    // this cycle, for lockstep checking against the ISA model
+    //-------------------------------------------------------------
+    function int cosim_retire;
+        input  int pipe;
+        output int pc;
+        output int opcode;
+        output int rd;
+        output int rd_val;
+        output int ra_val;
+        output int rb_val;
+        output int exception;
+    begin
+        if (pipe == 0)
+        begin
+            cosim_retire = {31'b0, pipe0_valid_wb_w};
+            pc           = pipe0_pc_wb_w;
+            opcode       = pipe0_opc_wb_w;
+            rd           = {27'b0, pipe0_rd_wb_w};
+            rd_val       = pipe0_result_wb_w;
+            ra_val       = pipe0_ra_val_wb_w;
+            rb_val       = pipe0_rb_val_wb_w;
+            exception    = {26'b0, pipe0_exception_wb_w};
+        end
+        else
+        begin
+            cosim_retire = {31'b0, pipe1_valid_wb_w};
+            pc           = pipe1_pc_wb_w;
+            opcode       = pipe1_opc_wb_w;
+            rd           = {27'b0, pipe1_rd_wb_w};
+            rd_val       = pipe1_result_wb_w;
+            ra_val       = pipe1_ra_val_wb_w;
+            rb_val       = pipe1_rb_val_wb_w;
+            exception    = {26'b0, pipe1_exception_wb_w};
+        end
+    end
+    endfunction
+
 `endif
 
 endmodule
@@ -10,18 +10,26 @@
 #include "verilated.h"
 #include "verilated_vcd_sc.h"
 
+#ifdef COSIM_LOCKSTEP
+#include "riscv.h"
+#include "cosim_lockstep.h"
+#endif
+
 #define MEM_BASE 0x00000000
 #define MEM_SIZE (64 * 1024)
 
+#define ISSUE_DPI_SCOPE "tb.DUT.Vriscv_tcm_top.riscv_tcm_top.u_riscv_core.u_issue"
+
 //-----------------------------------------------------------------
 // Command line options
 //-----------------------------------------------------------------
-#define GETOPTS_ARGS "f:c:h"
+#define GETOPTS_ARGS "f:c:lh"
 
 static struct option long_options[] =
 {
     {"bin",        required_argument, 0, 'f'},
     {"cycles",     required_argument, 0, 'c'},
+    {"lockstep",   no_argument,       0, 'l'},
     {"help",       no_argument,       0, 'h'},
     {0, 0, 0, 0}
 };
@@ -31,6 +39,7 @@ static void help_options(void)
     fprintf (stderr,"Usage:\n");
     fprintf (stderr,"  --bin         | -f FILE       File to load\n");
     fprintf (stderr,"  --cycles      | -c NUM        Max cycles to execute\n");
+    fprintf (stderr,"  --lockstep    | -l            Check retired instructions against the ISA model\n");
     exit(-1);
 }
 
@@ -50,6 +59,12 @@ public:
 
     std::string                  m_dpi_scope;
 
+#ifdef COSIM_LOCKSTEP
+    Riscv                       *m_ref;
+    LockstepChecker             *m_lockstep;
+    svScope                      m_issue_scope;
+#endif
+
     //-----------------------------------------------------------------
     // Signals
     //-----------------------------------------------------------------    
@@ -73,6 +88,7 @@ public:
         int64_t        max_cycles     = (int64_t)-1;
         const char *   filename       = NULL;
         int            help           = 0;
+        bool           lockstep       = false;
         int c;        
 
         int option_index = 0;
@@ -86,6 +102,9 @@ public:
                 case 'c':
                     max_cycles = (int64_t)strtoull(optarg, NULL, 0);
                     break;
+                case 'l':
+                    lockstep = true;
+                    break;
                 case '?':
                 default:
                     help = 1;   
@@ -129,6 +148,12 @@ public:
         {
             sc_stop();
         }
+
+        if (lockstep && !lockstep_init(MEM_BASE, MEM_SIZE, MEM_BASE))
+        {
+            sc_stop();
+            return;
+        }
         
         // Release CPU reset after TCM memory loaded
         for(int i = 0; i < 7; i++) wait();
@@ -143,9 +168,99 @@ public:
             wait();
         }
 
+#ifdef COSIM_LOCKSTEP
+        if (m_lockstep)
+            m_lockstep->print(stdout);
+#endif
+
         sc_stop();        
     }
 
+#ifdef COSIM_LOCKSTEP
+    //-----------------------------------------------------------------
+    // lockstep_init: ISA model with a copy of the memory image, reset
+    // to the boot vector alongside the CPU
+    //-----------------------------------------------------------------
+    bool lockstep_init(uint32_t base, uint32_t size, uint32_t boot_vector)
+    {
+        m_issue_scope = svGetScopeFromName(ISSUE_DPI_SCOPE);
+        if (!m_issue_scope)
+        {
+            fprintf(stderr, "ERROR: Cannot find scope %s\n", ISSUE_DPI_SCOPE);
+            return false;
+        }
+
+        m_ref = new Riscv();
+        m_ref->create_memory(base, size);
+        for (uint32_t i = 0; i < size; i++)
+            m_ref->write(base + i, this->read(base + i));
+        m_ref->reset(boot_vector);
+
+        m_lockstep = new LockstepChecker();
+        return m_lockstep->attach(m_ref);
+    }
+    //-----------------------------------------------------------------
+    // lockstep_retire: Instructions leaving writeback this cycle (pipe 0
+    // holds the older one), sampled mid cycle
+    //-----------------------------------------------------------------
+    void lockstep_retire(void)
+    {
+        if (!m_lockstep || m_lockstep->get_mismatch())
+            return;
+
+        svScope prev = svSetScope(m_issue_scope);
+
+        for (int pipe = 0; pipe < 2; pipe++)
+        {
+            int pc, opcode, rd, rd_val, ra_val, rb_val, exception;
+
+            if (!cosim_retire(pipe, &pc, &opcode, &rd, &rd_val, &ra_val, &rb_val, &exception))
+                continue;
+
+            t_trace_record rec;
+            memset(&rec, 0, sizeof(rec));
+            rec.pc     = pc;
+            rec.opcode = opcode;
+
+            if (exception)
+                rec.flags |= TRACE_FLAG_TRAP;
+            else if (rd != 0)
+            {
+                rec.flags   |= TRACE_FLAG_WB;
+                rec.rd       = rd;
+                rec.rd_value = rd_val;
+            }
+
+            // Store: address from rs1 + S-type immediate, data is rs2
+            if (!exception && (opcode & 0x7f) == 0x23)
+            {
+                int32_t imm = ((int32_t)(opcode & 0xfe000000) >> 20) | ((opcode >> 7) & 0x1f);
+                int width   = 1 << ((opcode >> 12) & 3);
+
+                rec.flags   |= TRACE_FLAG_STORE | (width << TRACE_WIDTH_SHIFT);
+                rec.mem_addr = ra_val + imm;
+                rec.mem_data = rb_val;
+            }
+
+            if (!m_lockstep->retire(rec))
+            {
+                cout << "LOCKSTEP: Mismatch at " << sc_time_stamp() << endl;
+                m_lockstep->print(stderr);
+                sc_stop();
+                break;
+            }
+        }
+
+        svSetScope(prev);
+    }
+#else
+    bool lockstep_init(uint32_t base, uint32_t size, uint32_t boot_vector)
+    {
+        fprintf(stderr, "ERROR: Lockstep checking needs a build with COSIM_LOCKSTEP\n");
+        return false;
+    }
+#endif
+
     void set_argcv(int argc, char* argv[]) { m_argc = argc; m_argv = argv; }
 
     //-----------------------------------------------------------------
@@ -163,6 +278,15 @@ public:
         m_dut->axi_i_out(axi_i_out);
         m_dut->axi_i_in(axi_i_in);
         m_dut->intr_in(intr_in);
+
+#ifdef COSIM_LOCKSTEP
+        m_ref      = NULL;
+        m_lockstep = NULL;
+
+        SC_METHOD(lockstep_retire);
+        sensitive << clk.neg();
+        dont_initialize();
+#endif
     }
 
     //-----------------------------------------------------------------